@@ -134,6 +134,9 @@
 #	define ANKI_GL_STR "ANKI_GL_ES"
 #endif
 
+// Use TlsfAllocator instead of HeapAllocator for the long lived allocators
+#define ANKI_TLSF_ALLOCATORS ${_ANKI_TLSF_ALLOCATORS}
+
 // Graphics backend
 #define ANKI_GR_BACKEND_GL 1
 #define ANKI_GR_BACKEND_VULKAN 2
@@ -22,6 +22,7 @@
 #include <anki/script/ScriptManager.h>
 #include <anki/resource/ResourceFilesystem.h>
 #include <anki/resource/AsyncLoader.h>
+#include <anki/resource/TextureStreamer.h>
 #include <anki/core/StagingGpuMemoryManager.h>
 #include <anki/ui/UiManager.h>
 #include <anki/ui/Canvas.h>
@@ -75,6 +76,7 @@ public:
 	BufferedValue<Second> m_sceneUpdateTime;
 	BufferedValue<Second> m_visTestsTime;
 	BufferedValue<Second> m_physicsTime;
+	BufferedValue<Second> m_animationTime;
 
 	PtrSize m_allocatedCpuMem = 0;
 	U64 m_allocCount = 0;
@@ -82,6 +84,8 @@ public:
 
 	U64 m_vkCpuMem = 0;
 	U64 m_vkGpuMem = 0;
+	PtrSize m_rtMem = 0;
+	PtrSize m_rtMemWithoutAliasing = 0;
 	U32 m_vkCmdbCount = 0;
 
 	U32 m_drawableCount = 0;
@@ -112,7 +116,7 @@ public:
 
 		nk_style_push_style_item(ctx, &ctx->style.window.fixed_background, nk_style_item_color(nk_rgba(0, 0, 0, 128)));
 
-		if(nk_begin(ctx, "Stats", nk_rect(5, 5, 230, 450), 0))
+		if(nk_begin(ctx, "Stats", nk_rect(5, 5, 230, 490), 0))
 		{
 			nk_layout_row_dynamic(ctx, 17, 1);
 
@@ -123,6 +127,7 @@ public:
 			labelTime(ctx, m_sceneUpdateTime.get(flush), "Scene update");
 			labelTime(ctx, m_visTestsTime.get(flush), "Visibility");
 			labelTime(ctx, m_physicsTime.get(flush), "Physics");
+			labelTime(ctx, m_animationTime.get(flush), "Animation");
 
 			nk_label(ctx, " ", NK_TEXT_ALIGN_LEFT);
 			nk_label(ctx, "Memory:", NK_TEXT_ALIGN_LEFT);
@@ -131,6 +136,8 @@ public:
 			labelUint(ctx, m_freeCount, "Total frees");
 			labelBytes(ctx, m_vkCpuMem, "Vulkan CPU");
 			labelBytes(ctx, m_vkGpuMem, "Vulkan GPU");
+			labelBytes(ctx, m_rtMem, "Render targets");
+			labelBytes(ctx, m_rtMemWithoutAliasing, "RTs w/o aliasing");
 
 			nk_label(ctx, " ", NK_TEXT_ALIGN_LEFT);
 			nk_label(ctx, "Vulkan:", NK_TEXT_ALIGN_LEFT);
@@ -431,6 +438,7 @@ Error App::initInternal(const ConfigSet& config_, AllocAlignedCallback allocCb,
 	rinit.m_physics = m_physics;
 	rinit.m_resourceFs = m_resourceFs;
 	rinit.m_config = &config;
+	rinit.m_threadHive = m_threadHive;
 	rinit.m_cacheDir = m_cacheDir.toCString();
 	rinit.m_allocCallback = m_allocCb;
 	rinit.m_allocCallbackData = m_allocCbData;
@@ -587,10 +595,12 @@ Error App::mainLoop()
 
 		m_gr->swapBuffers();
 		m_stagingMem->endFrame();
+		m_resources->getTextureStreamer().endFrame();
 
 		// Update the trace info with some async loader stats
-		U64 asyncTaskCount = m_resources->getAsyncLoader().getCompletedTaskCount();
+		const U64 asyncTaskCount = m_resources->getAsyncLoader().getCompletedTaskCount();
 		ANKI_TRACE_INC_COUNTER(RESOURCE_ASYNC_TASKS, asyncTaskCount - m_resourceCompletedAsyncTaskCount);
+		ANKI_TRACE_INC_COUNTER(RESOURCE_ASYNC_QUEUE_DEPTH, m_resources->getAsyncLoader().getPendingTaskCount());
 		m_resourceCompletedAsyncTaskCount = asyncTaskCount;
 
 		// Now resume the loader
@@ -617,6 +627,7 @@ Error App::mainLoop()
 			statsUi.m_sceneUpdateTime.set(m_scene->getStats().m_updateTime);
 			statsUi.m_visTestsTime.set(m_scene->getStats().m_visibilityTestsTime);
 			statsUi.m_physicsTime.set(m_scene->getStats().m_physicsUpdate);
+			statsUi.m_animationTime.set(m_scene->getStats().m_animationSampling + m_scene->getStats().m_animationPose);
 			statsUi.m_allocatedCpuMem = m_memStats.m_allocatedMem.load();
 			statsUi.m_allocCount = m_memStats.m_allocCount.load();
 			statsUi.m_freeCount = m_memStats.m_freeCount.load();
@@ -625,6 +636,8 @@ Error App::mainLoop()
 			statsUi.m_vkCpuMem = grStats.m_cpuMemory;
 			statsUi.m_vkGpuMem = grStats.m_gpuMemory;
 			statsUi.m_vkCmdbCount = grStats.m_commandBufferCount;
+			statsUi.m_rtMem = m_renderer->getStats().m_renderTargetMemory;
+			statsUi.m_rtMemWithoutAliasing = m_renderer->getStats().m_renderTargetMemoryWithoutAliasing;
 
 			statsUi.m_drawableCount = rqueue.countAllRenderables();
 		}
@@ -19,6 +19,10 @@ Config::Config()
 	newOption("r.clusterSizeY", 26);
 	newOption("r.clusterSizeZ", 32);
 	newOption("r.avgObjectsPerCluster", 16);
+	newOption("r.clusterBinZBinning",
+		true,
+		"Bin the objects to tiles and cluster slices before the cluster tests. If 0 test every object against every "
+		"cluster");
 
 	newOption("r.volumetricLightingAccumulation.clusterFractionXY", 4);
 	newOption("r.volumetricLightingAccumulation.clusterFractionZ", 4);
@@ -47,9 +51,15 @@ Config::Config()
 
 	newOption("r.final.motionBlurSamples", 32);
 
+	newOption("r.parallelCommandBufferRecording",
+		false,
+		"Record the primary command buffers of the render graph on all the ThreadHive threads. The pass callbacks "
+		"need to be thread-safe");
+
 	// Scene
 	newOption("scene.imageReflectionMaxDistance", 30.0);
 	newOption("scene.earlyZDistance", 10.0, "Objects with distance lower than that will be used in early Z");
+	newOption("scene.linearOctree", 0, "Use the flat SIMD friendly octree layout for visibility tests");
 
 	// Globals
 	newOption("width", 1280);
@@ -60,6 +70,16 @@ Config::Config()
 	newOption("rsrc.textureAnisotropy", 8);
 	newOption("rsrc.dataPaths", ".", "The engine loads assets only in from these paths. Separate them with :");
 	newOption("rsrc.transferScratchMemorySize", 256_MB);
+	newOption("rsrc.asyncLoaderThreadCount", 2, "The threads that load the resources in the background");
+	newOption("rsrc.textureStreamingBudget",
+		0,
+		"GPU memory for the mips of the streamed textures. The textures that load need more for a while since their "
+		"old and new mips are both resident. Zero (the default) disables the streaming and loads all the mips");
+	newOption("rsrc.textureStreamingTailSize", 64, "The streamed textures always keep the mips up to that size");
+	newOption("rsrc.shaderCacheMaxSize", 64_MB, "The shader cache evicts the least recently used binaries after that");
+	newOption("rsrc.precompileShaderVariants",
+		0,
+		"Compile all the shader variants a material can use when it loads instead of the first time they are drawn");
 
 	// Window
 	newOption("window.fullscreen", false);
@@ -13,12 +13,22 @@ namespace anki
 
 StagingGpuMemoryManager::~StagingGpuMemoryManager()
 {
-	m_gr->finish();
+	if(m_gr)
+	{
+		m_gr->finish();
 
-	for(auto& it : m_perFrameBuffers)
+		for(auto& it : m_perFrameBuffers)
+		{
+			it.m_buff->unmap();
+			it.m_buff = {};
+		}
+	}
+	else
 	{
-		it.m_buff->unmap();
-		it.m_buff = {};
+		for(auto& it : m_perFrameBuffers)
+		{
+			freeAligned(it.m_mappedMem);
+		}
 	}
 }
 
@@ -31,6 +41,16 @@ Error StagingGpuMemoryManager::init(GrManager* gr, const ConfigSet& cfg)
 	m_perFrameBuffers[StagingGpuMemoryType::VERTEX].m_size = cfg.getNumber("core.vertexPerFrameMemorySize");
 	m_perFrameBuffers[StagingGpuMemoryType::TEXTURE].m_size = cfg.getNumber("core.textureBufferPerFrameMemorySize");
 
+	if(!gr)
+	{
+		for(StagingGpuMemoryType type = StagingGpuMemoryType::UNIFORM; type < StagingGpuMemoryType::COUNT; ++type)
+		{
+			initCpuBuffer(type);
+		}
+
+		return Error::NONE;
+	}
+
 	initBuffer(StagingGpuMemoryType::UNIFORM,
 		gr->getDeviceCapabilities().m_uniformBufferBindOffsetAlignment,
 		gr->getDeviceCapabilities().m_uniformBufferMaxRange,
@@ -64,6 +84,14 @@ void StagingGpuMemoryManager::initBuffer(
 	perframe.m_mappedMem = static_cast<U8*>(perframe.m_buff->map(0, perframe.m_size, BufferMapAccessBit::WRITE));
 }
 
+void StagingGpuMemoryManager::initCpuBuffer(StagingGpuMemoryType type)
+{
+	auto& perframe = m_perFrameBuffers[type];
+
+	perframe.m_alloc.init(perframe.m_size, ANKI_SAFE_ALIGNMENT);
+	perframe.m_mappedMem = static_cast<U8*>(mallocAligned(perframe.m_size, ANKI_SAFE_ALIGNMENT));
+}
+
 void* StagingGpuMemoryManager::allocateFrame(PtrSize size, StagingGpuMemoryType usage, StagingGpuMemoryToken& token)
 {
 	PerFrameBuffer& buff = m_perFrameBuffers[usage];
@@ -69,6 +69,8 @@ public:
 
 	~StagingGpuMemoryManager();
 
+	/// @param gr If it's nullptr the memory is plain CPU memory and the tokens don't have buffers. Useful for tests
+	///           that only need to read back what was written and don't have a GPU.
 	ANKI_USE_RESULT Error init(GrManager* gr, const ConfigSet& cfg);
 
 	void endFrame();
@@ -81,6 +83,15 @@ public:
 	/// N-(MAX_FRAMES_IN_FLIGHT-1) frame.
 	void* tryAllocateFrame(PtrSize size, StagingGpuMemoryType usage, StagingGpuMemoryToken& token);
 
+	/// Get the CPU address of an allocation. Can be used to read back what was written before the memory is reclaimed.
+	void* getMappedMemory(const StagingGpuMemoryToken& token) const
+	{
+		ANKI_ASSERT(token.m_type < StagingGpuMemoryType::COUNT && !token.isUnused());
+		const PerFrameBuffer& buff = m_perFrameBuffers[token.m_type];
+		ANKI_ASSERT(buff.m_mappedMem && token.m_offset + token.m_range <= buff.m_size);
+		return buff.m_mappedMem + token.m_offset;
+	}
+
 private:
 	class PerFrameBuffer
 	{
@@ -96,6 +107,8 @@ private:
 
 	void initBuffer(
 		StagingGpuMemoryType type, U32 alignment, PtrSize maxAllocSize, BufferUsageBit usage, GrManager& gr);
+
+	void initCpuBuffer(StagingGpuMemoryType type);
 };
 /// @}
 
@@ -13,6 +13,7 @@
 #include <anki/util/BitSet.h>
 #include <anki/util/File.h>
 #include <anki/util/StringList.h>
+#include <anki/util/HighRezTimer.h>
 
 namespace anki
 {
@@ -23,9 +24,17 @@ namespace anki
 class RenderGraph::RT
 {
 public:
+	/// A value for m_lastBatchThatTransitionedIt. The surface was used by another render target that shares the same
+	/// texture and it needs a barrier even if the usage doesn't change.
+	static const U16 ALIASED = MAX_U16 - 1;
+
 	DynamicArray<TextureUsageBit> m_surfOrVolUsages;
 	DynamicArray<U16> m_lastBatchThatTransitionedIt;
 	TexturePtr m_texture; ///< Hold a reference.
+	U64 m_hash = 0; ///< The hash of the TextureInitInfo of non-imported render targets.
+	U32 m_aliasedRt = MAX_U32; ///< The render target that used the same texture before this one.
+	U16 m_firstBatch = MAX_U16; ///< The first batch that uses the render target.
+	U16 m_lastBatch = 0; ///< The last batch that uses the render target.
 };
 
 /// Same as RT but for buffers.
@@ -74,6 +83,26 @@ public:
 		, m_isTexture(false)
 	{
 	}
+
+	Bool operator==(const Barrier& b) const
+	{
+		if(m_isTexture != b.m_isTexture)
+		{
+			return false;
+		}
+
+		if(m_isTexture)
+		{
+			return m_texture.m_idx == b.m_texture.m_idx && m_texture.m_usageBefore == b.m_texture.m_usageBefore
+				   && m_texture.m_usageAfter == b.m_texture.m_usageAfter
+				   && m_texture.m_surface == b.m_texture.m_surface;
+		}
+		else
+		{
+			return m_buffer.m_idx == b.m_buffer.m_idx && m_buffer.m_usageBefore == b.m_buffer.m_usageBefore
+				   && m_buffer.m_usageAfter == b.m_buffer.m_usageAfter;
+		}
+	}
 };
 
 /// Contains some extra things the RenderPassBase cannot hold.
@@ -125,6 +154,86 @@ public:
 	DynamicArray<U32> m_passIndices;
 	DynamicArray<Barrier> m_barriersBefore;
 	CommandBuffer* m_cmdb; ///< Someone else holds the ref already so have a ptr here.
+	Bool8 m_newCommandBuffer; ///< The batch doesn't share the command buffer of the previous batch.
+};
+
+/// The parts of a baked graph that depend only on the structure of the RenderGraphDescription and not on the actual
+/// resources. The next graphs with the same structure reuse them.
+class RenderGraph::GraphTemplate
+{
+public:
+	class BatchTemplate
+	{
+	public:
+		U32 m_firstPass;
+		U32 m_passCount;
+		U32 m_firstBarrier;
+		U32 m_barrierCount;
+		Bool8 m_newCommandBuffer;
+	};
+
+	DynamicArray<U32> m_key; ///< The structure of the description. The hash alone might collide.
+	DynamicArray<U32> m_dependsOn; ///< The dependencies of all passes.
+	DynamicArray<U32> m_dependsOnOffsets; ///< Where the dependencies of a pass start in m_dependsOn. Plus one.
+	DynamicArray<BatchTemplate> m_batches;
+	DynamicArray<U32> m_passIndices; ///< The pass indices of all batches.
+	DynamicArray<Barrier> m_barriers; ///< The barriers of all batches.
+	Second m_bakeTime = 0.0; ///< How long it took to compute all the above.
+
+	void destroy(GrAllocator<U8> alloc)
+	{
+		m_key.destroy(alloc);
+		m_dependsOn.destroy(alloc);
+		m_dependsOnOffsets.destroy(alloc);
+		m_batches.destroy(alloc);
+		m_passIndices.destroy(alloc);
+		m_barriers.destroy(alloc);
+	}
+
+	Bool keyEquals(const DynamicArrayAuto<U32>& key) const
+	{
+		return m_key.getSize() == key.getSize() && memcmp(&m_key[0], &key[0], key.getSizeInBytes()) == 0;
+	}
+
+	/// Compare the baked parts, not the key.
+	Bool bakeEquals(const GraphTemplate& b) const
+	{
+		auto arraysEqual = [](const auto& x, const auto& y) {
+			if(x.getSize() != y.getSize())
+			{
+				return false;
+			}
+
+			for(U i = 0; i < x.getSize(); ++i)
+			{
+				if(!(x[i] == y[i]))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		};
+
+		if(m_batches.getSize() != b.m_batches.getSize())
+		{
+			return false;
+		}
+
+		for(U i = 0; i < m_batches.getSize(); ++i)
+		{
+			const BatchTemplate& x = m_batches[i];
+			const BatchTemplate& y = b.m_batches[i];
+			if(x.m_firstPass != y.m_firstPass || x.m_passCount != y.m_passCount || x.m_firstBarrier != y.m_firstBarrier
+				|| x.m_barrierCount != y.m_barrierCount || x.m_newCommandBuffer != y.m_newCommandBuffer)
+			{
+				return false;
+			}
+		}
+
+		return arraysEqual(m_dependsOn, b.m_dependsOn) && arraysEqual(m_dependsOnOffsets, b.m_dependsOnOffsets)
+			   && arraysEqual(m_passIndices, b.m_passIndices) && arraysEqual(m_barriers, b.m_barriers);
+	}
 };
 
 /// The RenderGraph build context.
@@ -140,6 +249,12 @@ public:
 
 	DynamicArray<CommandBufferPtr> m_graphicsCmdbs;
 
+	U32 m_recordingThreadCount = 1;
+
+	/// If it's not nullptr the context only validates a GraphTemplate. It doesn't create command buffers and it takes
+	/// the textures of the render targets from that context.
+	const BakeContext* m_validatedCtx = nullptr;
+
 	BakeContext(const StackAllocator<U8>& alloc)
 		: m_alloc(alloc)
 	{
@@ -235,6 +350,20 @@ RenderGraph::~RenderGraph()
 	}
 
 	m_fbCache.destroy(getAllocator());
+
+	destroyGraphTemplates();
+}
+
+void RenderGraph::destroyGraphTemplates()
+{
+	for(GraphTemplate* tmpl : m_graphTemplates)
+	{
+		tmpl->destroy(getAllocator());
+		getAllocator().deleteInstance(tmpl);
+	}
+
+	m_graphTemplates.destroy(getAllocator());
+	m_graphTemplateCount = 0;
 }
 
 RenderGraph* RenderGraph::newInstance(GrManager* manager)
@@ -323,25 +452,18 @@ TexturePtr RenderGraph::getOrCreateRenderTarget(const TextureInitInfo& initInf,
 }
 
 FramebufferPtr RenderGraph::getOrCreateFramebuffer(
-	const FramebufferDescription& fbDescr, const RenderTargetHandle* rtHandles, CString name, Bool& drawsToPresentable)
+	const FramebufferDescription& fbDescr, const RenderTargetHandle* rtHandles, CString name)
 {
 	ANKI_ASSERT(rtHandles);
 	U64 hash = fbDescr.m_hash;
 	ANKI_ASSERT(hash > 0);
 
-	drawsToPresentable = false;
-
 	// Create a hash that includes the render targets
 	Array<U64, MAX_COLOR_ATTACHMENTS + 1> uuids;
 	U count = 0;
 	for(U i = 0; i < fbDescr.m_colorAttachmentCount; ++i)
 	{
 		uuids[count++] = m_ctx->m_rts[rtHandles[i].m_idx].m_texture->getUuid();
-
-		if(!!(m_ctx->m_rts[rtHandles[i].m_idx].m_texture->getTextureUsage() & TextureUsageBit::PRESENT))
-		{
-			drawsToPresentable = true;
-		}
 	}
 
 	if(!!fbDescr.m_depthStencilAttachment.m_aspect)
@@ -555,34 +677,32 @@ RenderGraph::BakeContext* RenderGraph::newContext(const RenderGraphDescription&
 	{
 		RT& outRt = ctx->m_rts[rtIdx];
 
-		TexturePtr tex;
+		U surfOrVolumeCount;
 		Bool imported = descr.m_renderTargets[rtIdx].m_importedTex.isCreated();
 		if(imported)
 		{
 			// It's imported
-			tex = descr.m_renderTargets[rtIdx].m_importedTex;
+			const TexturePtr& tex = descr.m_renderTargets[rtIdx].m_importedTex;
+			outRt.m_texture = tex;
+			surfOrVolumeCount =
+				tex->getMipmapCount() * tex->getLayerCount() * (textureTypeIsCube(tex->getTextureType()) ? 6 : 1);
 		}
 		else
 		{
-			// Need to create new
+			// Need to create new. The texture will be picked when the lifetimes of the render targets are known
 
-			// Create a new TextureInitInfo with the derived usage
-			TextureInitInfo initInf = descr.m_renderTargets[rtIdx].m_initInfo;
-			initInf.m_usage = descr.m_renderTargets[rtIdx].m_usageDerivedByDeps;
-			ANKI_ASSERT(initInf.m_usage != TextureUsageBit::NONE);
+			const TextureInitInfo& initInf = descr.m_renderTargets[rtIdx].m_initInfo;
+			const TextureUsageBit usage = descr.m_renderTargets[rtIdx].m_usageDerivedByDeps;
+			ANKI_ASSERT(usage != TextureUsageBit::NONE);
 
 			// Create the new hash
-			const U64 hash = appendHash(&initInf.m_usage, sizeof(initInf.m_usage), descr.m_renderTargets[rtIdx].m_hash);
+			outRt.m_hash = appendHash(&usage, sizeof(usage), descr.m_renderTargets[rtIdx].m_hash);
 
-			// Get or create the texture
-			tex = getOrCreateRenderTarget(initInf, hash);
+			surfOrVolumeCount =
+				initInf.m_mipmapCount * initInf.m_layerCount * (textureTypeIsCube(initInf.m_type) ? 6 : 1);
 		}
 
-		outRt.m_texture = tex;
-
 		// Init the surfs or volumes
-		const U surfOrVolumeCount =
-			tex->getMipmapCount() * tex->getLayerCount() * (textureTypeIsCube(tex->getTextureType()) ? 6 : 1);
 		outRt.m_surfOrVolUsages.create(alloc,
 			surfOrVolumeCount,
 			(imported) ? descr.m_renderTargets[rtIdx].m_importedLastKnownUsage : TextureUsageBit::NONE);
@@ -601,7 +721,7 @@ RenderGraph::BakeContext* RenderGraph::newContext(const RenderGraphDescription&
 	return ctx;
 }
 
-void RenderGraph::initRenderPassesAndSetDeps(const RenderGraphDescription& descr, StackAllocator<U8>& alloc)
+void RenderGraph::initRenderPasses(const RenderGraphDescription& descr, StackAllocator<U8>& alloc)
 {
 	BakeContext& ctx = *m_ctx;
 	const U passCount = descr.m_passes.getSize();
@@ -629,7 +749,7 @@ void RenderGraph::initRenderPassesAndSetDeps(const RenderGraphDescription& descr
 			memcpy(&inf, &inDep.m_texture, sizeof(inf));
 		}
 
-		// Create command buffers and framebuffer
+		// Init the framebuffer info. The framebuffers will be created after the render targets
 		if(inPass.m_type == RenderPassDescriptionBase::Type::GRAPHICS)
 		{
 			const GraphicsRenderPassDescription& graphicsPass =
@@ -637,14 +757,9 @@ void RenderGraph::initRenderPassesAndSetDeps(const RenderGraphDescription& descr
 
 			if(graphicsPass.hasFramebuffer())
 			{
-				Bool drawsToPresentable;
-				outPass.fb() = getOrCreateFramebuffer(
-					graphicsPass.m_fbDescr, &graphicsPass.m_rtHandles[0], inPass.m_name.cstr(), drawsToPresentable);
-
 				outPass.m_fbRenderArea = graphicsPass.m_fbRenderArea;
-				outPass.m_drawsToPresentable = drawsToPresentable;
 
-				// Init the usage bits
+				// Init the usage bits. Also check if it draws to the swapchain (only imported textures can)
 				TextureUsageBit usage;
 				for(U i = 0; i < graphicsPass.m_fbDescr.m_colorAttachmentCount; ++i)
 				{
@@ -654,6 +769,12 @@ void RenderGraph::initRenderPassesAndSetDeps(const RenderGraphDescription& descr
 						usage);
 
 					outPass.m_colorUsages[i] = usage;
+
+					const TexturePtr& tex = descr.m_renderTargets[graphicsPass.m_rtHandles[i].m_idx].m_importedTex;
+					if(tex.isCreated() && !!(tex->getTextureUsage() & TextureUsageBit::PRESENT))
+					{
+						outPass.m_drawsToPresentable = true;
+					}
 				}
 
 				if(!!graphicsPass.m_fbDescr.m_depthStencilAttachment.m_aspect)
@@ -666,17 +787,6 @@ void RenderGraph::initRenderPassesAndSetDeps(const RenderGraphDescription& descr
 
 					outPass.m_dsUsage = usage;
 				}
-
-				// Do some pre-work for the second level command buffers
-				if(inPass.m_secondLevelCmdbsCount)
-				{
-					outPass.m_secondLevelCmdbs.create(alloc, inPass.m_secondLevelCmdbsCount);
-					CommandBufferInitInfo& cmdbInit = outPass.m_secondLevelCmdbInitInfo;
-					cmdbInit.m_flags = CommandBufferFlag::GRAPHICS_WORK | CommandBufferFlag::SECOND_LEVEL;
-					ANKI_ASSERT(cmdbInit.m_framebuffer.isCreated());
-					cmdbInit.m_colorAttachmentUsages = outPass.m_colorUsages;
-					cmdbInit.m_depthStencilAttachmentUsage = outPass.m_dsUsage;
-				}
 			}
 			else
 			{
@@ -687,8 +797,146 @@ void RenderGraph::initRenderPassesAndSetDeps(const RenderGraphDescription& descr
 		{
 			ANKI_ASSERT(inPass.m_secondLevelCmdbsCount == 0 && "Can't have second level cmdbs");
 		}
+	}
+}
+
+void RenderGraph::initRenderTargets(const RenderGraphDescription& descr)
+{
+	BakeContext& ctx = *m_ctx;
+
+	// Find the lifetimes of the render targets
+	for(U batchIdx = 0; batchIdx < ctx.m_batches.getSize(); ++batchIdx)
+	{
+		for(U32 passIdx : ctx.m_batches[batchIdx].m_passIndices)
+		{
+			for(const RenderPassDependency& dep : descr.m_passes[passIdx]->m_rtDeps)
+			{
+				RT& rt = ctx.m_rts[dep.m_texture.m_handle.m_idx];
+				rt.m_firstBatch = min<U16>(rt.m_firstBatch, batchIdx);
+				rt.m_lastBatch = max<U16>(rt.m_lastBatch, batchIdx);
+			}
+		}
+	}
+
+	// Walk the render targets in the order they start living. A render target can take the texture of a previous
+	// render target with the same init info if their lifetimes don't overlap
+	Array<U32, MAX_RENDER_GRAPH_RENDER_TARGETS> textureOwners;
+	U32 textureCount = 0;
+	m_stats.m_transientMemory = 0;
+	m_stats.m_transientMemoryWithoutAliasing = 0;
+
+	auto initRt = [&](U32 rtIdx) {
+		RT& rt = ctx.m_rts[rtIdx];
+		const RenderGraphDescription::RT& inRt = descr.m_renderTargets[rtIdx];
+		const PtrSize size = computeTextureMemorySize(inRt.m_initInfo);
+		m_stats.m_transientMemoryWithoutAliasing += size;
+
+		for(U i = 0; i < textureCount; ++i)
+		{
+			const RT& owner = ctx.m_rts[textureOwners[i]];
+			if(owner.m_hash == rt.m_hash && owner.m_lastBatch < rt.m_firstBatch)
+			{
+				rt.m_texture = owner.m_texture;
+				rt.m_aliasedRt = textureOwners[i];
+				textureOwners[i] = rtIdx;
+				return;
+			}
+		}
+
+		if(ctx.m_validatedCtx)
+		{
+			rt.m_texture = ctx.m_validatedCtx->m_rts[rtIdx].m_texture;
+		}
+		else
+		{
+			TextureInitInfo initInf = inRt.m_initInfo;
+			initInf.m_usage = inRt.m_usageDerivedByDeps;
+			rt.m_texture = getOrCreateRenderTarget(initInf, rt.m_hash);
+		}
+		textureOwners[textureCount++] = rtIdx;
+		m_stats.m_transientMemory += size;
+	};
+
+	for(U batchIdx = 0; batchIdx <= ctx.m_batches.getSize(); ++batchIdx)
+	{
+		for(U32 rtIdx = 0; rtIdx < ctx.m_rts.getSize(); ++rtIdx)
+		{
+			const RT& rt = ctx.m_rts[rtIdx];
+			const Bool unused = batchIdx == ctx.m_batches.getSize() && rt.m_firstBatch == MAX_U16;
+			if(!rt.m_texture.isCreated() && (rt.m_firstBatch == batchIdx || unused))
+			{
+				initRt(rtIdx);
+			}
+		}
+	}
+
+	ANKI_TRACE_INC_COUNTER(GR_RENDER_GRAPH_TRANSIENT_MEMORY, m_stats.m_transientMemory);
+	ANKI_TRACE_INC_COUNTER(GR_RENDER_GRAPH_TRANSIENT_MEMORY_UNALIASED, m_stats.m_transientMemoryWithoutAliasing);
+}
+
+PtrSize RenderGraph::computeTextureMemorySize(const TextureInitInfo& init)
+{
+	const U faceCount = textureTypeIsCube(init.m_type) ? 6 : 1;
+	PtrSize size = 0;
+	for(U mip = 0; mip < init.m_mipmapCount; ++mip)
+	{
+		const U width = max(init.m_width >> mip, 1u);
+		const U height = max(init.m_height >> mip, 1u);
+		if(init.m_type == TextureType::_3D)
+		{
+			size += computeVolumeSize(width, height, max(init.m_depth >> mip, 1u), init.m_format);
+		}
+		else
+		{
+			size += computeSurfaceSize(width, height, init.m_format) * init.m_layerCount * faceCount;
+		}
+	}
+
+	return size * init.m_samples;
+}
+
+void RenderGraph::initFramebuffers(const RenderGraphDescription& descr)
+{
+	BakeContext& ctx = *m_ctx;
+	for(U passIdx = 0; passIdx < ctx.m_passes.getSize(); ++passIdx)
+	{
+		const RenderPassDescriptionBase& inPass = *descr.m_passes[passIdx];
+		if(inPass.m_type != RenderPassDescriptionBase::Type::GRAPHICS)
+		{
+			continue;
+		}
+
+		const GraphicsRenderPassDescription& graphicsPass = static_cast<const GraphicsRenderPassDescription&>(inPass);
+		if(!graphicsPass.hasFramebuffer())
+		{
+			continue;
+		}
+
+		Pass& outPass = ctx.m_passes[passIdx];
+		outPass.fb() =
+			getOrCreateFramebuffer(graphicsPass.m_fbDescr, &graphicsPass.m_rtHandles[0], inPass.m_name.cstr());
+
+		// Do some pre-work for the second level command buffers
+		if(inPass.m_secondLevelCmdbsCount)
+		{
+			outPass.m_secondLevelCmdbs.create(ctx.m_alloc, inPass.m_secondLevelCmdbsCount);
+			CommandBufferInitInfo& cmdbInit = outPass.m_secondLevelCmdbInitInfo;
+			cmdbInit.m_flags = CommandBufferFlag::GRAPHICS_WORK | CommandBufferFlag::SECOND_LEVEL;
+			ANKI_ASSERT(cmdbInit.m_framebuffer.isCreated());
+			cmdbInit.m_colorAttachmentUsages = outPass.m_colorUsages;
+			cmdbInit.m_depthStencilAttachmentUsage = outPass.m_dsUsage;
+		}
+	}
+}
+
+void RenderGraph::setPassDependencies(const RenderGraphDescription& descr, StackAllocator<U8>& alloc)
+{
+	BakeContext& ctx = *m_ctx;
+	for(U passIdx = 0; passIdx < ctx.m_passes.getSize(); ++passIdx)
+	{
+		const RenderPassDescriptionBase& inPass = *descr.m_passes[passIdx];
+		Pass& outPass = ctx.m_passes[passIdx];
 
-		// Set dependencies
 		U j = passIdx;
 		while(j--)
 		{
@@ -708,6 +956,11 @@ void RenderGraph::initBatches()
 	U passesInBatchCount = 0;
 	const U passCount = m_ctx->m_passes.getSize();
 	ANKI_ASSERT(passCount > 0);
+
+	// Split the batches into command buffers with about the same number of passes so they can be recorded in parallel
+	const U passesPerCmdb = (passCount + m_ctx->m_recordingThreadCount - 1) / m_ctx->m_recordingThreadCount;
+	U passesInCmdb = 0;
+
 	while(passesInBatchCount < passCount)
 	{
 		Batch batch;
@@ -729,17 +982,17 @@ void RenderGraph::initBatches()
 		// Get or create cmdb for the batch.
 		// Create a new cmdb if the batch is writing to swapchain. This will help Vulkan to have a dependency of the
 		// swap chain image acquire to the 2nd command buffer instead of adding it to a single big cmdb.
-		if(m_ctx->m_graphicsCmdbs.isEmpty() || drawsToPresentable)
+		batch.m_newCommandBuffer =
+			m_ctx->m_graphicsCmdbs.isEmpty() || drawsToPresentable || passesInCmdb >= passesPerCmdb;
+		if(batch.m_newCommandBuffer)
 		{
-			CommandBufferInitInfo cmdbInit;
-			cmdbInit.m_flags = CommandBufferFlag::COMPUTE_WORK | CommandBufferFlag::GRAPHICS_WORK;
-			CommandBufferPtr cmdb = getManager().newCommandBuffer(cmdbInit);
-
-			m_ctx->m_graphicsCmdbs.emplaceBack(m_ctx->m_alloc, cmdb);
-
-			batch.m_cmdb = cmdb.get();
+			newBatchCommandBuffer();
+			passesInCmdb = 0;
 		}
 
+		batch.m_cmdb = m_ctx->m_graphicsCmdbs.getBack().get();
+		passesInCmdb += batch.m_passIndices.getSize();
+
 		// Push back batch
 		m_ctx->m_batches.emplaceBack(m_ctx->m_alloc, std::move(batch));
 
@@ -751,6 +1004,19 @@ void RenderGraph::initBatches()
 	}
 }
 
+void RenderGraph::newBatchCommandBuffer()
+{
+	CommandBufferPtr cmdb;
+	if(!m_ctx->m_validatedCtx)
+	{
+		CommandBufferInitInfo cmdbInit;
+		cmdbInit.m_flags = CommandBufferFlag::COMPUTE_WORK | CommandBufferFlag::GRAPHICS_WORK;
+		cmdb = getManager().newCommandBuffer(cmdbInit);
+	}
+
+	m_ctx->m_graphicsCmdbs.emplaceBack(m_ctx->m_alloc, cmdb);
+}
+
 template<typename TFunc>
 void RenderGraph::iterateSurfsOrVolumes(const TexturePtr& tex, const TextureSubresourceInfo& subresource, TFunc func)
 {
@@ -787,7 +1053,7 @@ void RenderGraph::setTextureBarrier(Batch& batch, const RenderPassDependency& de
 	iterateSurfsOrVolumes(
 		rt.m_texture, dep.m_texture.m_subresource, [&](U surfOrVolIdx, const TextureSurfaceInfo& surf) {
 			TextureUsageBit& crntUsage = rt.m_surfOrVolUsages[surfOrVolIdx];
-			if(crntUsage != depUsage)
+			if(crntUsage != depUsage || rt.m_lastBatchThatTransitionedIt[surfOrVolIdx] == RT::ALIASED)
 			{
 				// Check if we can merge barriers
 				if(rt.m_lastBatchThatTransitionedIt[surfOrVolIdx] == batchIdx)
@@ -835,6 +1101,28 @@ void RenderGraph::setBatchBarriers(const RenderGraphDescription& descr)
 	{
 		BitSet<MAX_RENDER_GRAPH_BUFFERS, U64> buffHasBarrierMask = {false};
 
+		// The render targets that start living in this batch and share a texture with a previous render target continue
+		// from the state the previous one left the texture
+		const U batchIdx = &batch - &ctx.m_batches[0];
+		for(RT& rt : ctx.m_rts)
+		{
+			if(rt.m_firstBatch != batchIdx || rt.m_aliasedRt == MAX_U32)
+			{
+				continue;
+			}
+
+			const RT& prevRt = ctx.m_rts[rt.m_aliasedRt];
+			ANKI_ASSERT(prevRt.m_surfOrVolUsages.getSize() == rt.m_surfOrVolUsages.getSize());
+			for(U i = 0; i < rt.m_surfOrVolUsages.getSize(); ++i)
+			{
+				if(prevRt.m_surfOrVolUsages[i] != TextureUsageBit::NONE)
+				{
+					rt.m_surfOrVolUsages[i] = prevRt.m_surfOrVolUsages[i];
+					rt.m_lastBatchThatTransitionedIt[i] = RT::ALIASED;
+				}
+			}
+		}
+
 		// For all passes of that batch
 		for(U passIdx : batch.m_passIndices)
 		{
@@ -923,22 +1211,344 @@ void RenderGraph::setBatchBarriers(const RenderGraphDescription& descr)
 	} // For all batches
 }
 
-void RenderGraph::compileNewGraph(const RenderGraphDescription& descr, StackAllocator<U8>& alloc)
+void RenderGraph::computeDescriptionKey(
+	const RenderGraphDescription& descr, U32 recordingThreadCount, DynamicArrayAuto<U32>& key)
+{
+	// Gather everything that affects the dependencies, the batches and the barriers. Those don't depend on the actual
+	// textures and buffers but they depend on their properties
+	auto push = [&](U32 x) { key.emplaceBack(x); };
+	auto push64 = [&](U64 x) {
+		push(U32(x));
+		push(U32(x >> U64(32)));
+	};
+
+	push(recordingThreadCount);
+	push(descr.m_passes.getSize());
+	push(descr.m_renderTargets.getSize());
+	push(descr.m_buffers.getSize());
+
+	for(const RenderGraphDescription::RT& rt : descr.m_renderTargets)
+	{
+		if(rt.m_importedTex.isCreated())
+		{
+			const TexturePtr& tex = rt.m_importedTex;
+			push(1);
+			push(U32(rt.m_importedLastKnownUsage));
+			push(!!(tex->getTextureUsage() & TextureUsageBit::PRESENT));
+			push(tex->getMipmapCount());
+			push(tex->getLayerCount());
+			push(U32(tex->getTextureType()));
+		}
+		else
+		{
+			push(0);
+			push64(rt.m_hash);
+		}
+	}
+
+	for(const RenderGraphDescription::Buffer& buff : descr.m_buffers)
+	{
+		push64(U64(buff.m_usage));
+	}
+
+	for(const RenderPassDescriptionBase* pass : descr.m_passes)
+	{
+		push(U32(pass->m_type));
+
+		if(pass->m_type == RenderPassDescriptionBase::Type::GRAPHICS)
+		{
+			// The color attachments decide if the pass draws to the swapchain
+			const GraphicsRenderPassDescription& gpass = static_cast<const GraphicsRenderPassDescription&>(*pass);
+			const U32 colorAttachmentCount = (gpass.hasFramebuffer()) ? gpass.m_fbDescr.m_colorAttachmentCount : 0;
+			push(colorAttachmentCount);
+			for(U i = 0; i < colorAttachmentCount; ++i)
+			{
+				push(gpass.m_rtHandles[i].m_idx);
+			}
+		}
+
+		push(pass->m_rtDeps.getSize());
+		for(const RenderPassDependency& dep : pass->m_rtDeps)
+		{
+			const TextureSubresourceInfo& subresource = dep.m_texture.m_subresource;
+			push(dep.m_texture.m_handle.m_idx);
+			push(U32(dep.m_texture.m_usage));
+			push(subresource.m_firstMipmap);
+			push(subresource.m_mipmapCount);
+			push(subresource.m_firstLayer);
+			push(subresource.m_layerCount);
+			push(U32(subresource.m_firstFace) | (U32(subresource.m_faceCount) << 8u)
+				 | (U32(subresource.m_depthStencilAspect) << 16u));
+		}
+
+		push(pass->m_buffDeps.getSize());
+		for(const RenderPassDependency& dep : pass->m_buffDeps)
+		{
+			push(dep.m_buffer.m_handle.m_idx);
+			push64(U64(dep.m_buffer.m_usage));
+		}
+	}
+}
+
+void RenderGraph::fillGraphTemplate(const BakeContext& ctx, GraphTemplate* tmpl)
+{
+	auto alloc = getAllocator();
+
+	// Dependencies
+	U32 dependencyCount = 0;
+	tmpl->m_dependsOnOffsets.create(alloc, ctx.m_passes.getSize() + 1);
+	for(U passIdx = 0; passIdx < ctx.m_passes.getSize(); ++passIdx)
+	{
+		tmpl->m_dependsOnOffsets[passIdx] = dependencyCount;
+		dependencyCount += ctx.m_passes[passIdx].m_dependsOn.getSize();
+	}
+	tmpl->m_dependsOnOffsets.getBack() = dependencyCount;
+
+	if(dependencyCount)
+	{
+		tmpl->m_dependsOn.create(alloc, dependencyCount);
+		for(U passIdx = 0; passIdx < ctx.m_passes.getSize(); ++passIdx)
+		{
+			const DynamicArray<U32>& deps = ctx.m_passes[passIdx].m_dependsOn;
+			if(deps.getSize())
+			{
+				memcpy(&tmpl->m_dependsOn[tmpl->m_dependsOnOffsets[passIdx]], &deps[0], deps.getSizeInBytes());
+			}
+		}
+	}
+
+	// Batches
+	U32 passCount = 0;
+	U32 barrierCount = 0;
+	tmpl->m_batches.create(alloc, ctx.m_batches.getSize());
+	for(U batchIdx = 0; batchIdx < ctx.m_batches.getSize(); ++batchIdx)
+	{
+		const Batch& batch = ctx.m_batches[batchIdx];
+		GraphTemplate::BatchTemplate& out = tmpl->m_batches[batchIdx];
+		out.m_firstPass = passCount;
+		out.m_passCount = batch.m_passIndices.getSize();
+		out.m_firstBarrier = barrierCount;
+		out.m_barrierCount = batch.m_barriersBefore.getSize();
+		out.m_newCommandBuffer = batch.m_newCommandBuffer;
+
+		passCount += out.m_passCount;
+		barrierCount += out.m_barrierCount;
+	}
+
+	tmpl->m_passIndices.create(alloc, passCount);
+	if(barrierCount)
+	{
+		tmpl->m_barriers.create(alloc, barrierCount, Barrier(0, BufferUsageBit::NONE, BufferUsageBit::NONE));
+	}
+
+	for(U batchIdx = 0; batchIdx < ctx.m_batches.getSize(); ++batchIdx)
+	{
+		const Batch& batch = ctx.m_batches[batchIdx];
+		const GraphTemplate::BatchTemplate& out = tmpl->m_batches[batchIdx];
+		memcpy(&tmpl->m_passIndices[out.m_firstPass], &batch.m_passIndices[0], batch.m_passIndices.getSizeInBytes());
+
+		if(out.m_barrierCount)
+		{
+			memcpy(&tmpl->m_barriers[out.m_firstBarrier],
+				&batch.m_barriersBefore[0],
+				batch.m_barriersBefore.getSizeInBytes());
+		}
+	}
+}
+
+void RenderGraph::storeGraphTemplate(U64 hash, const DynamicArrayAuto<U32>& key, Second bakeTime)
+{
+	auto alloc = getAllocator();
+
+	// Graphs with many different structures are not expected. Start over if there are too many
+	if(m_graphTemplateCount >= MAX_GRAPH_TEMPLATES)
+	{
+		destroyGraphTemplates();
+	}
+
+	GraphTemplate* tmpl = alloc.newInstance<GraphTemplate>();
+	tmpl->m_bakeTime = bakeTime;
+	tmpl->m_key.create(alloc, key.getSize());
+	memcpy(&tmpl->m_key[0], &key[0], key.getSizeInBytes());
+	fillGraphTemplate(*m_ctx, tmpl);
+
+	m_graphTemplates.emplace(alloc, hash, tmpl);
+	++m_graphTemplateCount;
+}
+
+void RenderGraph::initFromGraphTemplate(const GraphTemplate& tmpl)
+{
+	BakeContext& ctx = *m_ctx;
+	ANKI_ASSERT(tmpl.m_dependsOnOffsets.getSize() == ctx.m_passes.getSize() + 1);
+
+	// Dependencies
+	for(U passIdx = 0; passIdx < ctx.m_passes.getSize(); ++passIdx)
+	{
+		const U32 first = tmpl.m_dependsOnOffsets[passIdx];
+		const U32 count = tmpl.m_dependsOnOffsets[passIdx + 1] - first;
+		if(count)
+		{
+			DynamicArray<U32>& deps = ctx.m_passes[passIdx].m_dependsOn;
+			deps.create(ctx.m_alloc, count);
+			memcpy(&deps[0], &tmpl.m_dependsOn[first], deps.getSizeInBytes());
+		}
+
+		ctx.m_passIsInBatch.set(passIdx);
+	}
+
+	// Batches. The barriers point to the resources using indices so they only need a copy
+	ctx.m_batches.create(ctx.m_alloc, tmpl.m_batches.getSize());
+	for(U batchIdx = 0; batchIdx < ctx.m_batches.getSize(); ++batchIdx)
+	{
+		const GraphTemplate::BatchTemplate& in = tmpl.m_batches[batchIdx];
+		Batch& batch = ctx.m_batches[batchIdx];
+
+		batch.m_passIndices.create(ctx.m_alloc, in.m_passCount);
+		memcpy(&batch.m_passIndices[0], &tmpl.m_passIndices[in.m_firstPass], batch.m_passIndices.getSizeInBytes());
+
+		if(in.m_barrierCount)
+		{
+			batch.m_barriersBefore.create(ctx.m_alloc, in.m_barrierCount, tmpl.m_barriers[in.m_firstBarrier]);
+			memcpy(&batch.m_barriersBefore[0],
+				&tmpl.m_barriers[in.m_firstBarrier],
+				batch.m_barriersBefore.getSizeInBytes());
+		}
+
+		batch.m_newCommandBuffer = in.m_newCommandBuffer;
+		if(in.m_newCommandBuffer)
+		{
+			newBatchCommandBuffer();
+		}
+
+		batch.m_cmdb = ctx.m_graphicsCmdbs.getBack().get();
+	}
+}
+
+#if ANKI_EXTRA_CHECKS
+void RenderGraph::validateGraphTemplate(
+	const RenderGraphDescription& descr, StackAllocator<U8>& alloc, const GraphTemplate& tmpl)
+{
+	// Bake the graph from scratch in a different context and compare
+	BakeContext& cachedCtx = *m_ctx;
+	const RenderGraphStats cachedStats = m_stats;
+	BakeContext& ctx = *newContext(descr, alloc);
+	ctx.m_recordingThreadCount = cachedCtx.m_recordingThreadCount;
+	ctx.m_validatedCtx = &cachedCtx;
+	m_ctx = &ctx;
+
+	initRenderPasses(descr, alloc);
+	setPassDependencies(descr, alloc);
+	initBatches();
+	initRenderTargets(descr);
+	setBatchBarriers(descr);
+
+	GraphTemplate fresh;
+	fillGraphTemplate(ctx, &fresh);
+	ANKI_ASSERT(fresh.bakeEquals(tmpl) && "The cached graph doesn't match the one that was baked from scratch");
+	fresh.destroy(getAllocator());
+
+	// The render targets should have the same lifetimes so they should share the same textures
+	for(U rtIdx = 0; rtIdx < ctx.m_rts.getSize(); ++rtIdx)
+	{
+		const RT& a = ctx.m_rts[rtIdx];
+		const RT& b = cachedCtx.m_rts[rtIdx];
+		ANKI_ASSERT(a.m_firstBatch == b.m_firstBatch && a.m_lastBatch == b.m_lastBatch
+					&& a.m_aliasedRt == b.m_aliasedRt && a.m_texture.get() == b.m_texture.get());
+		(void)a;
+		(void)b;
+		ctx.m_rts[rtIdx].m_texture.reset(nullptr);
+	}
+
+	ANKI_ASSERT(m_stats.m_transientMemory == cachedStats.m_transientMemory
+				&& m_stats.m_transientMemoryWithoutAliasing == cachedStats.m_transientMemoryWithoutAliasing);
+	m_stats = cachedStats;
+
+	// The context lives in the stack allocator. Only the references need to be released
+	for(Buffer& buff : ctx.m_buffers)
+	{
+		buff.m_buffer.reset(nullptr);
+	}
+
+	ctx.m_graphicsCmdbs.destroy(alloc);
+	m_ctx = &cachedCtx;
+}
+#endif
+
+void RenderGraph::compileNewGraph(
+	const RenderGraphDescription& descr, StackAllocator<U8>& alloc, U32 recordingThreadCount)
 {
 	ANKI_TRACE_SCOPED_EVENT(GR_RENDER_GRAPH);
+	ANKI_ASSERT(recordingThreadCount > 0);
 
 	// Init the context
 	BakeContext& ctx = *newContext(descr, alloc);
+	ctx.m_recordingThreadCount = recordingThreadCount;
 	m_ctx = &ctx;
 
-	// Init the passes and find the dependencies between passes
-	initRenderPassesAndSetDeps(descr, alloc);
+	// Init the passes
+	initRenderPasses(descr, alloc);
+
+	// The renderer submits the same graph almost every frame so try to reuse the dependencies, the batches and the
+	// barriers of a previous graph with the same structure
+	DynamicArrayAuto<U32> key(alloc);
+	computeDescriptionKey(descr, recordingThreadCount, key);
+	const U64 hash = computeHash(&key[0], key.getSizeInBytes());
+	auto it = m_graphTemplates.find(hash);
+	Bool collision = false;
+	if(it != m_graphTemplates.getEnd() && !(*it)->keyEquals(key))
+	{
+		// Different structure with the same hash. Bake it from scratch and keep the old one in the cache
+		ANKI_GR_LOGW("Render graph template hash collision");
+		collision = true;
+	}
 
-	// Walk the graph and create pass batches
-	initBatches();
+	if(it != m_graphTemplates.getEnd() && !collision)
+	{
+		m_stats.m_reusedGraphTemplate = true;
 
-	// Create barriers between batches
-	setBatchBarriers(descr);
+		ANKI_TRACE_INC_COUNTER(GR_RENDER_GRAPH_CACHE_HITS, 1);
+#if ANKI_ENABLE_TRACE
+		const Second begin = HighRezTimer::getCurrentTime();
+#endif
+
+		initFromGraphTemplate(**it);
+		initRenderTargets(descr);
+
+#if ANKI_EXTRA_CHECKS
+		validateGraphTemplate(descr, alloc, **it);
+#endif
+
+#if ANKI_ENABLE_TRACE
+		const Second saved = (*it)->m_bakeTime - (HighRezTimer::getCurrentTime() - begin);
+		ANKI_TRACE_INC_COUNTER(GR_RENDER_GRAPH_SAVED_US, U64(max(saved, 0.0) * 1000000.0));
+#endif
+	}
+	else
+	{
+		m_stats.m_reusedGraphTemplate = false;
+		ANKI_TRACE_INC_COUNTER(GR_RENDER_GRAPH_CACHE_MISSES, 1);
+		const Second begin = HighRezTimer::getCurrentTime();
+
+		// Find the dependencies between passes
+		setPassDependencies(descr, alloc);
+
+		// Walk the graph and create pass batches
+		initBatches();
+
+		// Pick the textures of the render targets. The ones that don't live at the same time share textures
+		initRenderTargets(descr);
+
+		// Create barriers between batches
+		setBatchBarriers(descr);
+
+		if(!collision)
+		{
+			storeGraphTemplate(hash, key, HighRezTimer::getCurrentTime() - begin);
+		}
+	}
+
+	// Create the framebuffers now that all render targets have textures
+	initFramebuffers(descr);
 
 #if ANKI_DBG_RENDER_GRAPH
 	if(dumpDependencyDotFile(descr, ctx, "./"))
@@ -990,18 +1600,33 @@ void RenderGraph::runSecondLevel(U32 threadIdx)
 	}
 }
 
-void RenderGraph::run() const
+void RenderGraph::run(U32 threadIdx) const
 {
-	ANKI_TRACE_SCOPED_EVENT(GR_RENDER_GRAPH);
+	ANKI_TRACE_SCOPED_EVENT(GR_RENDER_GRAPH_RECORD);
 	ANKI_ASSERT(m_ctx);
+	ANKI_ASSERT(threadIdx < m_ctx->m_recordingThreadCount);
 
 	RenderPassWorkContext ctx;
 	ctx.m_rgraph = this;
 	ctx.m_currentSecondLevelCommandBufferIndex = 0;
 	ctx.m_secondLevelCommandBufferCount = 0;
 
-	for(const Batch& batch : m_ctx->m_batches)
+	U cmdbIdx = 0;
+	for(U batchIdx = 0; batchIdx < m_ctx->m_batches.getSize(); ++batchIdx)
 	{
+		const Batch& batch = m_ctx->m_batches[batchIdx];
+
+		// The command buffers are distributed to the threads. The batches of a command buffer are recorded in order
+		if(batchIdx > 0 && batch.m_cmdb != m_ctx->m_batches[batchIdx - 1].m_cmdb)
+		{
+			++cmdbIdx;
+		}
+
+		if(cmdbIdx % m_ctx->m_recordingThreadCount != threadIdx)
+		{
+			continue;
+		}
+
 		ctx.m_commandBuffer.reset(batch.m_cmdb);
 		CommandBufferPtr& cmdb = ctx.m_commandBuffer;
 
@@ -201,6 +201,9 @@ private:
 };
 
 /// Work callback for a RenderGraph pass.
+/// @note If the graph is compiled for more than one recording thread the callbacks of different passes run
+///       concurrently. They should only write to the command buffer of the RenderPassWorkContext and to thread-safe
+///       state.
 using RenderPassWorkCallback = void (*)(RenderPassWorkContext& ctx);
 
 /// RenderGraph pass dependency.
@@ -571,13 +574,23 @@ private:
 	DynamicArray<Buffer> m_buffers;
 };
 
+/// RenderGraph statistics of the last compiled graph.
+class RenderGraphStats
+{
+public:
+	PtrSize m_transientMemory = 0; ///< The memory of the render targets that are not imported.
+	PtrSize m_transientMemoryWithoutAliasing = 0; ///< The memory they would need if they didn't share textures.
+	Bool8 m_reusedGraphTemplate = false; ///< The graph reused the dependencies, batches and barriers of a previous one.
+};
+
 /// Accepts a descriptor of the frame's render passes and sets the dependencies between them.
 ///
 /// The idea for the RenderGraph is to automate:
 /// - Synchronization (barriers, events etc) between passes.
 /// - Command buffer creation for primary and secondary command buffers.
 /// - Framebuffer creation.
-/// - Render target creation (optional since textures can be imported as well).
+/// - Render target creation (optional since textures can be imported as well). Render targets that are not alive at the
+///   same time share textures.
 ///
 /// It accepts a description of the frame's render passes (compute and graphics), compiles that description to calculate
 /// dependencies and then populates command buffers with the help of multiple RenderPassWorkCallback.
@@ -592,7 +605,12 @@ public:
 
 	/// @name 1st step methods
 	/// @{
-	void compileNewGraph(const RenderGraphDescription& descr, StackAllocator<U8>& alloc);
+
+	/// @param recordingThreadCount The number of threads that will call run(). The batches are split into that many
+	///        command buffers (or more) so they can be recorded in parallel. If it's more than one the pass callbacks
+	///        need to be thread-safe.
+	void compileNewGraph(
+		const RenderGraphDescription& descr, StackAllocator<U8>& alloc, U32 recordingThreadCount = 1);
 	/// @}
 
 	/// @name 2nd step methods
@@ -605,8 +623,10 @@ public:
 	/// @name 3rd step methods
 	/// @{
 
-	/// Will call a number of RenderPassWorkCallback that populate 1st level command buffers.
-	void run() const;
+	/// Will call a number of RenderPassWorkCallback that populate 1st level command buffers. Every thread records
+	/// different command buffers. All the threads (see compileNewGraph) should call it before flush().
+	/// @note It's thread-safe against other run() calls with different threadIdx.
+	void run(U32 threadIdx = 0) const;
 	/// @}
 
 	/// @name 3rd step methods
@@ -621,6 +641,11 @@ public:
 	void reset();
 	/// @}
 
+	RenderGraphStats getStats() const
+	{
+		return m_stats;
+	}
+
 private:
 	/// Render targets of the same type+size+format.
 	class RenderTargetCacheEntry
@@ -641,10 +666,19 @@ private:
 	class RT;
 	class Buffer;
 	class Barrier;
+	class GraphTemplate;
+
+	static const U32 MAX_GRAPH_TEMPLATES = 16;
+
+	/// The baked parts of previous graphs. The key is the hash of their description's structure.
+	HashMap<U64, GraphTemplate*> m_graphTemplates;
+	U32 m_graphTemplateCount = 0;
 
 	BakeContext* m_ctx = nullptr;
 	U64 m_version = 0;
 
+	RenderGraphStats m_stats;
+
 	RenderGraph(GrManager* manager, CString name);
 
 	~RenderGraph();
@@ -652,15 +686,35 @@ private:
 	static ANKI_USE_RESULT RenderGraph* newInstance(GrManager* manager);
 
 	BakeContext* newContext(const RenderGraphDescription& descr, StackAllocator<U8>& alloc);
-	void initRenderPassesAndSetDeps(const RenderGraphDescription& descr, StackAllocator<U8>& alloc);
+	void initRenderPasses(const RenderGraphDescription& descr, StackAllocator<U8>& alloc);
+	void setPassDependencies(const RenderGraphDescription& descr, StackAllocator<U8>& alloc);
 	void initBatches();
+	void initRenderTargets(const RenderGraphDescription& descr);
 	void setBatchBarriers(const RenderGraphDescription& descr);
+	void initFramebuffers(const RenderGraphDescription& descr);
+	void newBatchCommandBuffer();
+
+	/// Gather the structure of the description. The graphs with the same key have the same dependencies, batches and
+	/// barriers.
+	static void computeDescriptionKey(
+		const RenderGraphDescription& descr, U32 recordingThreadCount, DynamicArrayAuto<U32>& key);
+	void fillGraphTemplate(const BakeContext& ctx, GraphTemplate* tmpl);
+	void storeGraphTemplate(U64 hash, const DynamicArrayAuto<U32>& key, Second bakeTime);
+	void initFromGraphTemplate(const GraphTemplate& tmpl);
+
+#if ANKI_EXTRA_CHECKS
+	/// Bake the graph from scratch and check that it's the same as the one that came from a GraphTemplate.
+	void validateGraphTemplate(
+		const RenderGraphDescription& descr, StackAllocator<U8>& alloc, const GraphTemplate& tmpl);
+#endif
+	void destroyGraphTemplates();
 
 	TexturePtr getOrCreateRenderTarget(const TextureInitInfo& initInf, U64 hash);
-	FramebufferPtr getOrCreateFramebuffer(const FramebufferDescription& fbDescr,
-		const RenderTargetHandle* rtHandles,
-		CString name,
-		Bool& drawsToPresentableTex);
+	FramebufferPtr getOrCreateFramebuffer(
+		const FramebufferDescription& fbDescr, const RenderTargetHandle* rtHandles, CString name);
+
+	/// Estimate the memory of a texture.
+	static PtrSize computeTextureMemorySize(const TextureInitInfo& init);
 
 	ANKI_HOT static Bool passADependsOnB(const RenderPassDescriptionBase& a, const RenderPassDescriptionBase& b);
 
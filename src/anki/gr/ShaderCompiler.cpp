@@ -327,6 +327,11 @@ ShaderCompiler::ShaderCompiler(GenericMemoryPoolAllocator<U8> alloc)
 	}
 }
 
+U32 ShaderCompiler::getVersion()
+{
+	return glslang::GetSpirvGeneratorVersion();
+}
+
 ShaderCompiler::~ShaderCompiler()
 {
 	LockGuard<Mutex> lock(m_refcountMtx);
@@ -451,60 +456,4 @@ void ShaderCompiler::logShaderErrorCode(CString error, CString source, GenericMe
 		&error[0]);
 }
 
-Error ShaderCompilerCache::compile(
-	CString source, U64* hash, const ShaderCompilerOptions& options, DynamicArrayAuto<U8>& bin) const
-{
-	Error err = compileInternal(source, hash, options, bin);
-	if(err)
-	{
-		ANKI_GR_LOGE("Failed to compile or retrieve shader from the cache");
-	}
-
-	return err;
-}
-
-Error ShaderCompilerCache::compileInternal(
-	CString source, U64* hash, const ShaderCompilerOptions& options, DynamicArrayAuto<U8>& bin) const
-{
-	ANKI_ASSERT(!source.isEmpty() && source.getLength() > 0);
-
-	// Compute hash
-	U64 fhash;
-	if(hash)
-	{
-		fhash = *hash;
-		ANKI_ASSERT(fhash != 0);
-	}
-	else
-	{
-		fhash = computeHash(&source[0], source.getLength());
-	}
-
-	fhash = appendHash(&options, sizeof(options), fhash);
-
-	// Search the cache
-	StringAuto fname(m_alloc);
-	fname.sprintf("%s/%llu.shdrbin", m_cacheDir.cstr(), fhash);
-	if(fileExists(fname.toCString()))
-	{
-		File file;
-		ANKI_CHECK(file.open(fname.toCString(), FileOpenFlag::READ | FileOpenFlag::BINARY));
-
-		PtrSize size = file.getSize();
-		bin.resize(size);
-		ANKI_CHECK(file.read(&bin[0], bin.getSize()));
-	}
-	else
-	{
-		ANKI_CHECK(m_compiler.compile(source, options, bin));
-
-		File file;
-		ANKI_CHECK(file.open(fname.toCString(), FileOpenFlag::WRITE | FileOpenFlag::BINARY));
-
-		ANKI_CHECK(file.write(&bin[0], bin.getSize()));
-	}
-
-	return Error::NONE;
-}
-
 } // end namespace anki
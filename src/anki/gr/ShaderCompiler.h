@@ -7,6 +7,9 @@
 
 #include <anki/gr/Common.h>
 #include <anki/util/DynamicArray.h>
+#include <anki/util/HashMap.h>
+#include <anki/util/Filesystem.h>
+#include <anki/util/Thread.h>
 
 namespace anki
 {
@@ -61,6 +64,9 @@ public:
 anki_internal:
 	static void logShaderErrorCode(CString error, CString source, GenericMemoryPoolAllocator<U8> alloc);
 
+	/// A number that changes when the compiler changes and the binaries it produces might be different.
+	static U32 getVersion();
+
 private:
 	GenericMemoryPoolAllocator<U8> m_alloc;
 	static I32 m_refcount;
@@ -68,22 +74,21 @@ private:
 };
 
 /// Like ShaderCompiler but on steroids. It uses a cache to avoid compiling shaders else it calls
-/// ShaderCompiler::compile
+/// ShaderCompiler::compile.
+///
+/// All the binaries live in a single pack file in the cache directory. The pack is memory mapped the first time the
+/// cache is used and an in-memory index of it is built. New binaries are appended to the pack in batches. When the
+/// cache is destroyed the pack is rewritten if it changed and the least recently used binaries are evicted to keep it
+/// under a size limit. The pack records the compiler version and a pack from a different version is discarded.
+/// @note It's thread-safe.
 class ShaderCompilerCache
 {
 public:
-	ShaderCompilerCache(GenericMemoryPoolAllocator<U8> alloc, CString cacheDir)
-		: m_alloc(alloc)
-		, m_compiler(alloc)
-	{
-		ANKI_ASSERT(!cacheDir.isEmpty());
-		m_cacheDir.create(alloc, cacheDir);
-	}
+	static const PtrSize DEFAULT_MAX_SIZE = 64_MB;
 
-	~ShaderCompilerCache()
-	{
-		m_cacheDir.destroy(m_alloc);
-	}
+	ShaderCompilerCache(GenericMemoryPoolAllocator<U8> alloc, CString cacheDir, PtrSize maxSize = DEFAULT_MAX_SIZE);
+
+	~ShaderCompilerCache();
 
 	/// Compile a shader.
 	/// @param source The source in GLSL.
@@ -93,13 +98,81 @@ public:
 	ANKI_USE_RESULT Error compile(
 		CString source, U64* hash, const ShaderCompilerOptions& options, DynamicArrayAuto<U8>& bin) const;
 
+	/// Append the binaries that are not in the pack yet.
+	ANKI_USE_RESULT Error flush() const;
+
+	/// Number of compile() calls that were served by the cache.
+	U32 getHitCount() const
+	{
+		return m_hitCount.load();
+	}
+
+	/// Number of compile() calls that had to compile.
+	U32 getMissCount() const
+	{
+		return m_missCount.load();
+	}
+
+	/// Number of binaries in the cache.
+	U32 getBinaryCount() const;
+
+	/// Size of the binaries in the cache, including their metadata.
+	PtrSize getSize() const
+	{
+		LockGuard<Mutex> lock(m_mtx);
+		return m_size;
+	}
+
+anki_internal:
+	class PackHeader;
+	class PackRecord;
+
 private:
-	GenericMemoryPoolAllocator<U8> m_alloc;
+	/// An entry of the index.
+	class Entry
+	{
+	public:
+		const PackRecord* m_record = nullptr; ///< Points to the mapped pack or to memory owned by the cache.
+		U64 m_lastUse = 0; ///< The session that last used it.
+		Bool8 m_owned = false; ///< The record was allocated by the cache.
+		Bool8 m_pending = false; ///< The record is not written to the pack yet.
+		Bool8 m_lastUseChanged = false; ///< m_lastUse differs from the one in the mapped record.
+	};
+
+	mutable GenericMemoryPoolAllocator<U8> m_alloc;
 	ShaderCompiler m_compiler;
 	String m_cacheDir;
+	String m_packFilename;
+	PtrSize m_maxSize;
+
+	mutable Mutex m_mtx; ///< Protects everything bellow.
+	mutable MemoryMappedFile m_pack;
+	mutable HashMap<U64, Entry> m_index;
+	mutable PtrSize m_size = 0; ///< Size of all the records.
+	mutable PtrSize m_pendingSize = 0; ///< Size of all pending records.
+	mutable U64 m_session = 0;
+	mutable Bool8 m_loaded = false;
+	mutable Bool8 m_lastUseChanged = false; ///< Some of the entries have m_lastUseChanged.
+	mutable Bool8 m_appendable = false; ///< The pack file exists and it's valid.
+
+	mutable Atomic<U32> m_hitCount = {0};
+	mutable Atomic<U32> m_missCount = {0};
 
 	ANKI_USE_RESULT Error compileInternal(
 		CString source, U64* hash, const ShaderCompilerOptions& options, DynamicArrayAuto<U8>& bin) const;
+
+	/// Map the pack and build the index.
+	ANKI_USE_RESULT Error loadPack() const;
+
+	ANKI_USE_RESULT Error flushInternal() const;
+
+	/// Evict and rewrite the whole pack.
+	ANKI_USE_RESULT Error rewritePack() const;
+
+	/// Overwrite the m_lastUse of the records that are already in the pack.
+	ANKI_USE_RESULT Error writeLastUses() const;
+
+	void destroyEntries() const;
 };
 /// @}
 
@@ -0,0 +1,505 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <anki/gr/ShaderCompiler.h>
+#include <anki/util/File.h>
+#include <algorithm>
+
+namespace anki
+{
+
+/// The pack starts with that.
+class ShaderCompilerCache::PackHeader
+{
+public:
+	static constexpr const char* MAGIC = "ANKISHC1";
+
+	Array<char, 8> m_magic;
+	U32 m_compilerVersion;
+	U32 m_optionsSize; ///< The size of ShaderCompilerOptions. The records are useless if it changed.
+	U64 m_session; ///< The last session that wrote the whole pack.
+};
+
+/// The header is followed by records. A record is that class followed by the binary, padded to the alignment of the
+/// record.
+class ShaderCompilerCache::PackRecord
+{
+public:
+	U64 m_hash;
+	U64 m_lastUse;
+	U32 m_binarySize;
+	U32 m_padding;
+	ShaderCompilerOptions m_options;
+
+	const U8* getBinary() const
+	{
+		return reinterpret_cast<const U8*>(this + 1);
+	}
+
+	U8* getBinary()
+	{
+		return reinterpret_cast<U8*>(this + 1);
+	}
+
+	static PtrSize computeTotalSize(PtrSize binarySize)
+	{
+		return getAlignedRoundUp(alignof(PackRecord), sizeof(PackRecord) + binarySize);
+	}
+};
+
+static_assert(sizeof(ShaderCompilerCache::PackHeader) % alignof(ShaderCompilerCache::PackRecord) == 0,
+	"The first record should be aligned");
+
+/// Append binaries to the pack when that many bytes are pending.
+static const PtrSize FLUSH_THRESHOLD = 1_MB;
+
+ShaderCompilerCache::ShaderCompilerCache(GenericMemoryPoolAllocator<U8> alloc, CString cacheDir, PtrSize maxSize)
+	: m_alloc(alloc)
+	, m_compiler(alloc)
+	, m_maxSize(maxSize)
+{
+	ANKI_ASSERT(!cacheDir.isEmpty());
+	m_cacheDir.create(alloc, cacheDir);
+	m_packFilename.sprintf(alloc, "%s/shader_cache.ankishdrpak", cacheDir.cstr());
+}
+
+ShaderCompilerCache::~ShaderCompilerCache()
+{
+	if(m_loaded)
+	{
+		Error err = Error::NONE;
+		if(!m_appendable || m_size > m_maxSize)
+		{
+			err = rewritePack();
+		}
+		else
+		{
+			err = flushInternal();
+			if(!err && m_lastUseChanged)
+			{
+				err = writeLastUses();
+			}
+		}
+
+		if(err)
+		{
+			ANKI_GR_LOGE("Failed to write the shader cache");
+		}
+	}
+
+	destroyEntries();
+	m_index.destroy(m_alloc);
+	m_pack.unmap();
+	m_packFilename.destroy(m_alloc);
+	m_cacheDir.destroy(m_alloc);
+}
+
+void ShaderCompilerCache::destroyEntries() const
+{
+	for(Entry& entry : m_index)
+	{
+		if(entry.m_owned)
+		{
+			m_alloc.getMemoryPool().free(const_cast<PackRecord*>(entry.m_record));
+			entry.m_owned = false;
+		}
+
+		entry.m_record = nullptr;
+	}
+}
+
+Error ShaderCompilerCache::compile(
+	CString source, U64* hash, const ShaderCompilerOptions& options, DynamicArrayAuto<U8>& bin) const
+{
+	Error err = compileInternal(source, hash, options, bin);
+	if(err)
+	{
+		ANKI_GR_LOGE("Failed to compile or retrieve shader from the cache");
+	}
+
+	return err;
+}
+
+Error ShaderCompilerCache::compileInternal(
+	CString source, U64* hash, const ShaderCompilerOptions& options, DynamicArrayAuto<U8>& bin) const
+{
+	ANKI_ASSERT(!source.isEmpty() && source.getLength() > 0);
+
+	// Compute hash
+	U64 fhash;
+	if(hash)
+	{
+		fhash = *hash;
+		ANKI_ASSERT(fhash != 0);
+	}
+	else
+	{
+		fhash = computeHash(&source[0], source.getLength());
+	}
+
+	fhash = appendHash(&options, sizeof(options), fhash);
+
+	// Search the cache
+	Bool collision = false;
+	{
+		LockGuard<Mutex> lock(m_mtx);
+
+		if(!m_loaded)
+		{
+			ANKI_CHECK(loadPack());
+		}
+
+		auto it = m_index.find(fhash);
+		if(it != m_index.getEnd())
+		{
+			const PackRecord& record = *it->m_record;
+			if(memcmp(&record.m_options, &options, sizeof(options)) == 0)
+			{
+				bin.resize(record.m_binarySize);
+				memcpy(&bin[0], record.getBinary(), record.m_binarySize);
+
+				// Remember the use. The records that are not in the pack yet already have the current session
+				if(it->m_lastUse != m_session)
+				{
+					ANKI_ASSERT(!it->m_pending);
+					it->m_lastUse = m_session;
+					it->m_lastUseChanged = true;
+					m_lastUseChanged = true;
+				}
+
+				m_hitCount.fetchAdd(1);
+				return Error::NONE;
+			}
+			else
+			{
+				ANKI_GR_LOGW("Shader cache hash collision. The shader won't be cached");
+				collision = true;
+			}
+		}
+	}
+
+	// Not found, compile it outside the lock
+	m_missCount.fetchAdd(1);
+	ANKI_CHECK(m_compiler.compile(source, options, bin));
+
+	if(collision)
+	{
+		return Error::NONE;
+	}
+
+	// Create the record
+	const PtrSize recordSize = PackRecord::computeTotalSize(bin.getSize());
+	void* recordMem = m_alloc.getMemoryPool().allocate(recordSize, alignof(PackRecord));
+	PackRecord* record = ::new(recordMem) PackRecord(); // Value-initialized so the padding is zero
+	record->m_hash = fhash;
+	record->m_binarySize = bin.getSize();
+	record->m_options = options;
+	memcpy(record->getBinary(), &bin[0], bin.getSize());
+
+	// Only the alignment bytes after the binary are left, zero them because they are written to the pack
+	const PtrSize tailSize = recordSize - sizeof(PackRecord) - bin.getSize();
+	if(tailSize)
+	{
+		memset(record->getBinary() + bin.getSize(), 0, tailSize);
+	}
+
+	// Add it to the index
+	LockGuard<Mutex> lock(m_mtx);
+
+	if(m_index.find(fhash) != m_index.getEnd())
+	{
+		// Another thread compiled the same shader in the meantime
+		m_alloc.getMemoryPool().free(record);
+		return Error::NONE;
+	}
+
+	record->m_lastUse = m_session;
+
+	Entry entry;
+	entry.m_record = record;
+	entry.m_lastUse = m_session;
+	entry.m_owned = true;
+	entry.m_pending = true;
+	m_index.emplace(m_alloc, fhash, entry);
+
+	m_size += recordSize;
+	m_pendingSize += recordSize;
+
+	if(m_pendingSize >= FLUSH_THRESHOLD)
+	{
+		ANKI_CHECK(flushInternal());
+	}
+
+	return Error::NONE;
+}
+
+Error ShaderCompilerCache::flush() const
+{
+	LockGuard<Mutex> lock(m_mtx);
+	if(m_loaded)
+	{
+		ANKI_CHECK(flushInternal());
+	}
+
+	return Error::NONE;
+}
+
+U32 ShaderCompilerCache::getBinaryCount() const
+{
+	LockGuard<Mutex> lock(m_mtx);
+
+	U32 count = 0;
+	for(const Entry& entry : m_index)
+	{
+		(void)entry;
+		++count;
+	}
+
+	return count;
+}
+
+Error ShaderCompilerCache::loadPack() const
+{
+	ANKI_ASSERT(!m_loaded);
+	m_loaded = true;
+	m_session = 1;
+
+	if(!fileExists(m_packFilename.toCString()))
+	{
+		return Error::NONE;
+	}
+
+	ANKI_CHECK(m_pack.map(m_packFilename.toCString()));
+	const U8* data = m_pack.getData();
+	const PtrSize size = m_pack.getSize();
+
+	// Check the header
+	const PackHeader* header = reinterpret_cast<const PackHeader*>(data);
+	if(size < sizeof(PackHeader) || memcmp(&header->m_magic[0], PackHeader::MAGIC, sizeof(header->m_magic)) != 0
+		|| header->m_compilerVersion != ShaderCompiler::getVersion()
+		|| header->m_optionsSize != sizeof(ShaderCompilerOptions))
+	{
+		ANKI_GR_LOGI("Discarding the shader cache because it's corrupted or from a different compiler version");
+		m_pack.unmap();
+		return Error::NONE;
+	}
+
+	// Build the index
+	U64 lastSession = header->m_session;
+	PtrSize offset = sizeof(PackHeader);
+	while(offset < size)
+	{
+		const PackRecord* record = reinterpret_cast<const PackRecord*>(data + offset);
+		if(size - offset < sizeof(PackRecord) || size - offset < PackRecord::computeTotalSize(record->m_binarySize))
+		{
+			ANKI_GR_LOGW("The shader cache is truncated. Ignoring the rest of it");
+			break;
+		}
+
+		const PtrSize recordSize = PackRecord::computeTotalSize(record->m_binarySize);
+		if(m_index.find(record->m_hash) == m_index.getEnd())
+		{
+			Entry entry;
+			entry.m_record = record;
+			entry.m_lastUse = record->m_lastUse;
+			m_index.emplace(m_alloc, record->m_hash, entry);
+
+			m_size += recordSize;
+			lastSession = max(lastSession, record->m_lastUse);
+		}
+
+		offset += recordSize;
+	}
+
+	// Appending is safe only if the whole pack is valid
+	m_appendable = offset == size;
+
+	// The appended records are not reflected in the header's session so check them as well
+	m_session = lastSession + 1;
+
+	return Error::NONE;
+}
+
+Error ShaderCompilerCache::flushInternal() const
+{
+	ANKI_ASSERT(m_loaded);
+
+	if(m_pendingSize == 0)
+	{
+		return Error::NONE;
+	}
+
+	if(!m_appendable)
+	{
+		return rewritePack();
+	}
+
+	File file;
+	ANKI_CHECK(file.open(m_packFilename.toCString(), FileOpenFlag::APPEND | FileOpenFlag::BINARY));
+
+	for(Entry& entry : m_index)
+	{
+		if(entry.m_pending)
+		{
+			ANKI_CHECK(file.write(entry.m_record, PackRecord::computeTotalSize(entry.m_record->m_binarySize)));
+			entry.m_pending = false;
+		}
+	}
+
+	m_pendingSize = 0;
+	return Error::NONE;
+}
+
+Error ShaderCompilerCache::rewritePack() const
+{
+	ANKI_ASSERT(m_loaded);
+
+	// Evict the least recently used. Leave some room so it doesn't happen every time a new shader is added
+	if(m_size > m_maxSize)
+	{
+		// Sort by hash and not by Entry pointers because erasing from the index moves the entries around
+		class LruItem
+		{
+		public:
+			U64 m_lastUse;
+			U64 m_hash;
+		};
+
+		DynamicArrayAuto<LruItem> items(m_alloc);
+		for(const Entry& entry : m_index)
+		{
+			items.emplaceBack(LruItem{entry.m_lastUse, entry.m_record->m_hash});
+		}
+
+		std::sort(items.getBegin(), items.getEnd(), [](const LruItem& a, const LruItem& b) {
+			return a.m_lastUse < b.m_lastUse;
+		});
+
+		const PtrSize targetSize = m_maxSize / 4 * 3;
+		U32 evictedCount = 0;
+		for(U32 i = 0; i < items.getSize() && m_size > targetSize; ++i)
+		{
+			auto it = m_index.find(items[i].m_hash);
+			ANKI_ASSERT(it != m_index.getEnd());
+			m_size -= PackRecord::computeTotalSize(it->m_record->m_binarySize);
+
+			if(it->m_pending)
+			{
+				m_pendingSize -= PackRecord::computeTotalSize(it->m_record->m_binarySize);
+			}
+
+			if(it->m_owned)
+			{
+				m_alloc.getMemoryPool().free(const_cast<PackRecord*>(it->m_record));
+			}
+
+			m_index.erase(m_alloc, it);
+			++evictedCount;
+		}
+
+		ANKI_GR_LOGI("Evicted %u binaries from the shader cache", evictedCount);
+	}
+
+	// Write everything to a new file
+	StringAuto tmpFilename(m_alloc);
+	tmpFilename.sprintf("%s.tmp", m_packFilename.cstr());
+
+	DynamicArrayAuto<PtrSize> offsets(m_alloc);
+	{
+		File file;
+		ANKI_CHECK(file.open(tmpFilename.toCString(), FileOpenFlag::WRITE | FileOpenFlag::BINARY));
+
+		PackHeader header;
+		memcpy(&header.m_magic[0], PackHeader::MAGIC, sizeof(header.m_magic));
+		header.m_compilerVersion = ShaderCompiler::getVersion();
+		header.m_optionsSize = sizeof(ShaderCompilerOptions);
+		header.m_session = m_session;
+		ANKI_CHECK(file.write(&header, sizeof(header)));
+
+		PtrSize offset = sizeof(header);
+		for(const Entry& entry : m_index)
+		{
+			PackRecord record = *entry.m_record;
+			record.m_lastUse = entry.m_lastUse;
+			ANKI_CHECK(file.write(&record, sizeof(record)));
+
+			const PtrSize recordSize = PackRecord::computeTotalSize(record.m_binarySize);
+			ANKI_CHECK(file.write(entry.m_record->getBinary(), recordSize - sizeof(record)));
+
+			offsets.emplaceBack(offset);
+			offset += recordSize;
+		}
+	}
+
+	// Replace the old pack. Unmap it first because some systems can't replace mapped files
+	m_pack.unmap();
+	std::remove(m_packFilename.cstr());
+	Error err = Error::NONE;
+	if(std::rename(tmpFilename.cstr(), m_packFilename.cstr()))
+	{
+		ANKI_GR_LOGE("Failed to rename %s", tmpFilename.cstr());
+		err = Error::FILE_ACCESS;
+	}
+	else
+	{
+		err = m_pack.map(m_packFilename.toCString());
+	}
+
+	if(err)
+	{
+		// The records that were in the old pack are gone, start over
+		destroyEntries();
+		m_index.destroy(m_alloc);
+		m_size = 0;
+		m_pendingSize = 0;
+		m_appendable = false;
+		return err;
+	}
+
+	// Point the index to the new pack
+	U32 count = 0;
+	for(Entry& entry : m_index)
+	{
+		if(entry.m_owned)
+		{
+			m_alloc.getMemoryPool().free(const_cast<PackRecord*>(entry.m_record));
+		}
+
+		entry.m_record = reinterpret_cast<const PackRecord*>(m_pack.getData() + offsets[count++]);
+		entry.m_owned = false;
+		entry.m_pending = false;
+		entry.m_lastUseChanged = false;
+	}
+
+	m_pendingSize = 0;
+	m_appendable = true;
+	m_lastUseChanged = false;
+	return Error::NONE;
+}
+
+Error ShaderCompilerCache::writeLastUses() const
+{
+	ANKI_ASSERT(m_loaded && m_appendable && m_pack.isMapped());
+
+	File file;
+	ANKI_CHECK(file.open(m_packFilename.toCString(), FileOpenFlag::READ | FileOpenFlag::WRITE | FileOpenFlag::BINARY));
+
+	for(Entry& entry : m_index)
+	{
+		if(entry.m_lastUseChanged)
+		{
+			ANKI_ASSERT(!entry.m_owned);
+			const PtrSize offset = reinterpret_cast<const U8*>(&entry.m_record->m_lastUse) - m_pack.getData();
+			ANKI_CHECK(file.seek(offset, File::SeekOrigin::BEGINNING));
+			ANKI_CHECK(file.write(&entry.m_lastUse, sizeof(entry.m_lastUse)));
+			entry.m_lastUseChanged = false;
+		}
+	}
+
+	m_lastUseChanged = false;
+	return Error::NONE;
+}
+
+} // end namespace anki
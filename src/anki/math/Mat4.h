@@ -116,6 +116,27 @@ public:
 		m(3, 3) = 1.0;
 	}
 
+	explicit TMat4(const TMat3x4<T>& m3)
+	{
+		TMat4& m = *this;
+		m(0, 0) = m3(0, 0);
+		m(0, 1) = m3(0, 1);
+		m(0, 2) = m3(0, 2);
+		m(0, 3) = m3(0, 3);
+		m(1, 0) = m3(1, 0);
+		m(1, 1) = m3(1, 1);
+		m(1, 2) = m3(1, 2);
+		m(1, 3) = m3(1, 3);
+		m(2, 0) = m3(2, 0);
+		m(2, 1) = m3(2, 1);
+		m(2, 2) = m3(2, 2);
+		m(2, 3) = m3(2, 3);
+		m(3, 0) = 0.0;
+		m(3, 1) = 0.0;
+		m(3, 2) = 0.0;
+		m(3, 3) = 1.0;
+	}
+
 	explicit TMat4(const TVec3<T>& v)
 	{
 		TMat4& m = *this;
@@ -39,6 +39,29 @@ static Bool insideClusterFrustum(const Array<Plane, 4>& planeArr, const TShape&
 	return true;
 }
 
+/// Get the number of objects of every type in the order of the cluster indices.
+static Array<U32, TYPED_OBJECT_COUNT> getTypedObjectCounts(const RenderQueue& rqueue)
+{
+	const Array<U32, TYPED_OBJECT_COUNT> counts = {{U32(rqueue.m_pointLights.getSize()),
+		U32(rqueue.m_spotLights.getSize()),
+		U32(rqueue.m_reflectionProbes.getSize()),
+		U32(rqueue.m_decals.getSize()),
+		U32(rqueue.m_fogDensityVolumes.getSize())}};
+	return counts;
+}
+
+/// The tiles and the cluster slices an object might touch.
+class ClusterBin::ObjectBounds
+{
+public:
+	U32 m_index; ///< The index in the RenderQueue array of its type.
+	U16 m_typeIdx;
+	U16 m_firstClusterZ;
+	U16 m_lastClusterZ;
+	Bool8 m_visible;
+	Array<U16, 4> m_tileRect; ///< Min X, min Y, max X and max Y. Inclusive.
+};
+
 /// Bin context.
 class ClusterBin::BinCtx
 {
@@ -55,12 +78,19 @@ public:
 	WeakArray<U32> m_lightIds;
 	WeakArray<U32> m_clusters;
 
-	Atomic<U32> m_tileIdxToProcess = {0};
+	Array<TileCtx*, ThreadHive::MAX_THREADS> m_tileCtxs = {}; ///< Per thread scratch data.
 	Atomic<U32> m_allocatedIndexCount = {TYPED_OBJECT_COUNT};
 
 	Vec4 m_unprojParams;
 
 	Bool m_clusterEdgesDirty;
+
+	/// @name Z binning
+	/// @{
+	WeakArray<ObjectBounds> m_objects; ///< The objects of all types in the order they are binned.
+	WeakArray<U32> m_tileObjectOffsets; ///< Where the objects of a tile start in m_tileObjects. One more than the tiles.
+	WeakArray<U32> m_tileObjects; ///< Indices to m_objects.
+	/// @}
 };
 
 class ClusterBin::TileCtx
@@ -115,6 +145,7 @@ void ClusterBin::init(
 	m_totalClusterCount = clusterCountX * clusterCountY * clusterCountZ;
 
 	m_avgObjectsPerCluster = cfg.getNumber("r.avgObjectsPerCluster");
+	m_zBinning = cfg.getNumber("r.clusterBinZBinning") != 0.0;
 
 	// The actual indices per cluster are
 	// - the object indices per cluster
@@ -162,9 +193,15 @@ void ClusterBin::bin(ClusterBinIn& in, ClusterBinOut& out)
 		sizeof(U32) * m_totalClusterCount, StagingGpuMemoryType::STORAGE, ctx.m_out->m_clustersToken));
 	ctx.m_clusters = WeakArray<U32>(clusters, m_totalClusterCount);
 
+	// Find the tiles and the cluster slices of the objects
+	ThreadHive& hive = *in.m_threadHive;
+	if(m_zBinning)
+	{
+		binObjectsToTiles(ctx);
+	}
+
 	// Create task for writing GPU buffers
-	Array<ThreadHiveTask, ThreadHive::MAX_THREADS + 1> tasks;
-	tasks[0] = ANKI_THREAD_HIVE_TASK(
+	ThreadHiveTask task = ANKI_THREAD_HIVE_TASK(
 		{
 			ANKI_TRACE_SCOPED_EVENT(R_WRITE_LIGHT_BUFFERS);
 			self->m_bin->writeTypedObjectsToGpuBuffers(*self);
@@ -172,41 +209,43 @@ void ClusterBin::bin(ClusterBinIn& in, ClusterBinOut& out)
 		&ctx,
 		nullptr,
 		nullptr);
+	hive.submitTasks(&task, 1);
 
-	// Create tasks for binning
-	tasks[1] = ANKI_THREAD_HIVE_TASK(
-		{
-			ANKI_TRACE_SCOPED_EVENT(R_BIN_TO_CLUSTERS);
-			BinCtx& ctx = *self;
+	// Bin the tiles. A row of tiles at a time
+	hive.parallelFor(0, m_clusterCounts[1], 0, [&ctx](U32 tileRow, U32 threadId) {
+		ANKI_TRACE_SCOPED_EVENT(R_BIN_TO_CLUSTERS);
 
-			TileCtx tileCtx(ctx.m_in->m_tempAlloc);
+		TileCtx*& tileCtx = ctx.m_tileCtxs[threadId];
+		if(tileCtx == nullptr)
+		{
+			// First tile of this thread, create the scratch data
+			tileCtx = ctx.m_in->m_tempAlloc.newInstance<TileCtx>(ctx.m_in->m_tempAlloc);
 			const U32 clusterCountZ = ctx.m_bin->m_clusterCounts[2];
-			tileCtx.m_clusterEdgesWSpace.create((clusterCountZ + 1) * 4);
-			tileCtx.m_clusterBoxes.create(clusterCountZ);
-			tileCtx.m_clusterSpheres.create(clusterCountZ);
-			tileCtx.m_indices.create(clusterCountZ * ctx.m_bin->m_avgObjectsPerCluster);
-			tileCtx.m_clusterInfos.create(clusterCountZ);
-			tileCtx.m_clusterCountZ = clusterCountZ;
-
-			const U tileCount = ctx.m_bin->m_clusterCounts[0] * ctx.m_bin->m_clusterCounts[1];
-			U tileIdx;
-			while((tileIdx = ctx.m_tileIdxToProcess.fetchAdd(1)) < tileCount)
-			{
-				ctx.m_bin->binTile(tileIdx, ctx, tileCtx);
-			}
-		},
-		&ctx,
-		nullptr,
-		nullptr);
+			tileCtx->m_clusterEdgesWSpace.create((clusterCountZ + 1) * 4);
+			tileCtx->m_clusterBoxes.create(clusterCountZ);
+			tileCtx->m_clusterSpheres.create(clusterCountZ);
+			tileCtx->m_indices.create(clusterCountZ * ctx.m_bin->m_avgObjectsPerCluster);
+			tileCtx->m_clusterInfos.create(clusterCountZ);
+			tileCtx->m_clusterCountZ = clusterCountZ;
+		}
 
-	for(U threadIdx = 1; threadIdx < in.m_threadHive->getThreadCount(); ++threadIdx)
+		const U32 tileCountX = ctx.m_bin->m_clusterCounts[0];
+		for(U32 tileIdx = tileRow * tileCountX; tileIdx < (tileRow + 1) * tileCountX; ++tileIdx)
+		{
+			ctx.m_bin->binTile(tileIdx, ctx, *tileCtx);
+		}
+	});
+
+	// Wait
+	hive.waitAllTasks();
+
+	for(TileCtx* tileCtx : ctx.m_tileCtxs)
 	{
-		tasks[threadIdx + 1] = tasks[1];
+		if(tileCtx)
+		{
+			ctx.m_in->m_tempAlloc.deleteInstance(tileCtx);
+		}
 	}
-
-	// Submit and wait
-	in.m_threadHive->submitTasks(&tasks[0], in.m_threadHive->getThreadCount() + 1);
-	in.m_threadHive->waitAllTasks();
 }
 
 void ClusterBin::prepare(BinCtx& ctx)
@@ -256,6 +295,217 @@ void ClusterBin::prepare(BinCtx& ctx)
 	ctx.m_unprojParams = ctx.m_in->m_renderQueue->m_projectionMatrix.extractPerspectiveUnprojectionParams();
 }
 
+void ClusterBin::binObjectsToTiles(BinCtx& ctx)
+{
+	ANKI_TRACE_SCOPED_EVENT(R_BIN_TO_TILES);
+
+	const RenderQueue& rqueue = *ctx.m_in->m_renderQueue;
+	StackAllocator<U8>& alloc = ctx.m_in->m_tempAlloc;
+	ThreadHive& hive = *ctx.m_in->m_threadHive;
+	const U32 tileCount = m_clusterCounts[0] * m_clusterCounts[1];
+
+	// Gather the objects of all types
+	const Array<U32, TYPED_OBJECT_COUNT> counts = getTypedObjectCounts(rqueue);
+
+	U32 objectCount = 0;
+	for(U32 count : counts)
+	{
+		objectCount += count;
+	}
+
+	ctx.m_objects = WeakArray<ObjectBounds>(
+		(objectCount) ? alloc.newArray<ObjectBounds>(objectCount) : nullptr, objectCount);
+
+	U32 objIdx = 0;
+	for(U typeIdx = 0; typeIdx < TYPED_OBJECT_COUNT; ++typeIdx)
+	{
+		for(U32 i = 0; i < counts[typeIdx]; ++i)
+		{
+			ctx.m_objects[objIdx].m_typeIdx = typeIdx;
+			ctx.m_objects[objIdx].m_index = i;
+			++objIdx;
+		}
+	}
+
+	// Compute the bounds of the objects
+	if(objectCount)
+	{
+		hive.parallelFor(0, objectCount, 0, [&](U32 objIdx, U32 threadId) {
+			computeObjectBounds(ctx, ctx.m_objects[objIdx]);
+		});
+		hive.waitAllTasks();
+	}
+
+	// Count the objects per tile and then write them. The objects of a tile stay in the same order
+	ctx.m_tileObjectOffsets = WeakArray<U32>(alloc.newArray<U32>(tileCount + 1, 0u), tileCount + 1);
+	for(const ObjectBounds& obj : ctx.m_objects)
+	{
+		if(!obj.m_visible)
+		{
+			continue;
+		}
+
+		for(U y = obj.m_tileRect[1]; y <= obj.m_tileRect[3]; ++y)
+		{
+			for(U x = obj.m_tileRect[0]; x <= obj.m_tileRect[2]; ++x)
+			{
+				++ctx.m_tileObjectOffsets[y * m_clusterCounts[0] + x + 1];
+			}
+		}
+	}
+
+	for(U32 tileIdx = 0; tileIdx < tileCount; ++tileIdx)
+	{
+		ctx.m_tileObjectOffsets[tileIdx + 1] += ctx.m_tileObjectOffsets[tileIdx];
+	}
+
+	const U32 tileObjectCount = ctx.m_tileObjectOffsets[tileCount];
+	ctx.m_tileObjects =
+		WeakArray<U32>((tileObjectCount) ? alloc.newArray<U32>(tileObjectCount) : nullptr, tileObjectCount);
+
+	DynamicArrayAuto<U32> tileObjectCounts(alloc);
+	tileObjectCounts.create(tileCount, 0);
+	for(U32 objIdx = 0; objIdx < objectCount; ++objIdx)
+	{
+		const ObjectBounds& obj = ctx.m_objects[objIdx];
+		if(!obj.m_visible)
+		{
+			continue;
+		}
+
+		for(U y = obj.m_tileRect[1]; y <= obj.m_tileRect[3]; ++y)
+		{
+			for(U x = obj.m_tileRect[0]; x <= obj.m_tileRect[2]; ++x)
+			{
+				const U tileIdx = y * m_clusterCounts[0] + x;
+				ctx.m_tileObjects[ctx.m_tileObjectOffsets[tileIdx] + tileObjectCounts[tileIdx]++] = objIdx;
+			}
+		}
+	}
+}
+
+void ClusterBin::computeObjectBounds(const BinCtx& ctx, ObjectBounds& obj) const
+{
+	const RenderQueue& rqueue = *ctx.m_in->m_renderQueue;
+	obj.m_visible = false;
+
+	// Compute a world space AABB
+	Aabb aabb;
+	switch(obj.m_typeIdx)
+	{
+	case 0:
+	{
+		const PointLightQueueElement& plight = rqueue.m_pointLights[obj.m_index];
+		aabb.setMin((plight.m_worldPosition - plight.m_radius).xyz0());
+		aabb.setMax((plight.m_worldPosition + plight.m_radius).xyz0());
+		break;
+	}
+	case 1:
+	{
+		const SpotLightQueueElement& slight = rqueue.m_spotLights[obj.m_index];
+		PerspectiveFrustum frustum;
+		frustum.setAll(slight.m_outerAngle, slight.m_outerAngle, 0.01f, slight.m_distance);
+		frustum.resetTransform(Transform(slight.m_worldTransform));
+		frustum.computeAabb(aabb);
+		break;
+	}
+	case 2:
+	{
+		const ReflectionProbeQueueElement& probe = rqueue.m_reflectionProbes[obj.m_index];
+		aabb.setMin(probe.m_aabbMin);
+		aabb.setMax(probe.m_aabbMax);
+		break;
+	}
+	case 3:
+	{
+		const DecalQueueElement& decal = rqueue.m_decals[obj.m_index];
+		Obb obb;
+		obb.setCenter(decal.m_obbCenter.xyz0());
+		obb.setRotation(Mat3x4(decal.m_obbRotation));
+		obb.setExtend(decal.m_obbExtend.xyz0());
+		obb.computeAabb(aabb);
+		break;
+	}
+	default:
+	{
+		ANKI_ASSERT(obj.m_typeIdx == 4);
+		const FogDensityQueueElement& fogVol = rqueue.m_fogDensityVolumes[obj.m_index];
+		if(fogVol.m_isBox)
+		{
+			aabb.setMin(fogVol.m_aabbMin);
+			aabb.setMax(fogVol.m_aabbMax);
+		}
+		else
+		{
+			aabb.setMin((fogVol.m_sphereCenter - fogVol.m_sphereRadius).xyz0());
+			aabb.setMax((fogVol.m_sphereCenter + fogVol.m_sphereRadius).xyz0());
+		}
+	}
+	}
+
+	// Move the corners to view space and find the depth range. The camera looks at -Z
+	Array<Vec4, 8> corners;
+	F32 minDepth = MAX_F32;
+	F32 maxDepth = MIN_F32;
+	for(U i = 0; i < 8; ++i)
+	{
+		const Vec4 corner((i & 1) ? aabb.getMax().x() : aabb.getMin().x(),
+			(i & 2) ? aabb.getMax().y() : aabb.getMin().y(),
+			(i & 4) ? aabb.getMax().z() : aabb.getMin().z(),
+			1.0f);
+		corners[i] = rqueue.m_viewMatrix * corner;
+		minDepth = min(minDepth, -corners[i].z());
+		maxDepth = max(maxDepth, -corners[i].z());
+	}
+
+	if(maxDepth < 0.0f)
+	{
+		// Behind the camera
+		return;
+	}
+
+	// Find the cluster slices using the inverse of computeClusterNear()
+	const ClustererMagicValues& magic = ctx.m_out->m_shaderMagicValues;
+	auto computeK = [&](F32 depth) -> U {
+		const F32 k = sqrt(max(depth - magic.m_val1.y(), 0.0f) / magic.m_val1.x());
+		return min<U>(U(k), m_clusterCounts[2] - 1);
+	};
+
+	obj.m_firstClusterZ = computeK(minDepth);
+	obj.m_lastClusterZ = computeK(maxDepth);
+
+	// Find the screen rectangle. If the box crosses the eye plane the projection is not reliable, use all tiles
+	Vec2 ndcMin(-1.0f);
+	Vec2 ndcMax(1.0f);
+	if(minDepth > EPSILON)
+	{
+		ndcMin = Vec2(MAX_F32);
+		ndcMax = Vec2(MIN_F32);
+		for(const Vec4& corner : corners)
+		{
+			const Vec4 clip = rqueue.m_projectionMatrix * corner;
+			const Vec2 ndc = clip.xy() / clip.w();
+			ndcMin = ndcMin.min(ndc);
+			ndcMax = ndcMax.max(ndc);
+		}
+
+		if(ndcMax.x() < -1.0f || ndcMax.y() < -1.0f || ndcMin.x() > 1.0f || ndcMin.y() > 1.0f)
+		{
+			// Outside the screen
+			return;
+		}
+	}
+
+	for(U i = 0; i < 2; ++i)
+	{
+		const F32 tileCount = F32(m_clusterCounts[i]);
+		obj.m_tileRect[i] = U16(clamp((ndcMin[i] * 0.5f + 0.5f) * tileCount, 0.0f, tileCount - 1.0f));
+		obj.m_tileRect[i + 2] = U16(clamp((ndcMax[i] * 0.5f + 0.5f) * tileCount, 0.0f, tileCount - 1.0f));
+	}
+
+	obj.m_visible = true;
+}
+
 void ClusterBin::binTile(U32 tileIdx, BinCtx& ctx, TileCtx& tileCtx)
 {
 	ANKI_ASSERT(tileIdx < m_clusterCounts[0] * m_clusterCounts[1]);
@@ -345,48 +595,79 @@ void ClusterBin::binTile(U32 tileIdx, BinCtx& ctx, TileCtx& tileCtx)
 	++inf.m_counts[typeIdx]; \
 	ANKI_ASSERT(inf.m_counts[typeIdx] <= m_avgObjectsPerCluster)
 
-	// Point lights
-	{
-		Sphere lightSphere;
-		for(U i = 0; i < ctx.m_in->m_renderQueue->m_pointLights.getSize(); ++i)
-		{
-			const PointLightQueueElement& plight = ctx.m_in->m_renderQueue->m_pointLights[i];
-			lightSphere.setCenter(plight.m_worldPosition.xyz0());
-			lightSphere.setRadius(plight.m_radius);
+	// Shapes for all object types. Create them once
+	Sphere sphere;
+	Aabb box;
+	Obb obb;
+	PerspectiveFrustum slightFrustum;
+	const RenderQueue& rqueue = *ctx.m_in->m_renderQueue;
 
-			if(!insideClusterFrustum(frustumPlanes, lightSphere))
+	auto binObject = [&](U typeIdx, U i, U firstClusterZ, U endClusterZ) {
+		const CollisionShape* shape = nullptr;
+		switch(typeIdx)
+		{
+		case 0:
+		{
+			const PointLightQueueElement& plight = rqueue.m_pointLights[i];
+			sphere.setCenter(plight.m_worldPosition.xyz0());
+			sphere.setRadius(plight.m_radius);
+			shape = &sphere;
+			break;
+		}
+		case 1:
+		{
+			const SpotLightQueueElement& slight = rqueue.m_spotLights[i];
+			slightFrustum.setAll(slight.m_outerAngle, slight.m_outerAngle, 0.01f, slight.m_distance);
+			slightFrustum.resetTransform(Transform(slight.m_worldTransform));
+			shape = &slightFrustum;
+			break;
+		}
+		case 2:
+		{
+			const ReflectionProbeQueueElement& probe = rqueue.m_reflectionProbes[i];
+			box.setMin(probe.m_aabbMin);
+			box.setMax(probe.m_aabbMax);
+			shape = &box;
+			break;
+		}
+		case 3:
+		{
+			const DecalQueueElement& decal = rqueue.m_decals[i];
+			obb.setCenter(decal.m_obbCenter.xyz0());
+			obb.setRotation(Mat3x4(decal.m_obbRotation));
+			obb.setExtend(decal.m_obbExtend.xyz0());
+			shape = &obb;
+			break;
+		}
+		default:
+		{
+			ANKI_ASSERT(typeIdx == 4);
+			const FogDensityQueueElement& fogVol = rqueue.m_fogDensityVolumes[i];
+			if(fogVol.m_isBox)
 			{
-				continue;
+				box.setMin(fogVol.m_aabbMin);
+				box.setMax(fogVol.m_aabbMax);
+				shape = &box;
 			}
-
-			for(U clusterZ = 0; clusterZ < m_clusterCounts[2]; ++clusterZ)
+			else
 			{
-				if(!testCollisionShapes(lightSphere, clusterBoxes[clusterZ]))
-				{
-					continue;
-				}
-
-				ANKI_SET_IDX(0);
+				sphere.setCenter(fogVol.m_sphereCenter.xyz0());
+				sphere.setRadius(fogVol.m_sphereRadius);
+				shape = &sphere;
 			}
 		}
-	}
+		}
 
-	// Spot lights
-	{
-		PerspectiveFrustum slightFrustum;
-		for(U i = 0; i < ctx.m_in->m_renderQueue->m_spotLights.getSize(); ++i)
+		if(!insideClusterFrustum(frustumPlanes, *shape))
 		{
-			const SpotLightQueueElement& slight = ctx.m_in->m_renderQueue->m_spotLights[i];
-			slightFrustum.setAll(slight.m_outerAngle, slight.m_outerAngle, 0.01f, slight.m_distance);
-			slightFrustum.resetTransform(Transform(slight.m_worldTransform));
-
-			if(!insideClusterFrustum(frustumPlanes, slightFrustum))
-			{
-				continue;
-			}
+			return;
+		}
 
-			for(U clusterZ = 0; clusterZ < m_clusterCounts[2]; ++clusterZ)
+		for(U clusterZ = firstClusterZ; clusterZ < endClusterZ; ++clusterZ)
+		{
+			if(typeIdx == 1)
 			{
+				const SpotLightQueueElement& slight = rqueue.m_spotLights[i];
 				if(!clusterSpheres[clusterZ].intersectsCone(slight.m_worldTransform.getTranslationPart().xyz0(),
 					   -slight.m_worldTransform.getZAxis(),
 					   slight.m_distance,
@@ -394,101 +675,37 @@ void ClusterBin::binTile(U32 tileIdx, BinCtx& ctx, TileCtx& tileCtx)
 				{
 					continue;
 				}
-
-				ANKI_SET_IDX(1);
 			}
-		}
-	}
-
-	// Probes
-	{
-		Aabb probeBox;
-		for(U i = 0; i < ctx.m_in->m_renderQueue->m_reflectionProbes.getSize(); ++i)
-		{
-			const ReflectionProbeQueueElement& probe = ctx.m_in->m_renderQueue->m_reflectionProbes[i];
-			probeBox.setMin(probe.m_aabbMin);
-			probeBox.setMax(probe.m_aabbMax);
-
-			if(!insideClusterFrustum(frustumPlanes, probeBox))
+			else if(!testCollisionShapes(*shape, clusterBoxes[clusterZ]))
 			{
 				continue;
 			}
 
-			for(U clusterZ = 0; clusterZ < m_clusterCounts[2]; ++clusterZ)
-			{
-				if(!testCollisionShapes(probeBox, clusterBoxes[clusterZ]))
-				{
-					continue;
-				}
-
-				ANKI_SET_IDX(2);
-			}
+			ANKI_SET_IDX(typeIdx);
 		}
-	}
+	};
 
-	// Decals
+	if(!m_zBinning)
 	{
-		Obb decalBox;
-		for(U i = 0; i < ctx.m_in->m_renderQueue->m_decals.getSize(); ++i)
-		{
-			const DecalQueueElement& decal = ctx.m_in->m_renderQueue->m_decals[i];
-			decalBox.setCenter(decal.m_obbCenter.xyz0());
-			decalBox.setRotation(Mat3x4(decal.m_obbRotation));
-			decalBox.setExtend(decal.m_obbExtend.xyz0());
-
-			if(!insideClusterFrustum(frustumPlanes, decalBox))
-			{
-				continue;
-			}
+		// Test all objects against all clusters of the tile
+		const Array<U32, TYPED_OBJECT_COUNT> counts = getTypedObjectCounts(rqueue);
 
-			for(U clusterZ = 0; clusterZ < m_clusterCounts[2]; ++clusterZ)
+		for(U typeIdx = 0; typeIdx < TYPED_OBJECT_COUNT; ++typeIdx)
+		{
+			for(U i = 0; i < counts[typeIdx]; ++i)
 			{
-				if(!testCollisionShapes(decalBox, clusterBoxes[clusterZ]))
-				{
-					continue;
-				}
-
-				ANKI_SET_IDX(3);
+				binObject(typeIdx, i, 0, m_clusterCounts[2]);
 			}
 		}
 	}
-
-	// Fog volumes
+	else
 	{
-		Aabb box;
-		Sphere sphere;
-		for(U i = 0; i < ctx.m_in->m_renderQueue->m_fogDensityVolumes.getSize(); ++i)
+		// Test only the objects that touch the tile and only against the clusters of their Z range. They are in the
+		// same order as above
+		for(U32 j = ctx.m_tileObjectOffsets[tileIdx]; j < ctx.m_tileObjectOffsets[tileIdx + 1]; ++j)
 		{
-			const FogDensityQueueElement& fogVol = ctx.m_in->m_renderQueue->m_fogDensityVolumes[i];
-
-			CollisionShape* shape;
-			if(fogVol.m_isBox)
-			{
-				box.setMin(fogVol.m_aabbMin);
-				box.setMax(fogVol.m_aabbMax);
-				shape = &box;
-			}
-			else
-			{
-				sphere.setCenter(fogVol.m_sphereCenter.xyz0());
-				sphere.setRadius(fogVol.m_sphereRadius);
-				shape = &sphere;
-			}
-
-			if(!insideClusterFrustum(frustumPlanes, *shape))
-			{
-				continue;
-			}
-
-			for(U clusterZ = 0; clusterZ < m_clusterCounts[2]; ++clusterZ)
-			{
-				if(!testCollisionShapes(*shape, clusterBoxes[clusterZ]))
-				{
-					continue;
-				}
-
-				ANKI_SET_IDX(4);
-			}
+			const ObjectBounds& obj = ctx.m_objects[ctx.m_tileObjects[j]];
+			binObject(obj.m_typeIdx, obj.m_index, obj.m_firstClusterZ, obj.m_lastClusterZ + 1);
 		}
 	}
 
@@ -661,7 +878,6 @@ void ClusterBin::writeTypedObjectsToGpuBuffers(BinCtx& ctx) const
 			out.m_texProjectionMat = in.m_textureMatrix;
 		}
 
-		ANKI_ASSERT(diffuseAtlas && specularRoughnessAtlas);
 		ctx.m_out->m_diffDecalTexView.reset(diffuseAtlas);
 		ctx.m_out->m_specularRoughnessDecalTexView.reset(specularRoughnessAtlas);
 	}
@@ -63,6 +63,7 @@ public:
 private:
 	class BinCtx;
 	class TileCtx;
+	class ObjectBounds;
 
 	HeapAllocator<U8> m_alloc;
 
@@ -70,12 +71,18 @@ private:
 	U32 m_totalClusterCount = 0;
 	U32 m_indexCount = 0;
 	U32 m_avgObjectsPerCluster = 0;
+	Bool8 m_zBinning = false; ///< Bin the objects to tiles and cluster slices before testing them against clusters.
 
 	DynamicArray<Vec4> m_clusterEdges; ///< Cache those for opt. [tileCount][K+1][4]
 	Vec4 m_prevUnprojParams = Vec4(0.0f); ///< To check if m_tiles is dirty.
 
 	void prepare(BinCtx& ctx);
 
+	/// Find the tiles and the cluster slices of every object. Used when m_zBinning is true.
+	void binObjectsToTiles(BinCtx& ctx);
+
+	void computeObjectBounds(const BinCtx& ctx, ObjectBounds& obj) const;
+
 	void binTile(U32 tileIdx, BinCtx& ctx, TileCtx& tileCtx);
 
 	void writeTypedObjectsToGpuBuffers(BinCtx& ctx) const;
@@ -79,6 +79,7 @@ void Dbg::run(RenderPassWorkContext& rgraphCtx, const RenderingContext& ctx)
 	dctx.m_key = RenderingKey(Pass::FS, 0, 1, false, false);
 	dctx.m_debugDraw = true;
 	dctx.m_debugDrawFlags = m_debugDrawFlags;
+	dctx.m_viewportHeight = m_r->getHeight();
 
 	// Draw
 	for(const RenderableQueueElement& el : ctx.m_renderQueue->m_renderables)
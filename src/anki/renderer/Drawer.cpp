@@ -42,6 +42,7 @@ void RenderableDrawer::drawRange(Pass pass,
 	const Mat4& viewMat,
 	const Mat4& viewProjMat,
 	const Mat4& prevViewProjMat,
+	U32 viewportHeight,
 	CommandBufferPtr cmdb,
 	const RenderableQueueElement* begin,
 	const RenderableQueueElement* end)
@@ -58,6 +59,7 @@ void RenderableDrawer::drawRange(Pass pass,
 	ctx.m_queueCtx.m_commandBuffer = cmdb;
 	ctx.m_queueCtx.m_key = RenderingKey(pass, 0, 1, false, false);
 	ctx.m_queueCtx.m_debugDraw = false;
+	ctx.m_queueCtx.m_viewportHeight = viewportHeight;
 
 	for(; begin != end; ++begin)
 	{
@@ -36,6 +36,7 @@ public:
 		const Mat4& viewMat,
 		const Mat4& viewProjMat,
 		const Mat4& prevViewProjMat,
+		U32 viewportHeight,
 		CommandBufferPtr cmdb,
 		const RenderableQueueElement* begin,
 		const RenderableQueueElement* end);
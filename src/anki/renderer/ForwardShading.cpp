@@ -57,6 +57,7 @@ void ForwardShading::run(const RenderingContext& ctx, RenderPassWorkContext& rgr
 			ctx.m_matrices.m_view,
 			ctx.m_matrices.m_viewProjectionJitter,
 			ctx.m_prevMatrices.m_viewProjectionJitter,
+			m_r->getHeight(),
 			cmdb,
 			ctx.m_renderQueue->m_forwardShadingRenderables.getBegin() + start,
 			ctx.m_renderQueue->m_forwardShadingRenderables.getBegin() + end);
@@ -351,6 +351,7 @@ void Indirect::runGBuffer(CommandBufferPtr& cmdb)
 				rqueue.m_viewMatrix,
 				rqueue.m_viewProjectionMatrix,
 				Mat4::getIdentity(), // Don't care about prev mats
+				m_gbuffer.m_tileSize,
 				cmdb,
 				rqueue.m_renderables.getBegin(),
 				rqueue.m_renderables.getEnd());
@@ -51,6 +51,7 @@ Error MainRenderer::init(ThreadHive* hive,
 	m_height = config.getNumber("height");
 	ConfigSet config2 = config;
 	m_renderingQuality = config.getNumber("r.renderingQuality");
+	m_parallelCommandBufferRecording = config.getNumber("r.parallelCommandBufferRecording") != 0.0;
 	UVec2 size(m_renderingQuality * F32(m_width), m_renderingQuality * F32(m_height));
 
 	config2.set("width", size.x());
@@ -96,6 +97,7 @@ Error MainRenderer::render(RenderQueue& rqueue, TexturePtr presentTex)
 	RenderingContext ctx(m_frameAlloc);
 	m_runCtx.m_ctx = &ctx;
 	m_runCtx.m_secondaryTaskId.set(0);
+	m_runCtx.m_primaryTaskId.set(0);
 
 	RenderTargetHandle presentRt = ctx.m_renderGraphDescr.importRenderTarget(presentTex, TextureUsageBit::NONE);
 
@@ -145,20 +147,35 @@ Error MainRenderer::render(RenderQueue& rqueue, TexturePtr presentTex)
 	}
 
 	// Bake the render graph
-	m_rgraph->compileNewGraph(ctx.m_renderGraphDescr, m_frameAlloc);
+	const U32 threadCount = m_r->getThreadHive().getThreadCount();
+	const U32 recordingThreadCount = (m_parallelCommandBufferRecording) ? threadCount : 1;
+	m_rgraph->compileNewGraph(ctx.m_renderGraphDescr, m_frameAlloc, recordingThreadCount);
 
 	// Populate the 2nd level command buffers
 	Array<ThreadHiveTask, ThreadHive::MAX_THREADS> tasks;
-	for(U i = 0; i < m_r->getThreadHive().getThreadCount(); ++i)
+	for(U i = 0; i < threadCount; ++i)
 	{
 		tasks[i].m_argument = this;
 		tasks[i].m_callback = executeSecondaryCallback;
 	}
-	m_r->getThreadHive().submitTasks(&tasks[0], m_r->getThreadHive().getThreadCount());
+	m_r->getThreadHive().submitTasks(&tasks[0], threadCount);
 	m_r->getThreadHive().waitAllTasks();
 
-	// Populate 1st level command buffers
-	m_rgraph->run();
+	// Populate 1st level command buffers. They push the 2nd level so they go after them
+	if(recordingThreadCount > 1)
+	{
+		for(U i = 0; i < recordingThreadCount; ++i)
+		{
+			tasks[i].m_argument = this;
+			tasks[i].m_callback = executePrimaryCallback;
+		}
+		m_r->getThreadHive().submitTasks(&tasks[0], recordingThreadCount);
+		m_r->getThreadHive().waitAllTasks();
+	}
+	else
+	{
+		m_rgraph->run();
+	}
 
 	// Flush
 	m_rgraph->flush();
@@ -170,6 +187,8 @@ Error MainRenderer::render(RenderQueue& rqueue, TexturePtr presentTex)
 	// Stats
 	static_cast<RendererStats&>(m_stats) = m_r->getStats();
 	m_stats.m_renderingTime = HighRezTimer::getCurrentTime() - m_stats.m_renderingTime;
+	m_stats.m_renderTargetMemory = m_rgraph->getStats().m_transientMemory;
+	m_stats.m_renderTargetMemoryWithoutAliasing = m_rgraph->getStats().m_transientMemoryWithoutAliasing;
 
 	return Error::NONE;
 }
@@ -183,6 +202,15 @@ void MainRenderer::executeSecondaryCallback(
 	self.m_rgraph->runSecondLevel(taskId);
 }
 
+void MainRenderer::executePrimaryCallback(
+	void* userData, U32 threadId, ThreadHive& hive, ThreadHiveSemaphore* signalSemaphore)
+{
+	MainRenderer& self = *static_cast<MainRenderer*>(userData);
+
+	const U taskId = self.m_runCtx.m_primaryTaskId.fetchAdd(1);
+	self.m_rgraph->run(taskId);
+}
+
 void MainRenderer::runBlit(RenderPassWorkContext& rgraphCtx)
 {
 	CommandBufferPtr& cmdb = rgraphCtx.m_commandBuffer;
@@ -26,6 +26,8 @@ class MainRendererStats : public RendererStats
 {
 public:
 	Second m_renderingTime ANKI_DBG_NULLIFY;
+	PtrSize m_renderTargetMemory ANKI_DBG_NULLIFY; ///< The memory of the render targets RenderGraph created.
+	PtrSize m_renderTargetMemoryWithoutAliasing ANKI_DBG_NULLIFY;
 };
 
 /// Main onscreen renderer
@@ -82,6 +84,9 @@ private:
 
 	F32 m_renderingQuality = 1.0;
 
+	/// Record the 1st level command buffers on all threads. The pass callbacks have to be thread-safe for that.
+	Bool8 m_parallelCommandBufferRecording = false;
+
 	RenderGraphPtr m_rgraph;
 	RenderTargetDescription m_tmpRtDesc;
 
@@ -92,6 +97,7 @@ private:
 	public:
 		const RenderingContext* m_ctx = nullptr;
 		Atomic<U32> m_secondaryTaskId = {0};
+		Atomic<U32> m_primaryTaskId = {0};
 	} m_runCtx;
 
 	void runBlit(RenderPassWorkContext& rgraphCtx);
@@ -112,6 +118,9 @@ private:
 
 	static void executeSecondaryCallback(
 		void* userData, U32 threadId, ThreadHive& hive, ThreadHiveSemaphore* signalSemaphore);
+
+	static void executePrimaryCallback(
+		void* userData, U32 threadId, ThreadHive& hive, ThreadHiveSemaphore* signalSemaphore);
 };
 /// @}
 
@@ -42,6 +42,7 @@ public:
 	StagingGpuMemoryManager* m_stagingGpuAllocator ANKI_DBG_NULLIFY;
 	Bool m_debugDraw; ///< If true the drawcall should be drawing some kind of debug mesh.
 	BitSet<U(RenderQueueDebugDrawFlag::COUNT), U32> m_debugDrawFlags = {false};
+	U32 m_viewportHeight = 0; ///< Used to pick the mips of the textures. If it's zero they request all their mips.
 };
 
 /// Draw callback for drawing.
@@ -195,6 +195,7 @@ void ShadowMapping::runShadowMapping(RenderPassWorkContext& rgraphCtx)
 			work.m_renderQueue->m_viewMatrix,
 			work.m_renderQueue->m_viewProjectionMatrix,
 			Mat4::getIdentity(), // Don't care about prev matrices here
+			work.m_viewport[3],
 			cmdb,
 			work.m_renderQueue->m_renderables.getBegin() + work.m_firstRenderableElement,
 			work.m_renderQueue->m_renderables.getBegin() + work.m_firstRenderableElement
@@ -0,0 +1,242 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <anki/resource/AnimationBinary.h>
+#include <anki/util/File.h>
+
+namespace anki
+{
+
+/// Find the keyframes that can't be reconstructed by interpolating the keyframes around them.
+/// @param interpolate Functor that interpolates 2 values.
+/// @param error Functor that returns the difference of 2 values.
+/// @param[out] kept The indices of the keyframes to keep.
+template<typename T, typename TInterpolateFunc, typename TErrorFunc>
+static void reduceKeyframes(ConstWeakArray<AnimationKeyframe<T>> keyframes,
+	F32 tolerance,
+	TInterpolateFunc interpolate,
+	TErrorFunc error,
+	DynamicArrayAuto<U32>& kept)
+{
+	const U32 count = keyframes.getSize();
+	if(count == 0)
+	{
+		return;
+	}
+
+	// Try to remove every keyframe. Check that all the removed keyframes between the last one that was kept and the
+	// next one can still be reconstructed
+	kept.emplaceBack(0);
+	for(U32 i = 1; i + 1 < count; ++i)
+	{
+		const AnimationKeyframe<T>& left = keyframes[kept.getBack()];
+		const AnimationKeyframe<T>& right = keyframes[i + 1];
+
+		Bool canRemove = true;
+		for(U32 j = kept.getBack() + 1; j <= i && canRemove; ++j)
+		{
+			const F32 u = F32((keyframes[j].getTime() - left.getTime()) / (right.getTime() - left.getTime()));
+			const T value = interpolate(left.getValue(), right.getValue(), u);
+			canRemove = error(value, keyframes[j].getValue()) <= tolerance;
+		}
+
+		if(!canRemove)
+		{
+			kept.emplaceBack(i);
+		}
+	}
+
+	if(count > 1)
+	{
+		kept.emplaceBack(count - 1);
+	}
+
+	// A constant track needs a single keyframe
+	if(kept.getSize() == 2 && error(keyframes[0].getValue(), keyframes[count - 1].getValue()) <= tolerance)
+	{
+		kept.resize(1);
+	}
+}
+
+/// Append data to the keyframe data and return the offset.
+static U32 appendKeyframeData(DynamicArrayAuto<U8>& data, const void* ptr, PtrSize size)
+{
+	const U32 offset = data.getSize();
+	data.resize(getAlignedRoundUp(alignof(F32), offset + size), 0);
+	memcpy(&data[offset], ptr, size);
+	return offset;
+}
+
+/// Write the times of the kept keyframes and return their offset.
+template<typename T>
+static U32 appendKeyframeTimes(GenericMemoryPoolAllocator<U8> alloc,
+	DynamicArrayAuto<U8>& data,
+	ConstWeakArray<AnimationKeyframe<T>> keyframes,
+	const DynamicArrayAuto<U32>& kept)
+{
+	DynamicArrayAuto<F32> times(alloc);
+	times.create(kept.getSize());
+	for(U32 i = 0; i < kept.getSize(); ++i)
+	{
+		times[i] = F32(keyframes[kept[i]].getTime());
+	}
+
+	return appendKeyframeData(data, &times[0], times.getSizeInBytes());
+}
+
+Error writeAnimationBinary(
+	GenericMemoryPoolAllocator<U8> alloc, const AnimationBinaryWriteInfo& info, CString outFilename)
+{
+	if(info.m_channels.getSize() == 0)
+	{
+		ANKI_RESOURCE_LOGE("No channels to write: %s", &outFilename[0]);
+		return Error::USER_DATA;
+	}
+
+	F32 startTime = MAX_F32;
+	F32 endTime = MIN_F32;
+	U32 inKeyframeCount = 0;
+	U32 outKeyframeCount = 0;
+	DynamicArrayAuto<AnimationBinaryFile::Channel> outChannels(alloc);
+	outChannels.create(info.m_channels.getSize());
+	DynamicArrayAuto<U8> keyframeData(alloc);
+	for(U32 c = 0; c < info.m_channels.getSize(); ++c)
+	{
+		const AnimationBinaryWriteChannel& in = info.m_channels[c];
+		AnimationBinaryFile::Channel& out = outChannels[c];
+		out = {};
+
+		if(in.m_name.getLength() == 0 || in.m_name.getLength() > AnimationBinaryFile::MAX_CHANNEL_NAME_LENGTH)
+		{
+			ANKI_RESOURCE_LOGE("Wrong channel name length: %s", &in.m_name[0]);
+			return Error::USER_DATA;
+		}
+		memcpy(&out.m_name[0], &in.m_name[0], in.m_name.getLength() + 1);
+
+		inKeyframeCount += in.m_positions.getSize() + in.m_rotations.getSize() + in.m_scales.getSize();
+		auto updateTimeRange = [&](Second first, Second last) {
+			startTime = min(startTime, F32(first));
+			endTime = max(endTime, F32(last));
+		};
+
+		// Positions
+		DynamicArrayAuto<U32> kept(alloc);
+		reduceKeyframes(in.m_positions,
+			info.m_positionTolerance,
+			[](const Vec3& a, const Vec3& b, F32 u) { return linearInterpolate(a, b, u); },
+			[](const Vec3& a, const Vec3& b) { return (a - b).getLength(); },
+			kept);
+
+		out.m_positions.m_keyframeCount = kept.getSize();
+		if(kept.getSize())
+		{
+			updateTimeRange(in.m_positions[0].getTime(), in.m_positions.getBack().getTime());
+
+			Vec3 posMin(MAX_F32), posMax(MIN_F32);
+			for(U32 k : kept)
+			{
+				posMin = posMin.min(in.m_positions[k].getValue());
+				posMax = posMax.max(in.m_positions[k].getValue());
+			}
+			out.m_positionMin = posMin;
+			out.m_positionRange = posMax - posMin;
+
+			DynamicArrayAuto<U16> packed(alloc);
+			packed.create(kept.getSize() * 3);
+			for(U32 i = 0; i < kept.getSize(); ++i)
+			{
+				AnimationBinaryFile::packPosition(
+					in.m_positions[kept[i]].getValue(), out.m_positionMin, out.m_positionRange, &packed[i * 3]);
+			}
+
+			out.m_positions.m_timesOffset = appendKeyframeTimes(alloc, keyframeData, in.m_positions, kept);
+			out.m_positions.m_valuesOffset = appendKeyframeData(keyframeData, &packed[0], packed.getSizeInBytes());
+		}
+		outKeyframeCount += kept.getSize();
+
+		// Rotations
+		kept.destroy();
+		reduceKeyframes(in.m_rotations,
+			info.m_rotationTolerance,
+			[](const Quat& a, const Quat& b, F32 u) { return a.slerp(b, u); },
+			[](const Quat& a, const Quat& b) { return 2.0f * acos(min(absolute(a.dot(b)), 1.0f)); },
+			kept);
+
+		out.m_rotations.m_keyframeCount = kept.getSize();
+		if(kept.getSize())
+		{
+			updateTimeRange(in.m_rotations[0].getTime(), in.m_rotations.getBack().getTime());
+
+			DynamicArrayAuto<U16> packed(alloc);
+			packed.create(kept.getSize() * 3);
+			for(U32 i = 0; i < kept.getSize(); ++i)
+			{
+				AnimationBinaryFile::packRotation(in.m_rotations[kept[i]].getValue(), &packed[i * 3]);
+			}
+
+			out.m_rotations.m_timesOffset = appendKeyframeTimes(alloc, keyframeData, in.m_rotations, kept);
+			out.m_rotations.m_valuesOffset = appendKeyframeData(keyframeData, &packed[0], packed.getSizeInBytes());
+		}
+		outKeyframeCount += kept.getSize();
+
+		// Scales
+		kept.destroy();
+		reduceKeyframes(in.m_scales,
+			info.m_scaleTolerance,
+			[](F32 a, F32 b, F32 u) { return linearInterpolate(a, b, u); },
+			[](F32 a, F32 b) { return absolute(a - b); },
+			kept);
+
+		out.m_scales.m_keyframeCount = kept.getSize();
+		if(kept.getSize())
+		{
+			updateTimeRange(in.m_scales[0].getTime(), in.m_scales.getBack().getTime());
+
+			DynamicArrayAuto<F32> values(alloc);
+			values.create(kept.getSize());
+			for(U32 i = 0; i < kept.getSize(); ++i)
+			{
+				values[i] = in.m_scales[kept[i]].getValue();
+			}
+
+			out.m_scales.m_timesOffset = appendKeyframeTimes(alloc, keyframeData, in.m_scales, kept);
+			out.m_scales.m_valuesOffset = appendKeyframeData(keyframeData, &values[0], values.getSizeInBytes());
+		}
+		outKeyframeCount += kept.getSize();
+	}
+
+	if(startTime > endTime)
+	{
+		ANKI_RESOURCE_LOGE("The channels don't have keyframes: %s", &outFilename[0]);
+		return Error::USER_DATA;
+	}
+
+	ANKI_RESOURCE_LOGI("Animation %s: %u keyframes reduced to %u, %u bytes of keyframe data",
+		&outFilename[0],
+		inKeyframeCount,
+		outKeyframeCount,
+		U32(keyframeData.getSize()));
+
+	// Write the file
+	AnimationBinaryFile::Header header = {};
+	memcpy(&header.m_magic[0], AnimationBinaryFile::MAGIC, sizeof(header.m_magic));
+	header.m_channelCount = outChannels.getSize();
+	header.m_keyframeDataSize = keyframeData.getSize();
+	header.m_startTime = startTime;
+	header.m_duration = endTime - startTime;
+
+	File file;
+	ANKI_CHECK(file.open(outFilename, FileOpenFlag::WRITE | FileOpenFlag::BINARY));
+	ANKI_CHECK(file.write(&header, sizeof(header)));
+	ANKI_CHECK(file.write(&outChannels[0], outChannels.getSizeInBytes()));
+	if(keyframeData.getSize())
+	{
+		ANKI_CHECK(file.write(&keyframeData[0], keyframeData.getSize()));
+	}
+
+	return Error::NONE;
+}
+
+} // end namespace anki
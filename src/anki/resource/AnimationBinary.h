@@ -0,0 +1,173 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#pragma once
+
+#include <anki/resource/AnimationResource.h>
+
+namespace anki
+{
+
+/// @addtogroup resource
+/// @{
+
+/// Information to decode animation binary files.
+///
+/// The file is a Header, followed by Header::m_channelCount Channels, followed by the keyframe data. All the offsets
+/// are relative to the beginning of the keyframe data and they are aligned to 4 bytes so the whole file can be
+/// mapped in memory and used as is.
+///
+/// For every track the keyframe data contain the F32 keyframe times followed by the compressed values. Positions are
+/// 3 U16 normalized in the Channel::m_positionMin and Channel::m_positionRange box. Rotations are 3 U16 packed with
+/// packRotation(). Scales are F32.
+class AnimationBinaryFile
+{
+public:
+	static constexpr const char* MAGIC = "ANKIANI1";
+
+	static const U32 MAX_CHANNEL_NAME_LENGTH = 63;
+
+	struct Track
+	{
+		U32 m_keyframeCount;
+		U32 m_timesOffset; ///< Offset of the F32 times.
+		U32 m_valuesOffset; ///< Offset of the values.
+	};
+
+	struct Channel
+	{
+		char m_name[MAX_CHANNEL_NAME_LENGTH + 1]; ///< Null terminated.
+
+		Track m_positions;
+		Track m_rotations;
+		Track m_scales;
+
+		Vec3 m_positionMin;
+		Vec3 m_positionRange;
+	};
+
+	struct Header
+	{
+		char m_magic[8]; ///< Magic word.
+		U32 m_channelCount;
+		U32 m_keyframeDataSize;
+		F32 m_startTime;
+		F32 m_duration;
+	};
+
+	/// Size in bytes of a compressed position or rotation.
+	static const U32 PACKED_VALUE_SIZE = sizeof(U16) * 3;
+
+	/// Quantize a position inside a box.
+	static void packPosition(const Vec3& pos, const Vec3& min, const Vec3& range, U16 out[3])
+	{
+		for(U i = 0; i < 3; ++i)
+		{
+			const F32 n = (range[i] > 0.0f) ? clamp((pos[i] - min[i]) / range[i], 0.0f, 1.0f) : 0.0f;
+			out[i] = U16(n * F32(MAX_U16) + 0.5f);
+		}
+	}
+
+	static Vec3 unpackPosition(const U16 in[3], const Vec3& min, const Vec3& range)
+	{
+		const F32 f = 1.0f / F32(MAX_U16);
+		return min + range * Vec3(F32(in[0]) * f, F32(in[1]) * f, F32(in[2]) * f);
+	}
+
+	/// Pack a unit quaternion using the smallest three method. The biggest component is dropped because it can be
+	/// computed from the other 3. The rest are quantized to 15 bits and the index of the dropped one goes to the
+	/// remaining bits.
+	static void packRotation(const Quat& q, U16 out[3])
+	{
+		U biggest = 0;
+		for(U i = 1; i < 4; ++i)
+		{
+			if(absolute(q[i]) > absolute(q[biggest]))
+			{
+				biggest = i;
+			}
+		}
+
+		// q and -q are the same rotation. Make the dropped component positive
+		const F32 sign = (q[biggest] < 0.0f) ? -1.0f : 1.0f;
+
+		U count = 0;
+		for(U i = 0; i < 4; ++i)
+		{
+			if(i == biggest)
+			{
+				continue;
+			}
+
+			// The smallest components are in [-1/sqrt(2), 1/sqrt(2)]
+			const F32 n = clamp(q[i] * sign * SQRT2 * 0.5f + 0.5f, 0.0f, 1.0f);
+			out[count++] = U16(n * F32(QUANTIZATION_MAX) + 0.5f);
+		}
+
+		out[0] |= U16((biggest & 1) << 15);
+		out[1] |= U16((biggest >> 1) << 15);
+	}
+
+	static Quat unpackRotation(const U16 in[3])
+	{
+		const U biggest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+
+		Array<F32, 3> smallest;
+		F32 sum = 0.0f;
+		for(U i = 0; i < 3; ++i)
+		{
+			const F32 n = F32(in[i] & QUANTIZATION_MAX) / F32(QUANTIZATION_MAX);
+			smallest[i] = (n - 0.5f) * 2.0f / SQRT2;
+			sum += smallest[i] * smallest[i];
+		}
+
+		Quat q;
+		U count = 0;
+		for(U i = 0; i < 4; ++i)
+		{
+			q[i] = (i == biggest) ? sqrt(max(0.0f, 1.0f - sum)) : smallest[count++];
+		}
+
+		return q;
+	}
+
+private:
+	static const U16 QUANTIZATION_MAX = 0x7FFF;
+	static constexpr F32 SQRT2 = 1.41421356f;
+};
+
+/// The uncompressed keyframes of a channel. See AnimationBinaryWriteInfo.
+class AnimationBinaryWriteChannel
+{
+public:
+	CString m_name;
+	ConstWeakArray<AnimationKeyframe<Vec3>> m_positions;
+	ConstWeakArray<AnimationKeyframe<Quat>> m_rotations;
+	ConstWeakArray<AnimationKeyframe<F32>> m_scales; ///< Only uniform scale.
+};
+
+/// The input of writeAnimationBinary.
+class AnimationBinaryWriteInfo
+{
+public:
+	ConstWeakArray<AnimationBinaryWriteChannel> m_channels;
+
+	/// A keyframe is removed if interpolating its neighbours gives a position that is closer than that.
+	F32 m_positionTolerance = 0.0001f;
+
+	/// A keyframe is removed if interpolating its neighbours gives a rotation that is closer than that (in radians).
+	F32 m_rotationTolerance = toRad(0.01f);
+
+	/// A keyframe is removed if interpolating its neighbours gives a scale that is closer than that.
+	F32 m_scaleTolerance = 0.001f;
+};
+
+/// Remove the keyframes that interpolating their neighbours reproduces, compress the rest and write an animation
+/// binary file.
+ANKI_USE_RESULT Error writeAnimationBinary(
+	GenericMemoryPoolAllocator<U8> alloc, const AnimationBinaryWriteInfo& info, CString outFilename);
+/// @}
+
+} // end namespace anki
@@ -4,7 +4,9 @@
 // http://www.anki3d.org/LICENSE
 
 #include <anki/resource/AnimationResource.h>
+#include <anki/resource/AnimationBinary.h>
 #include <anki/misc/Xml.h>
+#include <anki/util/Filesystem.h>
 
 namespace anki
 {
@@ -22,9 +24,142 @@ AnimationResource::~AnimationResource()
 	}
 
 	m_channels.destroy(getAllocator());
+	m_keyframeData.destroy(getAllocator());
 }
 
 Error AnimationResource::load(const ResourceFilename& filename, Bool async)
+{
+	StringAuto ext(getTempAllocator());
+	getFilepathExtension(filename, ext);
+
+	if(ext == "ankianim")
+	{
+		ANKI_CHECK(loadBinary(filename));
+	}
+	else
+	{
+		ANKI_CHECK(loadXml(filename));
+	}
+
+	return Error::NONE;
+}
+
+Error AnimationResource::loadBinary(const ResourceFilename& filename)
+{
+	ResourceFilePtr file;
+	ANKI_CHECK(openFile(filename, file));
+
+	// Header
+	AnimationBinaryFile::Header header;
+	ANKI_CHECK(file->read(&header, sizeof(header)));
+
+	if(memcmp(&header.m_magic[0], AnimationBinaryFile::MAGIC, 8) != 0)
+	{
+		ANKI_RESOURCE_LOGE("Wrong magic word");
+		return Error::USER_DATA;
+	}
+
+	if(header.m_channelCount == 0)
+	{
+		ANKI_RESOURCE_LOGE("Didn't found any channels");
+		return Error::USER_DATA;
+	}
+
+	const PtrSize fileSize =
+		sizeof(header) + sizeof(AnimationBinaryFile::Channel) * header.m_channelCount + header.m_keyframeDataSize;
+	if(fileSize != file->getSize())
+	{
+		ANKI_RESOURCE_LOGE("Unexpected file size");
+		return Error::USER_DATA;
+	}
+
+	// Channels
+	DynamicArrayAuto<AnimationBinaryFile::Channel> inChannels(getTempAllocator());
+	inChannels.create(header.m_channelCount);
+	ANKI_CHECK(file->read(&inChannels[0], inChannels.getSizeInBytes()));
+
+	// Keyframes. Read them all at once and point the channels to them
+	if(header.m_keyframeDataSize)
+	{
+		m_keyframeData.create(getAllocator(), header.m_keyframeDataSize);
+		ANKI_CHECK(file->read(&m_keyframeData[0], m_keyframeData.getSizeInBytes()));
+	}
+
+	auto checkTrack = [&](const AnimationBinaryFile::Track& track, U32 valueSize) -> Error {
+		const PtrSize timesEnd = PtrSize(track.m_timesOffset) + sizeof(F32) * track.m_keyframeCount;
+		const PtrSize valuesEnd = PtrSize(track.m_valuesOffset) + valueSize * track.m_keyframeCount;
+		if(!isAligned(alignof(F32), track.m_timesOffset) || !isAligned(alignof(F32), track.m_valuesOffset)
+			|| timesEnd > header.m_keyframeDataSize
+			|| valuesEnd > header.m_keyframeDataSize)
+		{
+			ANKI_RESOURCE_LOGE("Wrong keyframe offsets");
+			return Error::USER_DATA;
+		}
+
+		return Error::NONE;
+	};
+
+	auto getTimes = [&](const AnimationBinaryFile::Track& track) -> ConstWeakArray<F32> {
+		return ConstWeakArray<F32>(
+			reinterpret_cast<const F32*>(&m_keyframeData[0] + track.m_timesOffset), track.m_keyframeCount);
+	};
+
+	m_channels.create(getAllocator(), header.m_channelCount);
+	for(U i = 0; i < header.m_channelCount; ++i)
+	{
+		const AnimationBinaryFile::Channel& in = inChannels[i];
+		AnimationChannel& out = m_channels[i];
+
+		if(in.m_name[AnimationBinaryFile::MAX_CHANNEL_NAME_LENGTH] != '\0')
+		{
+			ANKI_RESOURCE_LOGE("Channel name is not null terminated");
+			return Error::USER_DATA;
+		}
+		out.m_name.create(getAllocator(), &in.m_name[0]);
+
+		ANKI_CHECK(checkTrack(in.m_positions, AnimationBinaryFile::PACKED_VALUE_SIZE));
+		ANKI_CHECK(checkTrack(in.m_rotations, AnimationBinaryFile::PACKED_VALUE_SIZE));
+		ANKI_CHECK(checkTrack(in.m_scales, sizeof(F32)));
+
+		if(in.m_positions.m_keyframeCount)
+		{
+			out.m_compressedPositions.m_times = getTimes(in.m_positions);
+			out.m_compressedPositions.m_values =
+				ConstWeakArray<U16>(reinterpret_cast<const U16*>(&m_keyframeData[0] + in.m_positions.m_valuesOffset),
+					in.m_positions.m_keyframeCount * 3);
+			out.m_positionMin = in.m_positionMin;
+			out.m_positionRange = in.m_positionRange;
+		}
+
+		if(in.m_rotations.m_keyframeCount)
+		{
+			out.m_compressedRotations.m_times = getTimes(in.m_rotations);
+			out.m_compressedRotations.m_values =
+				ConstWeakArray<U16>(reinterpret_cast<const U16*>(&m_keyframeData[0] + in.m_rotations.m_valuesOffset),
+					in.m_rotations.m_keyframeCount * 3);
+		}
+
+		// Scales are rare, don't compress them
+		if(in.m_scales.m_keyframeCount)
+		{
+			const ConstWeakArray<F32> times = getTimes(in.m_scales);
+			const F32* values = reinterpret_cast<const F32*>(&m_keyframeData[0] + in.m_scales.m_valuesOffset);
+
+			out.m_scales.create(getAllocator(), in.m_scales.m_keyframeCount);
+			for(U k = 0; k < in.m_scales.m_keyframeCount; ++k)
+			{
+				out.m_scales[k] = AnimationKeyframe<F32>(times[k], values[k]);
+			}
+		}
+	}
+
+	m_startTime = header.m_startTime;
+	m_duration = header.m_duration;
+
+	return Error::NONE;
+}
+
+Error AnimationResource::loadXml(const ResourceFilename& filename)
 {
 	XmlElement el;
 	I64 tmp;
@@ -217,50 +352,144 @@ Error AnimationResource::load(const ResourceFilename& filename, Bool async)
 	return Error::NONE;
 }
 
-void AnimationResource::interpolate(U channelIndex, Second time, Vec3& pos, Quat& rot, F32& scale) const
+template<typename TGetTimeFunc>
+U32 AnimationChannel::findKeyframe(U32 keyframeCount, Second time, U32 hint, TGetTimeFunc getTime)
 {
-	// Audjust time
-	if(time > m_startTime + m_duration)
+	ANKI_ASSERT(keyframeCount > 1);
+	const U32 lastLeft = keyframeCount - 2;
+
+	// Try the hint and the one after it. That's what happens when the time moves forward
+	if(hint <= lastLeft && getTime(hint) <= time)
 	{
-		time = mod(time - m_startTime, m_duration) + m_startTime;
+		if(time <= getTime(hint + 1))
+		{
+			return hint;
+		}
+
+		if(hint + 1 <= lastLeft && time <= getTime(hint + 2))
+		{
+			return hint + 1;
+		}
 	}
 
-	ANKI_ASSERT(time >= m_startTime && time <= m_startTime + m_duration);
-	ANKI_ASSERT(channelIndex < m_channels.getSize());
+	// Binary search for the first keyframe that is after the time
+	U32 first = 0;
+	U32 count = keyframeCount;
+	while(count > 0)
+	{
+		const U32 step = count / 2;
+		if(time < getTime(first + step))
+		{
+			count = step;
+		}
+		else
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+	}
 
-	const AnimationChannel& channel = m_channels[channelIndex];
+	return clamp<U32>(first, 1, keyframeCount - 1) - 1;
+}
 
-	// Position
-	if(channel.m_positions.getSize() > 1)
+/// Interpolate the keyframes of a single track.
+/// @param cursor The keyframe used last time. It will be updated. Can be nullptr.
+template<typename T, typename TGetTimeFunc, typename TGetValueFunc, typename TInterpolateFunc>
+static void interpolateTrack(U32 keyframeCount,
+	Second time,
+	U32* cursor,
+	TGetTimeFunc getTime,
+	TGetValueFunc getValue,
+	TInterpolateFunc interpolateValues,
+	T& out)
+{
+	if(keyframeCount > 1)
 	{
-		for(U i = 0; i < channel.m_positions.getSize() - 1; ++i)
+		const U32 i = AnimationChannel::findKeyframe(keyframeCount, time, (cursor) ? *cursor : 0, getTime);
+		const Second left = getTime(i);
+		const Second right = getTime(i + 1);
+		const Second u = clamp((time - left) / (right - left), 0.0, 1.0);
+		out = interpolateValues(getValue(i), getValue(i + 1), u);
+
+		if(cursor)
 		{
-			const AnimationKeyframe<Vec3>& left = channel.m_positions[i];
-			const AnimationKeyframe<Vec3>& right = channel.m_positions[i + 1];
-			if(time >= left.m_time && time <= right.m_time)
-			{
-				const Second u = (time - left.m_time) / (right.m_time - left.m_time);
-				pos = linearInterpolate(left.m_value, right.m_value, u);
-				break;
-			}
+			*cursor = i;
 		}
 	}
+	else if(keyframeCount == 1)
+	{
+		out = getValue(0);
+	}
+}
+
+void AnimationChannel::interpolate(
+	Second time, Vec3& pos, Quat& rot, F32& scale, AnimationChannelCursor* cursor) const
+{
+	auto lerp = [](const Vec3& a, const Vec3& b, Second u) { return linearInterpolate(a, b, u); };
+	auto slerp = [](const Quat& a, const Quat& b, Second u) { return a.slerp(b, u); };
+
+	// Position
+	if(m_compressedPositions.getKeyframeCount())
+	{
+		// Decompress the 2 keyframes that are needed
+		interpolateTrack(m_compressedPositions.getKeyframeCount(),
+			time,
+			(cursor) ? &cursor->m_position : nullptr,
+			[&](U32 i) { return Second(m_compressedPositions.m_times[i]); },
+			[&](U32 i) {
+				return AnimationBinaryFile::unpackPosition(
+					&m_compressedPositions.m_values[i * 3], m_positionMin, m_positionRange);
+			},
+			lerp,
+			pos);
+	}
+	else
+	{
+		interpolateTrack(m_positions.getSize(),
+			time,
+			(cursor) ? &cursor->m_position : nullptr,
+			[&](U32 i) { return m_positions[i].m_time; },
+			[&](U32 i) { return m_positions[i].m_value; },
+			lerp,
+			pos);
+	}
 
 	// Rotation
-	if(channel.m_rotations.getSize() > 1)
+	if(m_compressedRotations.getKeyframeCount())
 	{
-		for(U i = 0; i < channel.m_rotations.getSize() - 1; ++i)
-		{
-			const AnimationKeyframe<Quat>& left = channel.m_rotations[i];
-			const AnimationKeyframe<Quat>& right = channel.m_rotations[i + 1];
-			if(time >= left.m_time && time <= right.m_time)
-			{
-				const Second u = (time - left.m_time) / (right.m_time - left.m_time);
-				rot = left.m_value.slerp(right.m_value, u);
-				break;
-			}
-		}
+		interpolateTrack(m_compressedRotations.getKeyframeCount(),
+			time,
+			(cursor) ? &cursor->m_rotation : nullptr,
+			[&](U32 i) { return Second(m_compressedRotations.m_times[i]); },
+			[&](U32 i) { return AnimationBinaryFile::unpackRotation(&m_compressedRotations.m_values[i * 3]); },
+			slerp,
+			rot);
 	}
+	else
+	{
+		interpolateTrack(m_rotations.getSize(),
+			time,
+			(cursor) ? &cursor->m_rotation : nullptr,
+			[&](U32 i) { return m_rotations[i].m_time; },
+			[&](U32 i) { return m_rotations[i].m_value; },
+			slerp,
+			rot);
+	}
+}
+
+void AnimationResource::interpolate(
+	U channelIndex, Second time, Vec3& pos, Quat& rot, F32& scale, AnimationChannelCursor* cursor) const
+{
+	// Audjust time
+	if(time > m_startTime + m_duration)
+	{
+		time = mod(time - m_startTime, m_duration) + m_startTime;
+	}
+
+	ANKI_ASSERT(time >= m_startTime && time <= m_startTime + m_duration);
+	ANKI_ASSERT(channelIndex < m_channels.getSize());
+
+	m_channels[channelIndex].interpolate(time, pos, rot, scale, cursor);
 }
 
 } // end namespace anki
@@ -8,6 +8,7 @@
 #include <anki/resource/ResourceObject.h>
 #include <anki/Math.h>
 #include <anki/util/String.h>
+#include <anki/util/WeakArray.h>
 
 namespace anki
 {
@@ -23,8 +24,17 @@ template<typename T>
 class AnimationKeyframe
 {
 	friend class AnimationResource;
+	friend class AnimationChannel;
 
 public:
+	AnimationKeyframe() = default;
+
+	AnimationKeyframe(Second time, const T& value)
+		: m_time(time)
+		, m_value(value)
+	{
+	}
+
 	Second getTime() const
 	{
 		return m_time;
@@ -40,6 +50,29 @@ private:
 	T m_value;
 };
 
+/// Remembers the keyframes a channel used in its last interpolation. When an animation plays forward the next
+/// keyframes are found in constant time.
+class AnimationChannelCursor
+{
+public:
+	U32 m_position = 0;
+	U32 m_rotation = 0;
+};
+
+/// Compressed keyframes of a channel that was loaded from a binary file. See AnimationBinaryFile for the format of
+/// the values. The memory is owned by the AnimationResource.
+class AnimationCompressedTrack
+{
+public:
+	ConstWeakArray<F32> m_times;
+	ConstWeakArray<U16> m_values; ///< 3 U16 per keyframe.
+
+	U32 getKeyframeCount() const
+	{
+		return m_times.getSize();
+	}
+};
+
 /// Animation channel
 class AnimationChannel
 {
@@ -53,6 +86,15 @@ public:
 	DynamicArray<AnimationKeyframe<F32>> m_scales;
 	DynamicArray<AnimationKeyframe<F32>> m_cameraFovs;
 
+	/// @name Binary animations
+	/// If there are compressed keyframes the m_positions and m_rotations are empty.
+	/// @{
+	AnimationCompressedTrack m_compressedPositions;
+	AnimationCompressedTrack m_compressedRotations;
+	Vec3 m_positionMin = Vec3(0.0f);
+	Vec3 m_positionRange = Vec3(0.0f);
+	/// @}
+
 	void destroy(ResourceAllocator<U8> alloc)
 	{
 		m_name.destroy(alloc);
@@ -61,6 +103,16 @@ public:
 		m_scales.destroy(alloc);
 		m_cameraFovs.destroy(alloc);
 	}
+
+	/// Get the interpolated data. The values of the missing keyframes are not touched.
+	/// @param cursor Optional. It's used to find the keyframes faster and it will be updated.
+	void interpolate(Second time, Vec3& position, Quat& rotation, F32& scale, AnimationChannelCursor* cursor) const;
+
+	/// Find the keyframe before the time. The next one will be after the time.
+	/// @param hint A guess. If it's wrong a binary search will find the keyframe.
+	/// @param getTime A functor that returns the time of a keyframe.
+	template<typename TGetTimeFunc>
+	static U32 findKeyframe(U32 keyframeCount, Second time, U32 hint, TGetTimeFunc getTime);
 };
 
 /// Animation consists of keyframe data.
@@ -92,12 +144,23 @@ public:
 	}
 
 	/// Get the interpolated data
-	void interpolate(U channelIndex, Second time, Vec3& position, Quat& rotation, F32& scale) const;
+	/// @param cursor Optional. Pass one per channel and per player to make the interpolation of monotonic playback
+	///               faster.
+	void interpolate(U channelIndex,
+		Second time,
+		Vec3& position,
+		Quat& rotation,
+		F32& scale,
+		AnimationChannelCursor* cursor = nullptr) const;
 
 private:
 	DynamicArray<AnimationChannel> m_channels;
+	DynamicArray<U8> m_keyframeData; ///< The compressed keyframes of binary animations.
 	Second m_duration;
 	Second m_startTime;
+
+	ANKI_USE_RESULT Error loadXml(const ResourceFilename& filename);
+	ANKI_USE_RESULT Error loadBinary(const ResourceFilename& filename);
 };
 /// @}
 
@@ -5,13 +5,13 @@
 
 #include <anki/resource/AsyncLoader.h>
 #include <anki/util/Logger.h>
+#include <anki/util/HighRezTimer.h>
 #include <anki/core/Trace.h>
 
 namespace anki
 {
 
 AsyncLoader::AsyncLoader()
-	: m_thread("anki_asyload")
 {
 }
 
@@ -19,23 +19,34 @@ AsyncLoader::~AsyncLoader()
 {
 	stop();
 
-	if(!m_taskQueue.isEmpty())
+	if(m_pendingTaskCount.load())
 	{
-		ANKI_RESOURCE_LOGW("Stoping loading thread while there is work to do");
+		ANKI_RESOURCE_LOGW("Stoping loading threads while there is work to do");
 
-		while(!m_taskQueue.isEmpty())
+		for(IntrusiveList<AsyncLoaderTask>& queue : m_taskQueues)
 		{
-			AsyncLoaderTask* task = &m_taskQueue.getFront();
-			m_taskQueue.popFront();
-			m_alloc.deleteInstance(task);
+			while(!queue.isEmpty())
+			{
+				AsyncLoaderTask* task = &queue.getFront();
+				queue.popFront();
+				detachHandle(task);
+				m_alloc.deleteInstance(task);
+			}
 		}
 	}
 }
 
-void AsyncLoader::init(const HeapAllocator<U8>& alloc)
+void AsyncLoader::init(const ResourceAllocator<U8>& alloc, U32 threadCount)
 {
+	ANKI_ASSERT(threadCount > 0);
 	m_alloc = alloc;
-	m_thread.start(this, threadCallback);
+
+	m_threads.create(m_alloc, threadCount);
+	for(Thread*& thread : m_threads)
+	{
+		thread = m_alloc.newInstance<Thread>("anki_asyload");
+		thread->start(this, threadCallback);
+	}
 }
 
 void AsyncLoader::stop()
@@ -43,30 +54,41 @@ void AsyncLoader::stop()
 	{
 		LockGuard<Mutex> lock(m_mtx);
 		m_quit = true;
-		m_condVar.notifyOne();
+		m_condVar.notifyAll();
+	}
+
+	for(Thread* thread : m_threads)
+	{
+		Error err = thread->join();
+		(void)err;
+		m_alloc.deleteInstance(thread);
 	}
 
-	Error err = m_thread.join();
-	(void)err;
+	m_threads.destroy(m_alloc);
 }
 
 void AsyncLoader::pause()
 {
+	LockGuard<Mutex> lock(m_mtx);
+	m_paused = true;
+
+	while(m_runningTaskCount > 0)
 	{
-		LockGuard<Mutex> lock(m_mtx);
-		m_paused = true;
-		m_sync = true;
-		m_condVar.notifyOne();
+		m_taskDoneCondVar.wait(m_mtx);
 	}
-
-	m_barrier.wait();
 }
 
 void AsyncLoader::resume()
 {
 	LockGuard<Mutex> lock(m_mtx);
 	m_paused = false;
-	m_condVar.notifyOne();
+	m_condVar.notifyAll();
+}
+
+Bool AsyncLoader::isPaused()
+{
+	LockGuard<Mutex> lock(m_mtx);
+	return m_paused && m_runningTaskCount == 0;
 }
 
 Error AsyncLoader::threadCallback(ThreadCallbackInfo& info)
@@ -75,6 +97,38 @@ Error AsyncLoader::threadCallback(ThreadCallbackInfo& info)
 	return self.threadWorker();
 }
 
+AsyncLoaderTask* AsyncLoader::popTask()
+{
+	for(IntrusiveList<AsyncLoaderTask>& queue : m_taskQueues)
+	{
+		if(!queue.isEmpty())
+		{
+			AsyncLoaderTask* task = &queue.getFront();
+			queue.popFront();
+			m_pendingTaskCount.fetchSub(1);
+			return task;
+		}
+	}
+
+	return nullptr;
+}
+
+void AsyncLoader::pushTask(AsyncLoaderTask* task)
+{
+	m_taskQueues[task->m_priority].pushBack(task);
+	m_pendingTaskCount.fetchAdd(1);
+}
+
+void AsyncLoader::detachHandle(AsyncLoaderTask* task)
+{
+	if(task->m_handle)
+	{
+		ANKI_ASSERT(task->m_handle->m_task.load() == task);
+		task->m_handle->m_task.store(nullptr);
+		task->m_handle = nullptr;
+	}
+}
+
 Error AsyncLoader::threadWorker()
 {
 	Error err = Error::NONE;
@@ -82,98 +136,156 @@ Error AsyncLoader::threadWorker()
 	while(!err)
 	{
 		AsyncLoaderTask* task = nullptr;
-		Bool quit = false;
-		Bool sync = false;
 
 		{
 			// Wait for something
 			LockGuard<Mutex> lock(m_mtx);
-			while((m_taskQueue.isEmpty() || m_paused) && !m_quit && !m_sync)
+			while((m_pendingTaskCount.load() == 0 || m_paused) && !m_quit)
 			{
 				m_condVar.wait(m_mtx);
 			}
 
-			// Do some work
 			if(m_quit)
 			{
-				quit = true;
-			}
-			else if(m_sync)
-			{
-				sync = true;
-				m_sync = false;
-			}
-			else
-			{
-				task = &m_taskQueue.getFront();
-				m_taskQueue.popFront();
+				break;
 			}
+
+			task = popTask();
+			ANKI_ASSERT(task);
+			task->m_running = true;
+			++m_runningTaskCount;
 		}
 
-		if(quit)
+		// Exec the task
+		AsyncLoaderTaskContext ctx;
+
 		{
-			break;
+			ANKI_TRACE_SCOPED_EVENT(RSRC_ASYNC_TASK);
+			err = (*task)(ctx);
 		}
-		else if(sync)
+
+		if(!err)
 		{
-			m_barrier.wait();
+			m_completedTaskCount.fetchAdd(1);
 		}
 		else
 		{
-			// Exec the task
-			ANKI_ASSERT(task);
-			AsyncLoaderTaskContext ctx;
+			ANKI_RESOURCE_LOGE("Async loader task failed");
+		}
 
-			{
-				ANKI_TRACE_SCOPED_EVENT(RSRC_ASYNC_TASK);
-				err = (*task)(ctx);
-			}
+		// The latency is from the submission to the end of the execution. In ns. The counters are summed per frame so
+		// divide the latency with the count to get the average
+		ANKI_TRACE_INC_COUNTER(
+			RSRC_ASYNC_TASK_LATENCY, U64((HighRezTimer::getCurrentTime() - task->m_submitTime) * 1000000000.0));
+		ANKI_TRACE_INC_COUNTER(RSRC_ASYNC_TASK_LATENCY_COUNT, 1);
 
-			if(!err)
-			{
-				m_completedTaskCount.fetchAdd(1);
-			}
-			else
-			{
-				ANKI_RESOURCE_LOGE("Async loader task failed");
-			}
+		// Do other stuff
+		{
+			LockGuard<Mutex> lock(m_mtx);
+
+			task->m_running = false;
+			--m_runningTaskCount;
 
-			// Do other stuff
 			if(ctx.m_resubmitTask)
 			{
-				LockGuard<Mutex> lock(m_mtx);
-				m_taskQueue.pushBack(task);
+				pushTask(task);
 			}
 			else
 			{
-				// Delete the task
-				m_alloc.deleteInstance(task);
+				detachHandle(task);
 			}
 
 			if(ctx.m_pause)
 			{
-				LockGuard<Mutex> lock(m_mtx);
 				m_paused = true;
 			}
+
+			// Wake up the threads that wait for the running tasks and the workers that might have slept because of
+			// the resubmission
+			m_taskDoneCondVar.notifyAll();
+			if(ctx.m_resubmitTask && !m_paused)
+			{
+				m_condVar.notifyOne();
+			}
+		}
+
+		// Delete the task outside the lock because its destructor might release resources that cancel other tasks
+		if(!ctx.m_resubmitTask)
+		{
+			m_alloc.deleteInstance(task);
 		}
 	}
 
 	return err;
 }
 
-void AsyncLoader::submitTask(AsyncLoaderTask* task)
+void AsyncLoader::submitTask(AsyncLoaderTask* task, AsyncLoaderTaskPriority priority, AsyncLoaderTaskHandle* handle)
 {
 	ANKI_ASSERT(task);
+	ANKI_ASSERT(priority < AsyncLoaderTaskPriority::COUNT);
+	task->m_priority = priority;
+	task->m_submitTime = HighRezTimer::getCurrentTime();
 
 	// Append task to the list
 	LockGuard<Mutex> lock(m_mtx);
-	m_taskQueue.pushBack(task);
+
+	if(handle)
+	{
+		ANKI_ASSERT(handle->m_task.load() == nullptr && "The handle is in use");
+		handle->m_task.store(task);
+		task->m_handle = handle;
+	}
+
+	pushTask(task);
 
 	if(!m_paused)
 	{
-		// Wake up the thread if it's not paused
+		// Wake up a thread if the loader is not paused
 		m_condVar.notifyOne();
 	}
 }
 
+void AsyncLoader::cancelTask(AsyncLoaderTaskHandle& handle)
+{
+	AsyncLoaderTask* task = nullptr;
+
+	{
+		LockGuard<Mutex> lock(m_mtx);
+
+		// If it runs wait for it. It might get resubmitted so check again
+		while(handle.m_task.load() && handle.m_task.load()->m_running)
+		{
+			m_taskDoneCondVar.wait(m_mtx);
+		}
+
+		task = handle.m_task.load();
+		if(task)
+		{
+			m_taskQueues[task->m_priority].erase(task);
+			m_pendingTaskCount.fetchSub(1);
+			detachHandle(task);
+		}
+	}
+
+	if(task)
+	{
+		m_alloc.deleteInstance(task);
+		ANKI_TRACE_INC_COUNTER(RSRC_ASYNC_TASKS_CANCELED, 1);
+	}
+}
+
+void AsyncLoader::setTaskPriority(AsyncLoaderTaskHandle& handle, AsyncLoaderTaskPriority priority)
+{
+	ANKI_ASSERT(priority < AsyncLoaderTaskPriority::COUNT);
+	LockGuard<Mutex> lock(m_mtx);
+
+	AsyncLoaderTask* task = handle.m_task.load();
+	if(task && !task->m_running && task->m_priority != priority)
+	{
+		m_taskQueues[task->m_priority].erase(task);
+		task->m_priority = priority;
+		m_taskQueues[priority].pushBack(task);
+	}
+}
+
 } // end namespace anki
@@ -8,16 +8,30 @@
 #include <anki/resource/Common.h>
 #include <anki/util/Thread.h>
 #include <anki/util/List.h>
+#include <anki/util/DynamicArray.h>
 
 namespace anki
 {
 
 // Forward
 class AsyncLoader;
+class AsyncLoaderTaskHandle;
 
 /// @addtogroup resource
 /// @{
 
+/// The priority of an AsyncLoaderTask. The workers execute the tasks of higher priorities first.
+enum class AsyncLoaderTaskPriority : U8
+{
+	HIGH, ///< Something that is visible now waits for it.
+	MEDIUM, ///< Something near the camera will need it soon.
+	LOW, ///< Prefetching.
+
+	COUNT,
+	FIRST = 0
+};
+ANKI_ENUM_ALLOW_NUMERIC_OPERATIONS(AsyncLoaderTaskPriority, inline)
+
 class AsyncLoaderTaskContext
 {
 public:
@@ -31,15 +45,46 @@ public:
 /// Interface for tasks for the AsyncLoader.
 class AsyncLoaderTask : public IntrusiveListEnabled<AsyncLoaderTask>
 {
+	friend class AsyncLoader;
+
 public:
 	virtual ~AsyncLoaderTask()
 	{
 	}
 
 	virtual ANKI_USE_RESULT Error operator()(AsyncLoaderTaskContext& ctx) = 0;
+
+private:
+	AsyncLoaderTaskHandle* m_handle = nullptr;
+	Second m_submitTime = 0.0;
+	AsyncLoaderTaskPriority m_priority = AsyncLoaderTaskPriority::MEDIUM;
+	Bool8 m_running = false;
 };
 
-/// Asynchronous resource loader.
+/// Keeps track of a submitted task so it can be canceled or re-prioritized. The AsyncLoader clears it when the task
+/// is done.
+class AsyncLoaderTaskHandle : public NonCopyable
+{
+	friend class AsyncLoader;
+
+public:
+	~AsyncLoaderTaskHandle()
+	{
+		ANKI_ASSERT(m_task.load() == nullptr && "Forgot to cancel the task");
+	}
+
+	/// Check if the task waits or runs. It's threadsafe. The task may finish right after it returns true but if it
+	/// returns false the handle is free to be reused.
+	Bool isPending() const
+	{
+		return m_task.load() != nullptr;
+	}
+
+private:
+	Atomic<AsyncLoaderTask*> m_task = {nullptr}; ///< The AsyncLoader writes it with its lock held.
+};
+
+/// Asynchronous resource loader. It executes the tasks in a few worker threads.
 class AsyncLoader
 {
 public:
@@ -47,10 +92,17 @@ public:
 
 	~AsyncLoader();
 
-	void init(const HeapAllocator<U8>& alloc);
+	/// @param threadCount The number of worker threads. With a single thread the tasks of the same priority are
+	///                    executed in the order they were submitted.
+	void init(const ResourceAllocator<U8>& alloc, U32 threadCount = 1);
 
 	/// Submit a task.
-	void submitTask(AsyncLoaderTask* task);
+	/// @param[in,out] task The task.
+	/// @param priority The priority of the task.
+	/// @param[out] handle Optional handle that can cancel the task. It should live until the task is done.
+	void submitTask(AsyncLoaderTask* task,
+		AsyncLoaderTaskPriority priority = AsyncLoaderTaskPriority::MEDIUM,
+		AsyncLoaderTaskHandle* handle = nullptr);
 
 	/// Create a new asynchronous loading task.
 	template<typename TTask, typename... TArgs>
@@ -66,14 +118,24 @@ public:
 		submitTask(newTask<TTask>(std::forward<TArgs>(args)...));
 	}
 
-	/// Pause the loader. This method will block the main thread for the current async task to finish. The rest of the
+	/// Cancel a task. If the task waits in the queue it will be deleted without running. If it runs it will block
+	/// until it's done. After the call the handle is free to be destroyed.
+	void cancelTask(AsyncLoaderTaskHandle& handle);
+
+	/// Move a task that waits in the queue to another priority. It does nothing if the task is running or it's done.
+	void setTaskPriority(AsyncLoaderTaskHandle& handle, AsyncLoaderTaskPriority priority);
+
+	/// Pause the loader. This method will block the calling thread for the running tasks to finish. The rest of the
 	/// tasks in the queue will not be executed until resume is called.
 	void pause();
 
 	/// Resume the async loading.
 	void resume();
 
-	HeapAllocator<U8> getAllocator() const
+	/// Check if the loader is paused and no task runs.
+	Bool isPaused();
+
+	ResourceAllocator<U8> getAllocator() const
 	{
 		return m_alloc;
 	}
@@ -84,19 +146,26 @@ public:
 		return m_completedTaskCount.load();
 	}
 
-private:
-	HeapAllocator<U8> m_alloc;
-	Thread m_thread;
-	Barrier m_barrier = {2};
+	/// Get the number of tasks that wait in the queues.
+	U32 getPendingTaskCount() const
+	{
+		return m_pendingTaskCount.load();
+	}
 
-	Mutex m_mtx;
-	ConditionVariable m_condVar;
-	IntrusiveList<AsyncLoaderTask> m_taskQueue;
+private:
+	ResourceAllocator<U8> m_alloc;
+	DynamicArray<Thread*> m_threads;
+
+	Mutex m_mtx; ///< Protects the members bellow.
+	ConditionVariable m_condVar; ///< The workers wait on that for new tasks.
+	ConditionVariable m_taskDoneCondVar; ///< pause() and cancelTask() wait on that for the running tasks.
+	Array<IntrusiveList<AsyncLoaderTask>, U(AsyncLoaderTaskPriority::COUNT)> m_taskQueues;
+	U32 m_runningTaskCount = 0;
 	Bool8 m_quit = false;
 	Bool8 m_paused = false;
-	Bool8 m_sync = false;
 
 	Atomic<U64> m_completedTaskCount = {0};
+	Atomic<U32> m_pendingTaskCount = {0};
 
 	/// Thread callback
 	static ANKI_USE_RESULT Error threadCallback(ThreadCallbackInfo& info);
@@ -104,6 +173,15 @@ private:
 	Error threadWorker();
 
 	void stop();
+
+	/// Pick the first task of the highest priority. Needs to be called with the lock held.
+	AsyncLoaderTask* popTask();
+
+	/// Needs to be called with the lock held.
+	void pushTask(AsyncLoaderTask* task);
+
+	/// Clear the handle of a task that won't run again. Needs to be called with the lock held.
+	void detachHandle(AsyncLoaderTask* task);
 };
 /// @}
 
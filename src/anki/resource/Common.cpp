@@ -14,6 +14,9 @@ namespace anki
 template<typename T>
 void ResourcePtrDeleter<T>::operator()(T* ptr)
 {
+	// Don't let the loader touch a dead resource
+	ptr->getManager().getAsyncLoader().cancelTask(ptr->getAsyncLoadTaskHandle());
+
 	ptr->getManager().unregisterResource(ptr);
 	auto alloc = ptr->getAllocator();
 	alloc.deleteInstance(ptr);
@@ -78,8 +78,13 @@ using ResourcePtr = IntrusivePtr<T, ResourcePtrDeleter<T>>;
 #undef ANKI_INSTANTIATE_RESOURCE
 #undef ANKI_INSTANSIATE_RESOURCE_DELIMITER
 
+#if ANKI_TLSF_ALLOCATORS
+template<typename T>
+using ResourceAllocator = TlsfAllocator<T>;
+#else
 template<typename T>
 using ResourceAllocator = HeapAllocator<T>;
+#endif
 
 template<typename T>
 using TempResourceAllocator = StackAllocator<T>;
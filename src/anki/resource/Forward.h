@@ -13,6 +13,8 @@ namespace anki
 template<typename T>
 class AnimationKeyframe;
 
+class AnimationChannelCursor;
+
 class Bone;
 
 } // end namespace anki
@@ -317,6 +317,7 @@ static ANKI_USE_RESULT Error loadAnkiTexture(ResourceFilePtr file,
 	U32& depth,
 	U32& layerCount,
 	U8& toLoadMipCount,
+	U8& skippedMipCount,
 	ImageLoader::TextureType& textureType,
 	ImageLoader::ColorFormat& colorFormat)
 {
@@ -377,9 +378,6 @@ static ANKI_USE_RESULT Error loadAnkiTexture(ResourceFilePtr file,
 		return Error::USER_DATA;
 	}
 
-	width = header.m_width;
-	height = header.m_height;
-
 	// Check mip levels
 	U size = min(header.m_width, header.m_height);
 	U maxSize = max(header.m_width, header.m_height);
@@ -388,28 +386,30 @@ static ANKI_USE_RESULT Error loadAnkiTexture(ResourceFilePtr file,
 		maxSize = max<U>(maxSize, header.m_depthOrLayerCount);
 		size = min<U>(size, header.m_depthOrLayerCount);
 	}
-	toLoadMipCount = 0;
 	U tmpMipLevels = 0;
 	while(size >= 4) // The minimum size is 4x4
 	{
 		++tmpMipLevels;
-
-		if(maxSize <= maxTextureSize)
-		{
-			++toLoadMipCount;
-		}
-
 		size /= 2;
-		maxSize /= 2;
 	}
 
-	if(header.m_mipLevels > tmpMipLevels)
+	if(header.m_mipLevels == 0 || header.m_mipLevels > tmpMipLevels)
 	{
 		ANKI_RESOURCE_LOGE("Incorrect number of mip levels");
 		return Error::USER_DATA;
 	}
 
-	toLoadMipCount = min<U>(toLoadMipCount, header.m_mipLevels);
+	// Skip the mips that are bigger than the max texture size. Always load the last one
+	skippedMipCount = 0;
+	while(maxSize > maxTextureSize && skippedMipCount + 1u < header.m_mipLevels)
+	{
+		++skippedMipCount;
+		maxSize /= 2;
+	}
+
+	toLoadMipCount = header.m_mipLevels - skippedMipCount;
+	width = header.m_width >> skippedMipCount;
+	height = header.m_height >> skippedMipCount;
 
 	colorFormat = header.m_colorFormat;
 
@@ -426,7 +426,7 @@ static ANKI_USE_RESULT Error loadAnkiTexture(ResourceFilePtr file,
 		faceCount = 6;
 		break;
 	case ImageLoader::TextureType::_3D:
-		depth = header.m_depthOrLayerCount;
+		depth = header.m_depthOrLayerCount >> skippedMipCount;
 		layerCount = 1;
 		break;
 	case ImageLoader::TextureType::_2D_ARRAY:
@@ -496,15 +496,21 @@ static ANKI_USE_RESULT Error loadAnkiTexture(ResourceFilePtr file,
 					U dataSize = calcSurfaceSize(mipWidth, mipHeight, preferredCompression, header.m_colorFormat);
 
 					// Check if this mipmap can be skipped because of size
-					if(maxSize <= maxTextureSize)
+					if(mip >= skippedMipCount)
 					{
 						ImageLoader::Surface& surf = surfaces[index++];
 						surf.m_width = mipWidth;
 						surf.m_height = mipHeight;
 
-						surf.m_data.create(alloc, dataSize);
-
-						ANKI_CHECK(file->read(&surf.m_data[0], dataSize));
+						if(file->isMemoryMapped())
+						{
+							ANKI_CHECK(file->readDirect(dataSize, surf.m_mappedData));
+						}
+						else
+						{
+							surf.m_data.create(alloc, dataSize);
+							ANKI_CHECK(file->read(&surf.m_data[0], dataSize));
+						}
 					}
 					else
 					{
@@ -529,16 +535,22 @@ static ANKI_USE_RESULT Error loadAnkiTexture(ResourceFilePtr file,
 			U dataSize = calcVolumeSize(mipWidth, mipHeight, mipDepth, preferredCompression, header.m_colorFormat);
 
 			// Check if this mipmap can be skipped because of size
-			if(maxSize <= maxTextureSize)
+			if(mip >= skippedMipCount)
 			{
-				ImageLoader::Volume& vol = volumes[mip];
+				ImageLoader::Volume& vol = volumes[mip - skippedMipCount];
 				vol.m_width = mipWidth;
 				vol.m_height = mipHeight;
 				vol.m_depth = mipDepth;
 
-				vol.m_data.create(alloc, dataSize);
-
-				ANKI_CHECK(file->read(&vol.m_data[0], dataSize));
+				if(file->isMemoryMapped())
+				{
+					ANKI_CHECK(file->readDirect(dataSize, vol.m_mappedData));
+				}
+				else
+				{
+					vol.m_data.create(alloc, dataSize);
+					ANKI_CHECK(file->read(&vol.m_data[0], dataSize));
+				}
 			}
 			else
 			{
@@ -554,8 +566,33 @@ static ANKI_USE_RESULT Error loadAnkiTexture(ResourceFilePtr file,
 	return Error::NONE;
 }
 
+Error ImageLoader::peekTextureType(ResourceFilePtr file, const CString& filename, TextureType& type) const
+{
+	StringAuto ext(m_alloc);
+	getFilepathExtension(filename, ext);
+
+	if(ext == "ankitex")
+	{
+		AnkiTextureHeader header;
+		ANKI_CHECK(file->read(&header, sizeof(AnkiTextureHeader)));
+		ANKI_CHECK(file->seek(0, ResourceFile::SeekOrigin::BEGINNING));
+		type = header.m_type;
+	}
+	else
+	{
+		// The TGAs are always 2D. load() will complain about the rest
+		type = TextureType::_2D;
+	}
+
+	return Error::NONE;
+}
+
 Error ImageLoader::load(ResourceFilePtr file, const CString& filename, U32 maxTextureSize)
 {
+	// The loader can be reused
+	destroy();
+	m_skippedMipLevels = 0;
+
 	// get the extension
 	StringAuto ext(m_alloc);
 	getFilepathExtension(filename, ext);
@@ -617,8 +654,15 @@ Error ImageLoader::load(ResourceFilePtr file, const CString& filename, U32 maxTe
 			m_depth,
 			m_layerCount,
 			m_mipLevels,
+			m_skippedMipLevels,
 			m_textureType,
 			m_colorFormat));
+
+		// The surfaces may point to the file
+		if(file->isMemoryMapped())
+		{
+			m_file = file;
+		}
 	}
 	else
 	{
@@ -678,6 +722,7 @@ void ImageLoader::destroy()
 	}
 
 	m_volumes.destroy(m_alloc);
+	m_file.reset(nullptr);
 }
 
 } // end namespace anki
@@ -53,7 +53,13 @@ public:
 		U32 m_width;
 		U32 m_height;
 		U32 m_mipLevel;
-		DynamicArray<U8> m_data;
+		DynamicArray<U8> m_data; ///< The data if they were copied from the file.
+		ConstWeakArray<U8> m_mappedData; ///< The data if the file is memory mapped.
+
+		ConstWeakArray<U8> getData() const
+		{
+			return (m_mappedData.getSize()) ? m_mappedData : ConstWeakArray<U8>(m_data);
+		}
 	};
 
 	class Volume
@@ -63,7 +69,13 @@ public:
 		U32 m_height;
 		U32 m_depth;
 		U32 m_mipLevel;
-		DynamicArray<U8> m_data;
+		DynamicArray<U8> m_data; ///< The data if they were copied from the file.
+		ConstWeakArray<U8> m_mappedData; ///< The data if the file is memory mapped.
+
+		ConstWeakArray<U8> getData() const
+		{
+			return (m_mappedData.getSize()) ? m_mappedData : ConstWeakArray<U8>(m_data);
+		}
 	};
 
 	ImageLoader(GenericMemoryPoolAllocator<U8> alloc)
@@ -94,6 +106,12 @@ public:
 		return m_mipLevels;
 	}
 
+	/// Get the number of the first mip levels of the file that weren't loaded because of the maxTextureSize.
+	U getSkippedMipLevelsCount() const
+	{
+		return m_skippedMipLevels;
+	}
+
 	U getWidth() const
 	{
 		return m_width;
@@ -131,7 +149,11 @@ public:
 		return m_alloc;
 	}
 
-	/// Load an image file.
+	/// Read only the type of an image file. The file is rewound so it can be passed to load() after that.
+	ANKI_USE_RESULT Error peekTextureType(ResourceFilePtr file, const CString& filename, TextureType& type) const;
+
+	/// Load an image file. It can be called more than once.
+	/// @param maxTextureSize Skip the mip levels that are bigger than that. The last mip level is always loaded.
 	ANKI_USE_RESULT Error load(ResourceFilePtr file, const CString& filename, U32 maxTextureSize = MAX_U32);
 
 	Atomic<I32>& getRefcount()
@@ -148,8 +170,10 @@ private:
 	DynamicArray<Surface> m_surfaces;
 
 	DynamicArray<Volume> m_volumes;
+	ResourceFilePtr m_file; ///< Keeps the memory mapped file alive if the surfaces point to it.
 
 	U8 m_mipLevels = 0;
+	U8 m_skippedMipLevels = 0;
 	U32 m_width = 0;
 	U32 m_height = 0;
 	U32 m_depth = 0;
@@ -6,6 +6,7 @@
 #include <anki/resource/MaterialResource.h>
 #include <anki/resource/ResourceManager.h>
 #include <anki/misc/Xml.h>
+#include <anki/util/ThreadHive.h>
 
 namespace anki
 {
@@ -90,6 +91,11 @@ Error MaterialResource::load(const ResourceFilename& filename, Bool async)
 		ANKI_CHECK(parseInputs(el, async));
 	}
 
+	if(getManager().getPrecompileShaderVariants())
+	{
+		precompileVariants();
+	}
+
 	return Error::NONE;
 }
 
@@ -487,6 +493,9 @@ Error MaterialResource::parseInputs(XmlElement inputsEl, Bool async)
 					CString texfname;
 					ANKI_CHECK(inputEl.getAttributeText("value", texfname));
 					ANKI_CHECK(getManager().loadResource(texfname, mtlVar.m_tex, async));
+
+					// The renderer says which mips of the material textures are needed
+					mtlVar.m_tex->enableMipFeedback();
 					break;
 				}
 
@@ -533,9 +542,9 @@ const MaterialVariant& MaterialResource::getOrCreateVariant(const RenderingKey&
 
 	MaterialVariant& variant = m_variantMatrix[U(key.m_pass)][key.m_lod][getInstanceGroupIdx(key.m_instanceCount)]
 											  [key.m_skinned][key.m_velocity];
-	LockGuard<SpinLock> lock(m_variantMatrixMtx);
 
-	if(variant.m_variant == nullptr)
+	// No lock. Threads that race to create the same variant get the same pointer from the shader program resource
+	if(variant.m_variant.load(AtomicMemoryOrder::ACQUIRE) == nullptr)
 	{
 		const U mutatorCount = m_mutations.getSize() + ((m_instanceMutator) ? 1 : 0) + ((m_passMutator) ? 1 : 0)
 							   + ((m_lodMutator) ? 1 : 0) + ((m_bonesMutator) ? 1 : 0) + ((m_velocityMutator) ? 1 : 0);
@@ -583,16 +592,84 @@ const MaterialVariant& MaterialResource::getOrCreateVariant(const RenderingKey&
 			++count;
 		}
 
+		const ShaderProgramResourceVariant* progVariant;
 		m_prog->getOrCreateVariant(
 			ConstWeakArray<ShaderProgramResourceMutation>(mutations.getSize() ? &mutations[0] : nullptr, count),
 			ConstWeakArray<ShaderProgramResourceConstantValue>(
 				(m_constValues.getSize()) ? &m_constValues[0] : nullptr, m_constValues.getSize()),
-			variant.m_variant);
+			progVariant);
+
+		variant.m_variant.store(progVariant, AtomicMemoryOrder::RELEASE);
 	}
 
 	return variant;
 }
 
+void MaterialResource::precompileVariants()
+{
+	// Gather the keys the renderer might ask for
+	DynamicArrayAuto<RenderingKey> keys(getTempAllocator());
+
+	Array<Pass, U(Pass::COUNT)> passes;
+	U passCount = 0;
+	if(m_forwardShading)
+	{
+		passes[passCount++] = Pass::FS;
+	}
+	else
+	{
+		passes[passCount++] = Pass::GB;
+		passes[passCount++] = Pass::EZ;
+	}
+
+	if(m_shadow)
+	{
+		passes[passCount++] = Pass::SM;
+	}
+
+	const U instanceGroupCount = (isInstanced()) ? MAX_INSTANCE_GROUPS : 1;
+	const U skinnedCount = (m_bonesMutator) ? 2 : 1;
+	const U velocityCount = (m_velocityMutator) ? 2 : 1;
+
+	for(U p = 0; p < passCount; ++p)
+	{
+		for(U lod = 0; lod < m_lodCount; ++lod)
+		{
+			for(U instanceGroup = 0; instanceGroup < instanceGroupCount; ++instanceGroup)
+			{
+				for(U skinned = 0; skinned < skinnedCount; ++skinned)
+				{
+					for(U velocity = 0; velocity < velocityCount; ++velocity)
+					{
+						// Only the GBuffer pass writes velocity
+						if(velocity && passes[p] != Pass::GB)
+						{
+							continue;
+						}
+
+						keys.emplaceBack(passes[p], lod, 1 << instanceGroup, skinned != 0, velocity != 0);
+					}
+				}
+			}
+		}
+	}
+
+	// Create them. The hive is nullptr if the material is not loaded by the thread that owns the hive
+	ThreadHive* hive = getManager().getThreadHive();
+	if(hive && keys.getSize() > 1)
+	{
+		hive->parallelFor(0, keys.getSize(), 1, [&](U32 idx, U32 threadId) { getOrCreateVariant(keys[idx]); });
+		hive->waitAllTasks();
+	}
+	else
+	{
+		for(const RenderingKey& key : keys)
+		{
+			getOrCreateVariant(key);
+		}
+	}
+}
+
 U MaterialResource::getInstanceGroupIdx(U instanceCount)
 {
 	ANKI_ASSERT(instanceCount > 0);
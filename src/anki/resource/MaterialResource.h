@@ -151,29 +151,36 @@ public:
 
 	const ShaderProgramResourceVariant& getShaderProgramResourceVariant() const
 	{
-		ANKI_ASSERT(m_variant);
-		return *m_variant;
+		return *getVariant();
 	}
 
 	/// Return true of the the variable is active.
 	Bool variableActive(const MaterialVariable& var) const
 	{
 		ANKI_ASSERT(var.m_input);
-		return m_variant->variableActive(*var.m_input);
+		return getVariant()->variableActive(*var.m_input);
 	}
 
 	const ShaderProgramPtr& getShaderProgram() const
 	{
-		return m_variant->getProgram();
+		return getVariant()->getProgram();
 	}
 
 	U getUniformBlockSize() const
 	{
-		return m_variant->getUniformBlockSize();
+		return getVariant()->getUniformBlockSize();
 	}
 
 private:
-	const ShaderProgramResourceVariant* m_variant = nullptr;
+	/// It's set once and never changes after that so reading it doesn't need a lock.
+	Atomic<const ShaderProgramResourceVariant*> m_variant = {nullptr};
+
+	const ShaderProgramResourceVariant* getVariant() const
+	{
+		const ShaderProgramResourceVariant* variant = m_variant.load(AtomicMemoryOrder::ACQUIRE);
+		ANKI_ASSERT(variant);
+		return variant;
+	}
 };
 
 /// Material resource.
@@ -237,6 +244,8 @@ public:
 		return m_prog->isInstanced();
 	}
 
+	/// Get or create a variant. If the variant already exists the lookup is lock-free.
+	/// @note It's thread-safe.
 	const MaterialVariant& getOrCreateVariant(const RenderingKey& key) const;
 
 	const DynamicArray<MaterialVariable>& getVariables() const
@@ -270,9 +279,8 @@ private:
 
 	DynamicArray<ShaderProgramResourceMutation> m_mutations;
 
-	/// Matrix of variants.
+	/// Matrix of variants. The variants are created lazily or by precompileVariants().
 	mutable Array5d<MaterialVariant, U(Pass::COUNT), MAX_LOD_COUNT, MAX_INSTANCE_GROUPS, 2, 2> m_variantMatrix;
-	mutable SpinLock m_variantMatrixMtx;
 
 	DynamicArray<MaterialVariable> m_vars; ///< Non-const vars.
 	DynamicArray<ShaderProgramResourceConstantValue> m_constValues;
@@ -283,6 +291,10 @@ private:
 	ANKI_USE_RESULT Error parseInputs(XmlElement inputsEl, Bool async);
 
 	ANKI_USE_RESULT Error parseMutators(XmlElement mutatorsEl);
+
+	/// Create all the variants this material can be drawn with. They compile in parallel if the ResourceManager has a
+	/// ThreadHive.
+	void precompileVariants();
 };
 /// @}
 
@@ -164,7 +164,7 @@ Error MeshResource::load(const ResourceFilename& filename, Bool async)
 	// Submit the loading task
 	if(async)
 	{
-		getManager().getAsyncLoader().submitTask(task);
+		getManager().getAsyncLoader().submitTask(task, AsyncLoaderTaskPriority::MEDIUM, &getAsyncLoadTaskHandle());
 	}
 	else
 	{
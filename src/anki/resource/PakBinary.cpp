@@ -0,0 +1,124 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <anki/resource/PakBinary.h>
+#include <anki/util/File.h>
+#include <anki/util/Filesystem.h>
+#include <anki/util/StringList.h>
+
+namespace anki
+{
+
+/// Write some zeros.
+static ANKI_USE_RESULT Error writePadding(File& out, PtrSize size)
+{
+	const Array<U8, 256> zeros = {};
+	while(size > 0)
+	{
+		const PtrSize toWrite = min<PtrSize>(size, zeros.getSize());
+		ANKI_CHECK(out.write(&zeros[0], toWrite));
+		size -= toWrite;
+	}
+
+	return Error::NONE;
+}
+
+Error writePakArchive(GenericMemoryPoolAllocator<U8> alloc, CString inDir, CString outFilename)
+{
+	// Find the files
+	StringListAuto filenames(alloc);
+	ANKI_CHECK(walkDirectoryTree(inDir, &filenames, [](const CString& fname, void* ud, Bool isDir) -> Error {
+		if(!isDir)
+		{
+			static_cast<StringListAuto*>(ud)->pushBack(fname);
+		}
+
+		return Error::NONE;
+	}));
+
+	if(filenames.isEmpty())
+	{
+		ANKI_RESOURCE_LOGE("Directory is empty: %s", &inDir[0]);
+		return Error::USER_DATA;
+	}
+
+	filenames.sortAll();
+
+	// Compute the layout
+	PakBinaryFile::Header header = {};
+	memcpy(&header.m_magic[0], PakBinaryFile::MAGIC, sizeof(header.m_magic));
+	header.m_fileCount = 0;
+
+	DynamicArrayAuto<PakBinaryFile::Entry> entries(alloc);
+	for(const String& fname : filenames)
+	{
+		PakBinaryFile::Entry entry = {};
+		entry.m_filenameOffset = header.m_filenamesSize;
+		entry.m_filenameLength = fname.getLength();
+		header.m_filenamesSize += entry.m_filenameLength + 1;
+		entries.emplaceBack(entry);
+		++header.m_fileCount;
+	}
+
+	const PtrSize dataBegin = sizeof(header) + entries.getSizeInBytes() + header.m_filenamesSize;
+	PtrSize offset = dataBegin;
+	U32 count = 0;
+	StringAuto path(alloc);
+	for(const String& fname : filenames)
+	{
+		path.destroy();
+		path.sprintf("%s/%s", &inDir[0], &fname[0]);
+
+		File in;
+		ANKI_CHECK(in.open(path.toCString(), FileOpenFlag::READ | FileOpenFlag::BINARY));
+
+		PakBinaryFile::Entry& entry = entries[count++];
+		entry.m_dataSize = in.getSize();
+		entry.m_dataOffset = PakBinaryFile::alignDataOffset(offset, entry.m_dataSize);
+		offset = entry.m_dataOffset + entry.m_dataSize;
+	}
+
+	// Write the header, the entries and the filenames
+	File out;
+	ANKI_CHECK(out.open(outFilename, FileOpenFlag::WRITE | FileOpenFlag::BINARY));
+	ANKI_CHECK(out.write(&header, sizeof(header)));
+	ANKI_CHECK(out.write(&entries[0], entries.getSizeInBytes()));
+
+	for(const String& fname : filenames)
+	{
+		ANKI_CHECK(out.write(&fname[0], fname.getLength() + 1));
+	}
+
+	// Write the data
+	offset = dataBegin;
+	count = 0;
+	DynamicArrayAuto<U8> data(alloc);
+	for(const String& fname : filenames)
+	{
+		const PakBinaryFile::Entry& entry = entries[count++];
+		ANKI_CHECK(writePadding(out, entry.m_dataOffset - offset));
+
+		if(entry.m_dataSize > 0)
+		{
+			path.destroy();
+			path.sprintf("%s/%s", &inDir[0], &fname[0]);
+
+			File in;
+			ANKI_CHECK(in.open(path.toCString(), FileOpenFlag::READ | FileOpenFlag::BINARY));
+
+			data.resize(entry.m_dataSize);
+			ANKI_CHECK(in.read(&data[0], data.getSize()));
+			ANKI_CHECK(out.write(&data[0], data.getSize()));
+		}
+
+		offset = entry.m_dataOffset + entry.m_dataSize;
+	}
+
+	ANKI_RESOURCE_LOGI(
+		"Packed %u files to %s. The archive is %uKB", header.m_fileCount, &outFilename[0], U32(offset / 1024));
+	return Error::NONE;
+}
+
+} // end namespace anki
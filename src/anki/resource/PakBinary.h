@@ -0,0 +1,60 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#pragma once
+
+#include <anki/resource/Common.h>
+#include <anki/util/Functions.h>
+
+namespace anki
+{
+
+/// @addtogroup resource
+/// @{
+
+/// Information to decode .ankipak archives.
+///
+/// The file is a Header, followed by Header::m_fileCount Entries, followed by the null terminated filenames, followed
+/// by the data of the files. The data are not compressed so the archive can be mapped in memory and the files can be
+/// used in place. The data of every file start at an offset aligned to DATA_ALIGNMENT. The files that are bigger than
+/// a page start at a page boundary so they don't share pages with other files.
+class PakBinaryFile
+{
+public:
+	static constexpr const char* MAGIC = "ANKIPAK1";
+
+	static const U32 PAGE_SIZE = 4096;
+	static const U32 DATA_ALIGNMENT = 16;
+
+	struct Entry
+	{
+		U64 m_dataOffset; ///< Offset of the data from the beginning of the archive.
+		U64 m_dataSize;
+		U32 m_filenameOffset; ///< Offset of the filename from the beginning of the filenames.
+		U32 m_filenameLength; ///< Without the null terminator.
+	};
+
+	struct Header
+	{
+		char m_magic[8]; ///< Magic word.
+		U32 m_fileCount;
+		U32 m_filenamesSize; ///< The size of all the filenames including their null terminators.
+	};
+
+	/// Get the offset where the data of a file should start.
+	/// @param offset The first free offset of the archive.
+	/// @param dataSize The size of the file.
+	static PtrSize alignDataOffset(PtrSize offset, PtrSize dataSize)
+	{
+		return getAlignedRoundUp((dataSize >= PAGE_SIZE) ? PAGE_SIZE : DATA_ALIGNMENT, offset);
+	}
+};
+
+/// Pack all the files of a directory to an .ankipak archive. The filenames in the archive are relative to the
+/// directory and they are sorted so the archive is the same every time.
+ANKI_USE_RESULT Error writePakArchive(GenericMemoryPoolAllocator<U8> alloc, CString inDir, CString outFilename);
+/// @}
+
+} // end namespace anki
@@ -4,9 +4,11 @@
 // http://www.anki3d.org/LICENSE
 
 #include <anki/resource/ResourceFilesystem.h>
+#include <anki/resource/PakBinary.h>
 #include <anki/util/Filesystem.h>
 #include <anki/misc/ConfigSet.h>
 #include <anki/core/Trace.h>
+#include <anki/util/Hash.h>
 #include <contrib/minizip/unzip.h>
 
 namespace anki
@@ -58,11 +60,77 @@ public:
 	}
 };
 
+/// An archive that stays open. It keeps the minizip handles that the files are done with so the next files don't have
+/// to open the archive and parse its central directory again. It's owned by ResourceFilesystem::Path.
+class ResourceFilesystem::ZipArchive
+{
+public:
+	GenericMemoryPoolAllocator<U8> m_alloc;
+	String m_path;
+	DynamicArray<unzFile> m_freeHandles;
+	U32 m_acquiredHandleCount = 0; ///< The handles of the open files. Used to catch files that outlive the archive.
+	Mutex m_mtx; ///< Protects m_freeHandles and m_acquiredHandleCount.
+
+	ZipArchive(GenericMemoryPoolAllocator<U8> alloc)
+		: m_alloc(alloc)
+	{
+	}
+
+	~ZipArchive()
+	{
+		ANKI_ASSERT(m_acquiredHandleCount == 0 && "Some ZipResourceFile outlived the ResourceFilesystem");
+
+		for(unzFile handle : m_freeHandles)
+		{
+			unzClose(handle);
+		}
+
+		m_freeHandles.destroy(m_alloc);
+		m_path.destroy(m_alloc);
+	}
+
+	/// Get a handle that no-one else uses.
+	unzFile acquireHandle()
+	{
+		{
+			LockGuard<Mutex> lock(m_mtx);
+			if(m_freeHandles.getSize() > 0)
+			{
+				unzFile handle = m_freeHandles.getBack();
+				m_freeHandles.resize(m_alloc, m_freeHandles.getSize() - 1);
+				++m_acquiredHandleCount;
+				return handle;
+			}
+		}
+
+		unzFile handle = unzOpen(&m_path[0]);
+		if(handle)
+		{
+			LockGuard<Mutex> lock(m_mtx);
+			++m_acquiredHandleCount;
+		}
+
+		return handle;
+	}
+
+	/// Give back a handle of acquireHandle().
+	void releaseHandle(unzFile handle)
+	{
+		ANKI_ASSERT(handle);
+		LockGuard<Mutex> lock(m_mtx);
+		ANKI_ASSERT(m_acquiredHandleCount > 0);
+		--m_acquiredHandleCount;
+		m_freeHandles.emplaceBack(m_alloc, handle);
+	}
+};
+
 /// ZIP file
 class ZipResourceFile final : public ResourceFile
 {
 public:
-	unzFile m_archive = nullptr;
+	/// The archive of the file. It's owned by the ResourceFilesystem so the file shouldn't outlive it.
+	ResourceFilesystem::ZipArchive* m_zip = nullptr;
+	unzFile m_archive = nullptr; ///< A handle acquired from m_zip.
 	PtrSize m_size = 0;
 
 	ZipResourceFile(GenericMemoryPoolAllocator<U8> alloc)
@@ -74,26 +142,30 @@ public:
 	{
 		if(m_archive)
 		{
-			// It's open
-			unzClose(m_archive);
+			// It's open, give it back to the archive
+			unzCloseCurrentFile(m_archive);
+			m_zip->releaseHandle(m_archive);
 			m_archive = nullptr;
 			m_size = 0;
 		}
 	}
 
-	ANKI_USE_RESULT Error open(const CString& archive, const CString& archivedFname)
+	ANKI_USE_RESULT Error open(ResourceFilesystem::ZipArchive& zip, PtrSize archivePos, PtrSize archiveFileIdx)
 	{
-		// Open archive
-		m_archive = unzOpen(&archive[0]);
+		// Get a handle of the archive
+		m_zip = &zip;
+		m_archive = zip.acquireHandle();
 		if(m_archive == nullptr)
 		{
 			ANKI_RESOURCE_LOGE("Failed to open archive");
 			return Error::FILE_ACCESS;
 		}
 
-		// Locate archived
-		const int caseSensitive = 1;
-		if(unzLocateFile(m_archive, &archivedFname[0], caseSensitive) != UNZ_OK)
+		// Go to the archived file. The position came from the central directory when the archive was added
+		unz_file_pos pos;
+		pos.pos_in_zip_directory = archivePos;
+		pos.num_of_file = archiveFileIdx;
+		if(unzGoToFilePos(m_archive, &pos) != UNZ_OK)
 		{
 			ANKI_RESOURCE_LOGE("Failed to locate file in archive");
 			return Error::FILE_ACCESS;
@@ -116,16 +188,6 @@ public:
 		return Error::NONE;
 	}
 
-	void close()
-	{
-		if(m_archive)
-		{
-			unzClose(m_archive);
-			m_archive = nullptr;
-			m_size = 0;
-		}
-	}
-
 	ANKI_USE_RESULT Error read(void* buff, PtrSize size) override
 	{
 		ANKI_TRACE_SCOPED_EVENT(RSRC_FILE_READ);
@@ -193,18 +255,111 @@ public:
 	}
 };
 
+/// A file of a memory mapped .ankipak.
+class PakResourceFile final : public ResourceFile
+{
+public:
+	const U8* m_data = nullptr; ///< Points to the mapping of the ResourceFilesystem so the file shouldn't outlive it.
+	PtrSize m_size = 0;
+	PtrSize m_pos = 0;
+
+	PakResourceFile(GenericMemoryPoolAllocator<U8> alloc)
+		: ResourceFile(alloc)
+	{
+	}
+
+	ANKI_USE_RESULT Error read(void* buff, PtrSize size) override
+	{
+		ConstWeakArray<U8> data;
+		ANKI_CHECK(readDirect(size, data));
+		if(size)
+		{
+			ANKI_TRACE_SCOPED_EVENT(RSRC_FILE_READ);
+			memcpy(buff, &data[0], size);
+		}
+
+		return Error::NONE;
+	}
+
+	ANKI_USE_RESULT Error readAllText(GenericMemoryPoolAllocator<U8> alloc, String& out) override
+	{
+		ANKI_ASSERT(m_size);
+		out.create(alloc, '?', m_size);
+		m_pos = 0;
+		return read(&out[0], m_size);
+	}
+
+	ANKI_USE_RESULT Error readU32(U32& u) override
+	{
+		// Assume machine and file have same endianness
+		return read(&u, sizeof(u));
+	}
+
+	ANKI_USE_RESULT Error readF32(F32& f) override
+	{
+		// Assume machine and file have same endianness
+		return read(&f, sizeof(f));
+	}
+
+	ANKI_USE_RESULT Error seek(PtrSize offset, SeekOrigin origin) override
+	{
+		const PtrSize base = (origin == SeekOrigin::BEGINNING) ? 0 : ((origin == SeekOrigin::CURRENT) ? m_pos : m_size);
+		if(base + offset > m_size)
+		{
+			ANKI_RESOURCE_LOGE("Seeking past the end of the file");
+			return Error::FUNCTION_FAILED;
+		}
+
+		m_pos = base + offset;
+		return Error::NONE;
+	}
+
+	PtrSize getSize() const override
+	{
+		return m_size;
+	}
+
+	Bool isMemoryMapped() const override
+	{
+		return true;
+	}
+
+	ANKI_USE_RESULT Error readDirect(PtrSize size, ConstWeakArray<U8>& out) override
+	{
+		if(m_pos + size > m_size)
+		{
+			ANKI_RESOURCE_LOGE("File read failed");
+			return Error::FILE_ACCESS;
+		}
+
+		out = ConstWeakArray<U8>(m_data + m_pos, size);
+		m_pos += size;
+		return Error::NONE;
+	}
+};
+
 ResourceFilesystem::~ResourceFilesystem()
 {
 	for(Path& p : m_paths)
 	{
-		p.m_files.destroy(m_alloc);
-		p.m_path.destroy(m_alloc);
+		destroyPath(p);
 	}
 
 	m_paths.destroy(m_alloc);
+	m_fileIndex.destroy(m_alloc);
 	m_cacheDir.destroy(m_alloc);
 }
 
+void ResourceFilesystem::destroyPath(Path& p)
+{
+	p.m_files.destroy(m_alloc);
+	p.m_path.destroy(m_alloc);
+	m_alloc.deleteInstance(p.m_archive);
+	p.m_archive = nullptr;
+	m_alloc.deleteInstance(p.m_pak);
+	p.m_pak = nullptr;
+}
+
 Error ResourceFilesystem::init(const ConfigSet& config, const CString& cacheDir)
 {
 	StringListAuto paths(m_alloc);
@@ -235,98 +390,274 @@ void ResourceFilesystem::addCachePath(const CString& path)
 	m_paths.emplaceBack(m_alloc, std::move(p));
 }
 
-Error ResourceFilesystem::addNewPath(const CString& path)
+Error ResourceFilesystem::checkNewFiles(const DynamicArrayAuto<FileEntry>& entries) const
 {
-	U fileCount = 0;
-	static const CString extension(".ankizip");
-
-	auto pos = path.find(extension);
-	if(pos != CString::NPOS && pos == path.getLength() - extension.getLength())
+	class HashedFile
 	{
-		// It's an archive
+	public:
+		U64 m_hash;
+		const String* m_filename;
+	};
+
+	DynamicArrayAuto<HashedFile> files(m_alloc);
+	files.create(entries.getSize());
+	for(U32 i = 0; i < entries.getSize(); ++i)
+	{
+		const CString filename = entries[i].m_filename->toCString();
+		files[i].m_hash = computeHash(&filename[0], filename.getLength());
+		files[i].m_filename = entries[i].m_filename;
+	}
 
-		// Open
-		unzFile zfile = unzOpen(&path[0]);
-		if(!zfile)
+	// Against the other files of the new path
+	std::sort(files.getBegin(), files.getEnd(), [](const HashedFile& a, const HashedFile& b) {
+		return a.m_hash < b.m_hash;
+	});
+
+	for(U32 i = 1; i < files.getSize(); ++i)
+	{
+		if(files[i - 1].m_hash == files[i].m_hash && !(*files[i - 1].m_filename == *files[i].m_filename))
 		{
-			ANKI_RESOURCE_LOGE("Failed to open archive");
-			return Error::FILE_ACCESS;
+			ANKI_RESOURCE_LOGE("The hashes of 2 filenames collide: %s and %s",
+				&files[i - 1].m_filename->toCString()[0],
+				&files[i].m_filename->toCString()[0]);
+			return Error::USER_DATA;
 		}
+	}
 
-		// List files
-		if(unzGoToFirstFile(zfile) != UNZ_OK)
+	// Against the files of the older paths. The same filename is fine, the new path will hide the old file
+	for(const HashedFile& file : files)
+	{
+		auto it = m_fileIndex.find(file.m_hash);
+		if(it != m_fileIndex.getEnd() && !(*it->m_filename == *file.m_filename))
 		{
-			unzClose(zfile);
-			ANKI_RESOURCE_LOGE("unzGoToFirstFile() failed. Empty archive?");
-			return Error::FILE_ACCESS;
+			ANKI_RESOURCE_LOGE("The hashes of 2 filenames collide: %s and %s",
+				&file.m_filename->toCString()[0],
+				&it->m_filename->toCString()[0]);
+			return Error::USER_DATA;
 		}
+	}
+
+	return Error::NONE;
+}
+
+void ResourceFilesystem::indexFile(const FileEntry& entry)
+{
+	const CString filename = entry.m_filename->toCString();
+	const U64 hash = computeHash(&filename[0], filename.getLength());
+
+	auto it = m_fileIndex.find(hash);
+	if(it == m_fileIndex.getEnd())
+	{
+		m_fileIndex.emplace(m_alloc, hash, entry);
+	}
+	else
+	{
+		// The newest path hides the file of the older. Collisions were rejected by checkNewFiles()
+		ANKI_ASSERT(*it->m_filename == filename);
+		*it = entry;
+	}
+}
+
+Error ResourceFilesystem::loadPak(const CString& path, Path& p, DynamicArrayAuto<FileEntry>& entries)
+{
+	p.m_isArchive = true;
+	p.m_pak = m_alloc.newInstance<MemoryMappedFile>();
+
+	// Map it and check the header
+	MemoryMappedFile& pak = *p.m_pak;
+	ANKI_CHECK(pak.map(path));
+
+	PakBinaryFile::Header header;
+	if(pak.getSize() < sizeof(header))
+	{
+		ANKI_RESOURCE_LOGE("Archive is too small: %s", &path[0]);
+		return Error::USER_DATA;
+	}
 
-		Path p;
-		p.m_isArchive = true;
-		p.m_path.sprintf(m_alloc, "%s", &path[0]);
+	memcpy(&header, pak.getData(), sizeof(header));
+	if(memcmp(&header.m_magic[0], PakBinaryFile::MAGIC, sizeof(header.m_magic)) != 0)
+	{
+		ANKI_RESOURCE_LOGE("Wrong magic word: %s", &path[0]);
+		return Error::USER_DATA;
+	}
+
+	const PtrSize filenamesOffset = sizeof(header) + sizeof(PakBinaryFile::Entry) * PtrSize(header.m_fileCount);
+	if(filenamesOffset + header.m_filenamesSize > pak.getSize() || header.m_filenamesSize == 0
+		|| pak.getData()[filenamesOffset + header.m_filenamesSize - 1] != '\0')
+	{
+		ANKI_RESOURCE_LOGE("Archive is corrupted: %s", &path[0]);
+		return Error::USER_DATA;
+	}
 
-		do
+	// Add the files
+	const PakBinaryFile::Entry* pakEntries =
+		reinterpret_cast<const PakBinaryFile::Entry*>(pak.getData() + sizeof(header));
+	const char* filenames = reinterpret_cast<const char*>(pak.getData() + filenamesOffset);
+	for(U32 i = 0; i < header.m_fileCount; ++i)
+	{
+		const PakBinaryFile::Entry& in = pakEntries[i];
+		if(PtrSize(in.m_filenameOffset) + in.m_filenameLength >= header.m_filenamesSize
+			|| in.m_dataOffset + in.m_dataSize > pak.getSize())
 		{
-			Array<char, 1024> filename;
+			ANKI_RESOURCE_LOGE("Archive is corrupted: %s", &path[0]);
+			return Error::USER_DATA;
+		}
 
-			unz_file_info info;
-			if(unzGetCurrentFileInfo(zfile, &info, &filename[0], filename.getSize(), nullptr, 0, nullptr, 0) != UNZ_OK)
-			{
-				unzClose(zfile);
-				ANKI_RESOURCE_LOGE("unzGetCurrentFileInfo() failed");
-				return Error::FILE_ACCESS;
-			}
+		p.m_files.pushBack(m_alloc, CString(filenames + in.m_filenameOffset));
 
-			// If compressed size is zero then it's a dir
-			if(info.uncompressed_size > 0)
-			{
-				p.m_files.pushBackSprintf(m_alloc, "%s", &filename[0]);
-				++fileCount;
-			}
-		} while(unzGoToNextFile(zfile) == UNZ_OK);
+		FileEntry entry;
+		entry.m_filename = &p.m_files.getBack();
+		entry.m_pakOffset = in.m_dataOffset;
+		entry.m_pakSize = in.m_dataSize;
+		entries.emplaceBack(entry);
+	}
 
-		m_paths.emplaceFront(m_alloc, std::move(p));
-		unzClose(zfile);
+	return Error::NONE;
+}
+
+Error ResourceFilesystem::loadZip(const CString& path, Path& p, DynamicArrayAuto<FileEntry>& entries)
+{
+	p.m_isArchive = true;
+
+	// Open
+	unzFile zfile = unzOpen(&path[0]);
+	if(!zfile)
+	{
+		ANKI_RESOURCE_LOGE("Failed to open archive");
+		return Error::FILE_ACCESS;
 	}
-	else
+
+	// Keep the archive open from now on. The files will reuse the handle that lists them and the archive will close it
+	// if something fails
+	p.m_archive = m_alloc.newInstance<ZipArchive>(m_alloc);
+	p.m_archive->m_path.create(m_alloc, path);
+	p.m_archive->m_freeHandles.emplaceBack(m_alloc, zfile);
+
+	// List files
+	if(unzGoToFirstFile(zfile) != UNZ_OK)
 	{
-		// It's simple directory
+		ANKI_RESOURCE_LOGE("unzGoToFirstFile() failed. Empty archive?");
+		return Error::FILE_ACCESS;
+	}
 
-		m_paths.emplaceFront(m_alloc, Path());
-		Path& p = m_paths.getFront();
-		p.m_path.sprintf(m_alloc, "%s", &path[0]);
-		p.m_isArchive = false;
+	do
+	{
+		Array<char, 1024> filename;
 
-		struct UserData
+		unz_file_info info;
+		if(unzGetCurrentFileInfo(zfile, &info, &filename[0], filename.getSize(), nullptr, 0, nullptr, 0) != UNZ_OK)
 		{
-			ResourceFilesystem* m_sys;
-			U* m_fileCount;
-		} ud{this, &fileCount};
+			ANKI_RESOURCE_LOGE("unzGetCurrentFileInfo() failed");
+			return Error::FILE_ACCESS;
+		}
 
-		ANKI_CHECK(walkDirectoryTree(path, &ud, [](const CString& fname, void* ud, Bool isDir) -> Error {
-			if(isDir)
+		// If compressed size is zero then it's a dir
+		if(info.uncompressed_size > 0)
+		{
+			unz_file_pos filePos;
+			if(unzGetFilePos(zfile, &filePos) != UNZ_OK)
 			{
-				return Error::NONE;
+				ANKI_RESOURCE_LOGE("unzGetFilePos() failed");
+				return Error::FILE_ACCESS;
 			}
 
-			UserData* udd = static_cast<UserData*>(ud);
-			ResourceFilesystem* self = udd->m_sys;
+			p.m_files.pushBackSprintf(m_alloc, "%s", &filename[0]);
 
-			Path& p = self->m_paths.getFront();
-			p.m_files.pushBackSprintf(self->m_alloc, "%s", &fname[0]);
+			FileEntry entry;
+			entry.m_filename = &p.m_files.getBack();
+			entry.m_archivePos = filePos.pos_in_zip_directory;
+			entry.m_archiveFileIdx = filePos.num_of_file;
+			entries.emplaceBack(entry);
+		}
+	} while(unzGoToNextFile(zfile) == UNZ_OK);
 
-			++(*udd->m_fileCount);
-			return Error::NONE;
-		}));
+	return Error::NONE;
+}
+
+Error ResourceFilesystem::loadDirectory(const CString& path, Path& p, DynamicArrayAuto<FileEntry>& entries)
+{
+	p.m_isArchive = false;
+
+	struct UserData
+	{
+		ResourceFilesystem* m_sys;
+		Path* m_path;
+	} ud{this, &p};
 
-		if(p.m_files.getSize() < 1)
+	ANKI_CHECK(walkDirectoryTree(path, &ud, [](const CString& fname, void* ud, Bool isDir) -> Error {
+		if(isDir)
 		{
-			ANKI_RESOURCE_LOGE("Directory is empty: %s", &path[0]);
-			return Error::USER_DATA;
+			return Error::NONE;
 		}
+
+		UserData* udd = static_cast<UserData*>(ud);
+		udd->m_path->m_files.pushBackSprintf(udd->m_sys->m_alloc, "%s", &fname[0]);
+		return Error::NONE;
+	}));
+
+	if(p.m_files.getSize() < 1)
+	{
+		ANKI_RESOURCE_LOGE("Directory is empty: %s", &path[0]);
+		return Error::USER_DATA;
+	}
+
+	for(const String& fname : p.m_files)
+	{
+		FileEntry entry;
+		entry.m_filename = &fname;
+		entries.emplaceBack(entry);
+	}
+
+	return Error::NONE;
+}
+
+Error ResourceFilesystem::addNewPath(const CString& path)
+{
+	static const CString extension(".ankizip");
+	static const CString pakExtension(".ankipak");
+
+	// Build the path and its files on the side. Nothing is published to m_paths and m_fileIndex until it's complete
+	Path p;
+	p.m_path.sprintf(m_alloc, "%s", &path[0]);
+	DynamicArrayAuto<FileEntry> entries(m_alloc);
+
+	Error err = Error::NONE;
+	auto pos = path.find(extension);
+	auto pakPos = path.find(pakExtension);
+	if(pakPos != CString::NPOS && pakPos == path.getLength() - pakExtension.getLength())
+	{
+		err = loadPak(path, p, entries);
+	}
+	else if(pos != CString::NPOS && pos == path.getLength() - extension.getLength())
+	{
+		err = loadZip(path, p, entries);
+	}
+	else
+	{
+		err = loadDirectory(path, p, entries);
 	}
 
-	ANKI_RESOURCE_LOGI("Added new data path \"%s\" that contains %u files", &path[0], fileCount);
+	if(!err)
+	{
+		err = checkNewFiles(entries);
+	}
+
+	if(err)
+	{
+		destroyPath(p);
+		return err;
+	}
+
+	// Publish. The moved list keeps its nodes so the filenames of the entries stay valid
+	m_paths.emplaceFront(m_alloc, std::move(p));
+	Path& newPath = m_paths.getFront();
+	for(FileEntry& entry : entries)
+	{
+		entry.m_path = &newPath;
+		indexFile(entry);
+	}
+
+	ANKI_RESOURCE_LOGI("Added new data path \"%s\" that contains %u files", &path[0], entries.getSize());
 	return Error::NONE;
 }
 
@@ -335,66 +666,66 @@ Error ResourceFilesystem::openFile(const ResourceFilename& filename, ResourceFil
 	ResourceFile* rfile = nullptr;
 	Error err = Error::NONE;
 
-	// Search for the fname in reverse order
-	for(const Path& p : m_paths)
+	// Search the data paths and the archives
+	auto it = m_fileIndex.find(computeHash(&filename[0], filename.getLength()));
+	if(it != m_fileIndex.getEnd() && *it->m_filename == filename)
 	{
-		// Check if it's cache
-		if(p.m_isCache)
+		const FileEntry& entry = *it;
+		if(entry.m_path->m_pak)
 		{
-			StringAuto newFname(m_alloc);
-			newFname.sprintf("%s/%s", &p.m_path[0], &filename[0]);
-
-			if(fileExists(newFname.toCString()))
-			{
-				// In cache
+			PakResourceFile* file = m_alloc.newInstance<PakResourceFile>(m_alloc);
+			rfile = file;
 
-				CResourceFile* file = m_alloc.newInstance<CResourceFile>(m_alloc);
-				rfile = file;
+			file->m_data = entry.m_path->m_pak->getData() + entry.m_pakOffset;
+			file->m_size = entry.m_pakSize;
+		}
+		else if(entry.m_path->m_isArchive)
+		{
+			ZipResourceFile* file = m_alloc.newInstance<ZipResourceFile>(m_alloc);
+			rfile = file;
 
-				err = file->m_file.open(&newFname[0], FileOpenFlag::READ);
-			}
+			err = file->open(*entry.m_path->m_archive, entry.m_archivePos, entry.m_archiveFileIdx);
 		}
 		else
 		{
-			// In data path or archive
-
-			for(const String& pfname : p.m_files)
-			{
-				if(pfname != filename)
-				{
-					continue;
-				}
-
-				// Found
-				if(p.m_isArchive)
-				{
-					ZipResourceFile* file = m_alloc.newInstance<ZipResourceFile>(m_alloc);
-					rfile = file;
-
-					err = file->open(p.m_path.toCString(), filename);
-				}
-				else
-				{
-					StringAuto newFname(m_alloc);
-					newFname.sprintf("%s/%s", &p.m_path[0], &filename[0]);
+			StringAuto newFname(m_alloc);
+			newFname.sprintf("%s/%s", &entry.m_path->m_path[0], &filename[0]);
 
-					CResourceFile* file = m_alloc.newInstance<CResourceFile>(m_alloc);
-					rfile = file;
+			CResourceFile* file = m_alloc.newInstance<CResourceFile>(m_alloc);
+			rfile = file;
 
-					err = file->m_file.open(&newFname[0], FileOpenFlag::READ);
+			err = file->m_file.open(&newFname[0], FileOpenFlag::READ);
 
 #if 0
-					printf("Opening asset %s\n", &newFname[0]);
+			printf("Opening asset %s\n", &newFname[0]);
 #endif
-				}
+		}
+	}
+	else
+	{
+		// Search the cache
+		for(const Path& p : m_paths)
+		{
+			if(!p.m_isCache)
+			{
+				continue;
 			}
-		} // end if cache
 
-		if(rfile)
-		{
-			break;
+			StringAuto newFname(m_alloc);
+			newFname.sprintf("%s/%s", &p.m_path[0], &filename[0]);
+
+			if(fileExists(newFname.toCString()))
+			{
+				// In cache
+
+				CResourceFile* file = m_alloc.newInstance<CResourceFile>(m_alloc);
+				rfile = file;
+
+				err = file->m_file.open(&newFname[0], FileOpenFlag::READ);
+				break;
+			}
 		}
-	} // end for all paths
+	}
 
 	if(err)
 	{
@@ -10,12 +10,16 @@
 #include <anki/util/StringList.h>
 #include <anki/util/File.h>
 #include <anki/util/Ptr.h>
+#include <anki/util/HashMap.h>
+#include <anki/util/WeakArray.h>
 
 namespace anki
 {
 
 // Forward
 class ConfigSet;
+class ZipResourceFile;
+class MemoryMappedFile;
 
 /// @addtogroup resource
 /// @{
@@ -55,6 +59,22 @@ public:
 	/// Get the size of the file.
 	virtual PtrSize getSize() const = 0;
 
+	/// Check if the file is in memory and readDirect() can be used.
+	virtual Bool isMemoryMapped() const
+	{
+		return false;
+	}
+
+	/// Get a pointer to the next bytes of a memory mapped file instead of copying them. It advances the position like
+	/// read() does. The memory is valid as long as the file is alive.
+	/// @param size The number of bytes.
+	/// @param[out] out Points to the data of the file.
+	virtual ANKI_USE_RESULT Error readDirect(PtrSize size, ConstWeakArray<U8>& out)
+	{
+		ANKI_ASSERT(0 && "The file is not memory mapped");
+		return Error::FUNCTION_FAILED;
+	}
+
 	Atomic<I32>& getRefcount()
 	{
 		return m_refcount;
@@ -76,6 +96,8 @@ using ResourceFilePtr = IntrusivePtr<ResourceFile>;
 /// Resource filesystem.
 class ResourceFilesystem : public NonCopyable
 {
+	friend class ZipResourceFile;
+
 public:
 	ResourceFilesystem(GenericMemoryPoolAllocator<U8> alloc)
 		: m_alloc(alloc)
@@ -86,17 +108,24 @@ public:
 
 	ANKI_USE_RESULT Error init(const ConfigSet& config, const CString& cacheDir);
 
-	/// Search the path list to find the file. Then open the file for reading. It's thread-safe.
+	/// Find the file in the index of the data paths or in the cache. Then open the file for reading. It's thread-safe.
 	ANKI_USE_RESULT Error openFile(const ResourceFilename& filename, ResourceFilePtr& file);
 
 #if !ANKI_TESTS
 private:
 #endif
+	class ZipArchive;
+
 	class Path : public NonCopyable
 	{
 	public:
 		StringList m_files; ///< Files inside the directory.
 		String m_path; ///< A directory or an archive.
+		/// The open archive if the path is a zip archive. The path owns it and the ZipResourceFiles borrow it so they
+		/// shouldn't outlive the ResourceFilesystem.
+		ZipArchive* m_archive = nullptr;
+		/// The mapped archive if the path is a pak. Owned like m_archive.
+		MemoryMappedFile* m_pak = nullptr;
 		Bool8 m_isArchive = false;
 		Bool8 m_isCache = false;
 
@@ -105,29 +134,73 @@ private:
 		Path(Path&& b)
 			: m_files(std::move(b.m_files))
 			, m_path(std::move(b.m_path))
+			, m_archive(b.m_archive)
+			, m_pak(b.m_pak)
 			, m_isArchive(std::move(b.m_isArchive))
 			, m_isCache(std::move(b.m_isCache))
 		{
+			b.m_archive = nullptr;
+			b.m_pak = nullptr;
 		}
 
 		Path& operator=(Path&& b)
 		{
+			ANKI_ASSERT(m_archive == nullptr && m_pak == nullptr);
 			m_files = std::move(b.m_files);
 			m_path = std::move(b.m_path);
+			m_archive = b.m_archive;
+			b.m_archive = nullptr;
+			m_pak = b.m_pak;
+			b.m_pak = nullptr;
 			m_isArchive = std::move(b.m_isArchive);
 			m_isCache = std::move(b.m_isCache);
 			return *this;
 		}
 	};
 
+	/// A file of a directory or an archive.
+	class FileEntry
+	{
+	public:
+		Path* m_path = nullptr;
+		const String* m_filename = nullptr; ///< Points to Path::m_files.
+
+		/// The position of the file in the central directory of the archive. Only for zip archives.
+		PtrSize m_archivePos = 0;
+		PtrSize m_archiveFileIdx = 0;
+
+		/// Where the file is in the mapping. Only for paks.
+		PtrSize m_pakOffset = 0;
+		PtrSize m_pakSize = 0;
+	};
+
 	GenericMemoryPoolAllocator<U8> m_alloc;
 	List<Path> m_paths;
+	HashMap<U64, FileEntry> m_fileIndex; ///< The files of all the paths. If a file is in many paths the newest wins.
 	String m_cacheDir;
 
-	/// Add a filesystem path or an archive. The path is read-only.
+	/// Add a filesystem path or an archive (.ankizip or .ankipak). The path is read-only.
 	ANKI_USE_RESULT Error addNewPath(const CString& path);
 
 	void addCachePath(const CString& path);
+
+	/// Check that the files of a new path don't collide with each other or with the indexed files.
+	ANKI_USE_RESULT Error checkNewFiles(const DynamicArrayAuto<FileEntry>& entries) const;
+
+	/// Add the file of a path to m_fileIndex. The file should have passed checkNewFiles().
+	void indexFile(const FileEntry& entry);
+
+	/// Map a .ankipak and list its files. The path is not published, destroyPath() cleans it on error.
+	ANKI_USE_RESULT Error loadPak(const CString& path, Path& p, DynamicArrayAuto<FileEntry>& entries);
+
+	/// Open a .ankizip and list its files. The path is not published, destroyPath() cleans it on error.
+	ANKI_USE_RESULT Error loadZip(const CString& path, Path& p, DynamicArrayAuto<FileEntry>& entries);
+
+	/// List the files of a directory. The path is not published, destroyPath() cleans it on error.
+	ANKI_USE_RESULT Error loadDirectory(const CString& path, Path& p, DynamicArrayAuto<FileEntry>& entries);
+
+	/// Free everything a path owns.
+	void destroyPath(Path& p);
 };
 /// @}
 
@@ -5,6 +5,7 @@
 
 #include <anki/resource/ResourceManager.h>
 #include <anki/resource/AsyncLoader.h>
+#include <anki/resource/TextureStreamer.h>
 #include <anki/resource/AnimationResource.h>
 #include <anki/resource/MaterialResource.h>
 #include <anki/resource/MeshResource.h>
@@ -19,6 +20,7 @@
 #include <anki/util/Logger.h>
 #include <anki/misc/ConfigSet.h>
 #include <anki/gr/ShaderCompiler.h>
+#include <anki/util/ThreadHive.h>
 
 namespace anki
 {
@@ -31,6 +33,7 @@ ResourceManager::~ResourceManager()
 {
 	m_cacheDir.destroy(m_alloc);
 	m_alloc.deleteInstance(m_asyncLoader);
+	m_alloc.deleteInstance(m_textureStreamer);
 	m_alloc.deleteInstance(m_transferGpuAlloc);
 	m_alloc.deleteInstance(m_shaderCompiler);
 }
@@ -40,6 +43,7 @@ Error ResourceManager::init(ResourceManagerInitInfo& init)
 	m_gr = init.m_gr;
 	m_physics = init.m_physics;
 	m_fs = init.m_resourceFs;
+	m_threadHive = init.m_threadHive;
 	m_alloc = ResourceAllocator<U8>(init.m_allocCallback, init.m_allocCallbackData);
 
 	m_tmpAlloc = TempResourceAllocator<U8>(init.m_allocCallback, init.m_allocCallbackData, 10 * 1024 * 1024);
@@ -50,6 +54,7 @@ Error ResourceManager::init(ResourceManagerInitInfo& init)
 	//
 	m_maxTextureSize = init.m_config->getNumber("rsrc.maxTextureSize");
 	m_textureAnisotropy = init.m_config->getNumber("rsrc.textureAnisotropy");
+	m_precompileShaderVariants = init.m_config->getNumber("rsrc.precompileShaderVariants") != 0.0;
 
 // Init type resource managers
 //
@@ -63,16 +68,26 @@ Error ResourceManager::init(ResourceManagerInitInfo& init)
 
 	// Init the thread
 	m_asyncLoader = m_alloc.newInstance<AsyncLoader>();
-	m_asyncLoader->init(m_alloc);
+	m_asyncLoader->init(m_alloc, init.m_config->getNumber("rsrc.asyncLoaderThreadCount"));
 
 	m_transferGpuAlloc = m_alloc.newInstance<TransferGpuAllocator>();
 	ANKI_CHECK(m_transferGpuAlloc->init(init.m_config->getNumber("rsrc.transferScratchMemorySize"), m_gr, m_alloc));
 
-	m_shaderCompiler = m_alloc.newInstance<ShaderCompilerCache>(m_alloc, m_cacheDir.toCString());
+	m_textureStreamer = m_alloc.newInstance<TextureStreamer>(m_alloc,
+		PtrSize(init.m_config->getNumber("rsrc.textureStreamingBudget")),
+		U32(init.m_config->getNumber("rsrc.textureStreamingTailSize")));
+
+	m_shaderCompiler = m_alloc.newInstance<ShaderCompilerCache>(
+		m_alloc, m_cacheDir.toCString(), init.m_config->getNumber("rsrc.shaderCacheMaxSize"));
 
 	return Error::NONE;
 }
 
+ThreadHive* ResourceManager::getThreadHive() const
+{
+	return (m_threadHive && m_threadHive->isOwnerThread()) ? m_threadHive : nullptr;
+}
+
 U64 ResourceManager::getAsyncTaskCompletedCount() const
 {
 	return m_asyncLoader->getCompletedTaskCount();
@@ -6,7 +6,10 @@
 #pragma once
 
 #include <anki/resource/TransferGpuAllocator.h>
-#include <anki/util/List.h>
+#include <anki/util/HashMap.h>
+#include <anki/util/Hash.h>
+#include <anki/util/Thread.h>
+#include <anki/util/Atomic.h>
 #include <anki/util/Functions.h>
 #include <anki/util/String.h>
 
@@ -21,11 +24,14 @@ class ResourceManager;
 class AsyncLoader;
 class ResourceManagerModel;
 class ShaderCompilerCache;
+class ThreadHive;
+class TextureStreamer;
 
 /// @addtogroup resource
 /// @{
 
-/// Manage resources of a certain type
+/// Manage resources of a certain type. It's thread safe. The resources are found using the hash of their filename and
+/// if a thread asks for a resource that another thread is loading it waits for that load instead of loading it again.
 template<typename Type>
 class TypeResourceManager
 {
@@ -37,27 +43,122 @@ protected:
 	~TypeResourceManager()
 	{
 		ANKI_ASSERT(m_ptrs.isEmpty() && "Forgot to delete some resources");
+		ANKI_ASSERT(m_loading.isEmpty());
 		m_ptrs.destroy(m_alloc);
+		m_loading.destroy(m_alloc);
 	}
 
-	Type* findLoadedResource(const CString& filename)
+	/// Find a resource and take a reference to it. If another thread is loading the resource wait for it to finish. If
+	/// no-one has it the caller has to load it and then call endLoad().
+	/// @param filename The filename of the resource.
+	/// @param[out] ptr The resource with one more reference or nullptr if the caller has to load it.
+	/// @return The error of the load this thread waited for.
+	ANKI_USE_RESULT Error findOrBeginLoad(const CString& filename, Type*& ptr)
 	{
-		auto it = find(filename);
-		return (it != m_ptrs.end()) ? *it : nullptr;
+		const U64 hash = computeFilenameHash(filename);
+		LockGuard<Mutex> lock(m_mtx);
+
+		while(true)
+		{
+			auto it = m_ptrs.find(hash);
+			if(it != m_ptrs.getEnd())
+			{
+				Type* other = *it;
+				ANKI_ASSERT(other->getFilename() == filename && "Hash collision");
+
+				// Take a reference but never resurrect a resource that is being deleted
+				I32 refcount = other->getRefcount().load();
+				while(refcount > 0 && !other->getRefcount().compareExchange(refcount, refcount + 1))
+				{
+				}
+
+				if(refcount > 0)
+				{
+					ptr = other;
+					return Error::NONE;
+				}
+
+				// It's about to be deleted, forget about it and load it again
+				m_ptrs.erase(m_alloc, it);
+			}
+
+			auto lit = m_loading.find(hash);
+			if(lit == m_loading.getEnd())
+			{
+				// The caller will load it
+				m_loading.emplace(m_alloc, hash, m_alloc.template newInstance<LoadingResource>());
+				ptr = nullptr;
+				return Error::NONE;
+			}
+
+			// Another thread loads it, wait for it
+			LoadingResource* loading = *lit;
+			++loading->m_waiterCount;
+			while(!loading->m_done)
+			{
+				m_condVar.wait(m_mtx);
+			}
+
+			const Error err = loading->m_err;
+			if(--loading->m_waiterCount == 0)
+			{
+				m_alloc.deleteInstance(loading);
+			}
+
+			if(err)
+			{
+				return err;
+			}
+
+			// Loaded, go back and take a reference
+		}
 	}
 
-	void registerResource(Type* ptr)
+	/// Finish the load that findOrBeginLoad() assigned to this thread.
+	/// @param filename The filename of the resource.
+	/// @param ptr The resource. The caller should hold a reference to it. It's nullptr if the load failed.
+	/// @param err The error of the load.
+	void endLoad(const CString& filename, Type* ptr, Error err)
 	{
-		ANKI_ASSERT(ptr->getRefcount().load() == 0);
-		ANKI_ASSERT(find(ptr->getFilename()) == m_ptrs.getEnd());
-		m_ptrs.pushBack(m_alloc, ptr);
+		ANKI_ASSERT(!!err == (ptr == nullptr));
+		ANKI_ASSERT(!ptr || ptr->getRefcount().load() > 0);
+		const U64 hash = computeFilenameHash(filename);
+
+		LockGuard<Mutex> lock(m_mtx);
+
+		if(ptr)
+		{
+			ANKI_ASSERT(m_ptrs.find(hash) == m_ptrs.getEnd());
+			m_ptrs.emplace(m_alloc, hash, ptr);
+		}
+
+		auto lit = m_loading.find(hash);
+		ANKI_ASSERT(lit != m_loading.getEnd());
+		LoadingResource* loading = *lit;
+		m_loading.erase(m_alloc, lit);
+
+		if(loading->m_waiterCount == 0)
+		{
+			m_alloc.deleteInstance(loading);
+		}
+		else
+		{
+			loading->m_err = err;
+			loading->m_done = true;
+			m_condVar.notifyAll();
+		}
 	}
 
 	void unregisterResource(Type* ptr)
 	{
-		auto it = find(ptr->getFilename());
-		ANKI_ASSERT(it != m_ptrs.end());
-		m_ptrs.erase(m_alloc, it);
+		LockGuard<Mutex> lock(m_mtx);
+
+		// findOrBeginLoad() may have already replaced it
+		auto it = m_ptrs.find(computeFilenameHash(ptr->getFilename()));
+		if(it != m_ptrs.getEnd() && *it == ptr)
+		{
+			m_ptrs.erase(m_alloc, it);
+		}
 	}
 
 	void init(ResourceAllocator<U8> alloc)
@@ -66,24 +167,24 @@ protected:
 	}
 
 private:
-	using Container = List<Type*>;
+	/// A resource that some thread loads.
+	class LoadingResource
+	{
+	public:
+		Error m_err = Error::NONE;
+		U32 m_waiterCount = 0; ///< The threads that wait for the load.
+		Bool8 m_done = false;
+	};
 
 	ResourceAllocator<U8> m_alloc;
-	Container m_ptrs;
+	HashMap<U64, Type*> m_ptrs;
+	HashMap<U64, LoadingResource*> m_loading;
+	Mutex m_mtx; ///< Protects m_ptrs and m_loading.
+	ConditionVariable m_condVar; ///< Signals the end of the loads.
 
-	typename Container::Iterator find(const CString& filename)
+	static U64 computeFilenameHash(const CString& filename)
 	{
-		typename Container::Iterator it;
-
-		for(it = m_ptrs.getBegin(); it != m_ptrs.getEnd(); ++it)
-		{
-			if((*it)->getFilename() == filename)
-			{
-				break;
-			}
-		}
-
-		return it;
+		return computeHash(&filename[0], filename.getLength());
 	}
 };
 
@@ -94,6 +195,7 @@ public:
 	PhysicsWorld* m_physics = nullptr;
 	ResourceFilesystem* m_resourceFs = nullptr;
 	const ConfigSet* m_config = nullptr;
+	ThreadHive* m_threadHive = nullptr; ///< Optional. Used to load things in parallel.
 	CString m_cacheDir;
 	AllocAlignedCallback m_allocCallback = 0;
 	void* m_allocCallbackData = nullptr;
@@ -123,7 +225,7 @@ public:
 
 	ANKI_USE_RESULT Error init(ResourceManagerInitInfo& init);
 
-	/// Load a resource.
+	/// Load a resource. It's thread safe and it can be called from ThreadHive tasks.
 	template<typename T>
 	ANKI_USE_RESULT Error loadResource(const CString& filename, ResourcePtr<T>& out, Bool async = true);
 
@@ -138,6 +240,15 @@ anki_internal:
 		return m_textureAnisotropy;
 	}
 
+	Bool getPrecompileShaderVariants() const
+	{
+		return m_precompileShaderVariants;
+	}
+
+	/// Get the ThreadHive. It may be nullptr. It's also nullptr if the caller is not the thread that owns the hive
+	/// (a task of the hive or the async loader for example) since only the owner can wait for the tasks.
+	ThreadHive* getThreadHive() const;
+
 	ResourceAllocator<U8>& getAllocator()
 	{
 		return m_alloc;
@@ -176,18 +287,6 @@ anki_internal:
 		return m_cacheDir;
 	}
 
-	template<typename T>
-	T* findLoadedResource(const CString& filename)
-	{
-		return TypeResourceManager<T>::findLoadedResource(filename);
-	}
-
-	template<typename T>
-	void registerResource(T* ptr)
-	{
-		TypeResourceManager<T>::registerResource(ptr);
-	}
-
 	template<typename T>
 	void unregisterResource(T* ptr)
 	{
@@ -199,6 +298,11 @@ anki_internal:
 		return *m_asyncLoader;
 	}
 
+	TextureStreamer& getTextureStreamer()
+	{
+		return *m_textureStreamer;
+	}
+
 	const ShaderCompilerCache& getShaderCompiler() const
 	{
 		ANKI_ASSERT(m_shaderCompiler);
@@ -208,7 +312,7 @@ anki_internal:
 	/// Get the number of times loadResource() was called.
 	U64 getLoadingRequestCount() const
 	{
-		return m_loadRequestCount;
+		return m_loadRequestCount.load();
 	}
 
 	/// Get the total number of completed async tasks.
@@ -218,16 +322,21 @@ private:
 	GrManager* m_gr = nullptr;
 	PhysicsWorld* m_physics = nullptr;
 	ResourceFilesystem* m_fs = nullptr;
+	ThreadHive* m_threadHive = nullptr;
 	ResourceAllocator<U8> m_alloc;
 	TempResourceAllocator<U8> m_tmpAlloc;
+	Mutex m_tmpAllocMtx; ///< Protects m_tmpAllocLoadCount.
+	U32 m_tmpAllocLoadCount = 0; ///< The loads that may use m_tmpAlloc.
 	String m_cacheDir;
 	U32 m_maxTextureSize;
 	U32 m_textureAnisotropy;
+	Bool8 m_precompileShaderVariants = false;
 	AsyncLoader* m_asyncLoader = nullptr; ///< Async loading thread
-	U64 m_uuid = 0;
-	U64 m_loadRequestCount = 0;
+	Atomic<U64> m_uuid = {0};
+	Atomic<U64> m_loadRequestCount = {0};
 	TransferGpuAllocator* m_transferGpuAlloc = nullptr;
 	ShaderCompilerCache* m_shaderCompiler = nullptr;
+	TextureStreamer* m_textureStreamer = nullptr;
 };
 /// @}
 
@@ -12,57 +12,64 @@ template<typename T>
 Error ResourceManager::loadResource(const CString& filename, ResourcePtr<T>& out, Bool async)
 {
 	ANKI_ASSERT(!out.isCreated() && "Already loaded");
+	m_loadRequestCount.fetchAdd(1);
 
-	Error err = Error::NONE;
-	++m_loadRequestCount;
-
-	T* const other = findLoadedResource<T>(filename);
+	// Find it or wait for the thread that loads it
+	T* other;
+	Error err = TypeResourceManager<T>::findOrBeginLoad(filename, other);
+	if(err)
+	{
+		ANKI_RESOURCE_LOGE("Failed to load resource: %s", &filename[0]);
+		return err;
+	}
 
 	if(other)
 	{
-		// Found
+		// Found. findOrBeginLoad() took a reference for us
 		out.reset(other);
+		other->getRefcount().fetchSub(1);
+		return Error::NONE;
 	}
-	else
-	{
-		// Allocate ptr
-		T* ptr = m_alloc.newInstance<T>(this);
-		ANKI_ASSERT(ptr->getRefcount().load() == 0);
 
-		// Populate the ptr. Use a block to cleanup temp_pool allocations
-		auto& pool = m_tmpAlloc.getMemoryPool();
+	// Allocate ptr
+	T* ptr = m_alloc.newInstance<T>(this);
+	ANKI_ASSERT(ptr->getRefcount().load() == 0);
 
-		{
-			U allocsCountBefore = pool.getAllocationsCount();
-			(void)allocsCountBefore;
-
-			err = ptr->load(filename, async);
-			if(err)
-			{
-				ANKI_RESOURCE_LOGE("Failed to load resource: %s", &filename[0]);
-				m_alloc.deleteInstance(ptr);
-				return err;
-			}
-
-			ANKI_ASSERT(pool.getAllocationsCount() == allocsCountBefore && "Forgot to deallocate");
-		}
+	// Populate the ptr. Other loads may use the temp pool at the same time so reset it only when no load is running.
+	// NOTE: Count the loads because resources load other resources
+	{
+		LockGuard<Mutex> lock(m_tmpAllocMtx);
+		++m_tmpAllocLoadCount;
+	}
 
-		ptr->setFilename(filename);
-		ptr->setUuid(++m_uuid);
+	err = ptr->load(filename, async);
 
-		// Reset the memory pool if no-one is using it.
-		// NOTE: Check because resources load other resources
-		if(pool.getAllocationsCount() == 0)
+	{
+		LockGuard<Mutex> lock(m_tmpAllocMtx);
+		ANKI_ASSERT(m_tmpAllocLoadCount > 0);
+		auto& pool = m_tmpAlloc.getMemoryPool();
+		if(--m_tmpAllocLoadCount == 0 && pool.getAllocationsCount() == 0)
 		{
 			pool.reset();
 		}
+	}
 
-		// Register resource
-		registerResource(ptr);
-		out.reset(ptr);
+	if(err)
+	{
+		ANKI_RESOURCE_LOGE("Failed to load resource: %s", &filename[0]);
+		m_alloc.deleteInstance(ptr);
+		TypeResourceManager<T>::endLoad(filename, nullptr, err);
+		return err;
 	}
 
-	return err;
+	ptr->setFilename(filename);
+	ptr->setUuid(m_uuid.fetchAdd(1) + 1);
+
+	// Register resource
+	out.reset(ptr);
+	TypeResourceManager<T>::endLoad(filename, ptr, Error::NONE);
+
+	return Error::NONE;
 }
 
 } // end namespace anki
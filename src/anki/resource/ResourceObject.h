@@ -7,6 +7,7 @@
 
 #include <anki/resource/Common.h>
 #include <anki/resource/ResourceFilesystem.h>
+#include <anki/resource/AsyncLoader.h>
 #include <anki/util/Atomic.h>
 #include <anki/util/String.h>
 
@@ -80,11 +81,19 @@ anki_internal:
 
 	ANKI_USE_RESULT Error openFileParseXml(const ResourceFilename& filename, XmlDocument& xml);
 
+	/// The handle of the task that loads the resource asynchronously. The task gets canceled if the resource dies
+	/// before it's loaded.
+	AsyncLoaderTaskHandle& getAsyncLoadTaskHandle()
+	{
+		return m_asyncLoadTask;
+	}
+
 private:
 	ResourceManager* m_manager;
 	Atomic<I32> m_refcount;
 	String m_fname; ///< Unique resource name.
 	U64 m_uuid = 0;
+	AsyncLoaderTaskHandle m_asyncLoadTask;
 };
 /// @}
 
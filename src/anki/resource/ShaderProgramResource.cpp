@@ -149,9 +149,7 @@ ShaderProgramResource::~ShaderProgramResource()
 		ShaderProgramResourceVariant* variant = *it;
 		m_variants.erase(getAllocator(), it);
 
-		variant->m_blockInfos.destroy(alloc);
-		variant->m_texUnits.destroy(alloc);
-		alloc.deleteInstance(variant);
+		destroyVariant(variant);
 	}
 
 	for(Input& var : m_inputVars)
@@ -288,27 +286,127 @@ void ShaderProgramResource::getOrCreateVariant(ConstWeakArray<ShaderProgramResou
 	// Compute hash
 	U64 hash = computeVariantHash(mutation, constants);
 
+	{
+		LockGuard<Mutex> lock(m_mtx);
+
+		auto it = m_variants.find(hash);
+		if(it != m_variants.getEnd())
+		{
+			variant = *it;
+			return;
+		}
+	}
+
+	// Create one outside the lock so different variants can compile in parallel
+	ShaderProgramResourceVariant* v = getAllocator().newInstance<ShaderProgramResourceVariant>();
+	initVariant(mutation, constants, *v);
+
 	LockGuard<Mutex> lock(m_mtx);
 
 	auto it = m_variants.find(hash);
 	if(it != m_variants.getEnd())
 	{
+		// Another thread created the same variant in the meantime, use that one
+		destroyVariant(v);
 		variant = *it;
 	}
 	else
 	{
-		// Create one
-		ShaderProgramResourceVariant* v = getAllocator().newInstance<ShaderProgramResourceVariant>();
-		initVariant(mutation, constants, *v);
-
 		m_variants.emplace(getAllocator(), hash, v);
 		variant = v;
 	}
 }
 
+void ShaderProgramResource::destroyVariant(ShaderProgramResourceVariant* variant) const
+{
+	auto alloc = getAllocator();
+	variant->m_blockInfos.destroy(alloc);
+	variant->m_texUnits.destroy(alloc);
+	alloc.deleteInstance(variant);
+}
+
 void ShaderProgramResource::initVariant(ConstWeakArray<ShaderProgramResourceMutation> mutations,
 	ConstWeakArray<ShaderProgramResourceConstantValue> constants,
 	ShaderProgramResourceVariant& variant) const
+{
+	StringAuto shaderHeader(getTempAllocator());
+	initVariantInfo(mutations, constants, variant, shaderHeader);
+
+	// Create the program name
+	StringAuto progName(getTempAllocator());
+	getFilepathFilename(getFilename(), progName);
+	char* cprogName = const_cast<char*>(progName.cstr());
+	if(progName.getLength() > MAX_GR_OBJECT_NAME_LENGTH)
+	{
+		cprogName[MAX_GR_OBJECT_NAME_LENGTH] = '\0';
+	}
+
+	// Create the shaders and the program
+	ShaderProgramInitInfo progInf(cprogName);
+	for(ShaderType i = ShaderType::FIRST; i < ShaderType::COUNT; ++i)
+	{
+		if(!(m_shaderStages & ShaderTypeBit(1 << U(i))))
+		{
+			continue;
+		}
+
+		DynamicArrayAuto<U8> bin(getTempAllocator());
+		Error err = compileVariantShader(shaderHeader.toCString(), i, bin);
+		if(err)
+		{
+			ANKI_RESOURCE_LOGF("Shader compilation failed");
+		}
+
+		ShaderInitInfo inf(cprogName);
+		inf.m_shaderType = i;
+		inf.m_binary = ConstWeakArray<U8>(&bin[0], bin.getSize());
+
+		progInf.m_shaders[i] = getManager().getGrManager().newShader(inf);
+	}
+
+	variant.m_prog = getManager().getGrManager().newShaderProgram(progInf);
+}
+
+Error ShaderProgramResource::precompileVariant(ConstWeakArray<ShaderProgramResourceMutation> mutations,
+	ConstWeakArray<ShaderProgramResourceConstantValue> constants) const
+{
+	ShaderProgramResourceVariant variant;
+	StringAuto shaderHeader(getTempAllocator());
+	initVariantInfo(mutations, constants, variant, shaderHeader);
+
+	Error err = Error::NONE;
+	for(ShaderType i = ShaderType::FIRST; i < ShaderType::COUNT && !err; ++i)
+	{
+		if(!!(m_shaderStages & ShaderTypeBit(1 << U(i))))
+		{
+			DynamicArrayAuto<U8> bin(getTempAllocator());
+			err = compileVariantShader(shaderHeader.toCString(), i, bin);
+		}
+	}
+
+	variant.m_blockInfos.destroy(getAllocator());
+	variant.m_texUnits.destroy(getAllocator());
+	return err;
+}
+
+Error ShaderProgramResource::compileVariantShader(
+	CString shaderHeader, ShaderType type, DynamicArrayAuto<U8>& bin) const
+{
+	StringAuto src(getTempAllocator());
+	src.append(shaderHeader);
+	src.append(m_source);
+
+	ShaderCompilerOptions compileOptions;
+	compileOptions.setFromGrManager(getManager().getGrManager());
+	compileOptions.m_shaderType = type;
+
+	return getManager().getShaderCompiler().compile(src.toCString(), nullptr, compileOptions, bin);
+}
+
+void ShaderProgramResource::initVariantInfo(ConstWeakArray<ShaderProgramResourceMutation> mutations,
+	ConstWeakArray<ShaderProgramResourceConstantValue> constants,
+	ShaderProgramResourceVariant& variant,
+	StringAuto& shaderHeader) const
 {
 	variant.m_activeInputVars.unsetAll();
 	variant.m_blockInfos.create(getAllocator(), m_inputVars.getSize());
@@ -548,52 +646,7 @@ void ShaderProgramResource::initVariant(ConstWeakArray<ShaderProgramResourceMuta
 		shaderHeaderSrc.pushBack(str.toCString());
 	}
 
-	StringAuto shaderHeader(getTempAllocator());
 	shaderHeaderSrc.join("", shaderHeader);
-
-	// Create the program name
-	StringAuto progName(getTempAllocator());
-	getFilepathFilename(getFilename(), progName);
-	char* cprogName = const_cast<char*>(progName.cstr());
-	if(progName.getLength() > MAX_GR_OBJECT_NAME_LENGTH)
-	{
-		cprogName[MAX_GR_OBJECT_NAME_LENGTH] = '\0';
-	}
-
-	// Create the shaders and the program
-	ShaderProgramInitInfo progInf(cprogName);
-	for(ShaderType i = ShaderType::FIRST; i < ShaderType::COUNT; ++i)
-	{
-		if(!(m_shaderStages & ShaderTypeBit(1 << U(i))))
-		{
-			continue;
-		}
-
-		StringAuto src(getTempAllocator());
-		src.append(shaderHeader);
-		src.append(m_source);
-
-		// Compile
-		DynamicArrayAuto<U8> bin(getTempAllocator());
-
-		ShaderCompilerOptions compileOptions;
-		compileOptions.setFromGrManager(getManager().getGrManager());
-		compileOptions.m_shaderType = i;
-
-		Error err = getManager().getShaderCompiler().compile(src.toCString(), nullptr, compileOptions, bin);
-		if(err)
-		{
-			ANKI_RESOURCE_LOGF("Shader compilation failed");
-		}
-
-		ShaderInitInfo inf(cprogName);
-		inf.m_shaderType = i;
-		inf.m_binary = ConstWeakArray<U8>(&bin[0], bin.getSize());
-
-		progInf.m_shaders[i] = getManager().getGrManager().newShader(inf);
-	}
-
-	variant.m_prog = getManager().getGrManager().newShaderProgram(progInf);
 }
 
 } // end namespace anki
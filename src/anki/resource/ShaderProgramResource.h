@@ -314,6 +314,12 @@ public:
 			variant);
 	}
 
+	/// Compile the shaders of a variant without creating any graphics objects. The binaries end up in the shader cache.
+	/// Unlike getOrCreateVariant() a compilation error is not fatal.
+	/// @note It's thread-safe.
+	ANKI_USE_RESULT Error precompileVariant(ConstWeakArray<ShaderProgramResourceMutation> mutations,
+		ConstWeakArray<ShaderProgramResourceConstantValue> constants) const;
+
 	/// Has tessellation shaders.
 	Bool hasTessellation() const
 	{
@@ -360,6 +366,16 @@ private:
 	void initVariant(ConstWeakArray<ShaderProgramResourceMutation> mutations,
 		ConstWeakArray<ShaderProgramResourceConstantValue> constants,
 		ShaderProgramResourceVariant& variant) const;
+
+	/// Compute the block infos and the texture units of a variant and the header of its source.
+	void initVariantInfo(ConstWeakArray<ShaderProgramResourceMutation> mutations,
+		ConstWeakArray<ShaderProgramResourceConstantValue> constants,
+		ShaderProgramResourceVariant& variant,
+		StringAuto& shaderHeader) const;
+
+	ANKI_USE_RESULT Error compileVariantShader(CString shaderHeader, ShaderType type, DynamicArrayAuto<U8>& bin) const;
+
+	void destroyVariant(ShaderProgramResourceVariant* variant) const;
 };
 
 /// Smart initializer of multiple ShaderProgramResourceConstantValue.
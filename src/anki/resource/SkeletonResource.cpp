@@ -18,6 +18,7 @@ SkeletonResource::~SkeletonResource()
 	}
 
 	m_bones.destroy(getAllocator());
+	m_bonesSortedByHierarchy.destroy(getAllocator());
 }
 
 Error SkeletonResource::load(const ResourceFilename& filename, Bool async)
@@ -130,6 +131,30 @@ Error SkeletonResource::load(const ResourceFilename& filename, Bool async)
 		++it;
 	}
 
+	// Sort the bones so the parents come before their children
+	if(m_rootBoneIdx == MAX_U32)
+	{
+		ANKI_RESOURCE_LOGE("Skeleton doesn't have a root bone");
+		return Error::USER_DATA;
+	}
+
+	m_bonesSortedByHierarchy.create(getAllocator(), m_bones.getSize());
+	U32 sortedCount = 0;
+	m_bonesSortedByHierarchy[sortedCount++] = m_rootBoneIdx;
+	for(U i = 0; i < sortedCount; ++i)
+	{
+		for(const Bone* child : m_bones[m_bonesSortedByHierarchy[i]].getChildren())
+		{
+			m_bonesSortedByHierarchy[sortedCount++] = child->m_idx;
+		}
+	}
+
+	if(sortedCount != m_bones.getSize())
+	{
+		ANKI_RESOURCE_LOGE("Some bones are not connected to the root bone");
+		return Error::USER_DATA;
+	}
+
 	return Error::NONE;
 }
 
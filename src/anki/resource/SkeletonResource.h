@@ -47,6 +47,11 @@ public:
 		return m_idx;
 	}
 
+	const Bone* getParent() const
+	{
+		return m_parent;
+	}
+
 	ConstWeakArray<Bone*> getChildren() const
 	{
 		return ConstWeakArray<Bone*>((m_childrenCount) ? &m_children[0] : nullptr, m_childrenCount);
@@ -124,8 +129,16 @@ public:
 		return m_bones[m_rootBoneIdx];
 	}
 
+	/// Get the indices of the bones sorted so that the parents come before their children. Iterating them is the same
+	/// as walking the hierarchy.
+	ConstWeakArray<U32> getBonesSortedByHierarchy() const
+	{
+		return ConstWeakArray<U32>(m_bonesSortedByHierarchy);
+	}
+
 private:
 	DynamicArray<Bone> m_bones;
+	DynamicArray<U32> m_bonesSortedByHierarchy;
 	U32 m_rootBoneIdx = MAX_U32;
 };
 /// @}
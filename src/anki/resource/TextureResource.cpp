@@ -7,6 +7,7 @@
 #include <anki/resource/ImageLoader.h>
 #include <anki/resource/ResourceManager.h>
 #include <anki/resource/AsyncLoader.h>
+#include <anki/resource/TextureStreamer.h>
 
 namespace anki
 {
@@ -21,6 +22,7 @@ public:
 	TransferGpuAllocator* m_trfAlloc ANKI_DBG_NULLIFY;
 	TextureType m_texType;
 	TexturePtr m_tex;
+	FencePtr m_fence; ///< The fence of the last upload.
 
 	LoadingContext(GenericMemoryPoolAllocator<U8> alloc)
 		: m_loader(alloc)
@@ -45,8 +47,44 @@ public:
 	}
 };
 
+/// Creates a texture with more or less mips for the TextureStreamer.
+class TextureResource::StreamTask : public AsyncLoaderTask
+{
+public:
+	TextureResource* m_rsrc;
+	TextureResource::LoadingContext m_ctx;
+	U8 m_mip;
+	Format m_format;
+
+	StreamTask(TextureResource* rsrc, U8 mip, Format format, GenericMemoryPoolAllocator<U8> alloc)
+		: m_rsrc(rsrc)
+		, m_ctx(alloc)
+		, m_mip(mip)
+		, m_format(format)
+	{
+	}
+
+	Error operator()(AsyncLoaderTaskContext& ctx) final
+	{
+		const Error err = m_rsrc->streamMips(m_mip, m_format, m_ctx);
+		if(err)
+		{
+			m_ctx.m_tex.reset(nullptr);
+		}
+
+		m_rsrc->getManager().getTextureStreamer().finishStreaming(m_rsrc->m_streaming, m_ctx.m_tex, m_ctx.m_fence);
+		return err;
+	}
+};
+
 TextureResource::~TextureResource()
 {
+	if(m_streamed)
+	{
+		// Unregister first so the streamer won't submit other tasks
+		getManager().getTextureStreamer().unregisterTexture(m_streaming);
+		getManager().getAsyncLoader().cancelTask(m_streaming.m_streamTask);
+	}
 }
 
 Error TextureResource::load(const ResourceFilename& filename, Bool async)
@@ -75,7 +113,35 @@ Error TextureResource::load(const ResourceFilename& filename, Bool async)
 	ResourceFilePtr file;
 	ANKI_CHECK(openFile(filename, file));
 
-	ANKI_CHECK(loader.load(file, filename, getManager().getMaxTextureSize()));
+	// The 2D textures that load asynchronously are streamed so load only their tail mips
+	TextureStreamer& streamer = getManager().getTextureStreamer();
+	const U32 maxTextureSize = getManager().getMaxTextureSize();
+	Bool canStream = false;
+	if(async && streamer.isEnabled())
+	{
+		ImageLoader::TextureType type;
+		ANKI_CHECK(loader.peekTextureType(file, filename, type));
+		canStream = type == ImageLoader::TextureType::_2D;
+	}
+
+	ANKI_CHECK(
+		loader.load(file, filename, (canStream) ? min(maxTextureSize, streamer.getTailSize()) : maxTextureSize));
+
+	Bool stream = false;
+	U firstMip = 0;
+	const U skippedMipCount = loader.getSkippedMipLevelsCount();
+	if(canStream && skippedMipCount > 0)
+	{
+		// Find the finest mip that fits the max texture size
+		U maxSize = max(loader.getWidth(), loader.getHeight()) << skippedMipCount;
+		while(maxSize > maxTextureSize && firstMip < skippedMipCount)
+		{
+			++firstMip;
+			maxSize /= 2;
+		}
+
+		stream = firstMip < skippedMipCount;
+	}
 
 	// Various sizes
 	init.m_width = loader.getWidth();
@@ -174,7 +240,7 @@ Error TextureResource::load(const ResourceFilename& filename, Bool async)
 	// Upload the data
 	if(async)
 	{
-		getManager().getAsyncLoader().submitTask(task);
+		getManager().getAsyncLoader().submitTask(task, AsyncLoaderTaskPriority::MEDIUM, &getAsyncLoadTaskHandle());
 	}
 	else
 	{
@@ -196,9 +262,66 @@ Error TextureResource::load(const ResourceFilename& filename, Bool async)
 	TextureViewInitInfo viewInit(m_tex, "Rsrc");
 	m_texView = getManager().getGrManager().newTextureView(viewInit);
 
+	// Let the streamer load the rest of the mips
+	if(stream)
+	{
+		m_size.x() <<= skippedMipCount - firstMip;
+		m_size.y() <<= skippedMipCount - firstMip;
+		m_streaming.m_rsrc = this;
+		m_streaming.m_size = m_size.xy();
+		m_streaming.m_format = init.m_format;
+		m_streaming.m_mipCount = U8(skippedMipCount + loader.getMipLevelsCount());
+		m_streaming.m_firstMip = U8(firstMip);
+		m_streaming.m_tailMip = U8(skippedMipCount);
+		m_streaming.m_residentMip = m_streaming.m_tailMip;
+		m_streaming.m_wantedMip = m_streaming.m_tailMip;
+		m_streamed = true;
+
+		streamer.registerTexture(m_streaming);
+	}
+
 	return Error::NONE;
 }
 
+Error TextureResource::streamMips(U8 mip, Format format, LoadingContext& ctx)
+{
+	ANKI_ASSERT(mip >= m_streaming.m_firstMip && mip <= m_streaming.m_tailMip);
+
+	ResourceFilePtr file;
+	ANKI_CHECK(openFile(getFilename(), file));
+
+	const U32 maxSize = max(m_size.x(), m_size.y()) >> (mip - m_streaming.m_firstMip);
+	ANKI_CHECK(ctx.m_loader.load(file, getFilename(), maxSize));
+	ANKI_ASSERT(ctx.m_loader.getSkippedMipLevelsCount() == mip);
+
+	TextureInitInfo init("RsrcTexStreamed");
+	init.m_usage = TextureUsageBit::SAMPLED_ALL | TextureUsageBit::TRANSFER_DESTINATION;
+	init.m_initialUsage = TextureUsageBit::SAMPLED_ALL;
+	init.m_width = ctx.m_loader.getWidth();
+	init.m_height = ctx.m_loader.getHeight();
+	init.m_depth = 1;
+	init.m_layerCount = 1;
+	init.m_type = TextureType::_2D;
+	init.m_format = format;
+	init.m_mipmapCount = ctx.m_loader.getMipLevelsCount();
+
+	ctx.m_faces = 1;
+	ctx.m_layerCount = 1;
+	ctx.m_gr = &getManager().getGrManager();
+	ctx.m_trfAlloc = &getManager().getTransferGpuAllocator();
+	ctx.m_texType = init.m_type;
+	ctx.m_tex = ctx.m_gr->newTexture(init);
+
+	return load(ctx);
+}
+
+void TextureResource::submitStreamTask(U8 mip, AsyncLoaderTaskPriority priority)
+{
+	AsyncLoader& loader = getManager().getAsyncLoader();
+	StreamTask* task = loader.newTask<StreamTask>(this, mip, m_streaming.m_format, loader.getAllocator());
+	loader.submitTask(task, priority, &m_streaming.m_streamTask);
+}
+
 Error TextureResource::load(LoadingContext& ctx)
 {
 	const U copyCount = ctx.m_layerCount * ctx.m_faces * ctx.m_loader.getMipLevelsCount();
@@ -247,8 +370,8 @@ Error TextureResource::load(LoadingContext& ctx)
 			if(ctx.m_texType == TextureType::_3D)
 			{
 				const auto& vol = ctx.m_loader.getVolume(mip);
-				surfOrVolSize = vol.m_data.getSize();
-				surfOrVolData = &vol.m_data[0];
+				surfOrVolSize = vol.getData().getSize();
+				surfOrVolData = &vol.getData()[0];
 
 				allocationSize = computeVolumeSize(ctx.m_tex->getWidth() >> mip,
 					ctx.m_tex->getHeight() >> mip,
@@ -258,8 +381,8 @@ Error TextureResource::load(LoadingContext& ctx)
 			else
 			{
 				const auto& surf = ctx.m_loader.getSurface(mip, face, layer);
-				surfOrVolSize = surf.m_data.getSize();
-				surfOrVolData = &surf.m_data[0];
+				surfOrVolSize = surf.getData().getSize();
+				surfOrVolData = &surf.getData()[0];
 
 				allocationSize = computeSurfaceSize(
 					ctx.m_tex->getWidth() >> mip, ctx.m_tex->getHeight() >> mip, ctx.m_tex->getFormat());
@@ -314,7 +437,7 @@ Error TextureResource::load(LoadingContext& ctx)
 		}
 
 		// Flush batch
-		FencePtr fence;
+		FencePtr& fence = ctx.m_fence;
 		cmdb->flush(&fence);
 
 		for(U i = 0; i < handleCount; ++i)
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <anki/resource/ResourceObject.h>
+#include <anki/resource/TextureStreamer.h>
 #include <anki/Gr.h>
 
 namespace anki
@@ -17,9 +18,12 @@ namespace anki
 /// Texture resource class.
 ///
 /// It loads or creates an image and then loads it in the GPU. It supports compressed and uncompressed TGAs and AnKi's
-/// texture format.
+/// texture format. The 2D textures that load asynchronously are streamed: At first only their tail mips are loaded and
+/// the TextureStreamer replaces the GPU texture with bigger or smaller ones later.
 class TextureResource : public ResourceObject
 {
+	friend class TextureStreamer;
+
 public:
 	TextureResource(ResourceManager* manager)
 		: ResourceObject(manager)
@@ -31,13 +35,13 @@ public:
 	/// Load a texture
 	ANKI_USE_RESULT Error load(const ResourceFilename& filename, Bool async);
 
-	/// Get the texture.
+	/// Get the texture. The TextureStreamer replaces it between frames so don't keep the reference for later frames.
 	const TexturePtr& getGrTexture() const
 	{
 		return m_tex;
 	}
 
-	/// Get the texture view.
+	/// Get the texture view. Same as getGrTexture() it's valid for the current frame.
 	const TextureViewPtr& getGrTextureView() const
 	{
 		return m_texView;
@@ -49,6 +53,20 @@ public:
 		return m_sampler;
 	}
 
+	/// Let the feedback of the renderer drive the streaming. Without it a streamed texture streams in all its mips.
+	void enableMipFeedback()
+	{
+		m_streaming.m_mipFeedback.store(1);
+	}
+
+	/// The renderer calls it with the finest mip level it needs in the current frame. The mip is relative to the
+	/// size of the texture. It's threadsafe.
+	void requestMip(U32 mip) const
+	{
+		m_streaming.m_requestedMip.min(mip);
+	}
+
+	/// The size of the texture when all its mips are resident.
 	U getWidth() const
 	{
 		ANKI_ASSERT(m_size.x());
@@ -77,6 +95,7 @@ private:
 	static constexpr U MAX_COPIES_BEFORE_FLUSH = 4;
 
 	class TexUploadTask;
+	class StreamTask;
 	class LoadingContext;
 
 	TexturePtr m_tex;
@@ -85,7 +104,19 @@ private:
 	UVec3 m_size = UVec3(0u);
 	U32 m_layerCount = 0;
 
+	/// @name Streaming
+	/// @{
+	StreamedTexture m_streaming;
+	Bool8 m_streamed = false;
+	/// @}
+
 	ANKI_USE_RESULT static Error load(LoadingContext& ctx);
+
+	/// Create a new texture that has the mips from mip and bellow and upload them.
+	ANKI_USE_RESULT Error streamMips(U8 mip, Format format, LoadingContext& ctx);
+
+	/// Submit a StreamTask.
+	void submitStreamTask(U8 mip, AsyncLoaderTaskPriority priority);
 };
 /// @}
 
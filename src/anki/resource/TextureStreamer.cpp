@@ -0,0 +1,240 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <anki/resource/TextureStreamer.h>
+#include <anki/resource/TextureResource.h>
+#include <anki/resource/ResourceManager.h>
+#include <anki/core/Trace.h>
+#include <algorithm>
+
+namespace anki
+{
+
+PtrSize StreamedTexture::computeMemory(U8 mip) const
+{
+	ANKI_ASSERT(mip >= m_firstMip && mip < m_mipCount);
+
+	PtrSize size = 0;
+	for(U i = mip; i < m_mipCount; ++i)
+	{
+		size += computeSurfaceSize(m_size.x() >> (i - m_firstMip), m_size.y() >> (i - m_firstMip), m_format);
+	}
+
+	return size;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	ANKI_ASSERT(m_textures.getSize() == 0 && "Some textures are still alive");
+	m_textures.destroy(m_alloc);
+}
+
+void TextureStreamer::registerTexture(StreamedTexture& tex)
+{
+	LockGuard<Mutex> lock(m_mtx);
+	ANKI_ASSERT(tex.m_streamerIndex == MAX_U32);
+	tex.m_streamerIndex = m_textures.getSize();
+	m_textures.emplaceBack(m_alloc, &tex);
+
+	m_residentMemory += tex.computeMemory(tex.m_residentMip);
+}
+
+void TextureStreamer::unregisterTexture(StreamedTexture& tex)
+{
+	LockGuard<Mutex> lock(m_mtx);
+	ANKI_ASSERT(tex.m_streamerIndex < m_textures.getSize() && m_textures[tex.m_streamerIndex] == &tex);
+
+	// Swap it with the last
+	StreamedTexture* last = m_textures[m_textures.getSize() - 1];
+	m_textures[tex.m_streamerIndex] = last;
+	last->m_streamerIndex = tex.m_streamerIndex;
+	m_textures.resize(m_alloc, m_textures.getSize() - 1);
+	tex.m_streamerIndex = MAX_U32;
+
+	m_residentMemory -= tex.computeMemory(tex.m_residentMip);
+	if(tex.m_loadingMip != MAX_U8)
+	{
+		--m_loadsInFlight;
+	}
+}
+
+void TextureStreamer::finishStreaming(StreamedTexture& tex, TexturePtr newTex, FencePtr fence)
+{
+	LockGuard<Mutex> lock(m_mtx);
+
+	if(tex.m_streamerIndex == MAX_U32)
+	{
+		// It's dying
+		return;
+	}
+
+	ANKI_ASSERT(tex.m_loadingMip != MAX_U8);
+	if(newTex)
+	{
+		// endFrame() will swap it when the upload is done
+		tex.m_loadedTex = newTex;
+		tex.m_loadedFence = fence;
+	}
+	else
+	{
+		ANKI_RESOURCE_LOGE(
+			"Failed to stream the mips of %s. Will keep the ones it has", &tex.m_rsrc->getFilename()[0]);
+		tex.m_streamingFailed = true;
+		tex.m_loadingMip = MAX_U8;
+		--m_loadsInFlight;
+	}
+}
+
+void TextureStreamer::computeWantedMips()
+{
+	// Gather the feedback
+	PtrSize totalMemory = 0;
+	for(StreamedTexture* tex : m_textures)
+	{
+		const U32 requestedMip = tex->m_requestedMip.exchange(MAX_U32);
+
+		if(tex->m_streamingFailed)
+		{
+			tex->m_wantedMip = tex->m_residentMip;
+		}
+		else if(!tex->m_mipFeedback.load())
+		{
+			// Nobody gives feedback for it, stream in all the mips
+			tex->m_wantedMip = tex->m_firstMip;
+			tex->m_lastMipRequestFrame = m_frame;
+		}
+		else if(requestedMip != MAX_U32)
+		{
+			tex->m_wantedMip = U8(min<U32>(tex->m_firstMip + requestedMip, tex->m_tailMip));
+			tex->m_lastMipRequestFrame = m_frame;
+		}
+		else if(m_frame - tex->m_lastMipRequestFrame > UNUSED_FRAME_COUNT)
+		{
+			tex->m_wantedMip = tex->m_tailMip;
+		}
+
+		totalMemory += tex->computeMemory(tex->m_wantedMip);
+	}
+
+	ANKI_TRACE_INC_COUNTER(RSRC_STREAMED_TEXTURES_WANTED_MEMORY, totalMemory);
+
+	if(totalMemory <= m_budget)
+	{
+		return;
+	}
+
+	// Over the budget. Drop mips from the textures that were used the longest time ago first
+	std::sort(m_textures.getBegin(), m_textures.getEnd(), [](const StreamedTexture* a, const StreamedTexture* b) {
+		return a->m_lastMipRequestFrame < b->m_lastMipRequestFrame;
+	});
+
+	for(U32 i = 0; i < m_textures.getSize(); ++i)
+	{
+		StreamedTexture& tex = *m_textures[i];
+		tex.m_streamerIndex = i;
+
+		while(totalMemory > m_budget && tex.m_wantedMip < tex.m_tailMip && !tex.m_streamingFailed)
+		{
+			totalMemory -= tex.computeMemory(tex.m_wantedMip) - tex.computeMemory(tex.m_wantedMip + 1);
+			++tex.m_wantedMip;
+		}
+	}
+}
+
+U32 TextureStreamer::computeLoads(Array<Load, MAX_LOADS_IN_FLIGHT>& loads)
+{
+	++m_frame;
+	computeWantedMips();
+
+	// First the textures that are visible now, then the rest and last the ones that drop mips
+	U32 loadCount = 0;
+	for(AsyncLoaderTaskPriority priority = AsyncLoaderTaskPriority::FIRST; priority < AsyncLoaderTaskPriority::COUNT;
+		++priority)
+	{
+		for(StreamedTexture* tex : m_textures)
+		{
+			if(m_loadsInFlight >= MAX_LOADS_IN_FLIGHT)
+			{
+				break;
+			}
+
+			// The StreamTask of the previous load may still hold the handle
+			if(tex->m_loadingMip != MAX_U8 || tex->m_wantedMip == tex->m_residentMip || tex->m_streamTask.isPending())
+			{
+				continue;
+			}
+
+			AsyncLoaderTaskPriority texPriority;
+			if(tex->m_wantedMip > tex->m_residentMip)
+			{
+				texPriority = AsyncLoaderTaskPriority::LOW;
+			}
+			else if(tex->m_lastMipRequestFrame == m_frame && tex->m_mipFeedback.load())
+			{
+				texPriority = AsyncLoaderTaskPriority::HIGH;
+			}
+			else
+			{
+				texPriority = AsyncLoaderTaskPriority::MEDIUM;
+			}
+
+			if(texPriority == priority)
+			{
+				tex->m_loadingMip = tex->m_wantedMip;
+				++m_loadsInFlight;
+
+				Load& load = loads[loadCount++];
+				load.m_tex = tex;
+				load.m_mip = tex->m_wantedMip;
+				load.m_priority = priority;
+			}
+		}
+	}
+
+	return loadCount;
+}
+
+void TextureStreamer::endFrame()
+{
+	if(!isEnabled())
+	{
+		return;
+	}
+
+	LockGuard<Mutex> lock(m_mtx);
+
+	// Swap the textures that finished uploading
+	for(StreamedTexture* tex : m_textures)
+	{
+		if(tex->m_loadedFence && tex->m_loadedFence->clientWait(0.0))
+		{
+			m_residentMemory -= tex->computeMemory(tex->m_residentMip);
+			tex->m_residentMip = tex->m_loadingMip;
+			m_residentMemory += tex->computeMemory(tex->m_residentMip);
+
+			// Nothing reads the texture of the resource at that point so it can change
+			TextureResource& rsrc = *tex->m_rsrc;
+			ANKI_ASSERT(rsrc.getManager().getAsyncLoader().isPaused() && "Not a safe point to swap the textures");
+			rsrc.m_tex = std::move(tex->m_loadedTex);
+			rsrc.m_texView = rsrc.getManager().getGrManager().newTextureView(TextureViewInitInfo(rsrc.m_tex, "Rsrc"));
+			tex->m_loadedFence.reset(nullptr);
+			tex->m_loadingMip = MAX_U8;
+			--m_loadsInFlight;
+		}
+	}
+
+	// Submit the new loads
+	Array<Load, MAX_LOADS_IN_FLIGHT> loads;
+	const U32 loadCount = computeLoads(loads);
+	for(U32 i = 0; i < loadCount; ++i)
+	{
+		loads[i].m_tex->m_rsrc->submitStreamTask(loads[i].m_mip, loads[i].m_priority);
+		ANKI_TRACE_INC_COUNTER(RSRC_TEXTURE_STREAM_LOADS, 1);
+	}
+
+	ANKI_TRACE_INC_COUNTER(RSRC_STREAMED_TEXTURES_MEMORY, m_residentMemory);
+}
+
+} // end namespace anki
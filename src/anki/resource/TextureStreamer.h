@@ -0,0 +1,139 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#pragma once
+
+#include <anki/resource/Common.h>
+#include <anki/resource/AsyncLoader.h>
+#include <anki/Gr.h>
+#include <anki/util/DynamicArray.h>
+#include <anki/util/Thread.h>
+
+namespace anki
+{
+
+// Forward
+class TextureResource;
+
+/// @addtogroup resource
+/// @{
+
+/// The streaming state of a TextureResource. The mips are relative to the file. The TextureStreamer protects the non
+/// atomic members.
+class StreamedTexture
+{
+public:
+	TextureResource* m_rsrc = nullptr;
+	mutable Atomic<U32> m_requestedMip = {MAX_U32}; ///< The feedback of the current frame.
+	Atomic<U32> m_mipFeedback = {0};
+	U64 m_lastMipRequestFrame = 0;
+	U32 m_streamerIndex = MAX_U32; ///< Index in the TextureStreamer.
+	UVec2 m_size = UVec2(0u); ///< The size of m_firstMip.
+	Format m_format = Format::NONE;
+	U8 m_mipCount = 0; ///< All the mips of the file.
+	U8 m_firstMip = 0; ///< The finest mip that fits the max texture size.
+	U8 m_tailMip = 0; ///< The finest mip that is always resident.
+	U8 m_residentMip = 0; ///< The finest mip of the texture of m_rsrc.
+	U8 m_wantedMip = 0;
+	U8 m_loadingMip = MAX_U8; ///< The finest mip of the texture that loads.
+	Bool8 m_streamingFailed = false;
+
+	/// The new texture of a load. The TextureStreamer swaps it with the texture of m_rsrc when the fence is signaled.
+	TexturePtr m_loadedTex;
+	FencePtr m_loadedFence;
+
+	/// The handle of the StreamTask. The task publishes its texture before the AsyncLoader releases the handle so
+	/// a new load waits for both.
+	AsyncLoaderTaskHandle m_streamTask;
+
+	/// Get the GPU memory of the mips from mip and bellow.
+	PtrSize computeMemory(U8 mip) const;
+};
+
+/// Streams the mips of the TextureResources in and out under a memory budget. The renderer says which mips it needs
+/// with TextureResource::requestMip() and once per frame endFrame() picks the mips to load and submits AsyncLoader
+/// tasks that create the new textures. When their uploads are done the new textures replace the old ones.
+///
+/// The budget covers the mips the textures want. While a load is in flight both the old and the new texture are
+/// resident so the GPU memory may go over the budget by the size of the textures that load.
+class TextureStreamer : public NonCopyable
+{
+public:
+	/// A texture that is not requested for that many frames drops to its tail mips.
+	static const U32 UNUSED_FRAME_COUNT = 60;
+
+	/// The max number of textures that load at the same time.
+	static const U32 MAX_LOADS_IN_FLIGHT = 4;
+
+	TextureStreamer(ResourceAllocator<U8> alloc, PtrSize budget, U32 tailSize)
+		: m_alloc(alloc)
+		, m_budget(budget)
+		, m_tailSize(tailSize)
+	{
+	}
+
+	~TextureStreamer();
+
+	/// If it's disabled all the mips are loaded.
+	Bool isEnabled() const
+	{
+		return m_budget > 0;
+	}
+
+	/// The textures always keep the mips that are smaller or equal to that.
+	U32 getTailSize() const
+	{
+		return m_tailSize;
+	}
+
+	/// Swap the textures that finished loading and submit new loads. Call it from the main thread between frames with
+	/// the AsyncLoader paused, no other thread may use the textures of the TextureResources while it runs.
+	void endFrame();
+
+	/// Get the GPU memory of the streamed textures.
+	PtrSize getResidentMemory() const
+	{
+		return m_residentMemory;
+	}
+
+anki_internal:
+	/// A load that endFrame() submits.
+	class Load
+	{
+	public:
+		StreamedTexture* m_tex;
+		U8 m_mip;
+		AsyncLoaderTaskPriority m_priority;
+	};
+
+	void registerTexture(StreamedTexture& tex);
+
+	void unregisterTexture(StreamedTexture& tex);
+
+	/// The StreamTask calls that when it's done. If newTex is nullptr the task failed.
+	void finishStreaming(StreamedTexture& tex, TexturePtr newTex, FencePtr fence);
+
+	/// Start a new frame, decide the mips of the textures and pick the loads in the order they should be submitted.
+	/// It marks the textures as loading. endFrame() calls it with the lock held, it doesn't touch the GPU.
+	/// @return The number of loads.
+	U32 computeLoads(Array<Load, MAX_LOADS_IN_FLIGHT>& loads);
+
+private:
+	ResourceAllocator<U8> m_alloc;
+	PtrSize m_budget;
+	U32 m_tailSize;
+
+	Mutex m_mtx; ///< Protects the textures and the members bellow.
+	DynamicArray<StreamedTexture*> m_textures;
+	U32 m_loadsInFlight = 0;
+	U64 m_frame = 0;
+	PtrSize m_residentMemory = 0;
+
+	/// Decide the mips of the textures.
+	void computeWantedMips();
+};
+/// @}
+
+} // end namespace anki
@@ -29,8 +29,13 @@ class Event;
 /// @{
 
 /// The type of the scene's allocator
+#if ANKI_TLSF_ALLOCATORS
+template<typename T>
+using SceneAllocator = TlsfAllocator<T>;
+#else
 template<typename T>
 using SceneAllocator = HeapAllocator<T>;
+#endif
 
 /// The type of the scene's frame allocator
 template<typename T>
@@ -8,10 +8,25 @@
 #include <anki/collision/Aabb.h>
 #include <anki/collision/Frustum.h>
 #include <anki/util/ThreadHive.h>
+#include <anki/math/Simd.h>
 
 namespace anki
 {
 
+/// Get the deferred placement list of the calling thread.
+static U32 getDeferredPlacementListIndex(U32 listCount)
+{
+	static Atomic<U32> threadCount = {0};
+	static thread_local U32 idx = MAX_U32;
+
+	if(ANKI_UNLIKELY(idx == MAX_U32))
+	{
+		idx = threadCount.fetchAdd(1);
+	}
+
+	return idx % listCount;
+}
+
 /// Return a heatmap color.
 static Vec3 heatmap(F32 factor)
 {
@@ -60,16 +75,22 @@ Octree::~Octree()
 	ANKI_ASSERT(m_placeableCount == 0);
 	cleanupInternal();
 	ANKI_ASSERT(m_rootLeaf == nullptr);
+
+	m_linearNodes.destroy(m_alloc);
+	m_linearChildBounds.destroy(m_alloc);
 }
 
-void Octree::init(const Vec3& sceneAabbMin, const Vec3& sceneAabbMax, U32 maxDepth)
+void Octree::init(const Vec3& sceneAabbMin, const Vec3& sceneAabbMax, U32 maxDepth, OctreeLayout layout)
 {
 	ANKI_ASSERT(sceneAabbMin < sceneAabbMax);
 	ANKI_ASSERT(maxDepth > 0);
+	ANKI_ASSERT((layout == OctreeLayout::POINTER_TREE || maxDepth * 7 + 1 <= MAX_LINEAR_WALK_STACK_SIZE)
+				&& "The walk stack of the linear layout is not big enough");
 
 	m_maxDepth = maxDepth;
 	m_sceneAabbMin = sceneAabbMin;
 	m_sceneAabbMax = sceneAabbMax;
+	m_layout = layout;
 }
 
 void Octree::place(const Aabb& volume, OctreePlaceable* placeable)
@@ -98,9 +119,162 @@ void Octree::place(const Aabb& volume, OctreePlaceable* placeable)
 void Octree::remove(OctreePlaceable& placeable)
 {
 	LockGuard<Mutex> lock(m_globalMtx);
+
+	if(ANKI_UNLIKELY(placeable.m_deferredPlacement))
+	{
+		// Rare case, walk the lists and unlink it. Other threads might push to the lists at the same time
+		for(DeferredPlacementList& list : m_deferredPlacementLists)
+		{
+			LockGuard<SpinLock> listLock(list.m_lock);
+
+			OctreePlaceable* prev = nullptr;
+			for(OctreePlaceable* it = list.m_head; it; prev = it, it = it->m_nextDeferred)
+			{
+				if(it == &placeable)
+				{
+					if(prev)
+					{
+						prev->m_nextDeferred = it->m_nextDeferred;
+					}
+					else
+					{
+						list.m_head = it->m_nextDeferred;
+					}
+					break;
+				}
+			}
+		}
+
+		placeable.m_nextDeferred = nullptr;
+		placeable.m_deferredPlacement = false;
+	}
+
 	removeInternal(placeable);
 }
 
+void Octree::placeDeferred(const Aabb& volume, OctreePlaceable* placeable)
+{
+	ANKI_ASSERT(placeable);
+	ANKI_ASSERT(testCollisionShapes(volume, Aabb(m_sceneAabbMin, m_sceneAabbMax)) && "volume is outside the scene");
+
+	placeable->m_deferredVolume = volume;
+	if(placeable->m_deferredPlacement)
+	{
+		// Already in a list, just update the volume
+		return;
+	}
+
+	placeable->m_deferredPlacement = true;
+
+	DeferredPlacementList& list =
+		m_deferredPlacementLists[getDeferredPlacementListIndex(MAX_DEFERRED_PLACEMENT_LISTS)];
+	LockGuard<SpinLock> lock(list.m_lock);
+	placeable->m_nextDeferred = list.m_head;
+	list.m_head = placeable;
+}
+
+void Octree::applyDeferredPlacements(ThreadHive* hive)
+{
+	ANKI_TRACE_SCOPED_EVENT(SCENE_OCTREE_DEFERRED_PLACEMENTS);
+
+	// Lock before taking the lists so remove() can't run while a placeable is out of the lists but not placed yet
+	LockGuard<Mutex> lock(m_globalMtx);
+
+	// Gather the placeables
+	U32 count = 0;
+	Array<OctreePlaceable*, MAX_DEFERRED_PLACEMENT_LISTS> heads;
+	for(U32 i = 0; i < MAX_DEFERRED_PLACEMENT_LISTS; ++i)
+	{
+		DeferredPlacementList& list = m_deferredPlacementLists[i];
+		{
+			LockGuard<SpinLock> listLock(list.m_lock);
+			heads[i] = list.m_head;
+			list.m_head = nullptr;
+		}
+
+		for(OctreePlaceable* it = heads[i]; it; it = it->m_nextDeferred)
+		{
+			++count;
+		}
+	}
+
+	if(count == 0)
+	{
+		return;
+	}
+
+	ANKI_TRACE_INC_COUNTER(OCTREE_DEFERRED_PLACEMENTS, count);
+
+	DynamicArrayAuto<OctreePlaceable*> placeables(m_alloc);
+	placeables.create(count);
+	count = 0;
+	for(OctreePlaceable* head : heads)
+	{
+		for(OctreePlaceable* it = head; it; it = it->m_nextDeferred)
+		{
+			placeables[count++] = it;
+		}
+	}
+
+	// Remove
+	DynamicArrayAuto<Leaf*> sweptLeafs(m_alloc);
+	if(count >= BULK_REMOVAL_THRESHOLD)
+	{
+		ANKI_TRACE_INC_COUNTER(OCTREE_BULK_REMOVALS, 1);
+		bulkRemoveInternal(WeakArray<OctreePlaceable*>(&placeables[0], count), sweptLeafs);
+	}
+	else
+	{
+		for(OctreePlaceable* placeable : placeables)
+		{
+			removeInternal(*placeable);
+		}
+	}
+
+	// Create the root leaf. It might have been deleted when all the placeables got removed
+	if(!m_rootLeaf)
+	{
+		m_rootLeaf = newLeaf();
+		m_rootLeaf->m_aabbMin = m_sceneAabbMin;
+		m_rootLeaf->m_aabbMax = m_sceneAabbMax;
+	}
+
+	// Re-place
+	if(hive && count >= PARALLEL_PLACEMENT_THRESHOLD)
+	{
+		hive->parallelFor(0, count, 0, [&](U32 idx, U32 threadId) {
+			placeRecursive(placeables[idx]->m_deferredVolume, placeables[idx], m_rootLeaf, 0);
+		});
+		hive->waitAllTasks();
+	}
+	else
+	{
+		for(OctreePlaceable* placeable : placeables)
+		{
+			placeRecursive(placeable->m_deferredVolume, placeable, m_rootLeaf, 0);
+		}
+	}
+
+	for(OctreePlaceable* placeable : placeables)
+	{
+		placeable->m_nextDeferred = nullptr;
+		placeable->m_deferredPlacement = false;
+	}
+	m_placeableCount += count;
+
+	// The leafs that the bulk removal emptied and the re-placement didn't fill again are pruned
+	for(Leaf* leaf : sweptLeafs)
+	{
+		if(leaf->m_placeables.isEmpty())
+		{
+			cleanupInternal();
+			break;
+		}
+	}
+
+	releaseRecycledNodes();
+}
+
 Bool Octree::volumeTotallyInsideLeaf(const Aabb& volume, const Leaf& leaf)
 {
 	const Vec4& amin = volume.getMin();
@@ -135,15 +309,18 @@ void Octree::placeRecursive(const Aabb& volume, OctreePlaceable* placeable, Leaf
 		{
 			ANKI_ASSERT(node.m_leaf != parent && "Already binned. That's wrong");
 		}
+#endif
+
+		// Connect placeable and leaf
+		placeable->m_leafs.pushBack(newLeafNode(parent));
 
+		LockGuard<SpinLock> lock(parent->m_lock);
+#if ANKI_ASSERTS_ENABLED
 		for(const PlaceableNode& node : parent->m_placeables)
 		{
 			ANKI_ASSERT(node.m_placeable != placeable);
 		}
 #endif
-
-		// Connect placeable and leaf
-		placeable->m_leafs.pushBack(newLeafNode(parent));
 		parent->m_placeables.pushBack(newPlaceableNode(placeable));
 
 		return;
@@ -204,29 +381,35 @@ void Octree::placeRecursive(const Aabb& volume, OctreePlaceable* placeable, Leaf
 	const LeafMask maskUnion = maskX & maskY & maskZ;
 	ANKI_ASSERT(!!maskUnion && "Should be inside at least one leaf");
 
-	for(U i = 0; i < 8; ++i)
+	// Create the leafs the placeable touches
+	Array<Leaf*, 8> children;
 	{
-		const LeafMask crntBit = LeafMask(1u << i);
-
-		if(!!(maskUnion & crntBit))
+		LockGuard<SpinLock> lock(parent->m_lock);
+		for(U i = 0; i < 8; ++i)
 		{
-			// Inside the leaf, move deeper
+			const LeafMask crntBit = LeafMask(1u << i);
 
-			// Create the leaf
-			if(parent->m_children[i] == nullptr)
+			if(!!(maskUnion & crntBit) && parent->m_children[i] == nullptr)
 			{
 				Leaf* child = newLeaf();
 
 				// Compute AABB
-				Vec3 childAabbMin, childAabbMax;
 				computeChildAabb(
 					crntBit, parent->m_aabbMin, parent->m_aabbMax, center, child->m_aabbMin, child->m_aabbMax);
 
 				parent->m_children[i] = child;
 			}
 
-			// Move deeper
-			placeRecursive(volume, placeable, parent->m_children[i], depth + 1);
+			children[i] = parent->m_children[i];
+		}
+	}
+
+	// Move deeper
+	for(U i = 0; i < 8; ++i)
+	{
+		if(!!(maskUnion & LeafMask(1u << i)))
+		{
+			placeRecursive(volume, placeable, children[i], depth + 1);
 		}
 	}
 }
@@ -325,6 +508,76 @@ void Octree::removeInternal(OctreePlaceable& placeable)
 	}
 }
 
+void Octree::bulkRemoveInternal(WeakArray<OctreePlaceable*> placeables, DynamicArrayAuto<Leaf*>& leafs)
+{
+	// Disconnect the placeables from the leafs and gather the leafs that need to be swept
+	for(OctreePlaceable* placeable : placeables)
+	{
+		ANKI_ASSERT(placeable->m_deferredPlacement);
+		if(placeable->m_leafs.isEmpty())
+		{
+			continue;
+		}
+
+		while(!placeable->m_leafs.isEmpty())
+		{
+			LeafNode& leafNode = placeable->m_leafs.getFront();
+			placeable->m_leafs.popFront();
+
+			if(!leafNode.m_leaf->m_markedForBulkRemoval)
+			{
+				leafNode.m_leaf->m_markedForBulkRemoval = true;
+				leafs.emplaceBack(leafNode.m_leaf);
+			}
+
+			m_recycledLeafNodes.pushBack(&leafNode);
+		}
+
+		ANKI_ASSERT(m_placeableCount > 0);
+		--m_placeableCount;
+	}
+
+	ANKI_TRACE_INC_COUNTER(OCTREE_BULK_REMOVAL_LEAFS, leafs.getSize());
+
+	// Sweep every leaf once
+	for(Leaf* leaf : leafs)
+	{
+		auto it = leaf->m_placeables.getBegin();
+		while(it != leaf->m_placeables.getEnd())
+		{
+			PlaceableNode& placeableNode = *it;
+			++it;
+
+			if(placeableNode.m_placeable->m_deferredPlacement)
+			{
+				leaf->m_placeables.erase(&placeableNode);
+				m_recycledPlaceableNodes.pushBack(&placeableNode);
+			}
+		}
+
+		leaf->m_markedForBulkRemoval = false;
+	}
+
+	// Don't prune the leafs here, the placeables will be placed again in the same leafs more or less
+}
+
+void Octree::releaseRecycledNodes()
+{
+	while(!m_recycledPlaceableNodes.isEmpty())
+	{
+		PlaceableNode& node = m_recycledPlaceableNodes.getFront();
+		m_recycledPlaceableNodes.popFront();
+		releasePlaceableNode(&node);
+	}
+
+	while(!m_recycledLeafNodes.isEmpty())
+	{
+		LeafNode& node = m_recycledLeafNodes.getFront();
+		m_recycledLeafNodes.popFront();
+		releaseLeafNode(&node);
+	}
+}
+
 void Octree::gatherVisibleRecursive(const Frustum& frustum,
 	U32 testId,
 	OctreeNodeVisibilityTestCallback testCallback,
@@ -548,4 +801,136 @@ void Octree::gatherVisibleParallelTask(
 	}
 }
 
+void Octree::updateLinearTree()
+{
+	ANKI_ASSERT(m_layout == OctreeLayout::LINEAR);
+	if(m_linearTreeDirty.load() == 0)
+	{
+		return;
+	}
+
+	LockGuard<Mutex> lock(m_globalMtx);
+	if(m_linearTreeDirty.load() == 0)
+	{
+		// Someone else rebuilt it
+		return;
+	}
+
+	ANKI_TRACE_SCOPED_EVENT(SCENE_OCTREE_LINEARIZE);
+
+	// Grow the storage. Never shrink it to avoid re-allocations in dynamic scenes
+	if(m_linearNodes.getSize() < m_leafCount)
+	{
+		m_linearNodes.resize(m_alloc, m_leafCount);
+		m_linearChildBounds.resize(m_alloc, m_leafCount);
+	}
+
+	// Breadth first. The children of a leaf are stored next to each other and in the order of their octant so every
+	// level ends up sorted in Morton order
+	U32 nodeCount = 0;
+	U32 childBoundsCount = 0;
+	if(m_rootLeaf)
+	{
+		m_linearNodes[nodeCount++].m_leaf = m_rootLeaf;
+	}
+
+	for(U32 i = 0; i < nodeCount; ++i)
+	{
+		LinearNode& node = m_linearNodes[i];
+		const Leaf& leaf = *node.m_leaf;
+
+		if(!leaf.hasChildren())
+		{
+			node.m_firstChild = MAX_U32;
+			node.m_childBounds = MAX_U32;
+			continue;
+		}
+
+		node.m_firstChild = nodeCount;
+		node.m_childBounds = childBoundsCount;
+		LinearChildBounds& bounds = m_linearChildBounds[childBoundsCount++];
+		bounds.m_childMask = 0;
+
+		for(U32 c = 0; c < 8; ++c)
+		{
+			const Leaf* child = leaf.m_children[c];
+			if(child)
+			{
+				bounds.m_childMask |= 1u << c;
+				m_linearNodes[nodeCount++].m_leaf = const_cast<Leaf*>(child);
+
+				bounds.m_minX[c] = child->m_aabbMin.x();
+				bounds.m_minY[c] = child->m_aabbMin.y();
+				bounds.m_minZ[c] = child->m_aabbMin.z();
+				bounds.m_maxX[c] = child->m_aabbMax.x();
+				bounds.m_maxY[c] = child->m_aabbMax.y();
+				bounds.m_maxZ[c] = child->m_aabbMax.z();
+			}
+			else
+			{
+				bounds.m_minX[c] = bounds.m_minY[c] = bounds.m_minZ[c] = 0.0f;
+				bounds.m_maxX[c] = bounds.m_maxY[c] = bounds.m_maxZ[c] = 0.0f;
+			}
+		}
+	}
+
+	ANKI_ASSERT(nodeCount == m_leafCount);
+	m_linearNodeCount = nodeCount;
+
+	m_linearTreeDirty.store(0);
+}
+
+U32 Octree::testLinearChildren(const LinearChildBounds& bounds, const Frustum& frustum)
+{
+	// A box is outside a plane if its corner that is furthest along the plane's normal is behind the plane
+#if ANKI_SIMD == ANKI_SIMD_SSE
+	__m128 inside0 = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	__m128 inside1 = inside0;
+
+	for(const Plane& plane : frustum.getPlanesWorldSpace())
+	{
+		const Vec4& n = plane.getNormal();
+		const F32* x = (n.x() >= 0.0f) ? &bounds.m_maxX[0] : &bounds.m_minX[0];
+		const F32* y = (n.y() >= 0.0f) ? &bounds.m_maxY[0] : &bounds.m_minY[0];
+		const F32* z = (n.z() >= 0.0f) ? &bounds.m_maxZ[0] : &bounds.m_minZ[0];
+
+		const __m128 nx = _mm_set1_ps(n.x());
+		const __m128 ny = _mm_set1_ps(n.y());
+		const __m128 nz = _mm_set1_ps(n.z());
+		const __m128 offset = _mm_set1_ps(plane.getOffset());
+
+		__m128 dist0 = _mm_mul_ps(nx, _mm_load_ps(x));
+		dist0 = _mm_add_ps(dist0, _mm_mul_ps(ny, _mm_load_ps(y)));
+		dist0 = _mm_add_ps(dist0, _mm_mul_ps(nz, _mm_load_ps(z)));
+		inside0 = _mm_and_ps(inside0, _mm_cmpge_ps(dist0, offset));
+
+		__m128 dist1 = _mm_mul_ps(nx, _mm_load_ps(x + 4));
+		dist1 = _mm_add_ps(dist1, _mm_mul_ps(ny, _mm_load_ps(y + 4)));
+		dist1 = _mm_add_ps(dist1, _mm_mul_ps(nz, _mm_load_ps(z + 4)));
+		inside1 = _mm_and_ps(inside1, _mm_cmpge_ps(dist1, offset));
+	}
+
+	const U32 mask = U32(_mm_movemask_ps(inside0)) | (U32(_mm_movemask_ps(inside1)) << 4u);
+#else
+	U32 mask = bounds.m_childMask;
+	for(const Plane& plane : frustum.getPlanesWorldSpace())
+	{
+		const Vec4& n = plane.getNormal();
+		for(U32 c = 0; c < 8; ++c)
+		{
+			const F32 x = (n.x() >= 0.0f) ? bounds.m_maxX[c] : bounds.m_minX[c];
+			const F32 y = (n.y() >= 0.0f) ? bounds.m_maxY[c] : bounds.m_minY[c];
+			const F32 z = (n.z() >= 0.0f) ? bounds.m_maxZ[c] : bounds.m_minZ[c];
+
+			if(n.x() * x + n.y() * y + n.z() * z < plane.getOffset())
+			{
+				mask &= ~(1u << c);
+			}
+		}
+	}
+#endif
+
+	return mask & bounds.m_childMask;
+}
+
 } // end namespace anki
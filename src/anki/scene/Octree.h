@@ -12,6 +12,8 @@
 #include <anki/util/Enum.h>
 #include <anki/util/ObjectAllocator.h>
 #include <anki/util/List.h>
+#include <anki/util/DynamicArray.h>
+#include <anki/collision/Frustum.h>
 #include <anki/core/Trace.h>
 
 namespace anki
@@ -28,6 +30,18 @@ class ThreadHiveSemaphore;
 /// Callback to determine if an octree node is visible.
 using OctreeNodeVisibilityTestCallback = Bool (*)(void* userData, const Aabb& box);
 
+/// The memory layout that the Octree uses for visibility tests.
+enum class OctreeLayout : U8
+{
+	/// Walk the leafs through their child pointers.
+	POINTER_TREE,
+
+	/// Keep a flat copy of the tree where the leafs are sorted by level and in Morton order inside the level. The
+	/// bounds of the children are SoA so the frustum tests are done for 8 children at a time with SIMD. The copy is
+	/// rebuilt on the first visibility test after leafs got created or deleted.
+	LINEAR
+};
+
 /// Octree debug drawer.
 class OctreeDebugDrawer
 {
@@ -48,13 +62,29 @@ public:
 
 	~Octree();
 
-	void init(const Vec3& sceneAabbMin, const Vec3& sceneAabbMax, U32 maxDepth);
+	void init(const Vec3& sceneAabbMin,
+		const Vec3& sceneAabbMax,
+		U32 maxDepth,
+		OctreeLayout layout = OctreeLayout::POINTER_TREE);
 
 	/// Place or re-place an element in the tree.
 	/// @note It's thread-safe against place and remove methods.
 	void place(const Aabb& volume, OctreePlaceable* placeable);
 
-	/// Remove an element from the tree.
+	/// Record a new volume for a placeable and re-place it later in applyDeferredPlacements. Use it when many
+	/// placeables move at the same time.
+	/// @note It's thread-safe against other placeDeferred and remove calls. Every thread pushes to its own list so the
+	///       lock of the list is rarely contended. It shouldn't be called for the same placeable from different threads
+	///       before applyDeferredPlacements.
+	void placeDeferred(const Aabb& volume, OctreePlaceable* placeable);
+
+	/// Place all the placeables that were recorded with placeDeferred.
+	/// @param hive If it's not nullptr and there are many placeables the re-placement will run in the threads of the
+	///             hive. The caller should be the thread that owns the hive.
+	/// @note It's thread-safe against place and remove methods but not against placeDeferred.
+	void applyDeferredPlacements(ThreadHive* hive = nullptr);
+
+	/// Remove an element from the tree. It will also cancel a pending deferred placement.
 	/// @note It's thread-safe against place and remove methods.
 	void remove(OctreePlaceable& placeable);
 
@@ -72,7 +102,17 @@ public:
 		void* testCallbackUserData,
 		DynamicArrayAuto<void*>& out)
 	{
-		gatherVisibleRecursive(frustum, testId, testCallback, testCallbackUserData, m_rootLeaf, out);
+		if(m_layout == OctreeLayout::LINEAR)
+		{
+			walkTree(testId,
+				frustum,
+				[&](const Aabb& box) { return testCallback == nullptr || testCallback(testCallbackUserData, box); },
+				[&](void* placeableUserData) { out.emplaceBack(placeableUserData); });
+		}
+		else
+		{
+			gatherVisibleRecursive(frustum, testId, testCallback, testCallbackUserData, m_rootLeaf, out);
+		}
 	}
 
 	/// Similar to gatherVisible but it spawns ThreadHive tasks.
@@ -99,6 +139,20 @@ public:
 		walkTreeInternal(*m_rootLeaf, testId, testFunc, newPlaceableFunc);
 	}
 
+	/// Walk the tree and test the leafs against a frustum first. Similar to the other walkTree but it uses the SIMD
+	/// path if the layout is OctreeLayout::LINEAR.
+	/// @tparam TTestAabbFunc Additional test for the leafs that are inside the frustum.
+	///                       Signature: Bool(*)(const Aabb& leafBox)
+	/// @tparam TNewPlaceableFunc See the other walkTree.
+	/// @note It's thread-safe against other walkTree and gatherVisible calls.
+	template<typename TTestAabbFunc, typename TNewPlaceableFunc>
+	void walkTree(U32 testId, const Frustum& frustum, TTestAabbFunc testFunc, TNewPlaceableFunc newPlaceableFunc);
+
+	U32 getLeafCount() const
+	{
+		return m_leafCount;
+	}
+
 	/// Debug draw.
 	void debugDraw(OctreeDebugDrawer& drawer) const
 	{
@@ -110,6 +164,14 @@ private:
 	class GatherParallelCtx;
 	class GatherParallelTaskCtx;
 
+	/// A list of placeables that called placeDeferred. Every thread pushes to its own list.
+	class alignas(ANKI_CACHE_LINE_SIZE) DeferredPlacementList
+	{
+	public:
+		OctreePlaceable* m_head = nullptr;
+		SpinLock m_lock; ///< Taken by the owner thread's pushes and by remove().
+	};
+
 	/// List node.
 	class PlaceableNode : public IntrusiveListEnabled<PlaceableNode>
 	{
@@ -133,6 +195,8 @@ private:
 		Vec3 m_aabbMin;
 		Vec3 m_aabbMax;
 		Array<Leaf*, 8> m_children = {};
+		Bool8 m_markedForBulkRemoval = false;
+		SpinLock m_lock; ///< Protects m_placeables and m_children when the placements run in parallel.
 
 #if ANKI_ASSERTS_ENABLED
 		~Leaf()
@@ -165,6 +229,44 @@ private:
 #endif
 	};
 
+	/// A leaf of the linear layout. Keep it small, the walk is bound by memory access.
+	class LinearNode
+	{
+	public:
+		Leaf* m_leaf; ///< The placeables are still in the leaf.
+		U32 m_firstChild; ///< Index to m_linearNodes. The children are next to each other.
+		U32 m_childBounds; ///< Index to m_linearChildBounds or MAX_U32 if there are no children.
+	};
+
+	/// The bounds of the children of a LinearNode in SoA form.
+	class alignas(16) LinearChildBounds
+	{
+	public:
+		/// @name Unused children have zero sized boxes
+		/// @{
+		Array<F32, 8> m_minX;
+		Array<F32, 8> m_minY;
+		Array<F32, 8> m_minZ;
+		Array<F32, 8> m_maxX;
+		Array<F32, 8> m_maxY;
+		Array<F32, 8> m_maxZ;
+		/// @}
+
+		U32 m_childMask; ///< One bit per existing child.
+
+		Aabb getAabb(U32 child) const
+		{
+			return Aabb(Vec3(m_minX[child], m_minY[child], m_minZ[child]),
+				Vec3(m_maxX[child], m_maxY[child], m_maxZ[child]));
+		}
+
+		/// Get the offset of a child from LinearNode::m_firstChild.
+		U32 getChildOffset(U32 child) const
+		{
+			return U32(__builtin_popcount(m_childMask & ((1u << child) - 1u)));
+		}
+	};
+
 	/// P: Stands for positive and N: Negative
 	enum class LeafMask : U8
 	{
@@ -193,6 +295,7 @@ private:
 	Vec3 m_sceneAabbMin = Vec3(0.0f);
 	Vec3 m_sceneAabbMax = Vec3(0.0f);
 	Mutex m_globalMtx;
+	SpinLock m_nodeAllocLock; ///< Protects the allocation of leafs and nodes when the placements run in parallel.
 
 	ObjectAllocatorSameType<Leaf, 256> m_leafAlloc;
 	ObjectAllocatorSameType<LeafNode, 128> m_leafNodeAlloc;
@@ -200,21 +303,68 @@ private:
 
 	Leaf* m_rootLeaf = nullptr;
 	U32 m_placeableCount = 0;
+	U32 m_leafCount = 0;
+
+	/// @name Linear layout
+	/// @{
+	OctreeLayout m_layout = OctreeLayout::POINTER_TREE;
+	Atomic<U32> m_linearTreeDirty = {0}; ///< Set when leafs got created or deleted.
+	DynamicArray<LinearNode> m_linearNodes;
+	DynamicArray<LinearChildBounds> m_linearChildBounds;
+	U32 m_linearNodeCount = 0;
+	/// @}
+
+	static const U32 MAX_LINEAR_WALK_STACK_SIZE = 128;
+
+	/// @name Deferred placement
+	/// @{
+	static const U32 MAX_DEFERRED_PLACEMENT_LISTS = 16;
+
+	/// After that many deferred placements the removals will sweep the affected leafs once instead of searching
+	/// every leaf for every placeable.
+	static const U32 BULK_REMOVAL_THRESHOLD = 64;
+
+	/// After that many deferred placements applyDeferredPlacements will re-place them in parallel.
+	static const U32 PARALLEL_PLACEMENT_THRESHOLD = 256;
+
+	Array<DeferredPlacementList, MAX_DEFERRED_PLACEMENT_LISTS> m_deferredPlacementLists;
+
+	/// The bulk removal keeps the nodes here so the re-placement can reuse them. Searching the object allocators'
+	/// chunks is what dominates the re-placement cost of many placeables.
+	IntrusiveList<PlaceableNode> m_recycledPlaceableNodes;
+	IntrusiveList<LeafNode> m_recycledLeafNodes;
+	/// @}
 
 	Leaf* newLeaf()
 	{
+		LockGuard<SpinLock> lock(m_nodeAllocLock);
+		++m_leafCount;
+		m_linearTreeDirty.store(1);
 		return m_leafAlloc.newInstance(m_alloc);
 	}
 
 	void releaseLeaf(Leaf* leaf)
 	{
+		ANKI_ASSERT(m_leafCount > 0);
+		--m_leafCount;
+		m_linearTreeDirty.store(1);
 		m_leafAlloc.deleteInstance(m_alloc, leaf);
 	}
 
 	PlaceableNode* newPlaceableNode(OctreePlaceable* placeable)
 	{
 		ANKI_ASSERT(placeable);
-		PlaceableNode* out = m_placeableNodeAlloc.newInstance(m_alloc);
+		LockGuard<SpinLock> lock(m_nodeAllocLock);
+		PlaceableNode* out;
+		if(!m_recycledPlaceableNodes.isEmpty())
+		{
+			out = &m_recycledPlaceableNodes.getFront();
+			m_recycledPlaceableNodes.popFront();
+		}
+		else
+		{
+			out = m_placeableNodeAlloc.newInstance(m_alloc);
+		}
 		out->m_placeable = placeable;
 		return out;
 	}
@@ -227,7 +377,17 @@ private:
 	LeafNode* newLeafNode(Leaf* leaf)
 	{
 		ANKI_ASSERT(leaf);
-		LeafNode* out = m_leafNodeAlloc.newInstance(m_alloc);
+		LockGuard<SpinLock> lock(m_nodeAllocLock);
+		LeafNode* out;
+		if(!m_recycledLeafNodes.isEmpty())
+		{
+			out = &m_recycledLeafNodes.getFront();
+			m_recycledLeafNodes.popFront();
+		}
+		else
+		{
+			out = m_leafNodeAlloc.newInstance(m_alloc);
+		}
 		out->m_leaf = leaf;
 		return out;
 	}
@@ -237,6 +397,7 @@ private:
 		m_leafNodeAlloc.deleteInstance(m_alloc, node);
 	}
 
+	/// @note It's thread-safe against other placeRecursive calls for different placeables.
 	void placeRecursive(const Aabb& volume, OctreePlaceable* placeable, Leaf* parent, U32 depth);
 
 	static Bool volumeTotallyInsideLeaf(const Aabb& volume, const Leaf& leaf);
@@ -251,6 +412,14 @@ private:
 	/// Remove a placeable from the tree.
 	void removeInternal(OctreePlaceable& placeable);
 
+	/// Remove many placeables from the tree. The placeables should have OctreePlaceable::m_deferredPlacement set. The
+	/// nodes end up in the recycled lists.
+	/// @param[out] leafs The leafs that lost placeables. The caller should prune the ones that remain empty.
+	void bulkRemoveInternal(WeakArray<OctreePlaceable*> placeables, DynamicArrayAuto<Leaf*>& leafs);
+
+	/// Release the nodes that the re-placement didn't reuse.
+	void releaseRecycledNodes();
+
 	static void gatherVisibleRecursive(const Frustum& frustum,
 		U32 testId,
 		OctreeNodeVisibilityTestCallback testCallback,
@@ -275,6 +444,14 @@ private:
 
 	template<typename TTestAabbFunc, typename TNewPlaceableFunc>
 	void walkTreeInternal(Leaf& leaf, U32 testId, TTestAabbFunc testFunc, TNewPlaceableFunc newPlaceableFunc);
+
+	/// Rebuild the linear layout if the tree changed.
+	/// @note It's thread-safe against other visibility tests.
+	void updateLinearTree();
+
+	/// Test the children of a linear node against the frustum planes.
+	/// @return A mask with one bit for every visible child.
+	static U32 testLinearChildren(const LinearChildBounds& bounds, const Frustum& frustum);
 };
 
 /// An entity that can be placed in octrees.
@@ -294,6 +471,13 @@ private:
 	Atomic<U64> m_visitedMask = {0u};
 	IntrusiveList<Octree::LeafNode> m_leafs; ///< A list of leafs this placeable belongs.
 
+	/// @name Deferred placement
+	/// @{
+	Aabb m_deferredVolume;
+	OctreePlaceable* m_nextDeferred = nullptr;
+	Bool8 m_deferredPlacement = false; ///< It's in one of the deferred placement lists.
+	/// @}
+
 	/// Check if already visited.
 	/// @note It's thread-safe.
 	Bool alreadyVisited(U32 testId)
@@ -337,6 +521,70 @@ inline void Octree::walkTreeInternal(Leaf& leaf, U32 testId, TTestAabbFunc testF
 
 	ANKI_TRACE_INC_COUNTER(OCTREE_VISIBLE_LEAFS, visibleLeafs);
 }
+
+template<typename TTestAabbFunc, typename TNewPlaceableFunc>
+inline void Octree::walkTree(
+	U32 testId, const Frustum& frustum, TTestAabbFunc testFunc, TNewPlaceableFunc newPlaceableFunc)
+{
+	if(m_layout == OctreeLayout::POINTER_TREE)
+	{
+		walkTree(testId,
+			[&](const Aabb& box) { return frustum.insideFrustum(box) && testFunc(box); },
+			newPlaceableFunc);
+		return;
+	}
+
+	updateLinearTree();
+	if(m_linearNodeCount == 0)
+	{
+		return;
+	}
+
+	// Depth first walk
+	Array<U32, MAX_LINEAR_WALK_STACK_SIZE> stack;
+	U32 stackSize = 1;
+	stack[0] = 0;
+	U visibleLeafs = 0;
+	(void)visibleLeafs;
+
+	while(stackSize)
+	{
+		const LinearNode& node = m_linearNodes[stack[--stackSize]];
+
+		// Visit the placeables that belong to that leaf
+		for(PlaceableNode& placeableNode : node.m_leaf->m_placeables)
+		{
+			if(!placeableNode.m_placeable->alreadyVisited(testId))
+			{
+				ANKI_ASSERT(placeableNode.m_placeable->m_userData);
+				newPlaceableFunc(placeableNode.m_placeable->m_userData);
+			}
+		}
+
+		if(node.m_childBounds == MAX_U32)
+		{
+			continue;
+		}
+
+		// Test the children in one go and then do the additional tests
+		const LinearChildBounds& bounds = m_linearChildBounds[node.m_childBounds];
+		U32 mask = testLinearChildren(bounds, frustum);
+		while(mask)
+		{
+			const U32 child = U32(__builtin_ctz(mask));
+			mask &= mask - 1;
+
+			if(testFunc(bounds.getAabb(child)))
+			{
+				++visibleLeafs;
+				ANKI_ASSERT(stackSize < MAX_LINEAR_WALK_STACK_SIZE);
+				stack[stackSize++] = node.m_firstChild + bounds.getChildOffset(child);
+			}
+		}
+	}
+
+	ANKI_TRACE_INC_COUNTER(OCTREE_VISIBLE_LEAFS, visibleLeafs);
+}
 /// @}
 
 } // end namespace anki
@@ -11,6 +11,8 @@
 #include <anki/resource/ModelResource.h>
 #include <anki/resource/ResourceManager.h>
 #include <anki/util/Functions.h>
+#include <anki/util/ThreadHive.h>
+#include <anki/core/Trace.h>
 #include <anki/physics/PhysicsBody.h>
 #include <anki/physics/PhysicsWorld.h>
 #include <anki/physics/PhysicsCollisionShape.h>
@@ -96,43 +98,6 @@ public:
 	}
 };
 
-/// Simple particle for simple simulation
-class ParticleEmitterNode::ParticleSimple : public ParticleEmitterNode::ParticleBase
-{
-public:
-	Vec4 m_velocity = Vec4(0.0);
-	Vec4 m_acceleration = Vec4(0.0);
-
-	void revive(
-		const ParticleEmitterProperties& props, const Transform& trf, Second prevUpdateTime, Second crntTime) override
-	{
-		ParticleBase::revive(props, trf, prevUpdateTime, crntTime);
-		m_velocity = Vec4(0.0);
-
-		m_acceleration = getRandom(props.m_particle.m_minGravity, props.m_particle.m_maxGravity).xyz0();
-
-		// Set the initial position
-		m_crntPosition =
-			getRandom(props.m_particle.m_minStartingPosition, props.m_particle.m_maxStartingPosition).xyz0();
-
-		m_crntPosition += trf.getOrigin();
-	}
-
-	void simulate(Second prevUpdateTime, Second crntTime) override
-	{
-		ParticleBase::simulate(prevUpdateTime, crntTime);
-
-		Second dt = crntTime - prevUpdateTime;
-
-		Vec4 xp = m_crntPosition;
-		Vec4 xc = m_acceleration * (dt * dt) + m_velocity * dt + xp;
-
-		m_crntPosition = xc;
-
-		m_velocity += m_acceleration * dt;
-	}
-};
-
 /// Particle for bullet simulations
 class ParticleEmitterNode::PhysParticle : public ParticleEmitterNode::ParticleBase
 {
@@ -204,6 +169,55 @@ public:
 	}
 };
 
+/// Shared by the tasks that simulate the particles of a big emitter.
+class ParticleEmitterNode::SimulationContext
+{
+public:
+	ParticleEmitterNode* m_node;
+	F32 m_dt;
+	F32* m_verts;
+	WeakArray<ParticleBounds> m_taskBounds; ///< One per task so the tasks don't share anything.
+
+	/// Combine the bounds of all tasks.
+	void combine()
+	{
+		ParticleBounds bounds;
+		for(const ParticleBounds& b : m_taskBounds)
+		{
+			bounds.merge(b);
+		}
+
+		m_node->setBounds(bounds);
+	}
+};
+
+/// Simulate a range of particles.
+class ParticleEmitterNode::SimulateParticlesTask
+{
+public:
+	SimulationContext* m_ctx;
+	U32 m_taskIdx;
+
+	SimulateParticlesTask(SimulationContext* ctx, U32 taskIdx)
+		: m_ctx(ctx)
+		, m_taskIdx(taskIdx)
+	{
+	}
+
+	void simulate()
+	{
+		ANKI_TRACE_SCOPED_EVENT(SCENE_PARTICLES_SIMULATE);
+
+		ParticlePool& pool = m_ctx->m_node->m_pool;
+		const U32 begin = m_taskIdx * PARTICLES_PER_TASK;
+		const U32 end = min(begin + PARTICLES_PER_TASK, pool.getParticleCount());
+
+		ParticleBounds bounds;
+		pool.simulate(begin, end, m_ctx->m_dt, m_ctx->m_verts + begin * ParticlePool::VERTEX_FLOAT_COUNT, bounds);
+		m_ctx->m_taskBounds[m_taskIdx] = bounds;
+	}
+};
+
 /// The derived render component for particle emitters.
 class ParticleEmitterNode::MyRenderComponent : public MaterialRenderComponent
 {
@@ -387,24 +401,133 @@ void ParticleEmitterNode::createParticlesPhysicsSimulation(SceneGraph* scene)
 
 void ParticleEmitterNode::createParticlesSimpleSimulation()
 {
-	m_particles.create(getAllocator(), m_maxNumOfParticles);
+	m_pool.init(getAllocator(), m_maxNumOfParticles);
+}
 
-	for(U i = 0; i < m_maxNumOfParticles; i++)
+Error ParticleEmitterNode::frameUpdate(Second prevUpdateTime, Second crntTime)
+{
+	if(m_simulationType == SimulationType::SIMPLE)
 	{
-		ParticleSimple* part = getAllocator().newInstance<ParticleSimple>();
+		simpleSimulationUpdate(prevUpdateTime, crntTime);
+	}
+	else
+	{
+		physicsSimulationUpdate(prevUpdateTime, crntTime);
+	}
 
-		m_particles[i] = part;
+	return Error::NONE;
+}
+
+U32 ParticleEmitterNode::computeEmissionCount(Second prevUpdateTime, Second crntTime)
+{
+	U32 count = 0;
+	if(m_timeLeftForNextEmission <= 0.0)
+	{
+		count = m_particlesPerEmission;
+		m_timeLeftForNextEmission = m_emissionPeriod;
+	}
+	else
+	{
+		m_timeLeftForNextEmission -= crntTime - prevUpdateTime;
 	}
+
+	return count;
 }
 
-Error ParticleEmitterNode::frameUpdate(Second prevUpdateTime, Second crntTime)
+void ParticleEmitterNode::setBounds(const ParticleBounds& bounds)
+{
+	if(bounds.m_maxSize > 0.0f)
+	{
+		const Vec4 min = (bounds.m_aabbMin - bounds.m_maxSize).xyz0();
+		const Vec4 max = (bounds.m_aabbMax + bounds.m_maxSize).xyz0();
+		const Vec4 center = (min + max) / 2.0f;
+
+		m_obb = Obb(center, Mat3x4::getIdentity(), max - center);
+	}
+	else
+	{
+		m_obb = Obb(Vec4(0.0), Mat3x4::getIdentity(), Vec4(Vec3(0.001f), 0.0f));
+	}
+
+	getComponent<SpatialComponent>().markForUpdate();
+}
+
+void ParticleEmitterNode::simpleSimulationUpdate(Second prevUpdateTime, Second crntTime)
+{
+	// Compact first and then emit so the arrays don't change while the simulation tasks run
+	m_pool.removeDead();
+
+	const U32 emissionCount = computeEmissionCount(prevUpdateTime, crntTime);
+	const Vec3 origin = getComponent<MoveComponent>().getWorldTransform().getOrigin().xyz();
+	for(U32 i = 0; i < emissionCount; ++i)
+	{
+		ParticleInitInfo init;
+		init.m_position = getRandom(m_particle.m_minStartingPosition, m_particle.m_maxStartingPosition) + origin;
+		init.m_acceleration = getRandom(m_particle.m_minGravity, m_particle.m_maxGravity);
+		init.m_lifetime = getRandom(m_particle.m_minLife, m_particle.m_maxLife);
+		init.m_initialSize = getRandom(m_particle.m_minInitialSize, m_particle.m_maxInitialSize);
+		init.m_finalSize = getRandom(m_particle.m_minFinalSize, m_particle.m_maxFinalSize);
+		init.m_initialAlpha = getRandom(m_particle.m_minInitialAlpha, m_particle.m_maxInitialAlpha);
+		init.m_finalAlpha = getRandom(m_particle.m_minFinalAlpha, m_particle.m_maxFinalAlpha);
+
+		if(!m_pool.emit(init))
+		{
+			break;
+		}
+	}
+
+	m_aliveParticlesCount = m_pool.getParticleCount();
+	if(m_aliveParticlesCount == 0)
+	{
+		m_verts = nullptr;
+		setBounds(ParticleBounds());
+		return;
+	}
+
+	F32* verts = getFrameAllocator().newArray<F32>(m_aliveParticlesCount * ParticlePool::VERTEX_FLOAT_COUNT);
+	m_verts = verts;
+	const F32 dt = F32(crntTime - prevUpdateTime);
+
+	if(m_aliveParticlesCount <= PARTICLES_PER_TASK)
+	{
+		ParticleBounds bounds;
+		m_pool.simulate(0, m_aliveParticlesCount, dt, verts, bounds);
+		setBounds(bounds);
+		return;
+	}
+
+	// Big emitter, split the simulation to tasks. SceneGraph waits for them before the frame ends
+	ThreadHive& hive = getSceneGraph().getThreadHive();
+	const U32 taskCount = (m_aliveParticlesCount + PARTICLES_PER_TASK - 1) / PARTICLES_PER_TASK;
+
+	SimulationContext* ctx = getFrameAllocator().newInstance<SimulationContext>();
+	ctx->m_node = this;
+	ctx->m_dt = dt;
+	ctx->m_verts = verts;
+	ctx->m_taskBounds = WeakArray<ParticleBounds>(getFrameAllocator().newArray<ParticleBounds>(taskCount), taskCount);
+
+	ThreadHiveSemaphore* simulateSem = hive.newSemaphore(taskCount);
+	for(U32 i = 0; i < taskCount; ++i)
+	{
+		ThreadHiveTask task = ANKI_THREAD_HIVE_TASK({ self->simulate(); },
+			getFrameAllocator().newInstance<SimulateParticlesTask>(ctx, i),
+			nullptr,
+			simulateSem);
+
+		hive.submitTasks(&task, 1);
+	}
+
+	ThreadHiveTask combineTask = ANKI_THREAD_HIVE_TASK({ self->combine(); }, ctx, simulateSem, nullptr);
+	hive.submitTasks(&combineTask, 1);
+}
+
+void ParticleEmitterNode::physicsSimulationUpdate(Second prevUpdateTime, Second crntTime)
 {
 	// - Deactivate the dead particles
 	// - Calc the AABB
 	// - Calc the instancing stuff
 	//
-	Vec4 aabbmin(MAX_F32, MAX_F32, MAX_F32, 0.0f);
-	Vec4 aabbmax(MIN_F32, MIN_F32, MIN_F32, 0.0f);
+	ParticleBounds bounds;
 	m_aliveParticlesCount = 0;
 
 	F32* verts = reinterpret_cast<F32*>(getFrameAllocator().allocate(m_vertBuffSize));
@@ -413,8 +536,6 @@ Error ParticleEmitterNode::frameUpdate(Second prevUpdateTime, Second crntTime)
 	const F32* verts_base = verts;
 	(void)verts_base;
 
-	F32 maxParticleSize = -1.0f;
-
 	for(ParticleBase* p : m_particles)
 	{
 		if(p->isDead())
@@ -438,17 +559,17 @@ Error ParticleEmitterNode::frameUpdate(Second prevUpdateTime, Second crntTime)
 			// This will calculate a new world transformation
 			p->simulate(prevUpdateTime, crntTime);
 
-			const Vec4& origin = p->m_crntPosition;
+			const Vec3 origin = p->m_crntPosition.xyz();
 
-			aabbmin = aabbmin.min(origin);
-			aabbmax = aabbmax.max(origin);
+			bounds.m_aabbMin = bounds.m_aabbMin.min(origin);
+			bounds.m_aabbMax = bounds.m_aabbMax.max(origin);
 
 			verts[0] = origin.x();
 			verts[1] = origin.y();
 			verts[2] = origin.z();
 
 			verts[3] = p->m_crntSize;
-			maxParticleSize = max(maxParticleSize, p->m_crntSize);
+			bounds.m_maxSize = max(bounds.m_maxSize, p->m_crntSize);
 
 			verts[4] = clamp(p->m_crntAlpha, 0.0f, 1.0f);
 
@@ -457,27 +578,18 @@ Error ParticleEmitterNode::frameUpdate(Second prevUpdateTime, Second crntTime)
 		}
 	}
 
-	if(m_aliveParticlesCount != 0)
-	{
-		ANKI_ASSERT(maxParticleSize > 0.0f);
-		Vec4 min = aabbmin - maxParticleSize;
-		Vec4 max = aabbmax + maxParticleSize;
-		Vec4 center = (min + max) / 2.0;
-
-		m_obb = Obb(center.xyz0(), Mat3x4::getIdentity(), (max - center).xyz0());
-	}
-	else
+	if(m_aliveParticlesCount == 0)
 	{
-		m_obb = Obb(Vec4(0.0), Mat3x4::getIdentity(), Vec4(Vec3(0.001f), 0.0f));
 		m_verts = nullptr;
 	}
 
-	getComponent<SpatialComponent>().markForUpdate();
+	setBounds(bounds);
 
 	//
 	// Emit new particles
 	//
-	if(m_timeLeftForNextEmission <= 0.0)
+	const U32 emissionCount = computeEmissionCount(prevUpdateTime, crntTime);
+	if(emissionCount > 0)
 	{
 		MoveComponent& move = getComponent<MoveComponent>();
 
@@ -495,20 +607,12 @@ Error ParticleEmitterNode::frameUpdate(Second prevUpdateTime, Second crntTime)
 
 			// do the rest
 			++particlesCount;
-			if(particlesCount >= m_particlesPerEmission)
+			if(particlesCount >= emissionCount)
 			{
 				break;
 			}
 		} // end for all particles
-
-		m_timeLeftForNextEmission = m_emissionPeriod;
-	} // end if can emit
-	else
-	{
-		m_timeLeftForNextEmission -= crntTime - prevUpdateTime;
 	}
-
-	return Error::NONE;
 }
 
 } // end namespace anki
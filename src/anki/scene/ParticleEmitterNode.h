@@ -6,6 +6,7 @@
 #pragma once
 
 #include <anki/scene/SceneNode.h>
+#include <anki/scene/ParticlePool.h>
 #include <anki/resource/ParticleEmitterResource.h>
 #include <anki/renderer/RenderQueue.h>
 #include <anki/collision/Obb.h>
@@ -38,8 +39,9 @@ private:
 	class MyRenderComponent;
 	class MoveFeedbackComponent;
 	class ParticleBase;
-	class ParticleSimple;
 	class PhysParticle;
+	class SimulationContext;
+	class SimulateParticlesTask;
 
 	enum class SimulationType : U8
 	{
@@ -49,10 +51,14 @@ private:
 	};
 
 	/// Size of a single vertex.
-	static const U VERTEX_SIZE = 5 * sizeof(F32);
+	static const U VERTEX_SIZE = ParticlePool::VERTEX_FLOAT_COUNT * sizeof(F32);
+
+	/// Emitters with more particles than that will split the simple simulation to multiple ThreadHive tasks.
+	static const U32 PARTICLES_PER_TASK = 16 * 1024;
 
 	ParticleEmitterResourcePtr m_particleEmitterResource;
-	DynamicArray<ParticleBase*> m_particles;
+	DynamicArray<ParticleBase*> m_particles; ///< Used by the physics simulation.
+	ParticlePool m_pool; ///< Used by the simple simulation.
 	Second m_timeLeftForNextEmission = 0.0;
 	Obb m_obb;
 
@@ -72,6 +78,15 @@ private:
 	void createParticlesPhysicsSimulation(SceneGraph* scene);
 	void createParticlesSimpleSimulation();
 
+	void simpleSimulationUpdate(Second prevUpdateTime, Second crntTime);
+	void physicsSimulationUpdate(Second prevUpdateTime, Second crntTime);
+
+	/// Compute how many particles to emit this frame.
+	U32 computeEmissionCount(Second prevUpdateTime, Second crntTime);
+
+	/// Set the bounding volume from the bounds of the alive particles.
+	void setBounds(const ParticleBounds& bounds);
+
 	void onMoveComponentUpdate(MoveComponent& move);
 
 	void setupRenderableQueueElement(RenderableQueueElement& el) const
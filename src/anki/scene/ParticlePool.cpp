@@ -0,0 +1,241 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <anki/scene/ParticlePool.h>
+#include <anki/math/Simd.h>
+
+namespace anki
+{
+
+ParticlePool::~ParticlePool()
+{
+	iterateArrays([&](DynamicArray<F32>& arr) { arr.destroy(m_alloc); });
+}
+
+template<typename TFunc>
+void ParticlePool::iterateArrays(TFunc func)
+{
+	for(U i = 0; i < 3; ++i)
+	{
+		func(m_positions[i]);
+		func(m_velocities[i]);
+		func(m_accelerations[i]);
+	}
+
+	func(m_ages);
+	func(m_invLifetimes);
+	func(m_initialSizes);
+	func(m_sizeDeltas);
+	func(m_initialAlphas);
+	func(m_alphaDeltas);
+}
+
+void ParticlePool::init(SceneAllocator<U8> alloc, U32 capacity)
+{
+	ANKI_ASSERT(m_capacity == 0 && "Already initialized");
+	ANKI_ASSERT(capacity > 0);
+	m_alloc = alloc;
+	m_capacity = capacity;
+
+	// Zero everything so the padding doesn't contain garbage that the SIMD code will read
+	const U32 alignedCapacity = getAlignedRoundUp(4, capacity);
+	iterateArrays([&](DynamicArray<F32>& arr) { arr.create(m_alloc, alignedCapacity, 0.0f); });
+}
+
+Bool ParticlePool::emit(const ParticleInitInfo& init)
+{
+	ANKI_ASSERT(init.m_lifetime > 0.0f);
+
+	if(m_count == m_capacity)
+	{
+		return false;
+	}
+
+	const U32 i = m_count++;
+	for(U j = 0; j < 3; ++j)
+	{
+		m_positions[j][i] = init.m_position[j];
+		m_velocities[j][i] = init.m_velocity[j];
+		m_accelerations[j][i] = init.m_acceleration[j];
+	}
+
+	m_ages[i] = 0.0f;
+	m_invLifetimes[i] = 1.0f / init.m_lifetime;
+	m_initialSizes[i] = init.m_initialSize;
+	m_sizeDeltas[i] = init.m_finalSize - init.m_initialSize;
+	m_initialAlphas[i] = init.m_initialAlpha;
+	m_alphaDeltas[i] = init.m_finalAlpha - init.m_initialAlpha;
+
+	return true;
+}
+
+void ParticlePool::removeDead()
+{
+	U32 i = 0;
+	while(i < m_count)
+	{
+#if ANKI_SIMD == ANKI_SIMD_SSE
+		// Most particles are alive, skip them 4 at a time
+		if(isAligned(4, i) && i + 4 <= m_count)
+		{
+			const __m128 lifeFactor = _mm_mul_ps(_mm_loadu_ps(&m_ages[i]), _mm_loadu_ps(&m_invLifetimes[i]));
+			if(_mm_movemask_ps(_mm_cmpge_ps(lifeFactor, _mm_set1_ps(1.0f))) == 0)
+			{
+				i += 4;
+				continue;
+			}
+		}
+#endif
+
+		if(!isDead(i))
+		{
+			++i;
+			continue;
+		}
+
+		// Move the last particle to the hole. Don't advance because the moved particle might also be dead
+		const U32 last = --m_count;
+		if(i != last)
+		{
+			iterateArrays([&](DynamicArray<F32>& arr) { arr[i] = arr[last]; });
+		}
+	}
+}
+
+void ParticlePool::simulate(U32 begin, U32 end, F32 dt, F32* verts, ParticleBounds& bounds)
+{
+	ANKI_ASSERT(isAligned(4, begin) && "The ranges shouldn't share SIMD lanes");
+	ANKI_ASSERT(begin <= end && end <= m_count);
+	ANKI_ASSERT(verts);
+
+	// The integration is: x' = x + v * dt + a * dt^2, v' = v + a * dt
+
+#if ANKI_SIMD == ANKI_SIMD_SSE
+	const __m128 dtv = _mm_set1_ps(dt);
+	const __m128 dt2v = _mm_set1_ps(dt * dt);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 maxv = _mm_set1_ps(MAX_F32);
+	const __m128 minv = _mm_set1_ps(MIN_F32);
+	const __m128 laneIndices = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+	Array<__m128, 3> aabbMin = {{maxv, maxv, maxv}};
+	Array<__m128, 3> aabbMax = {{minv, minv, minv}};
+	__m128 maxSize = zero;
+
+	for(U32 i = begin; i < end; i += 4)
+	{
+		const __m128 age = _mm_add_ps(_mm_loadu_ps(&m_ages[i]), dtv);
+		_mm_storeu_ps(&m_ages[i], age);
+
+		const __m128 unclampedLifeFactor = _mm_mul_ps(age, _mm_loadu_ps(&m_invLifetimes[i]));
+		const __m128 lifeFactor = _mm_min_ps(unclampedLifeFactor, one);
+
+		// The lanes past the end belong to nobody, ignore them
+		const __m128 inRange = _mm_cmplt_ps(laneIndices, _mm_set1_ps(F32(end - i)));
+		const __m128 alive = _mm_and_ps(_mm_cmplt_ps(unclampedLifeFactor, one), inRange);
+
+		Array<__m128, 3> pos;
+		for(U j = 0; j < 3; ++j)
+		{
+			const __m128 a = _mm_loadu_ps(&m_accelerations[j][i]);
+			__m128 v = _mm_loadu_ps(&m_velocities[j][i]);
+			__m128 p = _mm_loadu_ps(&m_positions[j][i]);
+
+			p = _mm_add_ps(p, _mm_add_ps(_mm_mul_ps(v, dtv), _mm_mul_ps(a, dt2v)));
+			v = _mm_add_ps(v, _mm_mul_ps(a, dtv));
+
+			_mm_storeu_ps(&m_positions[j][i], p);
+			_mm_storeu_ps(&m_velocities[j][i], v);
+			pos[j] = p;
+
+			aabbMin[j] = _mm_min_ps(aabbMin[j], _mm_blendv_ps(maxv, p, alive));
+			aabbMax[j] = _mm_max_ps(aabbMax[j], _mm_blendv_ps(minv, p, alive));
+		}
+
+		// Dead particles get zero size so they are not visible till they get removed
+		__m128 size =
+			_mm_add_ps(_mm_loadu_ps(&m_initialSizes[i]), _mm_mul_ps(_mm_loadu_ps(&m_sizeDeltas[i]), lifeFactor));
+		size = _mm_and_ps(size, alive);
+		maxSize = _mm_max_ps(maxSize, size);
+
+		__m128 alpha =
+			_mm_add_ps(_mm_loadu_ps(&m_initialAlphas[i]), _mm_mul_ps(_mm_loadu_ps(&m_alphaDeltas[i]), lifeFactor));
+		alpha = _mm_min_ps(_mm_max_ps(alpha, zero), one);
+
+		// Interleave
+		Array2d<F32, VERTEX_FLOAT_COUNT, 4> soa;
+		_mm_storeu_ps(&soa[0][0], pos[0]);
+		_mm_storeu_ps(&soa[1][0], pos[1]);
+		_mm_storeu_ps(&soa[2][0], pos[2]);
+		_mm_storeu_ps(&soa[3][0], size);
+		_mm_storeu_ps(&soa[4][0], alpha);
+
+		const U32 laneCount = min<U32>(4, end - i);
+		F32* out = verts + (i - begin) * VERTEX_FLOAT_COUNT;
+		for(U32 lane = 0; lane < laneCount; ++lane)
+		{
+			for(U32 f = 0; f < VERTEX_FLOAT_COUNT; ++f)
+			{
+				*out++ = soa[f][lane];
+			}
+		}
+	}
+
+	// Reduce the lanes
+	Array2d<F32, 3, 4> mins, maxs;
+	Array<F32, 4> sizes;
+	for(U j = 0; j < 3; ++j)
+	{
+		_mm_storeu_ps(&mins[j][0], aabbMin[j]);
+		_mm_storeu_ps(&maxs[j][0], aabbMax[j]);
+	}
+	_mm_storeu_ps(&sizes[0], maxSize);
+
+	for(U lane = 0; lane < 4; ++lane)
+	{
+		bounds.m_aabbMin = bounds.m_aabbMin.min(Vec3(mins[0][lane], mins[1][lane], mins[2][lane]));
+		bounds.m_aabbMax = bounds.m_aabbMax.max(Vec3(maxs[0][lane], maxs[1][lane], maxs[2][lane]));
+		bounds.m_maxSize = max(bounds.m_maxSize, sizes[lane]);
+	}
+#else
+	const F32 dt2 = dt * dt;
+	for(U32 i = begin; i < end; ++i)
+	{
+		m_ages[i] += dt;
+		const F32 unclampedLifeFactor = m_ages[i] * m_invLifetimes[i];
+		const F32 lifeFactor = min(unclampedLifeFactor, 1.0f);
+		const Bool alive = unclampedLifeFactor < 1.0f;
+
+		Vec3 pos;
+		for(U j = 0; j < 3; ++j)
+		{
+			const F32 a = m_accelerations[j][i];
+			m_positions[j][i] += m_velocities[j][i] * dt + a * dt2;
+			m_velocities[j][i] += a * dt;
+			pos[j] = m_positions[j][i];
+		}
+
+		const F32 size = (alive) ? m_initialSizes[i] + m_sizeDeltas[i] * lifeFactor : 0.0f;
+		const F32 alpha = clamp(m_initialAlphas[i] + m_alphaDeltas[i] * lifeFactor, 0.0f, 1.0f);
+
+		if(alive)
+		{
+			bounds.m_aabbMin = bounds.m_aabbMin.min(pos);
+			bounds.m_aabbMax = bounds.m_aabbMax.max(pos);
+			bounds.m_maxSize = max(bounds.m_maxSize, size);
+		}
+
+		F32* out = verts + (i - begin) * VERTEX_FLOAT_COUNT;
+		out[0] = pos.x();
+		out[1] = pos.y();
+		out[2] = pos.z();
+		out[3] = size;
+		out[4] = alpha;
+	}
+#endif
+}
+
+} // end namespace anki
@@ -0,0 +1,115 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#pragma once
+
+#include <anki/scene/Common.h>
+#include <anki/Math.h>
+#include <anki/util/DynamicArray.h>
+
+namespace anki
+{
+
+/// @addtogroup scene
+/// @{
+
+/// The initial state of a particle.
+class ParticleInitInfo
+{
+public:
+	Vec3 m_position = Vec3(0.0f);
+	Vec3 m_velocity = Vec3(0.0f);
+	Vec3 m_acceleration = Vec3(0.0f);
+	F32 m_lifetime = 1.0f;
+	F32 m_initialSize = 1.0f;
+	F32 m_finalSize = 1.0f;
+	F32 m_initialAlpha = 1.0f;
+	F32 m_finalAlpha = 1.0f;
+};
+
+/// The bounds of some simulated particles.
+class ParticleBounds
+{
+public:
+	Vec3 m_aabbMin = Vec3(MAX_F32);
+	Vec3 m_aabbMax = Vec3(MIN_F32);
+	F32 m_maxSize = 0.0f;
+
+	void merge(const ParticleBounds& b)
+	{
+		m_aabbMin = m_aabbMin.min(b.m_aabbMin);
+		m_aabbMax = m_aabbMax.max(b.m_aabbMax);
+		m_maxSize = max(m_maxSize, b.m_maxSize);
+	}
+};
+
+/// A pool of simple particles. The particles are stored as a structure of arrays and they are simulated 4 at a time.
+/// The alive particles are always packed at the beginning of the arrays.
+class ParticlePool : public NonCopyable
+{
+public:
+	/// The floats of a vertex that simulate() writes. Position, size and alpha.
+	static const U32 VERTEX_FLOAT_COUNT = 5;
+
+	ParticlePool() = default;
+
+	~ParticlePool();
+
+	void init(SceneAllocator<U8> alloc, U32 capacity);
+
+	U32 getCapacity() const
+	{
+		return m_capacity;
+	}
+
+	U32 getParticleCount() const
+	{
+		return m_count;
+	}
+
+	/// Add a new particle.
+	/// @return False if the pool is full.
+	Bool emit(const ParticleInitInfo& init);
+
+	/// Remove the particles that reached the end of their life. The last particles move to the holes.
+	void removeDead();
+
+	/// Integrate the particles in [begin, end) and write their vertices. The particles that die during this step get
+	/// zero size. It's thread-safe for ranges that don't overlap.
+	/// @param[out] verts VERTEX_FLOAT_COUNT floats per particle in the range.
+	/// @param[out] bounds The bounds of the alive particles in the range.
+	void simulate(U32 begin, U32 end, F32 dt, F32* verts, ParticleBounds& bounds);
+
+private:
+	SceneAllocator<U8> m_alloc;
+
+	/// @name Particle data
+	/// The sizes are aligned to 4 so the SIMD code can read past the last particle.
+	/// @{
+	Array<DynamicArray<F32>, 3> m_positions;
+	Array<DynamicArray<F32>, 3> m_velocities;
+	Array<DynamicArray<F32>, 3> m_accelerations;
+	DynamicArray<F32> m_ages;
+	DynamicArray<F32> m_invLifetimes;
+	DynamicArray<F32> m_initialSizes;
+	DynamicArray<F32> m_sizeDeltas; ///< Final size minus initial size.
+	DynamicArray<F32> m_initialAlphas;
+	DynamicArray<F32> m_alphaDeltas; ///< Final alpha minus initial alpha.
+	/// @}
+
+	U32 m_capacity = 0;
+	U32 m_count = 0;
+
+	template<typename TFunc>
+	void iterateArrays(TFunc func);
+
+	Bool isDead(U32 i) const
+	{
+		return m_ages[i] * m_invLifetimes[i] >= 1.0f;
+	}
+};
+/// @}
+
+} // end namespace anki
@@ -8,6 +8,8 @@
 #include <anki/scene/PhysicsDebugNode.h>
 #include <anki/scene/ModelNode.h>
 #include <anki/scene/Octree.h>
+#include <anki/scene/components/SkinComponent.h>
+#include <anki/scene/components/OccluderComponent.h>
 #include <anki/core/Trace.h>
 #include <anki/physics/PhysicsWorld.h>
 #include <anki/resource/ResourceManager.h>
@@ -18,20 +20,6 @@
 namespace anki
 {
 
-const U NODE_UPDATE_BATCH = 10;
-
-class SceneGraph::UpdateSceneNodesCtx
-{
-public:
-	SceneGraph* m_scene = nullptr;
-
-	IntrusiveList<SceneNode>::Iterator m_crntNode;
-	SpinLock m_crntNodeLock;
-
-	Second m_prevUpdateTime;
-	Second m_crntTime;
-};
-
 SceneGraph::SceneGraph()
 {
 }
@@ -71,7 +59,9 @@ Error SceneGraph::init(AllocAlignedCallback allocCb,
 	m_scriptManager = scriptManager;
 
 	m_alloc = SceneAllocator<U8>(allocCb, allocCbData);
-	m_frameAlloc = SceneFrameAllocator<U8>(allocCb, allocCbData, 1 * 1024 * 1024);
+	// The frame allocator is hammered by the update threads, give them their own arenas
+	m_frameAlloc =
+		SceneFrameAllocator<U8>(allocCb, allocCbData, 1 * 1024 * 1024, 2.0, 0, true, ANKI_SAFE_ALIGNMENT, 16 * 1024);
 
 	m_earlyZDist = config.getNumber("scene.earlyZDistance");
 
@@ -80,7 +70,10 @@ Error SceneGraph::init(AllocAlignedCallback allocCb,
 	m_maxReflectionProxyDistance = config.getNumber("scene.imageReflectionMaxDistance");
 
 	m_octree = m_alloc.newInstance<Octree>(m_alloc);
-	m_octree->init(m_sceneMin, m_sceneMax, 5); // TODO
+	m_octree->init(m_sceneMin,
+		m_sceneMax,
+		5, // TODO
+		(config.getNumber("scene.linearOctree")) ? OctreeLayout::LINEAR : OctreeLayout::POINTER_TREE);
 
 	// Init the default main camera
 	ANKI_CHECK(newSceneNode<PerspectiveCameraNode>("mainCamera", m_defaultMainCam));
@@ -211,32 +204,33 @@ Error SceneGraph::update(Second prevUpdateTime, Second crntTime)
 		ANKI_TRACE_SCOPED_EVENT(SCENE_NODES_UPDATE);
 		ANKI_CHECK(m_events.updateAllEvents(prevUpdateTime, crntTime));
 
-		// Then the rest
-		Array<ThreadHiveTask, ThreadHive::MAX_THREADS> tasks;
-		UpdateSceneNodesCtx updateCtx;
-		updateCtx.m_scene = this;
-		updateCtx.m_crntNode = m_nodes.getBegin();
-		updateCtx.m_prevUpdateTime = prevUpdateTime;
-		updateCtx.m_crntTime = crntTime;
-
-		for(U i = 0; i < m_threadHive->getThreadCount(); i++)
+		// Then the rest. Gather the nodes that don't have a parent, the children will be updated by their parents
+		SceneNode** rootNodes = m_frameAlloc.newArray<SceneNode*>(max<U32>(m_nodesCount, 1));
+		U32 rootNodeCount = 0;
+		for(SceneNode& node : m_nodes)
 		{
-			tasks[i] = ANKI_THREAD_HIVE_TASK(
-				{
-					if(self->m_scene->updateNodes(*self))
-					{
-						ANKI_SCENE_LOGF("Will not recover");
-					}
-				},
-				&updateCtx,
-				nullptr,
-				nullptr);
+			if(node.getParent() == nullptr)
+			{
+				rootNodes[rootNodeCount++] = &node;
+			}
 		}
 
-		m_threadHive->submitTasks(&tasks[0], m_threadHive->getThreadCount());
+		m_threadHive->parallelFor(0, rootNodeCount, 0, [&](U32 idx, U32 threadId) {
+			if(updateNode(prevUpdateTime, crntTime, *rootNodes[idx]))
+			{
+				ANKI_SCENE_LOGF("Will not recover");
+			}
+		});
 		m_threadHive->waitAllTasks();
+
+		// The spatial components deferred their placements, do them all at once
+		m_octree->applyDeferredPlacements(m_threadHive);
+
+		gatherOccluders();
 	}
 
+	updateSkins();
+
 	m_stats.m_updateTime = HighRezTimer::getCurrentTime() - m_stats.m_updateTime;
 	return Error::NONE;
 }
@@ -295,54 +289,92 @@ Error SceneGraph::updateNode(Second prevTime, Second crntTime, SceneNode& node)
 	return err;
 }
 
-Error SceneGraph::updateNodes(UpdateSceneNodesCtx& ctx) const
+void SceneGraph::queueSkinUpdate(SkinComponent* skin)
 {
-	ANKI_TRACE_SCOPED_EVENT(SCENE_NODES_UPDATE);
+	ANKI_ASSERT(skin);
 
-	IntrusiveList<SceneNode>::ConstIterator end = m_nodes.getEnd();
+	SkinComponent* head = m_queuedSkins.load(AtomicMemoryOrder::RELAXED);
+	do
+	{
+		skin->m_nextQueued = head;
+	} while(!m_queuedSkins.compareExchange(head, skin));
+}
 
-	Bool quit = false;
-	Error err = Error::NONE;
-	while(!quit && !err)
+void SceneGraph::queueOccluder(OccluderComponent* occluder)
+{
+	ANKI_ASSERT(occluder);
+
+	OccluderComponent* head = m_queuedOccluders.load(AtomicMemoryOrder::RELAXED);
+	do
 	{
-		// Fetch a batch of scene nodes that don't have parent
-		Array<SceneNode*, NODE_UPDATE_BATCH> batch;
-		U batchSize = 0;
+		occluder->m_nextQueued = head;
+	} while(!m_queuedOccluders.compareExchange(head, occluder));
+}
 
-		{
-			LockGuard<SpinLock> lock(ctx.m_crntNodeLock);
+void SceneGraph::gatherOccluders()
+{
+	OccluderComponent* head = m_queuedOccluders.exchange(nullptr, AtomicMemoryOrder::ACQUIRE);
 
-			while(1)
-			{
-				if(batchSize == batch.getSize())
-				{
-					break;
-				}
-
-				if(ctx.m_crntNode == end)
-				{
-					quit = true;
-					break;
-				}
-
-				SceneNode& node = *ctx.m_crntNode;
-				if(node.getParent() == nullptr)
-				{
-					batch[batchSize++] = &node;
-				}
-
-				++ctx.m_crntNode;
-			}
-		}
+	m_occluderCount = 0;
+	for(OccluderComponent* it = head; it; it = it->m_nextQueued)
+	{
+		++m_occluderCount;
+	}
 
-		// Process nodes
-		for(U i = 0; i < batchSize && !err; ++i)
-		{
-			err = updateNode(ctx.m_prevUpdateTime, ctx.m_crntTime, *batch[i]);
-		}
+	m_occluders = (m_occluderCount) ? m_frameAlloc.newArray<OccluderComponent*>(m_occluderCount) : nullptr;
+	U32 count = 0;
+	for(OccluderComponent* it = head; it; it = it->m_nextQueued)
+	{
+		m_occluders[count++] = it;
 	}
+}
 
-	return err;
+void SceneGraph::updateSkins()
+{
+	ANKI_TRACE_SCOPED_EVENT(SCENE_SKINS_UPDATE);
+
+	// Gather the skins
+	U32 count = 0;
+	SkinComponent* head = m_queuedSkins.exchange(nullptr, AtomicMemoryOrder::ACQUIRE);
+	for(SkinComponent* it = head; it; it = it->m_nextQueued)
+	{
+		++count;
+	}
+
+	m_stats.m_animatedSkinCount = count;
+	m_stats.m_animationSampling = 0.0;
+	m_stats.m_animationPose = 0.0;
+	if(count == 0)
+	{
+		return;
+	}
+
+	SkinComponent** skins = m_frameAlloc.newArray<SkinComponent*>(count);
+	count = 0;
+	for(SkinComponent* it = head; it; it = it->m_nextQueued)
+	{
+		skins[count++] = it;
+	}
+
+	// Sample the animations of all skeletons
+	{
+		ANKI_TRACE_SCOPED_EVENT(SCENE_SKINS_SAMPLING);
+		m_stats.m_animationSampling = HighRezTimer::getCurrentTime();
+		m_threadHive->parallelFor(0, count, 0, [&](U32 idx, U32 threadId) { skins[idx]->sampleAnimations(); });
+		m_threadHive->waitAllTasks();
+		m_stats.m_animationSampling = HighRezTimer::getCurrentTime() - m_stats.m_animationSampling;
+	}
+
+	// Walk the hierarchies and compute the bone palettes
+	{
+		ANKI_TRACE_SCOPED_EVENT(SCENE_SKINS_POSE);
+		m_stats.m_animationPose = HighRezTimer::getCurrentTime();
+		m_threadHive->parallelFor(0, count, 0, [&](U32 idx, U32 threadId) { skins[idx]->computeBoneTransforms(); });
+		m_threadHive->waitAllTasks();
+		m_stats.m_animationPose = HighRezTimer::getCurrentTime() - m_stats.m_animationPose;
+	}
+
+	ANKI_TRACE_INC_COUNTER(SCENE_SKINS_ANIMATED, count);
 }
 
 } // end namespace anki
@@ -11,6 +11,7 @@
 #include <anki/util/Singleton.h>
 #include <anki/util/HighRezTimer.h>
 #include <anki/util/HashMap.h>
+#include <anki/util/WeakArray.h>
 #include <anki/core/App.h>
 #include <anki/scene/events/EventManager.h>
 
@@ -24,8 +25,9 @@ class CameraNode;
 class Input;
 class ConfigSet;
 class PerspectiveCameraNode;
-class UpdateSceneNodesCtx;
 class Octree;
+class SkinComponent;
+class OccluderComponent;
 
 /// @addtogroup scene
 /// @{
@@ -37,6 +39,9 @@ public:
 	Second m_updateTime ANKI_DBG_NULLIFY;
 	Second m_visibilityTestsTime ANKI_DBG_NULLIFY;
 	Second m_physicsUpdate ANKI_DBG_NULLIFY;
+	Second m_animationSampling ANKI_DBG_NULLIFY; ///< Time to interpolate and blend the animations of all skins.
+	Second m_animationPose ANKI_DBG_NULLIFY; ///< Time to compute the bone transforms of all skins.
+	U32 m_animatedSkinCount ANKI_DBG_NULLIFY;
 };
 
 /// The scene graph that  all the scene entities
@@ -44,6 +49,8 @@ class SceneGraph
 {
 	friend class SceneNode;
 	friend class UpdateSceneNodesTask;
+	friend class SkinComponent;
+	friend class OccluderComponent;
 
 public:
 	SceneGraph();
@@ -226,9 +233,13 @@ anki_internal:
 		return *m_octree;
 	}
 
-private:
-	class UpdateSceneNodesCtx;
+	/// Get the occluders that have vertices in the current frame. Valid after update().
+	ConstWeakArray<OccluderComponent*> getOccluders() const
+	{
+		return ConstWeakArray<OccluderComponent*>(m_occluders, m_occluderCount);
+	}
 
+private:
 	const Timestamp* m_globalTimestamp = nullptr;
 	Timestamp m_timestamp = 0; ///< Cached timestamp
 
@@ -268,6 +279,14 @@ private:
 
 	SceneGraphStats m_stats;
 
+	/// The skins that need to be animated this frame.
+	Atomic<SkinComponent*> m_queuedSkins = {nullptr};
+
+	/// The occluders of this frame.
+	Atomic<OccluderComponent*> m_queuedOccluders = {nullptr};
+	OccluderComponent** m_occluders = nullptr;
+	U32 m_occluderCount = 0;
+
 	/// Put a node in the appropriate containers
 	ANKI_USE_RESULT Error registerNode(SceneNode* node);
 	void unregisterNode(SceneNode* node);
@@ -275,9 +294,20 @@ private:
 	/// Delete the nodes that are marked for deletion
 	void deleteNodesMarkedForDeletion();
 
-	ANKI_USE_RESULT Error updateNodes(UpdateSceneNodesCtx& ctx) const;
 	ANKI_USE_RESULT static Error updateNode(Second prevTime, Second crntTime, SceneNode& node);
 
+	/// Queue a skin for the animation stage of the update. It's thread-safe.
+	void queueSkinUpdate(SkinComponent* skin);
+
+	/// Animate all the queued skins in parallel.
+	void updateSkins();
+
+	/// Queue an occluder for the visibility tests of the frame. It's thread-safe.
+	void queueOccluder(OccluderComponent* occluder);
+
+	/// Put the queued occluders to an array.
+	void gatherOccluders();
+
 	/// Do visibility tests.
 	static void doVisibilityTests(SceneNode& frustumable, SceneGraph& scene, RenderQueue& rqueue);
 };
@@ -6,6 +6,7 @@
 #include <anki/scene/SoftwareRasterizer.h>
 #include <anki/collision/Aabb.h>
 #include <anki/core/Trace.h>
+#include <anki/math/Simd.h>
 
 namespace anki
 {
@@ -19,17 +20,40 @@ void SoftwareRasterizer::prepare(const Mat4& mv, const Mat4& p, U width, U heigh
 	Plane::extractClipPlanes(p, m_planesL);
 	Plane::extractClipPlanes(m_mvp, m_planesW);
 
-	// Reset z buffer
+	// Allocate the buffers
 	ANKI_ASSERT(width > 0 && height > 0);
 	m_width = width;
 	m_height = height;
-	U size = width * height;
-	if(m_zbuffer.getSize() < size)
+	m_tileCountX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+	m_tileCountY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+	const U32 tileCount = m_tileCountX * m_tileCountY;
+	if(m_tileMaxDepth.getSize() < tileCount)
 	{
-		m_zbuffer.destroy(m_alloc);
-		m_zbuffer.create(m_alloc, size);
+		m_depth.destroy(m_alloc);
+		m_depth.create(m_alloc, tileCount * TILE_PIXEL_COUNT);
+		m_tileMaxDepth.destroy(m_alloc);
+		m_tileMaxDepth.create(m_alloc, tileCount);
+	}
+
+	// Reset the buffers. The pixels outside the screen get zero
+	for(U32 tileY = 0; tileY < m_tileCountY; ++tileY)
+	{
+		for(U32 tileX = 0; tileX < m_tileCountX; ++tileX)
+		{
+			F32* depth = getTileDepth(tileX, tileY);
+			for(U32 y = 0; y < TILE_HEIGHT; ++y)
+			{
+				for(U32 x = 0; x < TILE_WIDTH; ++x)
+				{
+					const Bool inside = tileX * TILE_WIDTH + x < m_width && tileY * TILE_HEIGHT + y < m_height;
+					depth[y * TILE_WIDTH + x] = (inside) ? 1.0f : 0.0f;
+				}
+			}
+
+			m_tileMaxDepth[tileY * m_tileCountX + tileX] = 1.0f;
+		}
 	}
-	memset(&m_zbuffer[0], 0xFF, sizeof(m_zbuffer[0]) * size);
 }
 
 void SoftwareRasterizer::clipTriangle(const Vec4* inVerts, Vec4* outVerts, U& outVertCount) const
@@ -163,7 +187,8 @@ void SoftwareRasterizer::clipTriangle(const Vec4* inVerts, Vec4* outVerts, U& ou
 	}
 }
 
-void SoftwareRasterizer::draw(const F32* verts, U vertCount, U stride, Bool backfaceCulling)
+template<typename TFunc>
+void SoftwareRasterizer::iterateTriangles(const F32* verts, U vertCount, U stride, Bool backfaceCulling, TFunc func)
 {
 	ANKI_ASSERT(verts && vertCount > 0 && (vertCount % 3) == 0);
 	ANKI_ASSERT(stride >= sizeof(F32) * 3 && (stride % sizeof(F32)) == 0);
@@ -203,7 +228,7 @@ void SoftwareRasterizer::draw(const F32* verts, U vertCount, U stride, Bool back
 			continue;
 		}
 
-		// Rasterize
+		// Setup
 		Array<Vec4, 3> clip;
 		for(U j = 0; j < clippedCount; j += 3)
 		{
@@ -213,87 +238,314 @@ void SoftwareRasterizer::draw(const F32* verts, U vertCount, U stride, Bool back
 				ANKI_ASSERT(clip[k].w() > 0.0f);
 			}
 
-			rasterizeTriangle(&clip[0]);
+			TriangleSetup setup;
+			if(setupTriangle(&clip[0], setup))
+			{
+				func(setup);
+			}
 		}
 	}
 }
 
-Bool SoftwareRasterizer::computeBarycetrinc(const Vec2& a, const Vec2& b, const Vec2& c, const Vec2& p, Vec3& uvw) const
+void SoftwareRasterizer::draw(const F32* verts, U vertCount, U stride, Bool backfaceCulling)
 {
-	Vec2 dca = c - a;
-	Vec2 dba = b - a;
-	Vec2 dap = a - p;
+	ANKI_TRACE_SCOPED_EVENT(SCENE_RASTERIZER_DRAW);
 
-	Vec3 n(dca.x(), dba.x(), dap.x());
-	Vec3 m(dca.y(), dba.y(), dap.y());
+	iterateTriangles(verts, vertCount, stride, backfaceCulling, [&](const TriangleSetup& setup) {
+		for(U32 tileY = setup.m_minTileY; tileY <= setup.m_maxTileY; ++tileY)
+		{
+			for(U32 tileX = setup.m_minTileX; tileX <= setup.m_maxTileX; ++tileX)
+			{
+				rasterizeTriangleInTile(setup, tileX, tileY);
+			}
+		}
+	});
+}
 
-	Vec3 k = n.cross(m);
+void SoftwareRasterizer::initBins(U32 binCount)
+{
+	ANKI_ASSERT(binCount > 0);
+	ANKI_ASSERT(m_bins.getSize() == 0 && "Already initialized");
+	m_bins.create(m_alloc, binCount);
+}
 
-	Bool skip = false;
-	if(!isZero(k.z()))
-	{
-		uvw = Vec3(1.0 - (k.x() + k.y()) / k.z(), k.y() / k.z(), k.x() / k.z());
+void SoftwareRasterizer::binTriangles(U32 binIdx, const F32* verts, U vertCount, U stride, Bool backfaceCulling)
+{
+	ANKI_TRACE_SCOPED_EVENT(SCENE_RASTERIZER_BIN);
+	Bin& bin = m_bins[binIdx];
+	ANKI_ASSERT(bin.m_tileOffsets.getSize() == 0 && "Bin is finalized");
+
+	U32 count = 0;
+	iterateTriangles(verts, vertCount, stride, backfaceCulling, [&](const TriangleSetup& setup) {
+		const U32 triIdx = U32(bin.m_triangles.getSize());
+		bin.m_triangles.emplaceBack(m_alloc, setup);
 
-		if(uvw.x() < 0.0f || uvw.y() < 0.0f || uvw.z() < 0.0f)
+		for(U32 tileY = setup.m_minTileY; tileY <= setup.m_maxTileY; ++tileY)
 		{
-			skip = true;
+			for(U32 tileX = setup.m_minTileX; tileX <= setup.m_maxTileX; ++tileX)
+			{
+				bin.m_tileTriangles.emplaceBack(m_alloc, tileY * m_tileCountX + tileX, triIdx);
+			}
 		}
+
+		++count;
+	});
+
+	ANKI_TRACE_INC_COUNTER(SCENE_RASTERIZER_BINNED_TRIANGLES, count);
+}
+
+void SoftwareRasterizer::finalizeBin(U32 binIdx)
+{
+	Bin& bin = m_bins[binIdx];
+	ANKI_ASSERT(bin.m_tileOffsets.getSize() == 0 && "Bin is finalized");
+
+	// Count the triangles of every tile
+	const U32 tileCount = m_tileCountX * m_tileCountY;
+	bin.m_tileOffsets.create(m_alloc, tileCount + 1, 0);
+	for(const TileTriangle& tt : bin.m_tileTriangles)
+	{
+		++bin.m_tileOffsets[tt.m_tile + 1];
 	}
-	else
+
+	for(U32 tile = 0; tile < tileCount; ++tile)
 	{
-		skip = true;
+		bin.m_tileOffsets[tile + 1] += bin.m_tileOffsets[tile];
 	}
 
-	return skip;
+	// Sort them by tile
+	if(bin.m_tileTriangles.getSize() > 0)
+	{
+		DynamicArrayAuto<U32> cursors(m_alloc);
+		cursors.create(tileCount);
+		memcpy(&cursors[0], &bin.m_tileOffsets[0], sizeof(U32) * tileCount);
+
+		bin.m_sortedTriangles.create(m_alloc, bin.m_tileTriangles.getSize());
+		for(const TileTriangle& tt : bin.m_tileTriangles)
+		{
+			bin.m_sortedTriangles[cursors[tt.m_tile]++] = tt.m_triangle;
+		}
+	}
+
+	bin.m_tileTriangles.destroy(m_alloc);
 }
 
-void SoftwareRasterizer::rasterizeTriangle(const Vec4* tri)
+void SoftwareRasterizer::rasterizeBinnedTiles(U32 firstTileY, U32 lastTileY)
+{
+	ANKI_TRACE_SCOPED_EVENT(SCENE_RASTERIZER_TILES);
+	ANKI_ASSERT(firstTileY <= lastTileY && lastTileY < m_tileCountY);
+
+	for(U32 tileY = firstTileY; tileY <= lastTileY; ++tileY)
+	{
+		for(U32 tileX = 0; tileX < m_tileCountX; ++tileX)
+		{
+			const U32 tile = tileY * m_tileCountX + tileX;
+			for(const Bin& bin : m_bins)
+			{
+				ANKI_ASSERT(bin.m_tileOffsets.getSize() > 0 && "Bin is not finalized");
+				for(U32 i = bin.m_tileOffsets[tile]; i < bin.m_tileOffsets[tile + 1]; ++i)
+				{
+					rasterizeTriangleInTile(bin.m_triangles[bin.m_sortedTriangles[i]], tileX, tileY);
+				}
+			}
+		}
+	}
+}
+
+Bool SoftwareRasterizer::setupTriangle(const Vec4* tri, TriangleSetup& setup) const
 {
 	ANKI_ASSERT(tri);
 
-	const Vec2 windowSize(m_width, m_height);
-	Array<Vec3, 3> ndc;
-	Array<Vec2, 3> window;
-	Vec2 bboxMin(MAX_F32), bboxMax(MIN_F32);
-	for(U i = 0; i < 3; i++)
+	// To window space
+	Array<Vec3, 3> win;
+	for(U i = 0; i < 3; ++i)
 	{
-		ndc[i] = tri[i].xyz() / tri[i].w();
-		window[i] = (ndc[i].xy() / 2.0 + 0.5) * windowSize;
+		ANKI_ASSERT(tri[i].w() > 0.0f);
+		const Vec3 ndc = tri[i].xyz() / tri[i].w();
+		win[i] = Vec3((ndc.x() * 0.5f + 0.5f) * F32(m_width), (ndc.y() * 0.5f + 0.5f) * F32(m_height), ndc.z());
+	}
 
-		for(U j = 0; j < 2; j++)
-		{
-			bboxMin[j] = floor(min(bboxMin[j], window[i][j]));
-			bboxMin[j] = clamp(bboxMin[j], 0.0f, windowSize[j]);
+	// Make it counter clockwise
+	F32 area = (win[1].x() - win[0].x()) * (win[2].y() - win[0].y())
+			   - (win[2].x() - win[0].x()) * (win[1].y() - win[0].y());
+	if(area < 0.0f)
+	{
+		std::swap(win[1], win[2]);
+		area = -area;
+	}
+
+	if(area < EPSILON)
+	{
+		// Degenerate
+		return false;
+	}
+
+	// Bounding box in pixels
+	const F32 minX = min(win[0].x(), min(win[1].x(), win[2].x()));
+	const F32 minY = min(win[0].y(), min(win[1].y(), win[2].y()));
+	const F32 maxX = max(win[0].x(), max(win[1].x(), win[2].x()));
+	const F32 maxY = max(win[0].y(), max(win[1].y(), win[2].y()));
+	if(maxX < 0.0f || maxY < 0.0f || minX >= F32(m_width) || minY >= F32(m_height))
+	{
+		// Outside the screen
+		return false;
+	}
+
+	setup.m_minTileX = U32(max(minX, 0.0f)) / TILE_WIDTH;
+	setup.m_minTileY = U32(max(minY, 0.0f)) / TILE_HEIGHT;
+	setup.m_maxTileX = U32(min(maxX, F32(m_width - 1))) / TILE_WIDTH;
+	setup.m_maxTileY = U32(min(maxY, F32(m_height - 1))) / TILE_HEIGHT;
+
+	// Edges. Edge i goes from vertex i to the next one
+	for(U i = 0; i < 3; ++i)
+	{
+		const Vec3& a = win[i];
+		const Vec3& b = win[(i + 1) % 3];
+		setup.m_edgeA[i] = a.y() - b.y();
+		setup.m_edgeB[i] = b.x() - a.x();
+		setup.m_edgeC[i] = -setup.m_edgeA[i] * a.x() - setup.m_edgeB[i] * a.y();
+	}
+
+	// Depth plane
+	const Vec3 d1 = win[1] - win[0];
+	const Vec3 d2 = win[2] - win[0];
+	setup.m_depthA = (d1.z() * d2.y() - d2.z() * d1.y()) / area;
+	setup.m_depthB = (d1.x() * d2.z() - d2.x() * d1.z()) / area;
+	setup.m_depthC = win[0].z() - setup.m_depthA * win[0].x() - setup.m_depthB * win[0].y();
+	setup.m_minDepth = max(0.0f, min(win[0].z(), min(win[1].z(), win[2].z())));
+
+	return true;
+}
+
+void SoftwareRasterizer::rasterizeTriangleInTile(const TriangleSetup& setup, U32 tileX, U32 tileY)
+{
+	F32& tileMaxDepth = m_tileMaxDepth[tileY * m_tileCountX + tileX];
+	if(setup.m_minDepth >= tileMaxDepth)
+	{
+		// The triangle is behind everything in the tile
+		return;
+	}
 
-			bboxMax[j] = ceil(max(bboxMax[j], window[i][j]));
-			bboxMax[j] = clamp(bboxMax[j], 0.0f, windowSize[j]);
+	// The pixel centers of the tile's corners
+	const F32 minX = F32(tileX * TILE_WIDTH) + 0.5f;
+	const F32 minY = F32(tileY * TILE_HEIGHT) + 0.5f;
+	const F32 maxX = minX + F32(TILE_WIDTH - 1);
+	const F32 maxY = minY + F32(TILE_HEIGHT - 1);
+
+	// Skip the tile if it's totally outside an edge
+	for(U i = 0; i < 3; ++i)
+	{
+		const F32 a = setup.m_edgeA[i];
+		const F32 b = setup.m_edgeB[i];
+		if(a * ((a > 0.0f) ? maxX : minX) + b * ((b > 0.0f) ? maxY : minY) + setup.m_edgeC[i] < 0.0f)
+		{
+			return;
 		}
 	}
 
-	for(F32 y = bboxMin.y() + 0.5; y < bboxMax.y() + 0.5; y += 1.0)
+	F32* depth = getTileDepth(tileX, tileY);
+
+#if ANKI_SIMD == ANKI_SIMD_SSE
+	static_assert(TILE_WIDTH == 8, "The code bellow processes 2 x 4 pixels per row");
+
+	const __m128 x0 = _mm_add_ps(_mm_set1_ps(minX), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+	const __m128 x1 = _mm_add_ps(x0, _mm_set1_ps(4.0f));
+	const __m128 y = _mm_set1_ps(minY);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	// The values of the edge equations and the depth in the first row
+	Array<__m128, 3> edge0, edge1, edgeStep;
+	for(U i = 0; i < 3; ++i)
+	{
+		const __m128 a = _mm_set1_ps(setup.m_edgeA[i]);
+		const __m128 b = _mm_set1_ps(setup.m_edgeB[i]);
+		const __m128 c = _mm_add_ps(_mm_mul_ps(b, y), _mm_set1_ps(setup.m_edgeC[i]));
+		edge0[i] = _mm_add_ps(_mm_mul_ps(a, x0), c);
+		edge1[i] = _mm_add_ps(_mm_mul_ps(a, x1), c);
+		edgeStep[i] = b;
+	}
+
+	const __m128 depthA = _mm_set1_ps(setup.m_depthA);
+	const __m128 depthC = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(setup.m_depthB), y), _mm_set1_ps(setup.m_depthC));
+	__m128 z0 = _mm_add_ps(_mm_mul_ps(depthA, x0), depthC);
+	__m128 z1 = _mm_add_ps(_mm_mul_ps(depthA, x1), depthC);
+	const __m128 depthStep = _mm_set1_ps(setup.m_depthB);
+
+	__m128 maxDepth = zero;
+	for(U32 row = 0; row < TILE_HEIGHT; ++row)
 	{
-		for(F32 x = bboxMin.x() + 0.5; x < bboxMax.x() + 0.5; x += 1.0)
+		F32* rowDepth = depth + row * TILE_WIDTH;
+
+		__m128 inside0 = _mm_cmpge_ps(edge0[0], zero);
+		inside0 = _mm_and_ps(inside0, _mm_cmpge_ps(edge0[1], zero));
+		inside0 = _mm_and_ps(inside0, _mm_cmpge_ps(edge0[2], zero));
+		__m128 inside1 = _mm_cmpge_ps(edge1[0], zero);
+		inside1 = _mm_and_ps(inside1, _mm_cmpge_ps(edge1[1], zero));
+		inside1 = _mm_and_ps(inside1, _mm_cmpge_ps(edge1[2], zero));
+
+		__m128 d0 = _mm_loadu_ps(rowDepth);
+		__m128 d1 = _mm_loadu_ps(rowDepth + 4);
+		const __m128 newD0 = _mm_min_ps(d0, _mm_min_ps(_mm_max_ps(z0, zero), one));
+		const __m128 newD1 = _mm_min_ps(d1, _mm_min_ps(_mm_max_ps(z1, zero), one));
+		d0 = _mm_or_ps(_mm_and_ps(inside0, newD0), _mm_andnot_ps(inside0, d0));
+		d1 = _mm_or_ps(_mm_and_ps(inside1, newD1), _mm_andnot_ps(inside1, d1));
+		_mm_storeu_ps(rowDepth, d0);
+		_mm_storeu_ps(rowDepth + 4, d1);
+
+		maxDepth = _mm_max_ps(maxDepth, _mm_max_ps(d0, d1));
+
+		// Next row
+		for(U i = 0; i < 3; ++i)
 		{
-			Vec2 p(x, y);
-			Vec3 bc;
-			if(!computeBarycetrinc(window[0], window[1], window[2], p, bc))
-			{
-				const F32 z0 = ndc[0].z();
-				const F32 z1 = ndc[1].z();
-				const F32 z2 = ndc[2].z();
+			edge0[i] = _mm_add_ps(edge0[i], edgeStep[i]);
+			edge1[i] = _mm_add_ps(edge1[i], edgeStep[i]);
+		}
+		z0 = _mm_add_ps(z0, depthStep);
+		z1 = _mm_add_ps(z1, depthStep);
+	}
 
-				F32 depth = z0 * bc[0] + z1 * bc[1] + z2 * bc[2];
-				ANKI_ASSERT(depth >= 0.0 && depth <= 1.0);
+	maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(1, 0, 3, 2)));
+	maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(2, 3, 0, 1)));
+	tileMaxDepth = _mm_cvtss_f32(maxDepth);
+#else
+	F32 maxDepth = 0.0f;
+	for(U32 row = 0; row < TILE_HEIGHT; ++row)
+	{
+		const F32 y = minY + F32(row);
+		for(U32 col = 0; col < TILE_WIDTH; ++col)
+		{
+			const F32 x = minX + F32(col);
+			F32& d = depth[row * TILE_WIDTH + col];
 
-				// Clamp it to a bit less that 1.0f because 1.0f will produce a 0 depthi
-				depth = min(depth, 1.0f - EPSILON);
+			Bool inside = true;
+			for(U i = 0; i < 3; ++i)
+			{
+				inside = inside && setup.m_edgeA[i] * x + setup.m_edgeB[i] * y + setup.m_edgeC[i] >= 0.0f;
+			}
 
-				// Store the min of the current value and new one
-				const U32 depthi = depth * MAX_U32;
-				m_zbuffer[U(y) * m_width + U(x)].min(depthi);
+			if(inside)
+			{
+				const F32 z = clamp(setup.m_depthA * x + setup.m_depthB * y + setup.m_depthC, 0.0f, 1.0f);
+				d = min(d, z);
 			}
+
+			maxDepth = max(maxDepth, d);
 		}
 	}
+
+	tileMaxDepth = maxDepth;
+#endif
+}
+
+F32 SoftwareRasterizer::computeTileMaxDepth(const F32* tileDepth) const
+{
+	F32 maxDepth = 0.0f;
+	for(U32 i = 0; i < TILE_PIXEL_COUNT; ++i)
+	{
+		maxDepth = max(maxDepth, tileDepth[i]);
+	}
+
+	return maxDepth;
 }
 
 Bool SoftwareRasterizer::visibilityTest(const CollisionShape& cs, const Aabb& aabb) const
@@ -306,24 +558,25 @@ Bool SoftwareRasterizer::visibilityTest(const CollisionShape& cs, const Aabb& aa
 
 Bool SoftwareRasterizer::visibilityTestInternal(const CollisionShape& cs, const Aabb& aabb) const
 {
-	// Set the AABB points
+	// Transform the AABB points. Use the columns of the matrix to share the work between the points
 	const Vec4& minv = aabb.getMin();
 	const Vec4& maxv = aabb.getMax();
+	const Vec4 xMin = m_mvp.getColumn(0) * minv.x();
+	const Vec4 xMax = m_mvp.getColumn(0) * maxv.x();
+	const Vec4 yMin = m_mvp.getColumn(1) * minv.y();
+	const Vec4 yMax = m_mvp.getColumn(1) * maxv.y();
+	const Vec4 zMin = m_mvp.getColumn(2) * minv.z() + m_mvp.getColumn(3);
+	const Vec4 zMax = m_mvp.getColumn(2) * maxv.z() + m_mvp.getColumn(3);
+
 	Array<Vec4, 8> boxPoints;
-	boxPoints[0] = minv.xyz1();
-	boxPoints[1] = Vec4(minv.x(), maxv.y(), minv.z(), 1.0f);
-	boxPoints[2] = Vec4(minv.x(), maxv.y(), maxv.z(), 1.0f);
-	boxPoints[3] = Vec4(minv.x(), minv.y(), maxv.z(), 1.0f);
-	boxPoints[4] = maxv.xyz1();
-	boxPoints[5] = Vec4(maxv.x(), minv.y(), maxv.z(), 1.0f);
-	boxPoints[6] = Vec4(maxv.x(), minv.y(), minv.z(), 1.0f);
-	boxPoints[7] = Vec4(maxv.x(), maxv.y(), minv.z(), 1.0f);
-
-	// Transform points
-	for(Vec4& p : boxPoints)
-	{
-		p = m_mvp * p;
-	}
+	boxPoints[0] = xMin + yMin + zMin;
+	boxPoints[1] = xMin + yMax + zMin;
+	boxPoints[2] = xMin + yMax + zMax;
+	boxPoints[3] = xMin + yMin + zMax;
+	boxPoints[4] = xMax + yMax + zMax;
+	boxPoints[5] = xMax + yMin + zMax;
+	boxPoints[6] = xMax + yMin + zMin;
+	boxPoints[7] = xMax + yMax + zMin;
 
 	// Check of a point touches the near plane
 	for(const Vec4& p : boxPoints)
@@ -370,16 +623,42 @@ Bool SoftwareRasterizer::visibilityTestInternal(const CollisionShape& cs, const
 	bboxMax.y() = ceilf(bboxMax.y());
 	bboxMax.y() = clamp(bboxMax.y(), 0.0f, F32(m_height));
 
-	// Loop the tiles
-	F32 minZ = bboxMin.z();
-	for(U y = bboxMin.y(); y < bboxMax.y(); y += 1.0f)
+	if(bboxMin.x() >= bboxMax.x() || bboxMin.y() >= bboxMax.y())
 	{
-		for(U x = bboxMin.x(); x < bboxMax.x(); x += 1.0f)
+		return false;
+	}
+
+	// Loop the tiles and test the hierarchical Z first
+	const F32 minZ = bboxMin.z();
+	const U32 minX = U32(bboxMin.x());
+	const U32 minY = U32(bboxMin.y());
+	const U32 maxX = U32(bboxMax.x()); // Exclusive
+	const U32 maxY = U32(bboxMax.y()); // Exclusive
+	for(U32 tileY = minY / TILE_HEIGHT; tileY <= (maxY - 1) / TILE_HEIGHT; ++tileY)
+	{
+		for(U32 tileX = minX / TILE_WIDTH; tileX <= (maxX - 1) / TILE_WIDTH; ++tileX)
 		{
-			U idx = U(y) * m_width + U(x);
-			U32 depthi = m_zbuffer[idx].get();
-			F32 depthf = depthi / F32(MAX_U32);
-			if(minZ < depthf)
+			if(minZ >= m_tileMaxDepth[tileY * m_tileCountX + tileX])
+			{
+				// Everything in the tile is in front of the box
+				continue;
+			}
+
+			// The part of the tile the box covers
+			const U32 tileMinX = tileX * TILE_WIDTH;
+			const U32 tileMinY = tileY * TILE_HEIGHT;
+			const U32 rectMinX = max(minX, tileMinX) - tileMinX;
+			const U32 rectMinY = max(minY, tileMinY) - tileMinY;
+			const U32 rectMaxX = min(maxX, tileMinX + TILE_WIDTH) - tileMinX;
+			const U32 rectMaxY = min(maxY, tileMinY + TILE_HEIGHT) - tileMinY;
+
+			if(rectMinX == 0 && rectMinY == 0 && rectMaxX == TILE_WIDTH && rectMaxY == TILE_HEIGHT)
+			{
+				// The box covers the whole tile so at least one of the pixels is behind the box
+				return true;
+			}
+
+			if(testTilePixels(tileX, tileY, rectMinX, rectMinY, rectMaxX, rectMaxY, minZ))
 			{
 				return true;
 			}
@@ -389,20 +668,69 @@ Bool SoftwareRasterizer::visibilityTestInternal(const CollisionShape& cs, const
 	return false;
 }
 
-void SoftwareRasterizer::fillDepthBuffer(ConstWeakArray<F32> depthValues)
+Bool SoftwareRasterizer::testTilePixels(
+	U32 tileX, U32 tileY, U32 minX, U32 minY, U32 maxX, U32 maxY, F32 minZ) const
 {
-	ANKI_ASSERT(m_zbuffer.getSize() == depthValues.getSize());
+	ANKI_ASSERT(minX < maxX && maxX <= TILE_WIDTH);
+	ANKI_ASSERT(minY < maxY && maxY <= TILE_HEIGHT);
+	const F32* depth = getTileDepth(tileX, tileY);
+
+#if ANKI_SIMD == ANKI_SIMD_SSE
+	// Mask the columns outside the rect
+	const __m128 col0 = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 col1 = _mm_add_ps(col0, _mm_set1_ps(4.0f));
+	const __m128 rectMinX = _mm_set1_ps(F32(minX));
+	const __m128 rectMaxX = _mm_set1_ps(F32(maxX));
+	const __m128 colMask0 = _mm_and_ps(_mm_cmpge_ps(col0, rectMinX), _mm_cmplt_ps(col0, rectMaxX));
+	const __m128 colMask1 = _mm_and_ps(_mm_cmpge_ps(col1, rectMinX), _mm_cmplt_ps(col1, rectMaxX));
+
+	const __m128 z = _mm_set1_ps(minZ);
+	__m128 behind = _mm_setzero_ps();
+	for(U32 row = minY; row < maxY; ++row)
+	{
+		const F32* rowDepth = depth + row * TILE_WIDTH;
+		behind = _mm_or_ps(behind, _mm_and_ps(colMask0, _mm_cmplt_ps(z, _mm_loadu_ps(rowDepth))));
+		behind = _mm_or_ps(behind, _mm_and_ps(colMask1, _mm_cmplt_ps(z, _mm_loadu_ps(rowDepth + 4))));
+	}
 
-	U count = depthValues.getSize();
-	while(count--)
+	return _mm_movemask_ps(behind) != 0;
+#else
+	for(U32 row = minY; row < maxY; ++row)
 	{
-		F32 depth = depthValues[count];
-		ANKI_ASSERT(depth >= 0.0f && depth <= 1.0f);
+		for(U32 col = minX; col < maxX; ++col)
+		{
+			if(minZ < depth[row * TILE_WIDTH + col])
+			{
+				return true;
+			}
+		}
+	}
 
-		depth = min(depth, 1.0f - EPSILON); // See a few lines above why is that
+	return false;
+#endif
+}
+
+void SoftwareRasterizer::fillDepthBuffer(ConstWeakArray<F32> depthValues)
+{
+	ANKI_ASSERT(depthValues.getSize() == m_width * m_height);
 
-		const U32 depthi = depth * MAX_U32;
-		m_zbuffer[count].set(depthi);
+	for(U32 y = 0; y < m_height; ++y)
+	{
+		F32* tileRow = getTileDepth(0, y / TILE_HEIGHT) + (y % TILE_HEIGHT) * TILE_WIDTH;
+		for(U32 x = 0; x < m_width; ++x)
+		{
+			const F32 depth = depthValues[y * m_width + x];
+			ANKI_ASSERT(depth >= 0.0f && depth <= 1.0f);
+			tileRow[(x / TILE_WIDTH) * TILE_PIXEL_COUNT + (x % TILE_WIDTH)] = depth;
+		}
+	}
+
+	for(U32 tileY = 0; tileY < m_tileCountY; ++tileY)
+	{
+		for(U32 tileX = 0; tileX < m_tileCountX; ++tileX)
+		{
+			m_tileMaxDepth[tileY * m_tileCountX + tileX] = computeTileMaxDepth(getTileDepth(tileX, tileY));
+		}
 	}
 }
 
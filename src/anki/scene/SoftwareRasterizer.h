@@ -16,17 +16,33 @@ namespace anki
 /// @addtogroup scene
 /// @{
 
-/// Software rasterizer for visibility tests.
+/// Software rasterizer for visibility tests. The depth buffer is split into tiles and every tile keeps the max depth
+/// of its pixels. That hierarchical Z level is what the visibility tests query first. The rasterization and the tests
+/// process the rows of a tile with SIMD.
 class SoftwareRasterizer
 {
 public:
+	static const U32 TILE_WIDTH = 8;
+	static const U32 TILE_HEIGHT = 8;
+	static const U32 TILE_PIXEL_COUNT = TILE_WIDTH * TILE_HEIGHT;
+
 	SoftwareRasterizer()
 	{
 	}
 
 	~SoftwareRasterizer()
 	{
-		m_zbuffer.destroy(m_alloc);
+		m_depth.destroy(m_alloc);
+		m_tileMaxDepth.destroy(m_alloc);
+
+		for(Bin& bin : m_bins)
+		{
+			bin.m_triangles.destroy(m_alloc);
+			bin.m_tileTriangles.destroy(m_alloc);
+			bin.m_tileOffsets.destroy(m_alloc);
+			bin.m_sortedTriangles.destroy(m_alloc);
+		}
+		m_bins.destroy(m_alloc);
 	}
 
 	/// Initialize.
@@ -43,9 +59,32 @@ public:
 	/// @param vertCount The number of verts to draw.
 	/// @param stride The stride (in bytes) of the next vertex.
 	/// @param backfaceCulling If true it will do backface culling.
-	/// @note It's thread-safe against other draw() invocations only.
+	/// @note It's not thread-safe.
 	void draw(const F32* verts, U vertCount, U stride, Bool backfaceCulling);
 
+	/// @name Binned rasterization
+	/// It's an alternative to draw() that can be used from many threads. Every thread bins triangles into its own bin
+	/// and then the tiles are rasterized. The tiles don't share any data so different threads can rasterize them.
+	/// @{
+
+	/// Create the bins. Call it after prepare().
+	void initBins(U32 binCount);
+
+	/// Setup some triangles and sort them into the tiles they touch. The arguments are the same as draw().
+	/// @note It's thread-safe against binTriangles() calls that use a different bin.
+	void binTriangles(U32 binIdx, const F32* verts, U vertCount, U stride, Bool backfaceCulling);
+
+	/// Call it when there are no more triangles for a bin.
+	/// @note It's thread-safe against binTriangles() and finalizeBin() calls that use a different bin.
+	void finalizeBin(U32 binIdx);
+
+	/// Rasterize the binned triangles of some rows of tiles. All the bins should be finalized.
+	/// @param firstTileY The first row of tiles.
+	/// @param lastTileY The last row of tiles. It's inclusive.
+	/// @note It's thread-safe against rasterizeBinnedTiles() calls that use different rows.
+	void rasterizeBinnedTiles(U32 firstTileY, U32 lastTileY);
+	/// @}
+
 	/// Fill the depth buffer with some values.
 	void fillDepthBuffer(ConstWeakArray<F32> depthValues);
 
@@ -53,9 +92,71 @@ public:
 	/// @param cs The collision shape in world space.
 	/// @param aabb The Aabb in of the cs in world space.
 	/// @return Return true if it's visible and false otherwise.
+	/// @note It's thread-safe against other visibilityTest() invocations.
 	Bool visibilityTest(const CollisionShape& cs, const Aabb& aabb) const;
 
+	U32 getWidth() const
+	{
+		return m_width;
+	}
+
+	U32 getHeight() const
+	{
+		return m_height;
+	}
+
+	U32 getTileCountY() const
+	{
+		return m_tileCountY;
+	}
+
 private:
+	/// A triangle ready for rasterization.
+	class TriangleSetup
+	{
+	public:
+		/// Edge equations. A pixel is inside when m_edgeA * x + m_edgeB * y + m_edgeC >= 0 for all edges.
+		Array<F32, 3> m_edgeA;
+		Array<F32, 3> m_edgeB;
+		Array<F32, 3> m_edgeC;
+
+		/// Depth plane. The depth of a pixel is m_depthA * x + m_depthB * y + m_depthC.
+		F32 m_depthA;
+		F32 m_depthB;
+		F32 m_depthC;
+		F32 m_minDepth;
+
+		/// The tiles the triangle touches. The max is inclusive.
+		U32 m_minTileX;
+		U32 m_minTileY;
+		U32 m_maxTileX;
+		U32 m_maxTileY;
+	};
+
+	/// A triangle that touches a tile.
+	class TileTriangle
+	{
+	public:
+		U32 m_tile;
+		U32 m_triangle;
+
+		TileTriangle(U32 tile, U32 triangle)
+			: m_tile(tile)
+			, m_triangle(triangle)
+		{
+		}
+	};
+
+	/// The triangles of one thread sorted by tile.
+	class Bin
+	{
+	public:
+		DynamicArray<TriangleSetup> m_triangles;
+		DynamicArray<TileTriangle> m_tileTriangles; ///< Gets destroyed when the bin is finalized.
+		DynamicArray<U32> m_tileOffsets; ///< Where the triangles of a tile start in m_sortedTriangles.
+		DynamicArray<U32> m_sortedTriangles; ///< Indices to m_triangles sorted by tile.
+	};
+
 	GenericMemoryPoolAllocator<U8> m_alloc;
 	Mat4 m_mv; ///< ModelView.
 	Mat4 m_p; ///< Projection.
@@ -64,18 +165,52 @@ private:
 	Array<Plane, 6> m_planesW; ///< In world space.
 	U32 m_width;
 	U32 m_height;
-	DynamicArray<Atomic<U32>> m_zbuffer;
+	U32 m_tileCountX;
+	U32 m_tileCountY;
+
+	/// The depth of the pixels. The pixels of a tile are stored together and the tiles are stored row by row. The
+	/// pixels of the tiles that are outside the screen are set to zero so they don't contribute to the max depth of
+	/// the tile.
+	DynamicArray<F32> m_depth;
+	DynamicArray<F32> m_tileMaxDepth; ///< The hierarchical Z.
+
+	DynamicArray<Bin> m_bins;
+
+	/// Transform, cull, clip and setup some triangles.
+	template<typename TFunc>
+	void iterateTriangles(const F32* verts, U vertCount, U stride, Bool backfaceCulling, TFunc func);
 
 	/// @param tri In clip space.
-	void rasterizeTriangle(const Vec4* tri);
+	/// @return False if the triangle doesn't cover any pixel.
+	Bool setupTriangle(const Vec4* tri, TriangleSetup& setup) const;
 
-	Bool computeBarycetrinc(const Vec2& a, const Vec2& b, const Vec2& c, const Vec2& p, Vec3& uvw) const;
+	/// Rasterize a triangle in a single tile.
+	void rasterizeTriangleInTile(const TriangleSetup& setup, U32 tileX, U32 tileY);
 
 	/// Clip triangle in the near plane.
 	/// @note Triangles in view space.
 	void clipTriangle(const Vec4* inTriangle, Vec4* outTriangles, U& outTriangleCount) const;
 
 	Bool visibilityTestInternal(const CollisionShape& cs, const Aabb& aabb) const;
+
+	/// Test the pixels of a tile that are inside a rect.
+	/// @return True if any pixel's depth is bigger than the minZ.
+	Bool testTilePixels(U32 tileX, U32 tileY, U32 minX, U32 minY, U32 maxX, U32 maxY, F32 minZ) const;
+
+	/// Compute the max depth of a tile.
+	F32 computeTileMaxDepth(const F32* tileDepth) const;
+
+	F32* getTileDepth(U32 tileX, U32 tileY)
+	{
+		ANKI_ASSERT(tileX < m_tileCountX && tileY < m_tileCountY);
+		return &m_depth[(tileY * m_tileCountX + tileX) * TILE_PIXEL_COUNT];
+	}
+
+	const F32* getTileDepth(U32 tileX, U32 tileY) const
+	{
+		ANKI_ASSERT(tileX < m_tileCountX && tileY < m_tileCountY);
+		return &m_depth[(tileY * m_tileCountX + tileX) * TILE_PIXEL_COUNT];
+	}
 };
 /// @}
 
@@ -69,21 +69,71 @@ void VisibilityContext::submitNewWork(const FrustumComponent& frc, RenderQueue&
 	// Submit new work
 	//
 
-	// Software rasterizer task
+	// Software rasterizer tasks. Skip them if there is nothing to test against
 	ThreadHiveSemaphore* prepareRasterizerSem = nullptr;
-	if(frc.visibilityTestsEnabled(FrustumComponentVisibilityTestFlag::OCCLUDERS) && frc.hasCoverageBuffer())
+	const U32 occluderCount = m_scene->getOccluders().getSize();
+	if(frc.visibilityTestsEnabled(FrustumComponentVisibilityTestFlag::OCCLUDERS)
+		&& (occluderCount > 0 || frc.hasCoverageBuffer()))
 	{
-		// Gather triangles task
+		if(frc.hasCoverageBuffer())
+		{
+			ConstWeakArray<F32> depthBuff;
+			frc.getCoverageBufferInfo(depthBuff, frcCtx->m_rasterizerWidth, frcCtx->m_rasterizerHeight);
+		}
+		else
+		{
+			frcCtx->m_rasterizerWidth = SW_RASTERIZER_WIDTH;
+			frcCtx->m_rasterizerHeight = SW_RASTERIZER_HEIGHT;
+		}
+
+		// Bin the occluders. One bin per task so the tasks don't share anything
+		frcCtx->m_rasterizerBinCount = min<U32>(hive.getThreadCount(), occluderCount);
+
+		// Prepare the rasterizer and fill the coverage buffer
 		ThreadHiveTask fillDepthTask = ANKI_THREAD_HIVE_TASK({ self->fill(); },
 			alloc.newInstance<FillRasterizerWithCoverageTask>(frcCtx),
 			nullptr,
 			hive.newSemaphore(1));
 
 		hive.submitTasks(&fillDepthTask, 1);
-
 		prepareRasterizerSem = fillDepthTask.m_signalSemaphore;
 	}
 
+	if(frcCtx->m_rasterizerBinCount > 0)
+	{
+		ThreadHiveSemaphore* binSem = hive.newSemaphore(frcCtx->m_rasterizerBinCount);
+		for(U32 i = 0; i < frcCtx->m_rasterizerBinCount; ++i)
+		{
+			ThreadHiveTask binTask = ANKI_THREAD_HIVE_TASK({ self->bin(); },
+				alloc.newInstance<BinOccludersTask>(frcCtx, i),
+				prepareRasterizerSem,
+				binSem);
+
+			hive.submitTasks(&binTask, 1);
+		}
+
+		// Rasterize the tiles. Every task gets a few rows of tiles
+		const U32 tileCountY =
+			(frcCtx->m_rasterizerHeight + SoftwareRasterizer::TILE_HEIGHT - 1) / SoftwareRasterizer::TILE_HEIGHT;
+		const U32 rasterizeTaskCount = min<U32>(hive.getThreadCount(), tileCountY);
+		const U32 rowsPerTask = (tileCountY + rasterizeTaskCount - 1) / rasterizeTaskCount;
+		ThreadHiveSemaphore* rasterizeSem = hive.newSemaphore(rasterizeTaskCount);
+		for(U32 i = 0; i < rasterizeTaskCount; ++i)
+		{
+			const U32 firstTileY = min(i * rowsPerTask, tileCountY - 1);
+			const U32 lastTileY = min((i + 1) * rowsPerTask, tileCountY) - 1;
+
+			ThreadHiveTask rasterizeTask = ANKI_THREAD_HIVE_TASK({ self->rasterize(); },
+				alloc.newInstance<RasterizeTilesTask>(frcCtx, firstTileY, lastTileY),
+				binSem,
+				rasterizeSem);
+
+			hive.submitTasks(&rasterizeTask, 1);
+		}
+
+		prepareRasterizerSem = rasterizeSem;
+	}
+
 	if(frc.visibilityTestsEnabled(FrustumComponentVisibilityTestFlag::OCCLUDERS))
 	{
 		rqueue.m_fillCoverageBufferCallback = FrustumComponent::fillCoverageBufferCallback;
@@ -110,20 +160,74 @@ void FillRasterizerWithCoverageTask::fill()
 
 	auto alloc = m_frcCtx->m_visCtx->m_scene->getFrameAllocator();
 
-	// Get the C-Buffer
-	ConstWeakArray<F32> depthBuff;
-	U32 width;
-	U32 height;
-	m_frcCtx->m_frc->getCoverageBufferInfo(depthBuff, width, height);
-	ANKI_ASSERT(width > 0 && height > 0 && depthBuff.getSize() > 0);
-
 	// Init the rasterizer
 	m_frcCtx->m_r = alloc.newInstance<SoftwareRasterizer>();
 	m_frcCtx->m_r->init(alloc);
-	m_frcCtx->m_r->prepare(m_frcCtx->m_frc->getViewMatrix(), m_frcCtx->m_frc->getProjectionMatrix(), width, height);
+	m_frcCtx->m_r->prepare(m_frcCtx->m_frc->getViewMatrix(),
+		m_frcCtx->m_frc->getProjectionMatrix(),
+		m_frcCtx->m_rasterizerWidth,
+		m_frcCtx->m_rasterizerHeight);
+	if(m_frcCtx->m_rasterizerBinCount > 0)
+	{
+		m_frcCtx->m_r->initBins(m_frcCtx->m_rasterizerBinCount);
+	}
+
+	// Get the C-Buffer
+	if(m_frcCtx->m_frc->hasCoverageBuffer())
+	{
+		ConstWeakArray<F32> depthBuff;
+		U32 width;
+		U32 height;
+		m_frcCtx->m_frc->getCoverageBufferInfo(depthBuff, width, height);
+		ANKI_ASSERT(width == m_frcCtx->m_rasterizerWidth && height == m_frcCtx->m_rasterizerHeight);
 
-	// Do the work
-	m_frcCtx->m_r->fillDepthBuffer(depthBuff);
+		m_frcCtx->m_r->fillDepthBuffer(depthBuff);
+	}
+}
+
+void BinOccludersTask::bin()
+{
+	ANKI_TRACE_SCOPED_EVENT(SCENE_VIS_BIN_OCCLUDERS);
+
+	const ConstWeakArray<OccluderComponent*> occluders = m_frcCtx->m_visCtx->m_scene->getOccluders();
+	const FrustumComponent& frc = *m_frcCtx->m_frc;
+	SoftwareRasterizer& r = *m_frcCtx->m_r;
+
+	// Every task gets a range of the occluders of the frame
+	const U32 totalCount = occluders.getSize();
+	const U32 occludersPerTask = (totalCount + m_frcCtx->m_rasterizerBinCount - 1) / m_frcCtx->m_rasterizerBinCount;
+	const U32 begin = min(m_binIdx * occludersPerTask, totalCount);
+	const U32 end = min(begin + occludersPerTask, totalCount);
+
+	U32 occluderCount = 0;
+	for(U32 i = begin; i < end; ++i)
+	{
+		const OccluderComponent& occluder = *occluders[i];
+		ANKI_ASSERT(occluder.hasVertices());
+		if(frc.insideFrustum(occluder.getBoundingVolume()))
+		{
+			const Vec3* verts;
+			U32 vertCount;
+			U32 stride;
+			occluder.getVertices(verts, vertCount, stride);
+
+			r.binTriangles(m_binIdx, &verts[0][0], vertCount, stride, true);
+			++occluderCount;
+		}
+	}
+
+	r.finalizeBin(m_binIdx);
+	m_frcCtx->m_binnedOccluderCount.fetchAdd(occluderCount);
+}
+
+void RasterizeTilesTask::rasterize()
+{
+	ANKI_TRACE_SCOPED_EVENT(SCENE_VIS_RASTERIZE_TILES);
+
+	if(m_frcCtx->m_binnedOccluderCount.load() > 0)
+	{
+		m_frcCtx->m_r->rasterizeBinnedTiles(m_firstTileY, m_lastTileY);
+	}
 }
 
 void GatherVisiblesFromOctreeTask::gather(ThreadHive& hive)
@@ -132,16 +236,19 @@ void GatherVisiblesFromOctreeTask::gather(ThreadHive& hive)
 
 	U testIdx = m_frcCtx->m_visCtx->m_testsCount.fetchAdd(1);
 
+	// Nothing got rasterized, don't bother testing against the rasterizer
+	if(m_frcCtx->m_r && m_frcCtx->m_binnedOccluderCount.load() == 0 && !m_frcCtx->m_frc->hasCoverageBuffer())
+	{
+		m_frcCtx->m_r->~SoftwareRasterizer();
+		m_frcCtx->m_r = nullptr;
+	}
+
 	// Walk the tree
 	m_frcCtx->m_visCtx->m_scene->getOctree().walkTree(testIdx,
+		m_frcCtx->m_frc->getFrustum(),
 		[&](const Aabb& box) {
-			Bool visible = m_frcCtx->m_frc->insideFrustum(box);
-			if(visible && m_frcCtx->m_r)
-			{
-				visible = m_frcCtx->m_r->visibilityTest(box, box);
-			}
-
-			return visible;
+			// Already inside the frustum
+			return m_frcCtx->m_r == nullptr || m_frcCtx->m_r->visibilityTest(box, box);
 		},
 		[&](void* placeableUserData) {
 			ANKI_ASSERT(placeableUserData);
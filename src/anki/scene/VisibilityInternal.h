@@ -20,8 +20,8 @@ namespace anki
 /// @{
 
 static const U32 MAX_SPATIALS_PER_VIS_TEST = 48; ///< Num of spatials to test in a single ThreadHive task.
-static const U32 SW_RASTERIZER_WIDTH = 80;
-static const U32 SW_RASTERIZER_HEIGHT = 50;
+static const U32 SW_RASTERIZER_WIDTH = 320;
+static const U32 SW_RASTERIZER_HEIGHT = 192;
 
 /// Sort objects on distance
 template<typename T>
@@ -145,8 +145,10 @@ public:
 
 	// S/W rasterizer members
 	SoftwareRasterizer* m_r = nullptr;
-	DynamicArray<Vec3> m_verts;
-	Atomic<U32> m_rasterizedVertCount = {0}; ///< That will be used by the RasterizeTrianglesTask.
+	U32 m_rasterizerWidth = 0;
+	U32 m_rasterizerHeight = 0;
+	U32 m_rasterizerBinCount = 0; ///< One bin per BinOccludersTask.
+	Atomic<U32> m_binnedOccluderCount = {0};
 
 	// Visibility test members
 	DynamicArray<RenderQueueView> m_queueViews; ///< Sub result. Will be combined later.
@@ -156,7 +158,7 @@ public:
 	RenderQueue* m_renderQueue = nullptr;
 };
 
-/// ThreadHive task to set the depth map of the S/W rasterizer.
+/// ThreadHive task to prepare the S/W rasterizer and set its depth map if there is a coverage buffer.
 class FillRasterizerWithCoverageTask
 {
 public:
@@ -173,6 +175,44 @@ public:
 static_assert(
 	std::is_trivially_destructible<FillRasterizerWithCoverageTask>::value == true, "Should be trivially destructible");
 
+/// ThreadHive task that bins the triangles of a range of occluders into the tiles of the S/W rasterizer.
+class BinOccludersTask
+{
+public:
+	FrustumVisibilityContext* m_frcCtx = nullptr;
+	U32 m_binIdx = 0;
+
+	BinOccludersTask(FrustumVisibilityContext* frcCtx, U32 binIdx)
+		: m_frcCtx(frcCtx)
+		, m_binIdx(binIdx)
+	{
+		ANKI_ASSERT(m_frcCtx);
+	}
+
+	void bin();
+};
+static_assert(std::is_trivially_destructible<BinOccludersTask>::value == true, "Should be trivially destructible");
+
+/// ThreadHive task that rasterizes some rows of tiles of the S/W rasterizer.
+class RasterizeTilesTask
+{
+public:
+	FrustumVisibilityContext* m_frcCtx = nullptr;
+	U32 m_firstTileY = 0;
+	U32 m_lastTileY = 0; ///< Inclusive.
+
+	RasterizeTilesTask(FrustumVisibilityContext* frcCtx, U32 firstTileY, U32 lastTileY)
+		: m_frcCtx(frcCtx)
+		, m_firstTileY(firstTileY)
+		, m_lastTileY(lastTileY)
+	{
+		ANKI_ASSERT(m_frcCtx);
+	}
+
+	void rasterize();
+};
+static_assert(std::is_trivially_destructible<RasterizeTilesTask>::value == true, "Should be trivially destructible");
+
 /// ThreadHive task to get visible nodes from the octree.
 class GatherVisiblesFromOctreeTask
 {
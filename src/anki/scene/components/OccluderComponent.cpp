@@ -4,6 +4,8 @@
 // http://www.anki3d.org/LICENSE
 
 #include <anki/scene/components/OccluderComponent.h>
+#include <anki/scene/SceneNode.h>
+#include <anki/scene/SceneGraph.h>
 
 namespace anki
 {
@@ -33,4 +35,16 @@ void OccluderComponent::setVertices(const Vec3* begin, U count, U stride)
 	m_aabb.setMax(maxv.xyz0());
 }
 
+Error OccluderComponent::update(SceneNode& node, Second prevTime, Second crntTime, Bool& updated)
+{
+	updated = false;
+
+	if(hasVertices())
+	{
+		node.getSceneGraph().queueOccluder(this);
+	}
+
+	return Error::NONE;
+}
+
 } // end namespace anki
@@ -18,6 +18,8 @@ namespace anki
 /// Occluder component.
 class OccluderComponent : public SceneComponent
 {
+	friend class SceneGraph;
+
 public:
 	static const SceneComponentType CLASS_TYPE = SceneComponentType::OCCLUDER;
 
@@ -36,6 +38,11 @@ public:
 		stride = m_stride;
 	}
 
+	Bool hasVertices() const
+	{
+		return m_count > 0;
+	}
+
 	/// Point the component to the vertex positions in world space. You are not supposed to call this often.
 	void setVertices(const Vec3* begin, U count, U stride);
 
@@ -44,11 +51,15 @@ public:
 		return m_aabb;
 	}
 
+	/// Queue the occluder for the visibility tests of the frame.
+	ANKI_USE_RESULT Error update(SceneNode& node, Second prevTime, Second crntTime, Bool& updated) override;
+
 private:
 	const Vec3* m_begin = nullptr;
 	U32 m_count = 0;
 	U32 m_stride = 0;
 	Aabb m_aabb;
+	OccluderComponent* m_nextQueued = nullptr; ///< Used by the SceneGraph to gather the occluders of a frame.
 };
 /// @}
 
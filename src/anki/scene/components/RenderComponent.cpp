@@ -5,6 +5,7 @@
 
 #include <anki/scene/components/RenderComponent.h>
 #include <anki/scene/SceneNode.h>
+#include <anki/scene/components/SpatialComponent.h>
 #include <anki/resource/TextureResource.h>
 #include <anki/resource/ResourceManager.h>
 #include <anki/util/Logger.h>
@@ -35,6 +36,51 @@ MaterialRenderComponent::~MaterialRenderComponent()
 	m_vars.destroy(m_node->getAllocator());
 }
 
+/// Get the finest mip of a texture that an object needs. It assumes that the texture covers the object once.
+static U32 computeTextureMip(F32 screenSize, const TextureResource& tex)
+{
+	const F32 texSize = F32(max(tex.getWidth(), tex.getHeight()));
+	if(screenSize >= texSize)
+	{
+		return 0;
+	}
+
+	// Every mip is half the size
+	return U32(log2(texSize / max(screenSize, 1.0f)));
+}
+
+F32 MaterialRenderComponent::computeScreenSize(
+	const RenderQueueDrawContext& ctx, ConstWeakArray<Mat4> transforms) const
+{
+	const SpatialComponent* sp = m_node->tryGetComponent<SpatialComponent>();
+	if(sp == nullptr || transforms.getSize() == 0 || ctx.m_viewportHeight == 0)
+	{
+		return MAX_F32;
+	}
+
+	// The instances have the same size. Move the bounding volume of the first one to the others
+	const Aabb& aabb = sp->getAabb();
+	const Vec4 offset = (aabb.getMin() + aabb.getMax()) * 0.5f - transforms[0].getTranslationPart();
+	const Vec4 up = ctx.m_cameraTransform.getColumn(1).xyz0() * (aabb.getMax() - aabb.getMin()).xyz0().getLength();
+
+	F32 ndcSize = 0.0f;
+	for(const Mat4& trf : transforms)
+	{
+		const Vec4 center = (trf.getTranslationPart() + offset).xyz1();
+		const Vec4 a = ctx.m_viewProjectionMatrix * center;
+		const Vec4 b = ctx.m_viewProjectionMatrix * (center + up);
+		if(a.w() <= EPSILON || b.w() <= EPSILON)
+		{
+			// The camera is too close
+			return MAX_F32;
+		}
+
+		ndcSize = max(ndcSize, absolute(b.y() / b.w() - a.y() / a.w()));
+	}
+
+	return ndcSize * 0.5f * F32(ctx.m_viewportHeight);
+}
+
 void MaterialRenderComponent::allocateAndSetupUniforms(U set,
 	const RenderQueueDrawContext& ctx,
 	ConstWeakArray<Mat4> transforms,
@@ -68,6 +114,10 @@ void MaterialRenderComponent::allocateAndSetupUniforms(U set,
 	uniformsBegin = uniforms;
 	uniformsEnd = uniforms + variant.getUniformBlockSize();
 
+	// The shadows don't need the fine mips of the textures, the other passes request them
+	const Bool requestMips = ctx.m_key.m_pass != Pass::SM;
+	const F32 screenSize = (requestMips) ? computeScreenSize(ctx, transforms) : 0.0f;
+
 	// Iterate variables
 	for(auto it = m_vars.getBegin(); it != m_vars.getEnd(); ++it)
 	{
@@ -263,6 +313,12 @@ void MaterialRenderComponent::allocateAndSetupUniforms(U set,
 		case ShaderVariableDataType::SAMPLER_3D:
 		case ShaderVariableDataType::SAMPLER_CUBE:
 		{
+			if(requestMips)
+			{
+				const TextureResource& tex = *mvar.getValue<TextureResourcePtr>();
+				tex.requestMip(computeTextureMip(screenSize, tex));
+			}
+
 			ctx.m_commandBuffer->bindTextureAndSampler(set,
 				progVariant.getTextureUnit(progvar),
 				mvar.getValue<TextureResourcePtr>()->getGrTextureView(),
@@ -140,6 +140,9 @@ private:
 	SceneNode* m_node;
 	Variables m_vars;
 	MaterialResourcePtr m_mtl;
+
+	/// Get the size in pixels of the closest instance. It returns MAX_F32 if it can't tell.
+	F32 computeScreenSize(const RenderQueueDrawContext& ctx, ConstWeakArray<Mat4> transforms) const;
 };
 /// @}
 
@@ -5,9 +5,9 @@
 
 #include <anki/scene/components/SkinComponent.h>
 #include <anki/scene/SceneNode.h>
+#include <anki/scene/SceneGraph.h>
 #include <anki/resource/SkeletonResource.h>
 #include <anki/resource/AnimationResource.h>
-#include <anki/util/BitSet.h>
 
 namespace anki
 {
@@ -19,23 +19,62 @@ SkinComponent::SkinComponent(SceneNode* node, SkeletonResourcePtr skeleton)
 {
 	ANKI_ASSERT(node);
 
-	m_boneTrfs.create(m_node->getAllocator(), m_skeleton->getBones().getSize());
+	const U32 boneCount = m_skeleton->getBones().getSize();
+	m_boneTrfs.create(m_node->getAllocator(), boneCount);
 	for(Mat4& trf : m_boneTrfs)
 	{
 		trf.setIdentity();
 	}
+
+	m_bonePoses.create(m_node->getAllocator(), boneCount);
+	m_boneWorldTrfs.create(m_node->getAllocator(), boneCount);
 }
 
 SkinComponent::~SkinComponent()
 {
 	m_boneTrfs.destroy(m_node->getAllocator());
+	m_bonePoses.destroy(m_node->getAllocator());
+	m_boneWorldTrfs.destroy(m_node->getAllocator());
+
+	for(Track& track : m_tracks)
+	{
+		track.m_cursors.destroy(m_node->getAllocator());
+		track.m_channelBones.destroy(m_node->getAllocator());
+	}
 }
 
 void SkinComponent::playAnimation(U track, AnimationResourcePtr anim, Second startTime, Bool repeat)
 {
-	m_tracks[track].m_anim = anim;
-	m_tracks[track].m_time = startTime;
-	m_tracks[track].m_repeat = repeat;
+	Track& t = m_tracks[track];
+	t.m_anim = anim;
+
+	// New animation, new cursors and find the bones once instead of every frame
+	t.m_cursors.destroy(m_node->getAllocator());
+	t.m_channelBones.destroy(m_node->getAllocator());
+	if(anim.isCreated())
+	{
+		const U32 channelCount = anim->getChannels().getSize();
+		t.m_cursors.create(m_node->getAllocator(), channelCount, AnimationChannelCursor());
+		t.m_channelBones.create(m_node->getAllocator(), channelCount);
+
+		for(U i = 0; i < channelCount; ++i)
+		{
+			const AnimationChannel& channel = anim->getChannels()[i];
+			const Bone* bone = m_skeleton->tryFindBone(channel.m_name.toCString());
+			if(bone)
+			{
+				t.m_channelBones[i] = bone->getIndex();
+			}
+			else
+			{
+				ANKI_SCENE_LOGW("Animation is referencing unknown bone \"%s\"", &channel.m_name[0]);
+				t.m_channelBones[i] = MAX_U32;
+			}
+		}
+	}
+
+	t.m_time = startTime;
+	t.m_repeat = repeat;
 }
 
 Error SkinComponent::update(SceneNode& node, Second prevTime, Second crntTime, Bool& updated)
@@ -53,56 +92,96 @@ Error SkinComponent::update(SceneNode& node, Second prevTime, Second crntTime, B
 		}
 
 		updated = true;
-
-		const Second animTime = track.m_time;
+		track.m_sampleTime = track.m_time;
 		track.m_time += timeDiff;
+	}
+
+	// The heavy work happens later. The SceneGraph animates all the skins of the frame together
+	if(updated)
+	{
+		m_node->getSceneGraph().queueSkinUpdate(this);
+	}
+
+	return Error::NONE;
+}
+
+void SkinComponent::sampleAnimations()
+{
+	for(BonePose& pose : m_bonePoses)
+	{
+		pose.m_rotation = Quat(0.0f);
+		pose.m_position = Vec3(0.0f);
+		pose.m_weight = 0.0f;
+	}
 
-		// Iterate the animation channels and interpolate
-		BitSet<128> bonesAnimated(false);
-		for(U i = 0; i < track.m_anim->getChannels().getSize(); ++i)
+	for(Track& track : m_tracks)
+	{
+		if(!track.m_anim.isCreated() || track.m_weight <= 0.0f)
 		{
-			const AnimationChannel& channel = track.m_anim->getChannels()[i];
-			const Bone* bone = m_skeleton->tryFindBone(channel.m_name.toCString());
-			if(!bone)
+			continue;
+		}
+
+		// Iterate the animation channels, interpolate and accumulate to the bones
+		for(U i = 0; i < track.m_channelBones.getSize(); ++i)
+		{
+			const U32 boneIdx = track.m_channelBones[i];
+			if(boneIdx == MAX_U32)
 			{
-				ANKI_SCENE_LOGW("Animation is referencing unknown bone \"%s\"", &channel.m_name[0]);
 				continue;
 			}
 
-			// Interpolate
-			Vec3 position;
-			Quat rotation;
-			F32 scale;
-			track.m_anim->interpolate(i, animTime, position, rotation, scale);
+			Vec3 position(0.0f);
+			Quat rotation(Quat::getIdentity());
+			F32 scale = 1.0f;
+			track.m_anim->interpolate(i, track.m_sampleTime, position, rotation, scale, &track.m_cursors[i]);
 
-			// Store
-			bonesAnimated.set(bone->getIndex());
-			m_boneTrfs[bone->getIndex()] = Mat4(position.xyz1(), Mat3(rotation), 1.0f) * bone->getVertexTransform();
-		}
+			BonePose& pose = m_bonePoses[boneIdx];
 
-		// Walk the bone hierarchy to add additional transforms
-		visitBones(m_skeleton->getRootBone(), Mat4::getIdentity(), bonesAnimated);
-	}
+			// q and -q are the same rotation but they don't blend
+			if(pose.m_rotation.dot(rotation) < 0.0f)
+			{
+				rotation = -rotation;
+			}
 
-	return Error::NONE;
+			pose.m_rotation += rotation * track.m_weight;
+			pose.m_position += position * track.m_weight;
+			pose.m_weight += track.m_weight;
+		}
+	}
 }
 
-void SkinComponent::visitBones(const Bone& bone, const Mat4& parentTrf, const BitSet<128>& bonesAnimated)
+void SkinComponent::computeBoneTransforms()
 {
-	Mat4 myTrf = parentTrf * bone.getTransform();
+	const DynamicArray<Bone>& bones = m_skeleton->getBones();
 
-	if(bonesAnimated.get(bone.getIndex()))
+	// Parents come before children so the parent transforms are ready when a child needs them
+	for(U32 boneIdx : m_skeleton->getBonesSortedByHierarchy())
 	{
-		m_boneTrfs[bone.getIndex()] = myTrf * m_boneTrfs[bone.getIndex()];
-	}
-	else
-	{
-		m_boneTrfs[bone.getIndex()] = myTrf * bone.getVertexTransform();
-	}
+		const Bone& bone = bones[boneIdx];
+		BonePose& pose = m_bonePoses[boneIdx];
 
-	for(const Bone* child : bone.getChildren())
-	{
-		visitBones(*child, myTrf, bonesAnimated);
+		Mat3x4 localTrf(bone.getTransform());
+		if(pose.m_weight > 0.0f)
+		{
+			// Less than full weight leaves some of the bind pose
+			if(pose.m_weight < 1.0f)
+			{
+				const Quat ident = (pose.m_rotation.w() < 0.0f) ? -Quat::getIdentity() : Quat::getIdentity();
+				pose.m_rotation += ident * (1.0f - pose.m_weight);
+				pose.m_weight = 1.0f;
+			}
+
+			const Vec3 position = pose.m_position / pose.m_weight;
+			const Quat rotation = pose.m_rotation.getNormalized();
+			localTrf = localTrf.combineTransformations(Mat3x4(position, Mat3(rotation)));
+		}
+
+		const Bone* parent = bone.getParent();
+		m_boneWorldTrfs[boneIdx] =
+			(parent) ? m_boneWorldTrfs[parent->getIndex()].combineTransformations(localTrf) : localTrf;
+
+		m_boneTrfs[boneIdx] =
+			Mat4(m_boneWorldTrfs[boneIdx].combineTransformations(Mat3x4(bone.getVertexTransform())));
 	}
 }
 
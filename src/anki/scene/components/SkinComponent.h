@@ -16,9 +16,11 @@ namespace anki
 /// @addtogroup scene
 /// @{
 
-/// Skin component.
+/// Skin component. It blends the animation tracks and computes the bone transforms.
 class SkinComponent : public SceneComponent
 {
+	friend class SceneGraph;
+
 public:
 	static const SceneComponentType CLASS_TYPE = SceneComponentType::SKIN;
 	static const U MAX_ANIMATION_TRACKS = 2;
@@ -31,6 +33,14 @@ public:
 
 	void playAnimation(U track, AnimationResourcePtr anim, Second startTime, Bool repeat);
 
+	/// Set how much a track contributes to the pose. The tracks that animate a bone are normalized if their weights sum
+	/// to more than 1. If they sum to less than 1 the bind pose fills the rest.
+	void setAnimationWeight(U track, F32 weight)
+	{
+		ANKI_ASSERT(weight >= 0.0f);
+		m_tracks[track].m_weight = weight;
+	}
+
 	const DynamicArray<Mat4>& getBoneTransforms() const
 	{
 		return m_boneTrfs;
@@ -41,16 +51,37 @@ private:
 	{
 	public:
 		AnimationResourcePtr m_anim;
-		F64 m_time;
-		Bool8 m_repeat;
+		DynamicArray<AnimationChannelCursor> m_cursors; ///< One per animation channel.
+		DynamicArray<U32> m_channelBones; ///< The bone of each animation channel or MAX_U32 if there is none.
+		F64 m_time = 0.0;
+		F64 m_sampleTime = 0.0; ///< The time of the animation that will be sampled this frame.
+		F32 m_weight = 1.0f;
+		Bool8 m_repeat = false;
+	};
+
+	/// The blended animation of a bone.
+	class BonePose
+	{
+	public:
+		Quat m_rotation;
+		Vec3 m_position;
+		F32 m_weight;
 	};
 
 	SceneNode* m_node;
 	SkeletonResourcePtr m_skeleton;
 	DynamicArray<Mat4> m_boneTrfs;
+	DynamicArray<BonePose> m_bonePoses;
+	DynamicArray<Mat3x4> m_boneWorldTrfs; ///< The bone transforms without the vertex transform.
 	Array<Track, MAX_ANIMATION_TRACKS> m_tracks;
 
-	void visitBones(const Bone& bone, const Mat4& parentTrf, const BitSet<128, U8>& bonesAnimated);
+	SkinComponent* m_nextQueued = nullptr; ///< Used by the SceneGraph to animate the skins of a frame in parallel.
+
+	/// Interpolate the tracks and blend them to the bone poses.
+	void sampleAnimations();
+
+	/// Compute the bone transforms from the bone poses.
+	void computeBoneTransforms();
 };
 /// @}
 
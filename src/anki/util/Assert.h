@@ -16,7 +16,8 @@
 namespace anki
 {
 
-void akassert(const char* exprTxt, const char* file, int line, const char* func);
+/// Print the failed assertion and abort.
+[[noreturn]] void akassert(const char* exprTxt, const char* file, int line, const char* func);
 
 } // end namespace
 
@@ -53,8 +53,8 @@ Error File::open(const CString& filename, FileOpenFlag flags)
 						  | FileOpenFlag::ENDIAN_LITTLE | FileOpenFlag::ENDIAN_BIG))
 				!= FileOpenFlag::NONE);
 
-	// Cannot be both
-	ANKI_ASSERT((flags & FileOpenFlag::READ) != (flags & FileOpenFlag::WRITE));
+	// Need at least one of them. Both open an existing file for updating
+	ANKI_ASSERT((flags & (FileOpenFlag::READ | FileOpenFlag::WRITE)) != FileOpenFlag::NONE);
 
 	//
 	// Determine the file type and open it
@@ -108,7 +108,11 @@ Error File::openCFile(const CString& filename, FileOpenFlag flags)
 	Error err = Error::NONE;
 	const char* openMode;
 
-	if((flags & FileOpenFlag::READ) != FileOpenFlag::NONE)
+	if((flags & (FileOpenFlag::READ | FileOpenFlag::WRITE)) == (FileOpenFlag::READ | FileOpenFlag::WRITE))
+	{
+		openMode = "r+b";
+	}
+	else if((flags & FileOpenFlag::READ) != FileOpenFlag::NONE)
 	{
 		openMode = "rb";
 	}
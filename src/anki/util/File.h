@@ -62,7 +62,8 @@ public:
 
 	/// Open a file.
 	/// @param[in] filename The file to open
-	/// @param[in] openMask The open flags. It's a combination of FileOpenFlag enum
+	/// @param[in] openMask The open flags. It's a combination of FileOpenFlag enum. READ | WRITE opens an existing file
+	///                     to overwrite parts of it.
 	ANKI_USE_RESULT Error open(const CString& filename, FileOpenFlag openMask);
 
 	/// Return true if the file is oppen
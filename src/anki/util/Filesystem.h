@@ -44,6 +44,43 @@ ANKI_USE_RESULT Error createDirectory(const CString& dir);
 /// Write the home directory to @a buff. The @a buffSize is the size of the @a buff. If the @buffSize is not enough the
 /// function will throw an exception.
 ANKI_USE_RESULT Error getHomeDirectory(GenericMemoryPoolAllocator<U8> alloc, String& out);
+
+/// A read-only memory mapping of a whole file. The pages are loaded on demand by the OS.
+class MemoryMappedFile : public NonCopyable
+{
+public:
+	MemoryMappedFile() = default;
+
+	~MemoryMappedFile()
+	{
+		unmap();
+	}
+
+	/// Map a file. An empty file gives an empty mapping.
+	ANKI_USE_RESULT Error map(const CString& filename);
+
+	void unmap();
+
+	Bool isMapped() const
+	{
+		return m_mapped;
+	}
+
+	const U8* getData() const
+	{
+		return static_cast<const U8*>(m_data);
+	}
+
+	PtrSize getSize() const
+	{
+		return m_size;
+	}
+
+private:
+	void* m_data = nullptr;
+	PtrSize m_size = 0;
+	Bool8 m_mapped = false;
+};
 /// @}
 
 } // end namespace anki
@@ -8,6 +8,9 @@
 #include <anki/util/Thread.h>
 #include <cstring>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <cerrno>
@@ -113,49 +116,66 @@ Error walkDirectoryTree(const CString& dir, void* userData, WalkDirectoryTreeCal
 static char g_removeDirectoryPath[PATH_MAX];
 static Mutex g_removeDirectoryLock;
 
-static Error removeDirectoryInternal(const CString& dirname)
+/// Remove the directory that is in g_removeDirectoryPath. The subdirectories append their names to the same buffer and
+/// truncate it back to dirnameLength when they are done.
+static Error removeDirectoryInternal(PtrSize dirnameLength)
 {
 	DIR* dir;
 	struct dirent* entry;
 
-	dir = opendir(dirname.get());
+	dir = opendir(g_removeDirectoryPath);
 	if(dir == nullptr)
 	{
 		ANKI_UTIL_LOGE("opendir() failed");
 		return Error::FUNCTION_FAILED;
 	}
 
-	while((entry = readdir(dir)) != nullptr)
+	Error err = Error::NONE;
+	while(!err && (entry = readdir(dir)) != nullptr)
 	{
 		if(strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
 		{
-			std::snprintf(g_removeDirectoryPath, size_t(PATH_MAX), "%s/%s", dirname.get(), entry->d_name);
-
-			if(entry->d_type == DT_DIR)
+			const I32 len = std::snprintf(
+				&g_removeDirectoryPath[dirnameLength], PATH_MAX - dirnameLength, "/%s", entry->d_name);
+			if(len < 0 || dirnameLength + len >= PATH_MAX)
 			{
-				Error err = removeDirectoryInternal(CString(g_removeDirectoryPath));
-				if(err)
-				{
-					return err;
-				}
+				ANKI_UTIL_LOGE("Path too long");
+				err = Error::FUNCTION_FAILED;
+			}
+			else if(entry->d_type == DT_DIR)
+			{
+				err = removeDirectoryInternal(dirnameLength + len);
 			}
 			else
 			{
 				remove(g_removeDirectoryPath);
 			}
+
+			g_removeDirectoryPath[dirnameLength] = '\0';
 		}
 	}
 
 	closedir(dir);
-	remove(dirname.get());
+	if(!err)
+	{
+		remove(g_removeDirectoryPath);
+	}
 
-	return Error::NONE;
+	return err;
 }
 
 Error removeDirectory(const CString& dirname)
 {
 	LockGuard<Mutex> lock(g_removeDirectoryLock);
-	return removeDirectoryInternal(dirname);
+
+	if(dirname.getLength() >= PATH_MAX)
+	{
+		ANKI_UTIL_LOGE("Path too long");
+		return Error::FUNCTION_FAILED;
+	}
+
+	memcpy(g_removeDirectoryPath, dirname.get(), dirname.getLength() + 1);
+	return removeDirectoryInternal(dirname.getLength());
 }
 
 Error createDirectory(const CString& dir)
@@ -188,4 +208,56 @@ Error getHomeDirectory(GenericMemoryPoolAllocator<U8> alloc, String& out)
 	return Error::NONE;
 }
 
+Error MemoryMappedFile::map(const CString& filename)
+{
+	unmap();
+
+	const int fd = open(filename.get(), O_RDONLY);
+	if(fd < 0)
+	{
+		ANKI_UTIL_LOGE("open() failed: %s : %s", strerror(errno), filename.get());
+		return Error::FILE_ACCESS;
+	}
+
+	Error err = Error::NONE;
+	struct stat s;
+	if(fstat(fd, &s) != 0)
+	{
+		ANKI_UTIL_LOGE("fstat() failed: %s : %s", strerror(errno), filename.get());
+		err = Error::FILE_ACCESS;
+	}
+	else if(s.st_size > 0)
+	{
+		void* data = mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED)
+		{
+			ANKI_UTIL_LOGE("mmap() failed: %s : %s", strerror(errno), filename.get());
+			err = Error::FILE_ACCESS;
+		}
+		else
+		{
+			m_data = data;
+			m_size = s.st_size;
+		}
+	}
+
+	// The mapping stays valid after the file is closed
+	close(fd);
+
+	m_mapped = !err;
+	return err;
+}
+
+void MemoryMappedFile::unmap()
+{
+	if(m_data)
+	{
+		munmap(m_data, m_size);
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_mapped = false;
+}
+
 } // end namespace anki
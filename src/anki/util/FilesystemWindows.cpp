@@ -201,4 +201,63 @@ Error walkDirectoryTree(const CString& dir, void* userData, WalkDirectoryTreeCal
 	return walkDirectoryTreeInternal(dir, userData, callback, baseDirLen);
 }
 
+Error MemoryMappedFile::map(const CString& filename)
+{
+	unmap();
+
+	HANDLE file = CreateFile(
+		filename.get(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		ANKI_UTIL_LOGE("CreateFile() failed: %s", filename.get());
+		return Error::FILE_ACCESS;
+	}
+
+	Error err = Error::NONE;
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size))
+	{
+		ANKI_UTIL_LOGE("GetFileSizeEx() failed: %s", filename.get());
+		err = Error::FILE_ACCESS;
+	}
+	else if(size.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* data = (mapping) ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if(data == nullptr)
+		{
+			ANKI_UTIL_LOGE("Failed to map file: %s", filename.get());
+			err = Error::FILE_ACCESS;
+		}
+		else
+		{
+			m_data = data;
+			m_size = size.QuadPart;
+		}
+
+		// The view keeps the mapping alive
+		if(mapping)
+		{
+			CloseHandle(mapping);
+		}
+	}
+
+	CloseHandle(file);
+
+	m_mapped = !err;
+	return err;
+}
+
+void MemoryMappedFile::unmap()
+{
+	if(m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_mapped = false;
+}
+
 } // end namespace anki
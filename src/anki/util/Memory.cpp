@@ -45,6 +45,69 @@ static void invalidateMemory(TPtr ptr, TSize size)
 #endif
 }
 
+/// The number of thread arenas a pool has. If there are more threads some of them will share arenas.
+static const U32 MAX_THREAD_ARENAS = 64;
+
+/// Get a small number that identifies the calling thread.
+static U32 getThreadArenaIndex()
+{
+	static Atomic<U32> threadCount = {0};
+	static thread_local U32 idx = MAX_U32;
+
+	if(ANKI_UNLIKELY(idx == MAX_U32))
+	{
+		idx = threadCount.fetchAdd(1) % MAX_THREAD_ARENAS;
+	}
+
+	return idx;
+}
+
+template<typename TArena>
+static TArena* newThreadArenas(AllocAlignedCallback allocCb, void* allocCbUserData)
+{
+	TArena* arenas =
+		static_cast<TArena*>(allocCb(allocCbUserData, nullptr, sizeof(TArena) * MAX_THREAD_ARENAS, alignof(TArena)));
+	if(arenas == nullptr)
+	{
+		ANKI_CREATION_OOM_ACTION();
+	}
+
+	for(U32 i = 0; i < MAX_THREAD_ARENAS; ++i)
+	{
+		::new(&arenas[i]) TArena();
+	}
+
+	return arenas;
+}
+
+template<typename TArena>
+static void deleteThreadArenas(AllocAlignedCallback allocCb, void* allocCbUserData, TArena* arenas)
+{
+	for(U32 i = 0; i < MAX_THREAD_ARENAS; ++i)
+	{
+		arenas[i].~TArena();
+	}
+
+	allocCb(allocCbUserData, arenas, 0, 0);
+}
+
+/// A bump allocator that belongs to one or more threads.
+class alignas(ANKI_CACHE_LINE_SIZE) StackMemoryPool::ThreadArena
+{
+public:
+	SpinLock m_lock; ///< It's almost never contended.
+	U8* m_mem = nullptr; ///< The next allocation.
+	U8* m_end = nullptr; ///< The end of the arena.
+};
+
+/// The current chunk of one or more threads.
+class alignas(ANKI_CACHE_LINE_SIZE) ChainMemoryPool::ThreadArena
+{
+public:
+	SpinLock m_lock; ///< It's almost never contended.
+	Chunk* m_chunk = nullptr;
+};
+
 void* mallocAligned(PtrSize size, PtrSize alignmentBytes)
 {
 	ANKI_ASSERT(size > 0);
@@ -161,6 +224,9 @@ void* BaseMemoryPool::allocate(PtrSize size, PtrSize alignmentBytes)
 	case Type::CHAIN:
 		out = static_cast<ChainMemoryPool*>(this)->allocate(size, alignmentBytes);
 		break;
+	case Type::TLSF:
+		out = static_cast<TlsfMemoryPool*>(this)->allocate(size, alignmentBytes);
+		break;
 	default:
 		ANKI_ASSERT(0);
 	}
@@ -181,6 +247,9 @@ void BaseMemoryPool::free(void* ptr)
 	case Type::CHAIN:
 		static_cast<ChainMemoryPool*>(this)->free(ptr);
 		break;
+	case Type::TLSF:
+		static_cast<TlsfMemoryPool*>(this)->free(ptr);
+		break;
 	default:
 		ANKI_ASSERT(0);
 	}
@@ -271,6 +340,11 @@ StackMemoryPool::StackMemoryPool()
 
 StackMemoryPool::~StackMemoryPool()
 {
+	if(m_threadArenas)
+	{
+		deleteThreadArenas(m_allocCb, m_allocCbUserData, m_threadArenas);
+	}
+
 	// Iterate all until you find an unused
 	for(Chunk& ch : m_chunks)
 	{
@@ -301,7 +375,8 @@ void StackMemoryPool::create(AllocAlignedCallback allocCb,
 	F32 nextChunkScale,
 	PtrSize nextChunkBias,
 	Bool ignoreDeallocationErrors,
-	PtrSize alignmentBytes)
+	PtrSize alignmentBytes,
+	PtrSize threadArenaSize)
 {
 	ANKI_ASSERT(!isCreated());
 	ANKI_ASSERT(allocCb);
@@ -334,6 +409,14 @@ void StackMemoryPool::create(AllocAlignedCallback allocCb,
 	{
 		ANKI_CREATION_OOM_ACTION();
 	}
+
+	// Create the thread arenas
+	if(threadArenaSize > 0)
+	{
+		m_threadArenaSize = getAlignedRoundUp(m_alignmentBytes, threadArenaSize);
+		ANKI_ASSERT(m_threadArenaSize <= m_initialChunkSize && "The arena should fit in a chunk");
+		m_threadArenas = newThreadArenas<ThreadArena>(m_allocCb, m_allocCbUserData);
+	}
 }
 
 void* StackMemoryPool::allocate(PtrSize size, PtrSize alignment)
@@ -346,6 +429,50 @@ void* StackMemoryPool::allocate(PtrSize size, PtrSize alignment)
 	ANKI_ASSERT(size > 0);
 	ANKI_ASSERT(size <= m_initialChunkSize && "The chunks should have enough space to hold at least one allocation");
 
+	void* out;
+	if(m_threadArenas && size * 4 <= m_threadArenaSize)
+	{
+		// Small allocation, use the arena of the thread
+		out = allocateFromThreadArena(size);
+	}
+	else
+	{
+		out = allocateFromChunks(size);
+
+		if(out && !m_threadArenas)
+		{
+			m_allocationsCount.fetchAdd(1);
+		}
+	}
+
+	return out;
+}
+
+void* StackMemoryPool::allocateFromThreadArena(PtrSize size)
+{
+	ThreadArena& arena = m_threadArenas[getThreadArenaIndex()];
+	LockGuard<SpinLock> lock(arena.m_lock);
+
+	if(ANKI_UNLIKELY(arena.m_mem + size > arena.m_end))
+	{
+		// Arena is full, refill it. The leftovers are wasted
+		U8* mem = static_cast<U8*>(allocateFromChunks(m_threadArenaSize));
+		if(mem == nullptr)
+		{
+			return nullptr;
+		}
+
+		arena.m_mem = mem;
+		arena.m_end = mem + m_threadArenaSize;
+	}
+
+	U8* out = arena.m_mem;
+	arena.m_mem += size;
+	return out;
+}
+
+void* StackMemoryPool::allocateFromChunks(PtrSize size)
+{
 	Chunk* crntChunk = nullptr;
 	Bool retry = true;
 	U8* out = nullptr;
@@ -363,7 +490,6 @@ void* StackMemoryPool::allocate(PtrSize size, PtrSize alignment)
 			// All is fine, there is enough space in the chunk
 
 			retry = false;
-			m_allocationsCount.fetchAdd(1);
 		}
 		else
 		{
@@ -437,15 +563,28 @@ void StackMemoryPool::free(void* ptr)
 	// allocated by this class
 	ANKI_ASSERT(ptr != nullptr && isAligned(m_alignmentBytes, ptr));
 
-	auto count = m_allocationsCount.fetchSub(1);
-	ANKI_ASSERT(count > 0);
-	(void)count;
+	if(m_threadArenas == nullptr)
+	{
+		auto count = m_allocationsCount.fetchSub(1);
+		ANKI_ASSERT(count > 0);
+		(void)count;
+	}
 }
 
 void StackMemoryPool::reset()
 {
 	ANKI_ASSERT(isCreated());
 
+	// Empty the arenas, they point to the chunks that will be recycled
+	if(m_threadArenas)
+	{
+		for(U32 i = 0; i < MAX_THREAD_ARENAS; ++i)
+		{
+			m_threadArenas[i].m_mem = nullptr;
+			m_threadArenas[i].m_end = nullptr;
+		}
+	}
+
 	// Iterate all until you find an unused
 	for(Chunk& ch : m_chunks)
 	{
@@ -493,7 +632,25 @@ ChainMemoryPool::ChainMemoryPool()
 
 ChainMemoryPool::~ChainMemoryPool()
 {
-	if(m_allocationsCount.load() != 0)
+	if(m_threadArenas)
+	{
+		// Drop the references of the arenas. If the chunks are still alive someone forgot to deallocate
+		for(U32 i = 0; i < MAX_THREAD_ARENAS; ++i)
+		{
+			if(m_threadArenas[i].m_chunk)
+			{
+				releaseChunk(m_threadArenas[i].m_chunk);
+			}
+		}
+
+		deleteThreadArenas(m_allocCb, m_allocCbUserData, m_threadArenas);
+
+		if(m_headChunk != nullptr)
+		{
+			ANKI_UTIL_LOGW("Memory pool destroyed before all memory being released");
+		}
+	}
+	else if(m_allocationsCount.load() != 0)
 	{
 		ANKI_UTIL_LOGW("Memory pool destroyed before all memory being released");
 	}
@@ -519,7 +676,8 @@ void ChainMemoryPool::create(AllocAlignedCallback allocCb,
 	PtrSize initialChunkSize,
 	F32 nextChunkScale,
 	PtrSize nextChunkBias,
-	PtrSize alignmentBytes)
+	PtrSize alignmentBytes,
+	Bool threadArenas)
 {
 	ANKI_ASSERT(!isCreated());
 	ANKI_ASSERT(initialChunkSize > 0);
@@ -550,12 +708,22 @@ void ChainMemoryPool::create(AllocAlignedCallback allocCb,
 	{
 		ANKI_ASSERT(0 && "Wrong arg");
 	}
+
+	if(threadArenas)
+	{
+		m_threadArenas = newThreadArenas<ThreadArena>(m_allocCb, m_allocCbUserData);
+	}
 }
 
 void* ChainMemoryPool::allocate(PtrSize size, PtrSize alignment)
 {
 	ANKI_ASSERT(isCreated());
 
+	if(m_threadArenas)
+	{
+		return allocateFromThreadArena(size, alignment);
+	}
+
 	Chunk* ch;
 	void* mem = nullptr;
 
@@ -568,7 +736,7 @@ void* ChainMemoryPool::allocate(PtrSize size, PtrSize alignment)
 	if(ch == nullptr || (mem = allocateFromChunk(ch, size, alignment)) == nullptr)
 	{
 		// Create new chunk
-		PtrSize chunkSize = computeNewChunkSize(size);
+		PtrSize chunkSize = computeNewChunkSize(size, m_tailChunk);
 		ch = createNewChunk(chunkSize);
 
 		// Chunk creation failed
@@ -589,6 +757,56 @@ void* ChainMemoryPool::allocate(PtrSize size, PtrSize alignment)
 	return mem;
 }
 
+void* ChainMemoryPool::allocateFromThreadArena(PtrSize size, PtrSize alignment)
+{
+	ThreadArena& arena = m_threadArenas[getThreadArenaIndex()];
+	LockGuard<SpinLock> lock(arena.m_lock);
+
+	void* mem = (arena.m_chunk) ? allocateFromChunk(arena.m_chunk, size, alignment) : nullptr;
+	if(mem == nullptr)
+	{
+		// Need a new chunk
+		Chunk* ch;
+		{
+			LockGuard<SpinLock> lock(*m_lock);
+			ch = createNewChunk(computeNewChunkSize(size, arena.m_chunk));
+		}
+
+		if(ch == nullptr)
+		{
+			return nullptr;
+		}
+
+		// The arena holds a reference to its chunk so it won't get deleted while it's being used
+		ch->m_allocationsCount.fetchAdd(1);
+
+		if(arena.m_chunk)
+		{
+			releaseChunk(arena.m_chunk);
+		}
+		arena.m_chunk = ch;
+
+		mem = allocateFromChunk(ch, size, alignment);
+		ANKI_ASSERT(mem != nullptr && "The chunk should have space");
+	}
+
+	return mem;
+}
+
+void ChainMemoryPool::releaseChunk(Chunk* ch)
+{
+	ANKI_ASSERT(ch);
+
+	const U32 count = ch->m_allocationsCount.fetchSub(1, AtomicMemoryOrder::ACQ_REL);
+	ANKI_ASSERT(count > 0);
+	if(count == 1)
+	{
+		// Chunk is empty. Delete it
+		LockGuard<SpinLock> lock(*m_lock);
+		destroyChunk(ch);
+	}
+}
+
 void ChainMemoryPool::free(void* ptr)
 {
 	ANKI_ASSERT(isCreated());
@@ -605,11 +823,18 @@ void ChainMemoryPool::free(void* ptr)
 	ANKI_ASSERT(chunk != nullptr);
 	ANKI_ASSERT((mem >= chunk->m_memory && mem < (chunk->m_memory + chunk->m_memsize)) && "Wrong chunk");
 
+	if(m_threadArenas)
+	{
+		releaseChunk(chunk);
+		return;
+	}
+
 	LockGuard<SpinLock> lock(*m_lock);
 
 	// Decrease the deallocation refcount and if it's zero delete the chunk
-	ANKI_ASSERT(chunk->m_allocationsCount > 0);
-	if(--chunk->m_allocationsCount == 0)
+	const U32 count = chunk->m_allocationsCount.fetchSub(1);
+	ANKI_ASSERT(count > 0);
+	if(count == 1)
 	{
 		// Chunk is empty. Delete it
 		destroyChunk(chunk);
@@ -648,15 +873,15 @@ PtrSize ChainMemoryPool::getAllocatedSize() const
 	return sum;
 }
 
-PtrSize ChainMemoryPool::computeNewChunkSize(PtrSize size) const
+PtrSize ChainMemoryPool::computeNewChunkSize(PtrSize size, const Chunk* prevChunk) const
 {
 	size += m_headerSize;
 
 	PtrSize crntMaxSize;
-	if(m_tailChunk != nullptr)
+	if(prevChunk != nullptr)
 	{
 		// Get the size of previous
-		crntMaxSize = m_tailChunk->m_memsize;
+		crntMaxSize = prevChunk->m_memsize;
 
 		// Compute new size
 		crntMaxSize = F32(crntMaxSize) * m_scale + m_bias;
@@ -664,7 +889,6 @@ PtrSize ChainMemoryPool::computeNewChunkSize(PtrSize size) const
 	else
 	{
 		// No chunks. Choose initial size
-		ANKI_ASSERT(m_headChunk == nullptr);
 		crntMaxSize = m_initSize;
 	}
 
@@ -691,7 +915,7 @@ ChainMemoryPool::Chunk* ChainMemoryPool::createNewChunk(PtrSize size)
 		invalidateMemory(chunk, allocationSize);
 
 		// Construct it
-		memset(chunk, 0, sizeof(Chunk));
+		::new(chunk) Chunk();
 
 		// Initialize it
 		chunk->m_memory = reinterpret_cast<U8*>(chunk) + chunkAllocSize;
@@ -735,7 +959,7 @@ void* ChainMemoryPool::allocateFromChunk(Chunk* ch, PtrSize size, PtrSize alignm
 		mem += m_headerSize;
 
 		ch->m_top = newTop;
-		++ch->m_allocationsCount;
+		ch->m_allocationsCount.fetchAdd(1);
 	}
 	else
 	{
@@ -776,4 +1000,496 @@ void ChainMemoryPool::destroyChunk(Chunk* ch)
 	m_allocCb(m_allocCbUserData, ch, 0, 0);
 }
 
+/// Index of the most significant set bit.
+template<typename T>
+static U32 findMsb(T x)
+{
+	ANKI_ASSERT(x != 0);
+	return (sizeof(T) > sizeof(U32)) ? 63u - U32(__builtin_clzll(U64(x))) : 31u - U32(__builtin_clz(U32(x)));
+}
+
+/// Index of the least significant set bit.
+static U32 findLsb(U32 x)
+{
+	ANKI_ASSERT(x != 0);
+	return U32(__builtin_ctz(x));
+}
+
+/// A block of memory. The header is followed by the payload. When the block is free the start of the payload holds
+/// the links of the free list.
+class TlsfMemoryPool::Block
+{
+public:
+	static const PtrSize HEADER_SIZE = ALIGNMENT;
+	static const PtrSize MIN_SIZE = ALIGNMENT; ///< Minimum payload. Enough for the free list links.
+	static const PtrSize FREE_BIT = 1;
+
+	/// The previous block in memory or nullptr if it's the first block of its area.
+	Block* m_prevPhysical;
+
+	/// The size of the payload. The lower bit is the free flag.
+	PtrSize m_sizeAndFlags;
+
+	Block*& nextFree()
+	{
+		return reinterpret_cast<Block**>(getPayload())[0];
+	}
+
+	Block*& prevFree()
+	{
+		return reinterpret_cast<Block**>(getPayload())[1];
+	}
+
+	PtrSize getSize() const
+	{
+		return m_sizeAndFlags & ~FREE_BIT;
+	}
+
+	void setSize(PtrSize size)
+	{
+		ANKI_ASSERT(isAligned(ALIGNMENT, size));
+		m_sizeAndFlags = size | (m_sizeAndFlags & FREE_BIT);
+	}
+
+	Bool isFree() const
+	{
+		return (m_sizeAndFlags & FREE_BIT) != 0;
+	}
+
+	void setFree(Bool free)
+	{
+		m_sizeAndFlags = (free) ? (m_sizeAndFlags | FREE_BIT) : (m_sizeAndFlags & ~FREE_BIT);
+	}
+
+	U8* getPayload()
+	{
+		return reinterpret_cast<U8*>(this) + HEADER_SIZE;
+	}
+
+	/// The next block in memory. The last block of an area is followed by a zero sized sentinel.
+	Block* getNextPhysical()
+	{
+		return reinterpret_cast<Block*>(getPayload() + getSize());
+	}
+
+	static Block* fromPayload(void* ptr)
+	{
+		return reinterpret_cast<Block*>(static_cast<U8*>(ptr) - HEADER_SIZE);
+	}
+};
+
+/// A big piece of memory that was requested from the allocation callback. The header is followed by the blocks and
+/// a sentinel block.
+class TlsfMemoryPool::Area
+{
+public:
+	static const PtrSize HEADER_SIZE = ALIGNMENT * 2;
+
+	Area* m_prev;
+	Area* m_next;
+	PtrSize m_size; ///< The size of the whole allocation.
+
+	Block* getFirstBlock()
+	{
+		return reinterpret_cast<Block*>(reinterpret_cast<U8*>(this) + HEADER_SIZE);
+	}
+
+	static Area* fromFirstBlock(Block* block)
+	{
+		ANKI_ASSERT(block->m_prevPhysical == nullptr);
+		return reinterpret_cast<Area*>(reinterpret_cast<U8*>(block) - HEADER_SIZE);
+	}
+};
+
+TlsfMemoryPool::TlsfMemoryPool()
+	: BaseMemoryPool(Type::TLSF)
+{
+	static_assert(sizeof(void*) * 2 <= Block::HEADER_SIZE, "Header doesn't fit");
+	static_assert(sizeof(void*) * 2 <= Block::MIN_SIZE, "Free list links don't fit");
+	static_assert(sizeof(Area) <= Area::HEADER_SIZE, "Header doesn't fit");
+}
+
+TlsfMemoryPool::~TlsfMemoryPool()
+{
+	if(m_allocationsCount.load() != 0)
+	{
+		ANKI_UTIL_LOGW("Memory pool destroyed before all memory being released");
+	}
+
+	while(m_areas)
+	{
+		Area* next = m_areas->m_next;
+		m_allocCb(m_allocCbUserData, m_areas, 0, 0);
+		m_areas = next;
+	}
+}
+
+void TlsfMemoryPool::create(
+	AllocAlignedCallback allocCb, void* allocCbUserData, PtrSize initialAreaSize, F32 nextAreaScale)
+{
+	ANKI_ASSERT(!isCreated());
+	ANKI_ASSERT(allocCb);
+	ANKI_ASSERT(initialAreaSize > 0);
+	ANKI_ASSERT(nextAreaScale >= 1.0f);
+
+	m_allocCb = allocCb;
+	m_allocCbUserData = allocCbUserData;
+	m_nextAreaSize = initialAreaSize;
+	m_nextAreaScale = nextAreaScale;
+
+	if(!newArea(Block::MIN_SIZE))
+	{
+		ANKI_CREATION_OOM_ACTION();
+	}
+}
+
+void* TlsfMemoryPool::allocate(PtrSize size, PtrSize alignment)
+{
+	ANKI_ASSERT(isCreated());
+	ANKI_ASSERT(alignment > 0 && isPowerOfTwo(alignment));
+
+	size = max<PtrSize>(getAlignedRoundUp(ALIGNMENT, size), Block::MIN_SIZE);
+
+	// For big alignments ask for more memory. In the worst case the aligned address will be far enough from the start
+	// of the block to leave room for a free block in front of it
+	PtrSize searchSize = size;
+	if(alignment > ALIGNMENT)
+	{
+		searchSize += alignment + Block::HEADER_SIZE + Block::MIN_SIZE;
+	}
+
+	if(ANKI_UNLIKELY(searchSize >= (PtrSize(1) << (FL_MAX - 1))))
+	{
+		ANKI_UTIL_LOGE("Allocation too big");
+		return nullptr;
+	}
+
+	LockGuard<SpinLock> lock(m_lock);
+
+	Block* block = findFreeBlock(searchSize);
+	if(ANKI_UNLIKELY(block == nullptr))
+	{
+		if(!newArea(searchSize))
+		{
+			ANKI_OOM_ACTION();
+			return nullptr;
+		}
+
+		block = findFreeBlock(searchSize);
+		ANKI_ASSERT(block);
+	}
+
+	removeFreeBlock(block);
+	ANKI_ASSERT(block->getSize() >= searchSize);
+
+	if(alignment > ALIGNMENT && !isAligned(alignment, block->getPayload()))
+	{
+		// Move the block forward and return the gap to the free lists. The previous block can't be free because free
+		// blocks are always merged
+		Block* gap = block;
+		U8* payload = gap->getPayload() + Block::HEADER_SIZE + Block::MIN_SIZE;
+		alignRoundUp(alignment, payload);
+		const PtrSize offset = payload - gap->getPayload();
+
+		block = Block::fromPayload(payload);
+		block->m_prevPhysical = gap;
+		block->m_sizeAndFlags = 0;
+		block->setSize(gap->getSize() - offset);
+		block->getNextPhysical()->m_prevPhysical = block;
+
+		gap->setSize(offset - Block::HEADER_SIZE);
+		insertFreeBlock(gap);
+	}
+
+	trimBlock(block, size);
+	block->setFree(false);
+	ANKI_ASSERT(isAligned(alignment, block->getPayload()));
+
+	m_usedMemory += block->getSize() + Block::HEADER_SIZE;
+	m_allocationsCount.fetchAdd(1);
+
+	return block->getPayload();
+}
+
+void TlsfMemoryPool::free(void* ptr)
+{
+	ANKI_ASSERT(isCreated());
+	if(ANKI_UNLIKELY(ptr == nullptr))
+	{
+		return;
+	}
+
+	Block* block = Block::fromPayload(ptr);
+	ANKI_ASSERT(!block->isFree() && "Double free or wrong pointer");
+
+	LockGuard<SpinLock> lock(m_lock);
+
+	m_usedMemory -= block->getSize() + Block::HEADER_SIZE;
+	m_allocationsCount.fetchSub(1);
+	block->setFree(true);
+
+	// Merge with the previous
+	Block* prev = block->m_prevPhysical;
+	if(prev && prev->isFree())
+	{
+		removeFreeBlock(prev);
+		prev->setSize(prev->getSize() + Block::HEADER_SIZE + block->getSize());
+		prev->getNextPhysical()->m_prevPhysical = prev;
+		block = prev;
+	}
+
+	// Merge with the next
+	Block* next = block->getNextPhysical();
+	if(next->isFree())
+	{
+		removeFreeBlock(next);
+		block->setSize(block->getSize() + Block::HEADER_SIZE + next->getSize());
+		block->getNextPhysical()->m_prevPhysical = block;
+	}
+
+	// If the whole area is free release it
+	if(block->m_prevPhysical == nullptr && block->getNextPhysical()->getSize() == 0 && m_areaCount > 1)
+	{
+		deleteArea(Area::fromFirstBlock(block));
+	}
+	else
+	{
+		insertFreeBlock(block);
+	}
+}
+
+TlsfMemoryPoolStats TlsfMemoryPool::getStats() const
+{
+	TlsfMemoryPoolStats stats;
+
+	LockGuard<SpinLock> lock(m_lock);
+
+	stats.m_reservedMemory = m_reservedMemory;
+	stats.m_usedMemory = m_usedMemory;
+	stats.m_freeMemory = m_freeMemory;
+	stats.m_freeBlockCount = m_freeBlockCount;
+	stats.m_areaCount = m_areaCount;
+
+	// The largest block is in the last non-empty list
+	if(m_flBitmap)
+	{
+		const U32 fl = findMsb(m_flBitmap);
+		const U32 sl = findMsb(m_slBitmaps[fl]);
+		for(Block* block = m_freeLists[fl][sl]; block; block = block->nextFree())
+		{
+			stats.m_largestFreeBlock = max(stats.m_largestFreeBlock, block->getSize());
+		}
+	}
+
+	stats.m_fragmentation = (m_freeMemory) ? 1.0f - F32(stats.m_largestFreeBlock) / F32(m_freeMemory) : 0.0f;
+
+	return stats;
+}
+
+Bool TlsfMemoryPool::newArea(PtrSize minBlockSize)
+{
+	const PtrSize overhead = Area::HEADER_SIZE + Block::HEADER_SIZE * 2;
+
+	// Make sure that the search will find the block even if it rounds up the size
+	PtrSize blockSize = minBlockSize;
+	if(blockSize >= SMALL_BLOCK_SIZE)
+	{
+		blockSize += (PtrSize(1) << (findMsb(blockSize) - SL_COUNT_LOG2)) - 1;
+	}
+	blockSize = getAlignedRoundUp(ALIGNMENT, max(blockSize, m_nextAreaSize - min(m_nextAreaSize, overhead)));
+
+	const PtrSize areaSize = blockSize + overhead;
+	Area* area = static_cast<Area*>(m_allocCb(m_allocCbUserData, nullptr, areaSize, ALIGNMENT));
+	if(area == nullptr)
+	{
+		return false;
+	}
+
+	invalidateMemory(area, areaSize);
+
+	area->m_prev = nullptr;
+	area->m_next = m_areas;
+	area->m_size = areaSize;
+	if(m_areas)
+	{
+		m_areas->m_prev = area;
+	}
+	m_areas = area;
+
+	Block* block = area->getFirstBlock();
+	block->m_prevPhysical = nullptr;
+	block->m_sizeAndFlags = 0;
+	block->setSize(blockSize);
+	block->setFree(true);
+
+	Block* sentinel = block->getNextPhysical();
+	sentinel->m_prevPhysical = block;
+	sentinel->m_sizeAndFlags = 0;
+
+	insertFreeBlock(block);
+
+	m_reservedMemory += areaSize;
+	++m_areaCount;
+	m_nextAreaSize = max(m_nextAreaSize, min(PtrSize(F64(m_nextAreaSize) * m_nextAreaScale), MAX_AREA_GROWTH_SIZE));
+
+	return true;
+}
+
+void TlsfMemoryPool::deleteArea(Area* area)
+{
+	if(area->m_prev)
+	{
+		area->m_prev->m_next = area->m_next;
+	}
+	else
+	{
+		ANKI_ASSERT(m_areas == area);
+		m_areas = area->m_next;
+	}
+
+	if(area->m_next)
+	{
+		area->m_next->m_prev = area->m_prev;
+	}
+
+	ANKI_ASSERT(m_areaCount > 0 && m_reservedMemory >= area->m_size);
+	--m_areaCount;
+	m_reservedMemory -= area->m_size;
+
+	invalidateMemory(area, area->m_size);
+	m_allocCb(m_allocCbUserData, area, 0, 0);
+}
+
+void TlsfMemoryPool::mapping(PtrSize size, U32& fl, U32& sl)
+{
+	if(size < SMALL_BLOCK_SIZE)
+	{
+		// Small blocks are linearly spaced in the first row
+		fl = 0;
+		sl = U32(size / (SMALL_BLOCK_SIZE / SL_COUNT));
+	}
+	else
+	{
+		// allocate() rejects the sizes that don't fit in the last row. Clamp anyway so the indices are always in range
+		ANKI_ASSERT(findMsb(size) < FL_MAX);
+		const U32 msb = min(findMsb(size), FL_MAX - 1);
+		sl = U32(size >> (msb - SL_COUNT_LOG2)) & (SL_COUNT - 1);
+		fl = msb - (FL_SHIFT - 1);
+	}
+
+	ANKI_ASSERT(fl < FL_COUNT && sl < SL_COUNT);
+}
+
+TlsfMemoryPool::Block* TlsfMemoryPool::findFreeBlock(PtrSize size) const
+{
+	// Round up to the next list so that any block of that list will be big enough
+	if(size >= SMALL_BLOCK_SIZE)
+	{
+		size += (PtrSize(1) << (findMsb(size) - SL_COUNT_LOG2)) - 1;
+	}
+
+	U32 fl, sl;
+	mapping(size, fl, sl);
+
+	// Search in the same row first
+	U32 slMap = m_slBitmaps[fl] & (MAX_U32 << sl);
+	if(slMap == 0)
+	{
+		// Search in the next rows
+		const U32 flMap = (fl + 1 < FL_COUNT) ? (m_flBitmap & (MAX_U32 << (fl + 1))) : 0;
+		if(flMap == 0)
+		{
+			return nullptr;
+		}
+
+		fl = findLsb(flMap);
+		slMap = m_slBitmaps[fl];
+		ANKI_ASSERT(slMap);
+	}
+
+	sl = findLsb(slMap);
+	ANKI_ASSERT(m_freeLists[fl][sl]);
+	return m_freeLists[fl][sl];
+}
+
+void TlsfMemoryPool::insertFreeBlock(Block* block)
+{
+	block->setFree(true);
+
+	U32 fl, sl;
+	mapping(block->getSize(), fl, sl);
+
+	Block* head = m_freeLists[fl][sl];
+	block->nextFree() = head;
+	block->prevFree() = nullptr;
+	if(head)
+	{
+		head->prevFree() = block;
+	}
+	m_freeLists[fl][sl] = block;
+
+	m_flBitmap |= 1u << fl;
+	m_slBitmaps[fl] |= 1u << sl;
+
+	++m_freeBlockCount;
+	m_freeMemory += block->getSize();
+}
+
+void TlsfMemoryPool::removeFreeBlock(Block* block)
+{
+	ANKI_ASSERT(block->isFree());
+
+	U32 fl, sl;
+	mapping(block->getSize(), fl, sl);
+
+	Block* next = block->nextFree();
+	Block* prev = block->prevFree();
+	if(next)
+	{
+		next->prevFree() = prev;
+	}
+
+	if(prev)
+	{
+		prev->nextFree() = next;
+	}
+	else
+	{
+		ANKI_ASSERT(m_freeLists[fl][sl] == block);
+		m_freeLists[fl][sl] = next;
+
+		if(next == nullptr)
+		{
+			// List got empty
+			m_slBitmaps[fl] &= ~(1u << sl);
+			if(m_slBitmaps[fl] == 0)
+			{
+				m_flBitmap &= ~(1u << fl);
+			}
+		}
+	}
+
+	ANKI_ASSERT(m_freeBlockCount > 0 && m_freeMemory >= block->getSize());
+	--m_freeBlockCount;
+	m_freeMemory -= block->getSize();
+}
+
+void TlsfMemoryPool::trimBlock(Block* block, PtrSize size)
+{
+	ANKI_ASSERT(block->getSize() >= size);
+
+	if(block->getSize() >= size + Block::HEADER_SIZE + Block::MIN_SIZE)
+	{
+		// The next block can't be free, no need to merge
+		Block* remaining = reinterpret_cast<Block*>(block->getPayload() + size);
+		remaining->m_prevPhysical = block;
+		remaining->m_sizeAndFlags = 0;
+		remaining->setSize(block->getSize() - size - Block::HEADER_SIZE);
+		remaining->getNextPhysical()->m_prevPhysical = remaining;
+
+		block->setSize(size);
+		insertFreeBlock(remaining);
+	}
+}
+
 } // end namespace anki
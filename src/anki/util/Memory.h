@@ -49,7 +49,7 @@ using AllocationSignature = U32;
 ///         returns nullptr
 void* allocAligned(void* userData, void* ptr, PtrSize size, PtrSize alignment);
 
-/// Generic memory pool. The base of HeapMemoryPool or StackMemoryPool or ChainMemoryPool.
+/// Generic memory pool. The base of HeapMemoryPool or StackMemoryPool or ChainMemoryPool or TlsfMemoryPool.
 class BaseMemoryPool : public NonCopyable
 {
 public:
@@ -59,7 +59,8 @@ public:
 		NONE,
 		HEAP,
 		STACK,
-		CHAIN
+		CHAIN,
+		TLSF
 	};
 
 	BaseMemoryPool(Type type)
@@ -184,13 +185,17 @@ public:
 	/// @param ignoreDeallocationErrors Method free() may fail if the ptr is not in the top of the stack. Set that to
 	///        true to suppress such errors
 	/// @param alignmentBytes The maximum supported alignment for returned memory
+	/// @param threadArenaSize If not zero every thread will bump-allocate from its own arena of that size and it will
+	///        go to the shared chunks only to refill it. Removes contention when many threads allocate. Allocations are
+	///        not counted in that mode.
 	void create(AllocAlignedCallback allocCb,
 		void* allocCbUserData,
 		PtrSize initialChunkSize,
 		F32 nextChunkScale = 2.0,
 		PtrSize nextChunkBias = 0,
 		Bool ignoreDeallocationErrors = true,
-		PtrSize alignmentBytes = ANKI_SAFE_ALIGNMENT);
+		PtrSize alignmentBytes = ANKI_SAFE_ALIGNMENT,
+		PtrSize threadArenaSize = 0);
 
 	/// Allocate aligned memory. The operation is thread safe
 	/// @param size The size to allocate
@@ -209,6 +214,8 @@ public:
 	PtrSize getMemoryCapacity() const;
 
 private:
+	class ThreadArena;
+
 	/// The memory chunk.
 	class Chunk
 	{
@@ -266,6 +273,18 @@ private:
 
 	/// Protect the m_crntChunkIdx.
 	Mutex m_lock;
+
+	/// The size of the per thread arenas. Zero if they are disabled.
+	PtrSize m_threadArenaSize = 0;
+
+	/// Per thread arenas.
+	ThreadArena* m_threadArenas = nullptr;
+
+	/// Allocate from the shared chunks.
+	void* allocateFromChunks(PtrSize size);
+
+	/// Allocate from the arena of the current thread.
+	void* allocateFromThreadArena(PtrSize size);
 };
 
 /// Chain memory pool. Almost similar to StackMemoryPool but more flexible and at the same time a bit slower.
@@ -285,12 +304,15 @@ public:
 	/// @param nextChunkScale Value that controls the next chunk.
 	/// @param nextChunkBias Value that controls the next chunk.
 	/// @param alignmentBytes The maximum supported alignment for returned memory.
+	/// @param threadArenas If true every thread will allocate from its own chunk and it will lock the pool only to get
+	///        a new chunk. Removes contention when many threads allocate. Allocations are not counted in that mode.
 	void create(AllocAlignedCallback allocCb,
 		void* allocCbUserData,
 		PtrSize initialChunkSize,
 		F32 nextChunkScale = 2.0,
 		PtrSize nextChunkBias = 0,
-		PtrSize alignmentBytes = ANKI_SAFE_ALIGNMENT);
+		PtrSize alignmentBytes = ANKI_SAFE_ALIGNMENT,
+		Bool threadArenas = false);
 
 	/// Allocate memory. This operation is thread safe
 	/// @param size The size to allocate
@@ -311,6 +333,8 @@ public:
 	/// @}
 
 private:
+	class ThreadArena;
+
 	/// A chunk of memory
 	struct Chunk
 	{
@@ -323,8 +347,9 @@ private:
 		/// Points to the memory and more specifically to the top of the stack
 		U8* m_top = nullptr;
 
-		/// Used to identify if the chunk can be deleted
-		PtrSize m_allocationsCount = 0;
+		/// Used to identify if the chunk can be deleted. A chunk that is the current chunk of a thread arena holds an
+		/// extra reference.
+		Atomic<U32> m_allocationsCount = {0};
 
 		/// Previous chunk in the list
 		Chunk* m_prev = nullptr;
@@ -357,9 +382,13 @@ private:
 	/// Cache a value.
 	PtrSize m_headerSize = 0;
 
+	/// Per thread arenas. nullptr if they are disabled.
+	ThreadArena* m_threadArenas = nullptr;
+
 	/// Compute the size for the next chunk.
 	/// @param size The current allocation size.
-	PtrSize computeNewChunkSize(PtrSize size) const;
+	/// @param prevChunk The chunk that got full or nullptr.
+	PtrSize computeNewChunkSize(PtrSize size, const Chunk* prevChunk) const;
 
 	/// Create a new chunk.
 	Chunk* createNewChunk(PtrSize size);
@@ -369,6 +398,120 @@ private:
 
 	/// Destroy a chunk.
 	void destroyChunk(Chunk* ch);
+
+	/// Allocate from the chunk of the current thread.
+	void* allocateFromThreadArena(PtrSize size, PtrSize alignment);
+
+	/// Drop a reference of a chunk and destroy it if it's empty. It's thread safe.
+	void releaseChunk(Chunk* ch);
+};
+
+/// TlsfMemoryPool statistics.
+class TlsfMemoryPoolStats
+{
+public:
+	PtrSize m_reservedMemory = 0; ///< Memory requested from the allocation callback.
+	PtrSize m_usedMemory = 0; ///< Memory of the allocated blocks, including their headers.
+	PtrSize m_freeMemory = 0; ///< Memory of the free blocks.
+	PtrSize m_largestFreeBlock = 0; ///< The biggest allocation that can be served without growing the pool.
+	U32 m_freeBlockCount = 0;
+	U32 m_areaCount = 0;
+
+	/// Zero if all the free memory is in one block. Close to 1 if the free memory is scattered in many small blocks.
+	F32 m_fragmentation = 0.0f;
+};
+
+/// General purpose memory pool that uses the Two-Level Segregated Fit algorithm. Allocations and deallocations are
+/// O(1) and they are served from big areas that are requested from the allocation callback. It's an alternative to
+/// HeapMemoryPool that doesn't fragment the system heap. It's thread safe.
+class TlsfMemoryPool : public BaseMemoryPool
+{
+public:
+	/// Default constructor.
+	TlsfMemoryPool();
+
+	/// Destroy.
+	~TlsfMemoryPool() final;
+
+	/// The real constructor.
+	/// @param allocCb The allocation function callback.
+	/// @param allocCbUserData The user data to pass to the allocation function.
+	/// @param initialAreaSize The size of the first area. It's allocated here.
+	/// @param nextAreaScale Every new area will be that much bigger than the previous.
+	void create(AllocAlignedCallback allocCb,
+		void* allocCbUserData,
+		PtrSize initialAreaSize = 1024 * 1024,
+		F32 nextAreaScale = 2.0f);
+
+	/// Allocate memory. This operation is thread safe.
+	/// @param size The size to allocate.
+	/// @param alignment The alignment of the returned address.
+	/// @return The allocated memory or nullptr on failure.
+	void* allocate(PtrSize size, PtrSize alignment);
+
+	/// Free memory. This operation is thread safe. Areas that become empty are returned to the allocation callback
+	/// unless it's the last area.
+	/// @param[in, out] ptr Memory block to deallocate.
+	void free(void* ptr);
+
+	/// Get statistics. It's thread safe.
+	TlsfMemoryPoolStats getStats() const;
+
+private:
+	class Block;
+	class Area;
+
+	static const U32 SL_COUNT_LOG2 = 5;
+	static const U32 SL_COUNT = 1u << SL_COUNT_LOG2;
+	static const U32 ALIGNMENT_LOG2 = 4;
+	static const PtrSize ALIGNMENT = PtrSize(1) << ALIGNMENT_LOG2;
+	static const U32 FL_SHIFT = SL_COUNT_LOG2 + ALIGNMENT_LOG2;
+	static const U32 FL_MAX = 40; ///< Blocks up to 1TB.
+	static const U32 FL_COUNT = FL_MAX - FL_SHIFT + 1;
+	static const PtrSize SMALL_BLOCK_SIZE = PtrSize(1) << FL_SHIFT;
+	static const PtrSize MAX_AREA_GROWTH_SIZE = 256 * 1024 * 1024; ///< Areas stop growing after that size.
+
+	static_assert(ALIGNMENT == ANKI_SAFE_ALIGNMENT, "Wrong assumption");
+	static_assert(FL_COUNT <= 32, "The first level bitmap is 32bit");
+
+	mutable SpinLock m_lock;
+
+	/// The heads of the free lists.
+	Array2d<Block*, FL_COUNT, SL_COUNT> m_freeLists = {};
+
+	/// Has a bit set for every non-empty row of m_slBitmaps.
+	U32 m_flBitmap = 0;
+
+	/// Has a bit set for every non-empty list.
+	Array<U32, FL_COUNT> m_slBitmaps = {};
+
+	Area* m_areas = nullptr;
+	PtrSize m_nextAreaSize = 0;
+	F32 m_nextAreaScale = 0.0f;
+
+	PtrSize m_reservedMemory = 0;
+	PtrSize m_usedMemory = 0;
+	PtrSize m_freeMemory = 0;
+	U32 m_freeBlockCount = 0;
+	U32 m_areaCount = 0;
+
+	/// Allocate a new area that has a free block of at least that size.
+	Bool newArea(PtrSize minBlockSize);
+
+	/// Give the area back to the allocation callback.
+	void deleteArea(Area* area);
+
+	/// Compute the free list of a block size.
+	static void mapping(PtrSize size, U32& fl, U32& sl);
+
+	/// Find a free block of at least that size.
+	Block* findFreeBlock(PtrSize size) const;
+
+	void insertFreeBlock(Block* block);
+	void removeFreeBlock(Block* block);
+
+	/// Cut the end of the block and put it in the free lists if it's big enough.
+	void trimBlock(Block* block, PtrSize size);
 };
 /// @}
 
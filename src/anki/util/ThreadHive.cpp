@@ -18,20 +18,130 @@ namespace anki
 #	define ANKI_HIVE_DEBUG_PRINT(...) ((void)0)
 #endif
 
+/// Marks a ThreadHiveSemaphore as released.
+static void* const RELEASED_SEMAPHORE = reinterpret_cast<void*>(PtrSize(1));
+
+/// A fixed size work-stealing deque (Chase-Lev). The owner thread pushes and pops from the bottom and the other
+/// threads steal from the top.
+class ThreadHive::TaskDeque
+{
+public:
+	TaskDeque()
+	{
+		m_top.set(0);
+		m_bottom.set(0);
+		for(Atomic<Task*>& t : m_tasks)
+		{
+			t.set(nullptr);
+		}
+	}
+
+	/// Push to the bottom. Only the owner can call that.
+	/// @return False if the deque is full.
+	Bool push(Task* task)
+	{
+		const I64 bottom = m_bottom.load(AtomicMemoryOrder::RELAXED);
+		const I64 top = m_top.load(AtomicMemoryOrder::ACQUIRE);
+		if(bottom - top >= I64(CAPACITY))
+		{
+			return false;
+		}
+
+		// The release publishes the task's fields to the thieves that acquire the bottom
+		m_tasks[bottom & (CAPACITY - 1)].store(task, AtomicMemoryOrder::RELAXED);
+		m_bottom.store(bottom + 1, AtomicMemoryOrder::RELEASE);
+		return true;
+	}
+
+	/// Pop from the bottom. Only the owner can call that.
+	Task* pop()
+	{
+		const I64 bottom = m_bottom.load(AtomicMemoryOrder::RELAXED) - 1;
+		m_bottom.store(bottom, AtomicMemoryOrder::RELAXED);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		I64 top = m_top.load(AtomicMemoryOrder::RELAXED);
+
+		Task* task = nullptr;
+		if(top <= bottom)
+		{
+			task = m_tasks[bottom & (CAPACITY - 1)].load(AtomicMemoryOrder::RELAXED);
+
+			if(top == bottom)
+			{
+				// Last one, race against the thieves
+				const I64 expected = top;
+				while(!m_top.compareExchange(top, top + 1, AtomicMemoryOrder::SEQ_CST) && top == expected)
+				{
+				}
+
+				if(top != expected)
+				{
+					task = nullptr;
+				}
+
+				m_bottom.store(bottom + 1, AtomicMemoryOrder::RELAXED);
+			}
+		}
+		else
+		{
+			m_bottom.store(bottom + 1, AtomicMemoryOrder::RELAXED);
+		}
+
+		return task;
+	}
+
+	/// Steal from the top. Any thread can call that.
+	Task* steal()
+	{
+		while(true)
+		{
+			I64 top = m_top.load(AtomicMemoryOrder::ACQUIRE);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const I64 bottom = m_bottom.load(AtomicMemoryOrder::ACQUIRE);
+
+			if(top >= bottom)
+			{
+				return nullptr;
+			}
+
+			Task* task = m_tasks[top & (CAPACITY - 1)].load(AtomicMemoryOrder::RELAXED);
+			if(m_top.compareExchange(top, top + 1, AtomicMemoryOrder::SEQ_CST))
+			{
+				return task;
+			}
+
+			// Lost the race, try again
+		}
+	}
+
+private:
+	static const U32 CAPACITY = 1024; ///< Must be power of two.
+
+	alignas(ANKI_CACHE_LINE_SIZE) Atomic<I64> m_top;
+	alignas(ANKI_CACHE_LINE_SIZE) Atomic<I64> m_bottom;
+	alignas(ANKI_CACHE_LINE_SIZE) Array<Atomic<Task*>, CAPACITY> m_tasks;
+};
+
 class ThreadHive::Thread
 {
 public:
 	U32 m_id; ///< An ID
 	anki::Thread m_thread; ///< Runs the workingFunc
 	ThreadHive* m_hive;
+	TaskDeque m_deque; ///< Tasks local to this thread.
 
 	/// Constructor
-	Thread(U32 id, ThreadHive* hive, Bool pinToCores)
+	Thread(U32 id, ThreadHive* hive)
 		: m_id(id)
 		, m_thread("anki_threadhive")
 		, m_hive(hive)
 	{
 		ANKI_ASSERT(hive);
+	}
+
+	/// Start the thread. The threads steal from each other so start them after all of them are constructed.
+	void start(Bool pinToCores)
+	{
 		m_thread.start(this, threadCallback, (pinToCores) ? I(m_id) : -1);
 	}
 
@@ -41,7 +151,9 @@ private:
 	{
 		Thread& self = *static_cast<Thread*>(info.m_userData);
 
+		m_crntThread = &self;
 		self.m_hive->threadRun(self.m_id);
+		m_crntThread = nullptr;
 		return Error::NONE;
 	}
 };
@@ -58,17 +170,28 @@ public:
 	ThreadHiveSemaphore* m_signalSemaphore;
 };
 
+thread_local ThreadHive::Thread* ThreadHive::m_crntThread = nullptr;
+
 ThreadHive::ThreadHive(U threadCount, GenericMemoryPoolAllocator<U8> alloc, Bool pinToCores)
 	: m_slowAlloc(alloc)
 	, m_alloc(alloc.getMemoryPool().getAllocationCallback(),
 		  alloc.getMemoryPool().getAllocationCallbackUserData(),
 		  1024 * 4)
 	, m_threadCount(threadCount)
+	, m_ownerThreadId(anki::Thread::getCurrentThreadId())
 {
-	m_threads = reinterpret_cast<Thread*>(m_slowAlloc.allocate(sizeof(Thread) * threadCount));
+	ANKI_ASSERT(threadCount > 0 && threadCount <= MAX_THREADS);
+
+	PtrSize alignment = alignof(Thread);
+	m_threads = reinterpret_cast<Thread*>(m_slowAlloc.allocate(sizeof(Thread) * threadCount, &alignment));
 	for(U i = 0; i < threadCount; ++i)
 	{
-		::new(&m_threads[i]) Thread(i, this, pinToCores);
+		::new(&m_threads[i]) Thread(i, this);
+	}
+
+	for(U i = 0; i < threadCount; ++i)
+	{
+		m_threads[i].start(pinToCores);
 	}
 }
 
@@ -100,12 +223,18 @@ ThreadHive::~ThreadHive()
 void ThreadHive::submitTasks(ThreadHiveTask* tasks, const U taskCount)
 {
 	ANKI_ASSERT(tasks && taskCount > 0);
+	ANKI_ASSERT((isOwnerThread() || isHiveThread()) && "Other threads would race with waitAllTasks()");
 
 	// Allocate tasks
 	Task* const htasks = m_alloc.newArray<Task>(taskCount);
 
-	// Initialize tasks
-	Task* prevTask = nullptr;
+	// Account for them before anything gets the chance to run
+	m_pendingTasks.fetchAdd(taskCount, AtomicMemoryOrder::ACQ_REL);
+
+	// Initialize tasks. Those that have unresolved dependencies will be parked on their semaphore
+	Task* readyHead = nullptr;
+	Task* readyTail = nullptr;
+	U readyCount = 0;
 	for(U i = 0; i < taskCount; ++i)
 	{
 		const ThreadHiveTask& inTask = tasks[i];
@@ -117,48 +246,116 @@ void ThreadHive::submitTasks(ThreadHiveTask* tasks, const U taskCount)
 		outTask.m_waitSemaphore = inTask.m_waitSemaphore;
 		outTask.m_signalSemaphore = inTask.m_signalSemaphore;
 
-		// Connect tasks
-		if(prevTask)
+		Bool parked = false;
+		if(outTask.m_waitSemaphore)
+		{
+			Atomic<void*>& waitingTasks = outTask.m_waitSemaphore->m_waitingTasks;
+			void* head = waitingTasks.load(AtomicMemoryOrder::ACQUIRE);
+			while(head != RELEASED_SEMAPHORE)
+			{
+				outTask.m_next = static_cast<Task*>(head);
+				if(waitingTasks.compareExchange(head, &outTask, AtomicMemoryOrder::ACQ_REL))
+				{
+					parked = true;
+					break;
+				}
+			}
+		}
+
+		if(!parked)
 		{
-			prevTask->m_next = &outTask;
+			// Connect tasks
+			outTask.m_next = nullptr;
+			if(readyTail)
+			{
+				readyTail->m_next = &outTask;
+			}
+			else
+			{
+				readyHead = &outTask;
+			}
+			readyTail = &outTask;
+			++readyCount;
 		}
-		prevTask = &outTask;
 	}
 
-	// Push work
+	if(readyCount)
 	{
-		LockGuard<Mutex> lock(m_mtx);
+		pushReadyTasks(readyHead, readyTail, readyCount);
+	}
+
+	ANKI_HIVE_DEBUG_PRINT("submit tasks\n");
+}
+
+void ThreadHive::pushReadyTasks(Task* first, Task* last, U taskCount)
+{
+	ANKI_ASSERT(first && last && taskCount > 0);
+	ANKI_ASSERT(last->m_next == nullptr);
+
+	Thread* thread = m_crntThread;
+	if(thread && thread->m_hive == this)
+	{
+		// A hive thread, push to the local deque
+		while(first)
+		{
+			// Read the next before pushing because the task might get stolen and run right away
+			Task* next = first->m_next;
+			if(!thread->m_deque.push(first))
+			{
+				break;
+			}
+			first = next;
+		}
+	}
+
+	if(first)
+	{
+		// Not a hive thread or the deque is full, use the shared queue
+		LockGuard<SpinLock> lock(m_queueLock);
 
 		if(m_head != nullptr)
 		{
-			ANKI_ASSERT(m_tail && m_head);
-			m_tail->m_next = &htasks[0];
-			m_tail = &htasks[taskCount - 1];
+			ANKI_ASSERT(m_tail);
+			m_tail->m_next = first;
 		}
 		else
 		{
 			ANKI_ASSERT(m_tail == nullptr);
-			m_head = &htasks[0];
-			m_tail = &htasks[taskCount - 1];
+			m_head = first;
 		}
+		m_tail = last;
+	}
 
-		m_pendingTasks += taskCount;
+	wakeThreads(taskCount);
+}
 
-		ANKI_HIVE_DEBUG_PRINT("submit tasks\n");
-	}
+void ThreadHive::wakeThreads(U taskCount)
+{
+	// Order the push of the tasks with the load of the counter. The sleeping threads do the opposite
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if(m_sleepingThreadCount.load(AtomicMemoryOrder::SEQ_CST) > 0)
+	{
+		LockGuard<Mutex> lock(m_mtx);
 
-	// Notify all threads
-	m_cvar.notifyAll();
+		if(taskCount > 1)
+		{
+			m_cvar.notifyAll();
+		}
+		else
+		{
+			m_cvar.notifyOne();
+		}
+	}
 }
 
 void ThreadHive::threadRun(U threadId)
 {
-	Task* task = nullptr;
-
-	while(!waitForWork(threadId, task))
+	Task* task;
+	while((task = waitForWork(threadId)) != nullptr)
 	{
 		// Run the task
-		ANKI_ASSERT(task && task->m_cb);
+		ANKI_ASSERT(task->m_cb);
 		ANKI_HIVE_DEBUG_PRINT(
 			"tid: %lu will exec %p (udata: %p)\n", threadId, static_cast<void*>(task), static_cast<void*>(task->m_arg));
 		task->m_cb(task->m_arg, threadId, *this, task->m_signalSemaphore);
@@ -167,39 +364,72 @@ void ThreadHive::threadRun(U threadId)
 		task->m_cb = nullptr;
 #endif
 
-		// Signal the semaphore as early as possible
-		if(task->m_signalSemaphore)
-		{
-			const U32 out = task->m_signalSemaphore->m_atomic.fetchSub(1);
-			(void)out;
-			ANKI_ASSERT(out > 0u);
-			ANKI_HIVE_DEBUG_PRINT("\tsem is %u\n", out - 1u);
-		}
+		completeTask(task);
 	}
 
 	ANKI_HIVE_DEBUG_PRINT("tid: %lu thread quits!\n", threadId);
 }
 
-Bool ThreadHive::waitForWork(U threadId, Task*& task)
+void ThreadHive::completeTask(Task* task)
 {
-	LockGuard<Mutex> lock(m_mtx);
+	// Signal the semaphore as early as possible
+	if(task->m_signalSemaphore)
+	{
+		decreaseSemaphore(*task->m_signalSemaphore);
+	}
+
+	const U32 pending = m_pendingTasks.fetchSub(1, AtomicMemoryOrder::ACQ_REL);
+	ANKI_ASSERT(pending > 0);
+	if(pending == 1)
+	{
+		// Out of tasks
+		LockGuard<Mutex> lock(m_mtx);
+		m_waitAllCvar.notifyAll();
+	}
+}
 
-	ANKI_HIVE_DEBUG_PRINT("tid: %lu locking\n", threadId);
+void ThreadHive::decreaseSemaphore(ThreadHiveSemaphore& sem)
+{
+	const U32 out = sem.m_atomic.fetchSub(1, AtomicMemoryOrder::ACQ_REL);
+	ANKI_ASSERT(out > 0u);
+	ANKI_HIVE_DEBUG_PRINT("\tsem is %u\n", out - 1u);
 
-	// Complete the previous task
-	if(task)
+	if(out == 1)
 	{
-		--m_pendingTasks;
+		// Dependency resolved, release the tasks that wait on it
+		void* head = sem.m_waitingTasks.exchange(RELEASED_SEMAPHORE, AtomicMemoryOrder::ACQ_REL);
+		ANKI_ASSERT(head != RELEASED_SEMAPHORE);
 
-		if(task->m_signalSemaphore || m_pendingTasks == 0)
+		Task* first = static_cast<Task*>(head);
+		if(first)
 		{
-			// A dependency maybe got resolved or we are out of tasks. Wake them all
-			ANKI_HIVE_DEBUG_PRINT("tid: %lu wake all\n", threadId);
-			m_cvar.notifyAll();
+			Task* last = first;
+			U count = 1;
+			while(last->m_next)
+			{
+				last = last->m_next;
+				++count;
+			}
+
+			pushReadyTasks(first, last, count);
 		}
 	}
+}
+
+ThreadHive::Task* ThreadHive::waitForWork(U threadId)
+{
+	Task* task = getNewTask(threadId);
+	if(task)
+	{
+		return task;
+	}
 
-	while(!m_quit && (task = getNewTask()) == nullptr)
+	LockGuard<Mutex> lock(m_mtx);
+
+	// Announce that we are going to sleep before looking for work one last time
+	m_sleepingThreadCount.fetchAdd(1, AtomicMemoryOrder::SEQ_CST);
+
+	while(!m_quit && (task = getNewTask(threadId)) == nullptr)
 	{
 		ANKI_HIVE_DEBUG_PRINT("tid: %lu waiting\n", threadId);
 
@@ -207,64 +437,142 @@ Bool ThreadHive::waitForWork(U threadId, Task*& task)
 		m_cvar.wait(m_mtx);
 	}
 
-	return m_quit;
+	m_sleepingThreadCount.fetchSub(1, AtomicMemoryOrder::SEQ_CST);
+
+	return (m_quit) ? nullptr : task;
 }
 
-ThreadHive::Task* ThreadHive::getNewTask()
+ThreadHive::Task* ThreadHive::getNewTask(U threadId)
 {
-	Task* prevTask = nullptr;
-	Task* task = m_head;
-	while(task)
+	// Try the local deque first
+	Task* task = m_threads[threadId].m_deque.pop();
+
+	// Then the shared queue
+	if(task == nullptr)
 	{
-		// Check if there are dependencies
-		const Bool allDepsCompleted = task->m_waitSemaphore == nullptr || task->m_waitSemaphore->m_atomic.load() == 0;
+		LockGuard<SpinLock> lock(m_queueLock);
 
-		if(allDepsCompleted)
+		task = m_head;
+		if(task)
 		{
-			// Found something, pop it
-			if(prevTask)
-			{
-				prevTask->m_next = task->m_next;
-			}
-
-			if(m_head == task)
+			m_head = task->m_next;
+			if(m_head == nullptr)
 			{
-				m_head = task->m_next;
+				ANKI_ASSERT(m_tail == task);
+				m_tail = nullptr;
 			}
+		}
+	}
 
-			if(m_tail == task)
-			{
-				m_tail = prevTask;
-			}
+	// Then steal from the others
+	for(U i = 1; i < m_threadCount && task == nullptr; ++i)
+	{
+		task = m_threads[(threadId + i) % m_threadCount].m_deque.steal();
+	}
 
 #if ANKI_EXTRA_CHECKS
-			task->m_next = nullptr;
-#endif
-			break;
-		}
-
-		prevTask = task;
-		task = task->m_next;
+	if(task)
+	{
+		task->m_next = nullptr;
 	}
+#endif
 
 	return task;
 }
 
+Bool ThreadHive::isHiveThread() const
+{
+	return m_crntThread && m_crntThread->m_hive == this;
+}
+
+Bool ThreadHive::isOwnerThread() const
+{
+	return anki::Thread::getCurrentThreadId() == m_ownerThreadId;
+}
+
 void ThreadHive::waitAllTasks()
 {
+	ANKI_ASSERT(isOwnerThread() && "Only the thread that created the hive can wait and reset the scratch memory");
 	ANKI_HIVE_DEBUG_PRINT("mt: waiting all\n");
 
-	LockGuard<Mutex> lock(m_mtx);
-	while(m_pendingTasks > 0)
 	{
-		m_cvar.wait(m_mtx);
+		LockGuard<Mutex> lock(m_mtx);
+		while(m_pendingTasks.load(AtomicMemoryOrder::ACQUIRE) > 0)
+		{
+			m_waitAllCvar.wait(m_mtx);
+		}
 	}
 
-	m_head = nullptr;
-	m_tail = nullptr;
+	ANKI_ASSERT(m_head == nullptr && m_tail == nullptr);
 	m_alloc.getMemoryPool().reset();
 
 	ANKI_HIVE_DEBUG_PRINT("mt: done waiting all\n");
 }
 
+void ThreadHiveTaskGraph::addDependency(Node* before, Node* after)
+{
+	ANKI_ASSERT(!m_submitted);
+	ANKI_ASSERT(before && after && before != after);
+
+	Node::Edge* edge = m_hive->newScratchInstance<Node::Edge>();
+	edge->m_node = after;
+	edge->m_next = before->m_successors;
+	before->m_successors = edge;
+
+	++after->m_dependencyCount;
+}
+
+void ThreadHiveTaskGraph::submit(ThreadHiveSemaphore* signalSemaphore)
+{
+	ANKI_ASSERT(!m_submitted);
+	m_submitted = true;
+
+	if(m_nodeCount == 0)
+	{
+		if(signalSemaphore)
+		{
+			m_hive->decreaseSemaphore(*signalSemaphore);
+		}
+		return;
+	}
+
+	// Every node will signal the semaphore so account for them
+	if(signalSemaphore && m_nodeCount > 1)
+	{
+		signalSemaphore->increaseSemaphore(m_nodeCount - 1);
+	}
+
+	// Create the semaphores before submitting anything because the nodes will signal their successors
+	for(Node* node = m_nodes; node; node = node->m_next)
+	{
+		node->m_waitSemaphore = (node->m_dependencyCount) ? m_hive->newSemaphore(node->m_dependencyCount) : nullptr;
+	}
+
+	ThreadHiveTask* tasks = static_cast<ThreadHiveTask*>(
+		m_hive->allocateScratchMemory(sizeof(ThreadHiveTask) * m_nodeCount, alignof(ThreadHiveTask)));
+	U count = 0;
+	for(Node* node = m_nodes; node; node = node->m_next)
+	{
+		ThreadHiveTask& task = tasks[count++];
+		task.m_callback = nodeCallback;
+		task.m_argument = node;
+		task.m_waitSemaphore = node->m_waitSemaphore;
+		task.m_signalSemaphore = signalSemaphore;
+	}
+	ANKI_ASSERT(count == m_nodeCount);
+
+	m_hive->submitTasks(tasks, m_nodeCount);
+}
+
+void ThreadHiveTaskGraph::nodeCallback(void* ud, U32 threadId, ThreadHive& hive, ThreadHiveSemaphore* signalSemaphore)
+{
+	Node& node = *static_cast<Node*>(ud);
+	node.m_callback(node.m_closure, threadId, hive);
+
+	for(Node::Edge* edge = node.m_successors; edge; edge = edge->m_next)
+	{
+		hive.decreaseSemaphore(*edge->m_node->m_waitSemaphore);
+	}
+}
+
 } // end namespace anki
@@ -8,12 +8,14 @@
 #include <anki/util/Thread.h>
 #include <anki/util/WeakArray.h>
 #include <anki/util/Allocator.h>
+#include <anki/util/Functions.h>
 
 namespace anki
 {
 
 // Forward
 class ThreadHive;
+class ThreadHiveTaskGraph;
 
 /// @addtogroup util_thread
 /// @{
@@ -22,10 +24,12 @@ class ThreadHive;
 class ThreadHiveSemaphore
 {
 	friend class ThreadHive;
+	friend class ThreadHiveTaskGraph;
 
 public:
 	/// Increase the value of the semaphore. It's easy to brake things with that.
 	/// @note It's thread-safe.
+	/// @note Don't call it after the semaphore reached zero. Tasks that wait on it might have already started.
 	void increaseSemaphore(U32 increase)
 	{
 		m_atomic.fetchAdd(increase);
@@ -34,6 +38,10 @@ public:
 private:
 	Atomic<U32> m_atomic;
 
+	/// Lock-free list of the tasks that wait on that semaphore. When the semaphore reaches zero it's marked as
+	/// released and the tasks become available for execution.
+	Atomic<void*> m_waitingTasks;
+
 	// No need to construct it or delete it
 	ThreadHiveSemaphore() = delete;
 	~ThreadHiveSemaphore() = delete;
@@ -75,6 +83,13 @@ public:
 
 /// A scheduler of small tasks. It takes a number of tasks and schedules them in one of the threads. The tasks can
 /// depend on previously submitted tasks or be completely independent.
+///
+/// Every thread of the hive owns a lock-free work-stealing deque. Tasks submitted from inside a task go to the deque of
+/// the current thread and idle threads steal from the others. Tasks submitted from threads outside the hive go to a
+/// shared queue. Tasks that wait on a semaphore are parked on that semaphore until it reaches zero.
+///
+/// The thread that creates the hive owns it. Only the owner and the tasks can submit work and only the owner can call
+/// waitAllTasks() because that frees the scratch memory of everything that was submitted.
 class ThreadHive : public NonCopyable
 {
 public:
@@ -99,6 +114,7 @@ public:
 		ThreadHiveSemaphore* sem =
 			reinterpret_cast<ThreadHiveSemaphore*>(m_alloc.allocate(sizeof(ThreadHiveSemaphore), &alignment));
 		sem->m_atomic.set(initialValue);
+		sem->m_waitingTasks.set(nullptr);
 		return sem;
 	}
 
@@ -126,11 +142,84 @@ public:
 		submitTasks(&task, 1);
 	}
 
-	/// Wait for all tasks to finish. Will block.
+	/// Allocate and construct an object in the scratch memory. The destructor will never be called.
+	template<typename T, typename... TArgs>
+	T* newScratchInstance(TArgs&&... args)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "The destructor won't be called");
+		T* out = static_cast<T*>(allocateScratchMemory(sizeof(T), alignof(T)));
+		::new(out) T(std::forward<TArgs>(args)...);
+		return out;
+	}
+
+	/// Run a functor for every index in [begin, end). The range is split adaptively: a task halves its range, submits
+	/// the upper half so idle threads can steal it and continues with the lower half until it's no bigger than the
+	/// grain size. The functor is copied to the scratch memory. The ThreadHiveTaskCallback callbacks can also call
+	/// this.
+	/// @param begin The first index.
+	/// @param end One past the last index.
+	/// @param grainSize The maximum number of indices a task will process without splitting. If zero it will be deduced
+	///                  from the range and the thread count.
+	/// @param func A functor with signature void(U32 idx, U32 threadId).
+	/// @param waitSemaphore The work will start when that semaphore reaches zero.
+	/// @param signalSemaphore When all indices are processed that semaphore will be decremented by one.
+	template<typename TFunc>
+	void parallelFor(U32 begin,
+		U32 end,
+		U32 grainSize,
+		const TFunc& func,
+		ThreadHiveSemaphore* waitSemaphore = nullptr,
+		ThreadHiveSemaphore* signalSemaphore = nullptr)
+	{
+		ANKI_ASSERT(begin <= end);
+
+		if(grainSize == 0)
+		{
+			grainSize = max<U32>(1, (end - begin) / (m_threadCount * PARALLEL_FOR_SPLITS_PER_THREAD));
+		}
+
+		ParallelForRange<TFunc>* range = newScratchInstance<ParallelForRange<TFunc>>();
+		range->m_func = newScratchInstance<TFunc>(func);
+		range->m_begin = begin;
+		range->m_end = end;
+		range->m_grainSize = grainSize;
+
+		ThreadHiveTask task;
+		task.m_callback = parallelForCallback<TFunc>;
+		task.m_argument = range;
+		task.m_waitSemaphore = waitSemaphore;
+		task.m_signalSemaphore = signalSemaphore;
+		submitTasks(&task, 1);
+	}
+
+	/// Wait for all tasks to finish and free the scratch memory. Will block. Only the owner thread can call it.
 	void waitAllTasks();
 
+	/// Check if the caller runs in one of the threads of this hive. Those threads can't call waitAllTasks().
+	Bool isHiveThread() const;
+
+	/// Check if the caller is the thread that created the hive.
+	Bool isOwnerThread() const;
+
 private:
+	friend class ThreadHiveTaskGraph;
+
+	/// parallelFor() will aim for that many leaf tasks per thread.
+	static const U32 PARALLEL_FOR_SPLITS_PER_THREAD = 4;
+
+	/// A sub-range of a parallelFor().
+	template<typename TFunc>
+	class ParallelForRange
+	{
+	public:
+		const TFunc* m_func;
+		U32 m_begin;
+		U32 m_end;
+		U32 m_grainSize;
+	};
+
 	class Thread;
+	class TaskDeque;
 
 	/// Lightweight task.
 	class Task;
@@ -139,25 +228,150 @@ private:
 	StackAllocator<U8> m_alloc;
 	Thread* m_threads = nullptr;
 	U32 m_threadCount = 0;
+	ThreadId m_ownerThreadId; ///< The thread that created the hive.
+
+	Task* m_head = nullptr; ///< Head of the queue of tasks submitted from outside the hive.
+	Task* m_tail = nullptr; ///< Tail of the queue of tasks submitted from outside the hive.
+	SpinLock m_queueLock; ///< Protects m_head and m_tail.
 
-	Task* m_head = nullptr; ///< Head of the task list.
-	Task* m_tail = nullptr; ///< Tail of the task list.
 	Bool m_quit = false;
-	U32 m_pendingTasks = 0;
+	Atomic<U32> m_pendingTasks = {0};
+	Atomic<U32> m_sleepingThreadCount = {0};
+
+	Mutex m_mtx; ///< Used only to put threads to sleep and wake them up.
+	ConditionVariable m_cvar; ///< Idle threads wait on that.
+	ConditionVariable m_waitAllCvar; ///< waitAllTasks() waits on that.
 
-	Mutex m_mtx;
-	ConditionVariable m_cvar;
+	static thread_local Thread* m_crntThread; ///< The hive thread that runs in this OS thread.
 
 	void threadRun(U threadId);
 
 	/// Wait for more tasks.
-	Bool waitForWork(U threadId, Task*& task);
+	/// @return The next task or nullptr if the hive quits.
+	Task* waitForWork(U threadId);
 
-	/// Get new work from the queue.
-	Task* getNewTask();
+	/// Get new work from the local deque, the shared queue or from other threads.
+	Task* getNewTask(U threadId);
+
+	/// Make a list of tasks available for execution.
+	void pushReadyTasks(Task* first, Task* last, U taskCount);
+
+	/// Wake some threads if they are sleeping.
+	void wakeThreads(U taskCount);
 
 	/// Complete a task.
-	void completeTask(U taskId);
+	void completeTask(Task* task);
+
+	/// Decrement the semaphore and release the tasks that wait on it if it reached zero.
+	void decreaseSemaphore(ThreadHiveSemaphore& sem);
+
+	template<typename TFunc>
+	static void parallelForCallback(void* ud, U32 threadId, ThreadHive& hive, ThreadHiveSemaphore* signalSemaphore)
+	{
+		const ParallelForRange<TFunc>& range = *static_cast<const ParallelForRange<TFunc>*>(ud);
+
+		// Split the range and give away the upper half till it's small enough
+		U32 end = range.m_end;
+		while(end - range.m_begin > range.m_grainSize)
+		{
+			const U32 middle = range.m_begin + (end - range.m_begin) / 2;
+
+			ParallelForRange<TFunc>* upper = hive.newScratchInstance<ParallelForRange<TFunc>>();
+			upper->m_func = range.m_func;
+			upper->m_begin = middle;
+			upper->m_end = end;
+			upper->m_grainSize = range.m_grainSize;
+
+			// The new task will signal the same semaphore so increase it now that this task still holds a reference
+			if(signalSemaphore)
+			{
+				signalSemaphore->increaseSemaphore(1);
+			}
+
+			ThreadHiveTask task;
+			task.m_callback = parallelForCallback<TFunc>;
+			task.m_argument = upper;
+			task.m_signalSemaphore = signalSemaphore;
+			hive.submitTasks(&task, 1);
+
+			end = middle;
+		}
+
+		for(U32 i = range.m_begin; i < end; ++i)
+		{
+			(*range.m_func)(i, threadId);
+		}
+	}
+};
+
+/// A small graph of tasks that run on a ThreadHive. The nodes are functors and the edges define the order of
+/// execution. Nodes that don't depend on each other may run in parallel. Everything is allocated from the scratch
+/// memory of the hive so nothing is valid after ThreadHive::waitAllTasks().
+class ThreadHiveTaskGraph : public NonCopyable
+{
+public:
+	/// A node of the graph. @memberof ThreadHiveTaskGraph
+	class Node
+	{
+		friend class ThreadHiveTaskGraph;
+
+	private:
+		class Edge
+		{
+		public:
+			Node* m_node;
+			Edge* m_next;
+		};
+
+		void (*m_callback)(void* closure, U32 threadId, ThreadHive& hive);
+		void* m_closure;
+		Node* m_next; ///< Next in the graph's list.
+		Edge* m_successors;
+		U32 m_dependencyCount;
+		ThreadHiveSemaphore* m_waitSemaphore;
+	};
+
+	ThreadHiveTaskGraph(ThreadHive& hive)
+		: m_hive(&hive)
+	{
+	}
+
+	/// Create a new node.
+	/// @param func A functor with signature void(U32 threadId, ThreadHive& hive).
+	template<typename TFunc>
+	Node* newNode(const TFunc& func)
+	{
+		ANKI_ASSERT(!m_submitted);
+
+		Node* node = m_hive->newScratchInstance<Node>();
+		node->m_callback = [](void* closure, U32 threadId, ThreadHive& hive) {
+			(*static_cast<TFunc*>(closure))(threadId, hive);
+		};
+		node->m_closure = m_hive->newScratchInstance<TFunc>(func);
+		node->m_next = m_nodes;
+		node->m_successors = nullptr;
+		node->m_dependencyCount = 0;
+		node->m_waitSemaphore = nullptr;
+
+		m_nodes = node;
+		++m_nodeCount;
+		return node;
+	}
+
+	/// Node @a after will start after node @a before is done.
+	void addDependency(Node* before, Node* after);
+
+	/// Submit all the nodes. Can't add more nodes or dependencies after that.
+	/// @param signalSemaphore When all nodes are done that semaphore will be decremented by one.
+	void submit(ThreadHiveSemaphore* signalSemaphore = nullptr);
+
+private:
+	ThreadHive* m_hive;
+	Node* m_nodes = nullptr;
+	U32 m_nodeCount = 0;
+	Bool8 m_submitted = false;
+
+	static void nodeCallback(void* ud, U32 threadId, ThreadHive& hive, ThreadHiveSemaphore* signalSemaphore);
 };
 /// @}
 
@@ -4,6 +4,7 @@
 // http://www.anki3d.org/LICENSE
 
 #include "tests/framework/Framework.h"
+#include <anki/resource/ImageLoader.h>
 #include <iostream>
 #include <cstring>
 #include <malloc.h>
@@ -285,4 +286,36 @@ ResourceManager* createResourceManager(
 	return resources;
 }
 
+Error writeAnkiTexture(CString filename, U32 size, U32 mipCount)
+{
+	File file;
+	ANKI_CHECK(file.open(filename, FileOpenFlag::WRITE | FileOpenFlag::BINARY));
+
+	Array<U8, 128> header = {};
+	const Array<U32, 8> headerValues = {{size,
+		size,
+		1,
+		U32(ImageLoader::TextureType::_2D),
+		U32(ImageLoader::ColorFormat::RGBA8),
+		U32(ImageLoader::DataCompression::RAW | ImageLoader::DataCompression::S3TC),
+		0,
+		mipCount}};
+	memcpy(&header[0], "ANKITEX1", 8);
+	memcpy(&header[8], &headerValues[0], 8 * sizeof(U32));
+	ANKI_CHECK(file.write(&header[0], header.getSize()));
+
+	for(U32 blockSize : {0u, 16u})
+	{
+		for(U32 mip = 0; mip < mipCount; ++mip)
+		{
+			const U32 mipSize = size >> mip;
+			const PtrSize dataSize = (blockSize) ? (mipSize / 4) * (mipSize / 4) * blockSize : mipSize * mipSize * 4;
+			std::vector<U8> data(dataSize, U8(mip));
+			ANKI_CHECK(file.write(&data[0], dataSize));
+		}
+	}
+
+	return Error::NONE;
+}
+
 } // end namespace anki
@@ -228,4 +228,7 @@ GrManager* createGrManager(const Config& cfg, NativeWindow* win);
 ResourceManager* createResourceManager(
 	const Config& cfg, GrManager* gr, PhysicsWorld*& physics, ResourceFilesystem*& resourceFs);
 
+/// Write a 2D RGBA .ankitex with RAW and S3TC data. The texels of every mip are equal to the mip level.
+ANKI_USE_RESULT Error writeAnkiTexture(CString filename, U32 size, U32 mipCount);
+
 } // end namespace anki
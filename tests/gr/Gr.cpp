@@ -8,6 +8,7 @@
 #include <anki/core/NativeWindow.h>
 #include <anki/core/Config.h>
 #include <anki/util/HighRezTimer.h>
+#include <anki/util/ThreadHive.h>
 #include <anki/core/StagingGpuMemoryManager.h>
 #include <anki/resource/TransferGpuAllocator.h>
 #include <ctime>
@@ -1787,6 +1788,239 @@ ANKI_TEST(Gr, RenderGraph)
 	}
 
 	rgraph->compileNewGraph(descr, alloc);
+
+	// Compile the same graph again. This time the batches and the barriers come from the first compilation
+	rgraph->reset();
+	rgraph->compileNewGraph(descr, alloc);
+
+	// Sharing textures between render targets never needs more memory
+	ANKI_TEST_EXPECT_GT(rgraph->getStats().m_transientMemory, 0u);
+	ANKI_TEST_EXPECT_LEQ(rgraph->getStats().m_transientMemory, rgraph->getStats().m_transientMemoryWithoutAliasing);
+	COMMON_END()
+}
+
+/// The user data of the passes of RenderGraphTemplates.
+class RenderGraphTemplateTestPass
+{
+public:
+	DynamicArrayAuto<U32>* m_order;
+	U32 m_idx;
+};
+
+/// Build a graph, compile it and record it. Return the order the passes were recorded.
+static void bakeRenderGraphTemplateTest(RenderGraph& rgraph,
+	TexturePtr importedTex,
+	U32 variant,
+	U32 recordingThreadCount,
+	StackAllocator<U8>& alloc,
+	DynamicArrayAuto<U32>& order,
+	RenderGraphStats& stats)
+{
+	RenderGraphDescription descr(alloc);
+	Array<RenderGraphTemplateTestPass, 8> passes;
+	U32 passCount = 0;
+	auto newPass = [&](CString name) -> GraphicsRenderPassDescription& {
+		GraphicsRenderPassDescription& pass = descr.newGraphicsRenderPass(name);
+		passes[passCount] = {&order, passCount};
+		pass.setWork(
+			[](RenderPassWorkContext& ctx) {
+				const RenderGraphTemplateTestPass& self = *static_cast<RenderGraphTemplateTestPass*>(ctx.m_userData);
+				self.m_order->emplaceBack(self.m_idx);
+			},
+			&passes[passCount],
+			0);
+		++passCount;
+		return pass;
+	};
+
+	// The 1st and the 3rd render targets don't live at the same time so they share a texture
+	RenderTargetHandle rtA = descr.newRenderTarget(newRTDescr("A"));
+	RenderTargetHandle rtB = descr.newRenderTarget(newRTDescr("B"));
+	RenderTargetHandle rtC = descr.newRenderTarget(newRTDescr("A"));
+	RenderTargetHandle importedRt = descr.importRenderTarget(importedTex, TextureUsageBit::SAMPLED_FRAGMENT);
+
+	newPass("A").newDependency({rtA, TextureUsageBit::FRAMEBUFFER_ATTACHMENT_WRITE});
+
+	GraphicsRenderPassDescription& passB = newPass("B");
+	passB.newDependency({rtA, TextureUsageBit::SAMPLED_FRAGMENT});
+	passB.newDependency({rtB, TextureUsageBit::FRAMEBUFFER_ATTACHMENT_WRITE});
+
+	GraphicsRenderPassDescription& passC = newPass("C");
+	passC.newDependency({rtB, TextureUsageBit::SAMPLED_FRAGMENT});
+	passC.newDependency({rtC, TextureUsageBit::FRAMEBUFFER_ATTACHMENT_WRITE});
+
+	if(variant == 1)
+	{
+		// An independent pass that changes the batches
+		newPass("Extra").newDependency({importedRt, TextureUsageBit::FRAMEBUFFER_ATTACHMENT_WRITE});
+	}
+
+	GraphicsRenderPassDescription& passD = newPass("D");
+	passD.newDependency({rtC, TextureUsageBit::SAMPLED_FRAGMENT});
+	passD.newDependency({importedRt, TextureUsageBit::SAMPLED_FRAGMENT});
+
+	rgraph.compileNewGraph(descr, alloc, recordingThreadCount);
+	for(U32 i = 0; i < recordingThreadCount; ++i)
+	{
+		rgraph.run(i);
+	}
+	rgraph.flush();
+
+	stats = rgraph.getStats();
+	rgraph.reset();
+}
+
+/// Check that the graphs that come from a cached template are the same as the ones that are baked from scratch. The
+/// ANKI_EXTRA_CHECKS builds also compare the batches and the barriers.
+ANKI_TEST(Gr, RenderGraphTemplates)
+{
+	COMMON_BEGIN()
+
+	StackAllocator<U8> alloc(allocAligned, nullptr, 2_MB);
+	RenderGraphPtr cachedGraph = gr->newRenderGraph();
+
+	TextureInitInfo texI("imported");
+	texI.m_width = texI.m_height = 16;
+	texI.m_usage = TextureUsageBit::FRAMEBUFFER_ATTACHMENT_WRITE | TextureUsageBit::SAMPLED_FRAGMENT;
+	texI.m_format = Format::R8G8B8A8_UNORM;
+	TexturePtr importedTex = gr->newTexture(texI);
+
+	for(U32 round = 0; round < 2; ++round)
+	{
+		for(U32 recordingThreadCount : {1u, 3u})
+		{
+			for(U32 variant = 0; variant < 2; ++variant)
+			{
+				DynamicArrayAuto<U32> cachedOrder(alloc);
+				RenderGraphStats cachedStats;
+				bakeRenderGraphTemplateTest(
+					*cachedGraph, importedTex, variant, recordingThreadCount, alloc, cachedOrder, cachedStats);
+
+				// Every structure is baked from scratch the 1st time
+				ANKI_TEST_EXPECT_EQ(cachedStats.m_reusedGraphTemplate, round == 1);
+
+				RenderGraphPtr freshGraph = gr->newRenderGraph();
+				DynamicArrayAuto<U32> freshOrder(alloc);
+				RenderGraphStats freshStats;
+				bakeRenderGraphTemplateTest(
+					*freshGraph, importedTex, variant, recordingThreadCount, alloc, freshOrder, freshStats);
+				ANKI_TEST_EXPECT_EQ(freshStats.m_reusedGraphTemplate, false);
+
+				ANKI_TEST_EXPECT_EQ(cachedOrder.getSize(), 4 + variant);
+				ANKI_TEST_EXPECT_EQ(cachedOrder.getSize(), freshOrder.getSize());
+				for(U32 i = 0; i < cachedOrder.getSize(); ++i)
+				{
+					ANKI_TEST_EXPECT_EQ(cachedOrder[i], freshOrder[i]);
+				}
+
+				ANKI_TEST_EXPECT_EQ(cachedStats.m_transientMemory, freshStats.m_transientMemory);
+				ANKI_TEST_EXPECT_LT(cachedStats.m_transientMemory, cachedStats.m_transientMemoryWithoutAliasing);
+			}
+		}
+	}
+
+	COMMON_END()
+}
+
+/// The user data of the passes of RenderGraphParallelRecording.
+class RenderGraphParallelTestPass
+{
+public:
+	Atomic<U32>* m_sequence;
+	U32 m_order;
+	CommandBuffer* m_cmdb;
+};
+
+/// Record a chain of passes on many threads at the same time.
+ANKI_TEST(Gr, RenderGraphParallelRecording)
+{
+	COMMON_BEGIN()
+
+	const U32 THREAD_COUNT = 3;
+	const U32 PASS_COUNT = 9;
+	HeapAllocator<U8> halloc(allocAligned, nullptr);
+	ThreadHive hive(THREAD_COUNT, halloc);
+	StackAllocator<U8> alloc(allocAligned, nullptr, 2_MB);
+	RenderGraphPtr rgraph = gr->newRenderGraph();
+
+	for(U32 frame = 0; frame < 2; ++frame)
+	{
+		RenderGraphDescription descr(alloc);
+		Atomic<U32> sequence = {0};
+		Array<RenderGraphParallelTestPass, PASS_COUNT> passes;
+
+		// Every pass depends on the previous one so every pass is a batch
+		RenderTargetHandle prevRt;
+		for(U32 i = 0; i < PASS_COUNT; ++i)
+		{
+			passes[i] = {&sequence, MAX_U32, nullptr};
+
+			RenderTargetHandle rt = descr.newRenderTarget(newRTDescr("Chain"));
+			GraphicsRenderPassDescription& pass =
+				descr.newGraphicsRenderPass(StringAuto(alloc).sprintf("Chain%u", i).toCString());
+			pass.newDependency({rt, TextureUsageBit::FRAMEBUFFER_ATTACHMENT_WRITE});
+			if(i > 0)
+			{
+				pass.newDependency({prevRt, TextureUsageBit::SAMPLED_FRAGMENT});
+			}
+			prevRt = rt;
+
+			pass.setWork(
+				[](RenderPassWorkContext& ctx) {
+					RenderGraphParallelTestPass& self = *static_cast<RenderGraphParallelTestPass*>(ctx.m_userData);
+					self.m_order = self.m_sequence->fetchAdd(1);
+					self.m_cmdb = ctx.m_commandBuffer.get();
+					ctx.m_commandBuffer->setViewport(0, 0, 16, 16);
+				},
+				&passes[i],
+				0);
+		}
+
+		rgraph->compileNewGraph(descr, alloc, THREAD_COUNT);
+
+		class
+		{
+		public:
+			RenderGraph* m_rgraph;
+			Atomic<U32> m_threadIdx = {0};
+		} runCtx;
+		runCtx.m_rgraph = rgraph.get();
+
+		Array<ThreadHiveTask, THREAD_COUNT> tasks;
+		for(ThreadHiveTask& task : tasks)
+		{
+			task.m_callback = [](void* ud, U32, ThreadHive&, ThreadHiveSemaphore*) {
+				auto& ctx = *static_cast<decltype(runCtx)*>(ud);
+				ctx.m_rgraph->run(ctx.m_threadIdx.fetchAdd(1));
+			};
+			task.m_argument = &runCtx;
+		}
+		hive.submitTasks(&tasks[0], THREAD_COUNT);
+		hive.waitAllTasks();
+
+		rgraph->flush();
+		rgraph->reset();
+
+		// All the passes were recorded once. The passes of a command buffer were recorded in order by the same thread
+		ANKI_TEST_EXPECT_EQ(sequence.load(), PASS_COUNT);
+		U32 cmdbCount = 0;
+		for(U32 i = 0; i < PASS_COUNT; ++i)
+		{
+			ANKI_TEST_EXPECT_NEQ(passes[i].m_order, MAX_U32);
+			ANKI_TEST_EXPECT_NEQ(passes[i].m_cmdb, nullptr);
+			if(i == 0 || passes[i].m_cmdb != passes[i - 1].m_cmdb)
+			{
+				++cmdbCount;
+			}
+			else
+			{
+				ANKI_TEST_EXPECT_GT(passes[i].m_order, passes[i - 1].m_order);
+			}
+		}
+
+		ANKI_TEST_EXPECT_EQ(cmdbCount, THREAD_COUNT);
+	}
+
 	COMMON_END()
 }
 
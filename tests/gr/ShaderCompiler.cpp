@@ -4,7 +4,9 @@
 // http://www.anki3d.org/LICENSE
 
 #include <anki/gr/ShaderCompiler.h>
+#include <anki/util/HighRezTimer.h>
 #include <tests/framework/Framework.h>
+#include <vector>
 
 ANKI_TEST(Gr, ShaderCompiler)
 {
@@ -21,3 +23,101 @@ void main()
 	options.m_outLanguage = ShaderLanguage::SPIRV;
 	ANKI_TEST_EXPECT_NO_ERR(cache.compile(SRC, nullptr, options, bin));
 }
+
+ANKI_TEST(Gr, ShaderCompilerCache)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+
+	const CString CACHE_DIR = "./shader_cache_test";
+	if(directoryExists(CACHE_DIR))
+	{
+		ANKI_TEST_EXPECT_NO_ERR(removeDirectory(CACHE_DIR));
+	}
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory(CACHE_DIR));
+
+	// Many different shaders
+	const U32 SHADER_COUNT = 200;
+	std::vector<StringAuto> sources;
+	for(U32 i = 0; i < SHADER_COUNT; ++i)
+	{
+		sources.emplace_back(alloc);
+		sources.back().sprintf(R"(layout(location = 0) out vec4 out_color;
+
+void main()
+{
+	out_color = vec4(%u.0);
+})",
+			i);
+	}
+
+	ShaderCompilerOptions options;
+	options.m_outLanguage = ShaderLanguage::SPIRV;
+	options.m_shaderType = ShaderType::FRAGMENT;
+
+	auto compileAll = [&](ShaderCompilerCache& cache, U32 begin, U32 end, std::vector<std::vector<U8>>* bins) {
+		for(U32 i = begin; i < end; ++i)
+		{
+			DynamicArrayAuto<U8> bin(alloc);
+			ANKI_TEST_EXPECT_NO_ERR(cache.compile(sources[i].toCString(), nullptr, options, bin));
+			if(bins)
+			{
+				bins->emplace_back(bin.getBegin(), bin.getEnd());
+			}
+		}
+	};
+
+	// Cold start, everything compiles
+	std::vector<std::vector<U8>> coldBins;
+	PtrSize cacheSize;
+	{
+		const Second begin = HighRezTimer::getCurrentTime();
+		ShaderCompilerCache cache(alloc, CACHE_DIR);
+		compileAll(cache, 0, SHADER_COUNT, &coldBins);
+		ANKI_TEST_EXPECT_EQ(cache.getMissCount(), SHADER_COUNT);
+		ANKI_TEST_EXPECT_EQ(cache.getHitCount(), 0);
+		ANKI_TEST_EXPECT_NO_ERR(cache.flush());
+
+		ANKI_TEST_LOGI("Cold: %u shaders in %fms", SHADER_COUNT, (HighRezTimer::getCurrentTime() - begin) * 1000.0);
+		cacheSize = cache.getSize();
+	}
+
+	// Warm start, everything comes from the pack
+	{
+		const Second begin = HighRezTimer::getCurrentTime();
+		ShaderCompilerCache cache(alloc, CACHE_DIR);
+		std::vector<std::vector<U8>> warmBins;
+		compileAll(cache, 0, SHADER_COUNT, &warmBins);
+		ANKI_TEST_EXPECT_EQ(cache.getMissCount(), 0);
+		ANKI_TEST_EXPECT_EQ(cache.getHitCount(), SHADER_COUNT);
+
+		ANKI_TEST_LOGI("Warm: %u shaders in %fms", SHADER_COUNT, (HighRezTimer::getCurrentTime() - begin) * 1000.0);
+		ANKI_TEST_EXPECT_EQ(warmBins == coldBins, true);
+	}
+
+	// Use only the first half. The pack is not rewritten, only the last uses are updated in place
+	{
+		ShaderCompilerCache cache(alloc, CACHE_DIR);
+		compileAll(cache, 0, SHADER_COUNT / 2, nullptr);
+		ANKI_TEST_EXPECT_EQ(cache.getHitCount(), SHADER_COUNT / 2);
+	}
+
+	// Use a smaller limit. The other half should get evicted first
+	{
+		ShaderCompilerCache cache(alloc, CACHE_DIR, cacheSize * 4 / 5);
+		compileAll(cache, 0, 1, nullptr);
+		ANKI_TEST_EXPECT_EQ(cache.getHitCount(), 1);
+	}
+
+	{
+		ShaderCompilerCache cache(alloc, CACHE_DIR);
+		compileAll(cache, 0, SHADER_COUNT / 2, nullptr);
+		ANKI_TEST_EXPECT_LEQ(cache.getSize(), cacheSize * 4 / 5);
+		ANKI_TEST_EXPECT_EQ(cache.getHitCount(), SHADER_COUNT / 2);
+		ANKI_TEST_EXPECT_EQ(cache.getMissCount(), 0);
+
+		compileAll(cache, SHADER_COUNT / 2, SHADER_COUNT, nullptr);
+		ANKI_TEST_EXPECT_GT(cache.getMissCount(), 0);
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory(CACHE_DIR));
+}
@@ -0,0 +1,532 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <tests/framework/Framework.h>
+#include <anki/renderer/ClusterBin.h>
+#include <anki/renderer/RenderQueue.h>
+#include <anki/core/Config.h>
+#include <anki/core/StagingGpuMemoryManager.h>
+#include <anki/Collision.h>
+#include <anki/util/HighRezTimer.h>
+#include <anki/util/ThreadHive.h>
+#include <anki/util/System.h>
+
+namespace anki
+{
+
+/// A random position inside the view frustum of the camera.
+static Vec3 randomPositionInView(F32 far)
+{
+	const F32 depth = randRange(1.0f, far);
+	return Vec3(randRange(-depth, depth), randRange(-depth, depth), -depth);
+}
+
+/// Random objects of all the types the ClusterBin knows about. The camera sits at the origin and looks at -Z.
+class ClusterBinTestScene
+{
+public:
+	DynamicArrayAuto<PointLightQueueElement> m_pointLights;
+	DynamicArrayAuto<SpotLightQueueElement> m_spotLights;
+	DynamicArrayAuto<ReflectionProbeQueueElement> m_probes;
+	DynamicArrayAuto<DecalQueueElement> m_decals;
+	DynamicArrayAuto<FogDensityQueueElement> m_fogVolumes;
+	RenderQueue m_rqueue;
+
+	ClusterBinTestScene(HeapAllocator<U8> alloc,
+		U32 pointLightCount,
+		U32 spotLightCount,
+		U32 probeCount,
+		U32 decalCount,
+		U32 fogVolumeCount);
+};
+
+ClusterBinTestScene::ClusterBinTestScene(HeapAllocator<U8> alloc,
+	U32 pointLightCount,
+	U32 spotLightCount,
+	U32 probeCount,
+	U32 decalCount,
+	U32 fogVolumeCount)
+	: m_pointLights(alloc)
+	, m_spotLights(alloc)
+	, m_probes(alloc)
+	, m_decals(alloc)
+	, m_fogVolumes(alloc)
+{
+	const F32 NEAR = 0.1f;
+	const F32 FAR = 200.0f;
+
+	m_pointLights.create(pointLightCount);
+	for(PointLightQueueElement& light : m_pointLights)
+	{
+		light.m_worldPosition = randomPositionInView(FAR);
+		light.m_radius = randRange(0.5f, 5.0f);
+		light.m_diffuseColor = Vec3(1.0f);
+		light.m_shadowRenderQueues[0] = nullptr;
+	}
+
+	m_spotLights.create(spotLightCount);
+	for(SpotLightQueueElement& light : m_spotLights)
+	{
+		const Vec3 dir = Vec3(randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f));
+		light.m_worldTransform =
+			Mat4(randomPositionInView(FAR).xyz1(), Mat3(Euler(dir.x(), dir.y(), dir.z())), 1.0f);
+		light.m_distance = randRange(1.0f, 10.0f);
+		light.m_outerAngle = toRad(randRange(20.0f, 60.0f));
+		light.m_innerAngle = light.m_outerAngle / 2.0f;
+		light.m_diffuseColor = Vec3(1.0f);
+		light.m_shadowRenderQueue = nullptr;
+	}
+
+	m_probes.create(probeCount);
+	for(ReflectionProbeQueueElement& probe : m_probes)
+	{
+		probe.m_worldPosition = randomPositionInView(FAR);
+		probe.m_aabbMin = probe.m_worldPosition - randRange(2.0f, 10.0f);
+		probe.m_aabbMax = probe.m_worldPosition + randRange(2.0f, 10.0f);
+		probe.m_textureArrayIndex = 0;
+	}
+
+	// The decals don't have texture atlases. The binning doesn't need them
+	m_decals.create(decalCount);
+	for(DecalQueueElement& decal : m_decals)
+	{
+		const Vec3 rot = Vec3(randRange(-PI, PI), randRange(-PI, PI), randRange(-PI, PI));
+		decal.m_diffuseAtlas = nullptr;
+		decal.m_specularRoughnessAtlas = nullptr;
+		decal.m_diffuseAtlasUv = Vec4(0.0f, 0.0f, 1.0f, 1.0f);
+		decal.m_specularRoughnessAtlasUv = Vec4(0.0f, 0.0f, 1.0f, 1.0f);
+		decal.m_diffuseAtlasBlendFactor = 1.0f;
+		decal.m_specularRoughnessAtlasBlendFactor = 1.0f;
+		decal.m_textureMatrix = Mat4::getIdentity();
+		decal.m_obbCenter = randomPositionInView(FAR);
+		decal.m_obbExtend = Vec3(randRange(0.5f, 4.0f), randRange(0.5f, 4.0f), randRange(0.1f, 1.0f));
+		decal.m_obbRotation = Mat3(Euler(rot.x(), rot.y(), rot.z()));
+	}
+
+	m_fogVolumes.create(fogVolumeCount);
+	for(U i = 0; i < fogVolumeCount; ++i)
+	{
+		FogDensityQueueElement& vol = m_fogVolumes[i];
+		vol.m_isBox = i & 1;
+		vol.m_density = 1.0f;
+		if(vol.m_isBox)
+		{
+			const Vec3 center = randomPositionInView(FAR);
+			vol.m_aabbMin = center - 5.0f;
+			vol.m_aabbMax = center + 5.0f;
+		}
+		else
+		{
+			vol.m_sphereCenter = randomPositionInView(FAR);
+			vol.m_sphereRadius = randRange(1.0f, 10.0f);
+		}
+	}
+
+	m_rqueue.m_cameraNear = NEAR;
+	m_rqueue.m_cameraFar = FAR;
+	m_rqueue.m_cameraTransform = Mat4::getIdentity();
+	m_rqueue.m_viewMatrix = Mat4::getIdentity();
+	m_rqueue.m_projectionMatrix = Mat4::calculatePerspectiveProjectionMatrix(toRad(90.0f), toRad(90.0f), NEAR, FAR);
+	m_rqueue.m_viewProjectionMatrix = m_rqueue.m_projectionMatrix * m_rqueue.m_viewMatrix;
+	m_rqueue.m_previousViewProjectionMatrix = m_rqueue.m_viewProjectionMatrix;
+	m_rqueue.m_pointLights = WeakArray<PointLightQueueElement>(&m_pointLights[0], pointLightCount);
+	m_rqueue.m_spotLights = WeakArray<SpotLightQueueElement>(&m_spotLights[0], spotLightCount);
+	m_rqueue.m_reflectionProbes = WeakArray<ReflectionProbeQueueElement>(&m_probes[0], probeCount);
+	m_rqueue.m_decals = WeakArray<DecalQueueElement>(&m_decals[0], decalCount);
+	m_rqueue.m_fogDensityVolumes = WeakArray<FogDensityQueueElement>(&m_fogVolumes[0], fogVolumeCount);
+}
+
+/// A world space AABB that contains an object of the queue and a point that is inside the object. The same order of
+/// types as the cluster indices.
+static void computeObjectBounds(const RenderQueue& rqueue, U typeIdx, U32 idx, Aabb& aabb, Vec3& inside)
+{
+	switch(typeIdx)
+	{
+	case 0:
+	{
+		const PointLightQueueElement& light = rqueue.m_pointLights[idx];
+		aabb.setMin((light.m_worldPosition - light.m_radius).xyz0());
+		aabb.setMax((light.m_worldPosition + light.m_radius).xyz0());
+		inside = light.m_worldPosition;
+		break;
+	}
+	case 1:
+	{
+		// The apex and the corners of the base of the cone
+		const SpotLightQueueElement& light = rqueue.m_spotLights[idx];
+		const F32 baseExtend = light.m_distance * tan(light.m_outerAngle / 2.0f);
+		Vec3 aabbMin = light.m_worldTransform.getTranslationPart().xyz();
+		Vec3 aabbMax = aabbMin;
+		for(U i = 0; i < 4; ++i)
+		{
+			const Vec3 local((i & 1) ? baseExtend : -baseExtend, (i & 2) ? baseExtend : -baseExtend, -light.m_distance);
+			const Vec3 corner = (light.m_worldTransform * local.xyz1()).xyz();
+			aabbMin = aabbMin.min(corner);
+			aabbMax = aabbMax.max(corner);
+		}
+		aabb.setMin(aabbMin.xyz0());
+		aabb.setMax(aabbMax.xyz0());
+		inside = (light.m_worldTransform * Vec4(0.0f, 0.0f, -light.m_distance / 2.0f, 1.0f)).xyz();
+		break;
+	}
+	case 2:
+	{
+		const ReflectionProbeQueueElement& probe = rqueue.m_reflectionProbes[idx];
+		aabb.setMin(probe.m_aabbMin);
+		aabb.setMax(probe.m_aabbMax);
+		inside = (probe.m_aabbMin + probe.m_aabbMax) / 2.0f;
+		break;
+	}
+	case 3:
+	{
+		// The corners of the OBB
+		const DecalQueueElement& decal = rqueue.m_decals[idx];
+		Vec3 aabbMin(MAX_F32);
+		Vec3 aabbMax(MIN_F32);
+		for(U i = 0; i < 8; ++i)
+		{
+			const Vec3 local((i & 1) ? decal.m_obbExtend.x() : -decal.m_obbExtend.x(),
+				(i & 2) ? decal.m_obbExtend.y() : -decal.m_obbExtend.y(),
+				(i & 4) ? decal.m_obbExtend.z() : -decal.m_obbExtend.z());
+			const Vec3 corner = decal.m_obbCenter + decal.m_obbRotation * local;
+			aabbMin = aabbMin.min(corner);
+			aabbMax = aabbMax.max(corner);
+		}
+		aabb.setMin(aabbMin.xyz0());
+		aabb.setMax(aabbMax.xyz0());
+		inside = decal.m_obbCenter;
+		break;
+	}
+	default:
+	{
+		ANKI_ASSERT(typeIdx == 4);
+		const FogDensityQueueElement& vol = rqueue.m_fogDensityVolumes[idx];
+		if(vol.m_isBox)
+		{
+			aabb.setMin(vol.m_aabbMin);
+			aabb.setMax(vol.m_aabbMax);
+			inside = (vol.m_aabbMin + vol.m_aabbMax) / 2.0f;
+		}
+		else
+		{
+			aabb.setMin((vol.m_sphereCenter - vol.m_sphereRadius).xyz0());
+			aabb.setMax((vol.m_sphereCenter + vol.m_sphereRadius).xyz0());
+			inside = vol.m_sphereCenter;
+		}
+	}
+	}
+}
+
+/// A cluster as the intersection of 6 half-spaces in view space. The side planes come from the rows of the projection
+/// matrix and the depth planes from the quadratic slicing of the view distance. It doesn't share any math with the
+/// ClusterBin.
+class ClusterBinTestFrustum
+{
+public:
+	Array<Vec4, 6> m_planes; ///< xyz: unit normal that points inside, w: offset.
+
+	ClusterBinTestFrustum(
+		const RenderQueue& rqueue, U32 tileX, U32 tileY, U32 clusterZ, U32 countX, U32 countY, U32 countZ)
+	{
+		const Mat4& proj = rqueue.m_projectionMatrix;
+		const Vec4 row0 = proj.getRow(0);
+		const Vec4 row1 = proj.getRow(1);
+		const Vec4 row3 = proj.getRow(3);
+
+		// A point is in the tile if ndcMin <= clip.xy / clip.w <= ndcMax
+		const F32 ndcMinX = F32(tileX) / countX * 2.0f - 1.0f;
+		const F32 ndcMaxX = F32(tileX + 1) / countX * 2.0f - 1.0f;
+		const F32 ndcMinY = F32(tileY) / countY * 2.0f - 1.0f;
+		const F32 ndcMaxY = F32(tileY + 1) / countY * 2.0f - 1.0f;
+		m_planes[0] = row0 - row3 * ndcMinX;
+		m_planes[1] = row3 * ndcMaxX - row0;
+		m_planes[2] = row1 - row3 * ndcMinY;
+		m_planes[3] = row3 * ndcMaxY - row1;
+
+		// The camera looks at -Z
+		auto sliceDepth = [&](U32 k) {
+			const F32 f = F32(k) / countZ;
+			return rqueue.m_cameraNear + (rqueue.m_cameraFar - rqueue.m_cameraNear) * f * f;
+		};
+		m_planes[4] = Vec4(0.0f, 0.0f, -1.0f, -sliceDepth(clusterZ));
+		m_planes[5] = Vec4(0.0f, 0.0f, 1.0f, sliceDepth(clusterZ + 1));
+
+		for(Vec4& plane : m_planes)
+		{
+			plane /= plane.xyz().getLength();
+		}
+	}
+
+	/// The AABB is completely outside the cluster, give or take a small distance.
+	Bool isOutside(const RenderQueue& rqueue, const Aabb& aabb) const
+	{
+		const F32 DISTANCE_EPSILON = 0.01f;
+
+		for(const Vec4& plane : m_planes)
+		{
+			Bool allOutside = true;
+			for(U i = 0; i < 8 && allOutside; ++i)
+			{
+				const Vec4 corner((i & 1) ? aabb.getMax().x() : aabb.getMin().x(),
+					(i & 2) ? aabb.getMax().y() : aabb.getMin().y(),
+					(i & 4) ? aabb.getMax().z() : aabb.getMin().z(),
+					1.0f);
+				allOutside = plane.dot(rqueue.m_viewMatrix * corner) < DISTANCE_EPSILON;
+			}
+
+			if(allOutside)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/// The point is inside the cluster and not too close to its faces.
+	Bool isInside(const RenderQueue& rqueue, const Vec3& point) const
+	{
+		const F32 DISTANCE_EPSILON = 0.01f;
+		const Vec4 viewPoint = rqueue.m_viewMatrix * point.xyz1();
+
+		for(const Vec4& plane : m_planes)
+		{
+			if(plane.dot(viewPoint) < DISTANCE_EPSILON)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+/// Get the objects of a type in a cluster from the binned indices.
+static ConstWeakArray<U32> getClusterObjects(
+	const DynamicArrayAuto<U32>& clusters, const DynamicArrayAuto<U32>& indices, U32 clusterIdx, U typeIdx)
+{
+	// The cluster points to the objects of the first type. The offsets of the other types are right before that
+	const U32 first = clusters[clusterIdx];
+	const U32 begin = (typeIdx == 0) ? first : indices[first - (TYPED_OBJECT_COUNT - 1) + typeIdx - 1];
+
+	U32 end = begin;
+	while(indices[end] != MAX_U32)
+	{
+		++end;
+	}
+
+	return ConstWeakArray<U32>((end > begin) ? &indices[begin] : nullptr, end - begin);
+}
+
+static Bool containsObject(ConstWeakArray<U32> objects, U32 idx)
+{
+	for(U32 obj : objects)
+	{
+		if(obj == idx)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// Bin a scene a few times and return the time of one bin. Keep the output of the first frame.
+static Second binClusterBinTestScene(const ClusterBinTestScene& scene,
+	Config& cfg,
+	Bool zBinning,
+	U32 frameCount,
+	ThreadHive& hive,
+	StagingGpuMemoryManager& stagingMem,
+	DynamicArrayAuto<U32>& clusters,
+	DynamicArrayAuto<U32>& indices)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	StackAllocator<U8> tempAlloc(allocAligned, nullptr, 1_MB);
+
+	cfg.set("r.clusterBinZBinning", zBinning);
+	ClusterBin clusterBin;
+	clusterBin.init(alloc,
+		cfg.getNumber("r.clusterSizeX"),
+		cfg.getNumber("r.clusterSizeY"),
+		cfg.getNumber("r.clusterSizeZ"),
+		cfg);
+
+	Second binTime = 0.0;
+	for(U frame = 0; frame < frameCount; ++frame)
+	{
+		ClusterBinIn in;
+		in.m_threadHive = &hive;
+		in.m_tempAlloc = tempAlloc;
+		in.m_renderQueue = &scene.m_rqueue;
+		in.m_stagingMem = &stagingMem;
+		in.m_shadowsEnabled = false;
+
+		ClusterBinOut out;
+		const Second begin = HighRezTimer::getCurrentTime();
+		clusterBin.bin(in, out);
+		binTime += HighRezTimer::getCurrentTime() - begin;
+
+		if(frame == 0)
+		{
+			const U32* clustersMem = static_cast<const U32*>(stagingMem.getMappedMemory(out.m_clustersToken));
+			clusters.create(out.m_clustersToken.m_range / sizeof(U32));
+			memcpy(&clusters[0], clustersMem, out.m_clustersToken.m_range);
+
+			const U32* indicesMem = static_cast<const U32*>(stagingMem.getMappedMemory(out.m_indicesToken));
+			indices.create(out.m_indicesToken.m_range / sizeof(U32));
+			memcpy(&indices[0], indicesMem, out.m_indicesToken.m_range);
+		}
+
+		stagingMem.endFrame();
+		tempAlloc.getMemoryPool().reset();
+	}
+
+	return binTime / frameCount;
+}
+
+/// Bin the same scene with and without Z binning and check both against a brute force cluster test. It doesn't need
+/// a GPU.
+ANKI_TEST(Renderer, ClusterBin)
+{
+	Config cfg;
+	initConfig(cfg);
+	cfg.set("r.clusterSizeX", 16);
+	cfg.set("r.clusterSizeY", 12);
+	cfg.set("r.clusterSizeZ", 16);
+	cfg.set("r.avgObjectsPerCluster", 64);
+	const U32 clusterCountX = cfg.getNumber("r.clusterSizeX");
+	const U32 clusterCountY = cfg.getNumber("r.clusterSizeY");
+	const U32 clusterCountZ = cfg.getNumber("r.clusterSizeZ");
+	const U32 avgObjectsPerCluster = cfg.getNumber("r.avgObjectsPerCluster");
+
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(getCpuCoresCount(), alloc);
+	StagingGpuMemoryManager stagingMem;
+	ANKI_TEST_EXPECT_NO_ERR(stagingMem.init(nullptr, cfg));
+
+	const ClusterBinTestScene scene(alloc, 128, 32, 16, 32, 16);
+	const RenderQueue& rqueue = scene.m_rqueue;
+
+	Array<DynamicArrayAuto<U32>, 2> clusters = {{DynamicArrayAuto<U32>(alloc), DynamicArrayAuto<U32>(alloc)}};
+	Array<DynamicArrayAuto<U32>, 2> indices = {{DynamicArrayAuto<U32>(alloc), DynamicArrayAuto<U32>(alloc)}};
+	for(U zBinning = 0; zBinning < 2; ++zBinning)
+	{
+		binClusterBinTestScene(scene, cfg, zBinning, 1, hive, stagingMem, clusters[zBinning], indices[zBinning]);
+	}
+
+	const Array<U32, TYPED_OBJECT_COUNT> objectCounts = {{U32(rqueue.m_pointLights.getSize()),
+		U32(rqueue.m_spotLights.getSize()),
+		U32(rqueue.m_reflectionProbes.getSize()),
+		U32(rqueue.m_decals.getSize()),
+		U32(rqueue.m_fogDensityVolumes.getSize())}};
+
+	U32 droppedCount = 0;
+	U32 insideCount = 0;
+	for(U32 clusterZ = 0; clusterZ < clusterCountZ; ++clusterZ)
+	{
+		for(U32 tileY = 0; tileY < clusterCountY; ++tileY)
+		{
+			for(U32 tileX = 0; tileX < clusterCountX; ++tileX)
+			{
+				const U32 clusterIdx = clusterZ * clusterCountX * clusterCountY + tileY * clusterCountX + tileX;
+				const ClusterBinTestFrustum frustum(
+					rqueue, tileX, tileY, clusterZ, clusterCountX, clusterCountY, clusterCountZ);
+
+				U32 bruteForceCount = 0;
+				for(U typeIdx = 0; typeIdx < TYPED_OBJECT_COUNT; ++typeIdx)
+				{
+					const ConstWeakArray<U32> bruteForce =
+						getClusterObjects(clusters[0], indices[0], clusterIdx, typeIdx);
+					const ConstWeakArray<U32> zBinned =
+						getClusterObjects(clusters[1], indices[1], clusterIdx, typeIdx);
+					bruteForceCount += bruteForce.getSize();
+
+					// Both are sorted by object index. The Z binned should be a subset
+					U32 z = 0;
+					for(U32 b = 0; b < bruteForce.getSize(); ++b)
+					{
+						if(z < zBinned.getSize() && zBinned[z] == bruteForce[b])
+						{
+							++z;
+							continue;
+						}
+
+						// Dropped. Make sure the object is outside the cluster
+						Aabb aabb;
+						Vec3 inside;
+						computeObjectBounds(rqueue, typeIdx, bruteForce[b], aabb, inside);
+						ANKI_TEST_EXPECT_EQ(frustum.isOutside(rqueue, aabb), true);
+						++droppedCount;
+					}
+
+					ANKI_TEST_EXPECT_EQ(z, zBinned.getSize());
+
+					// The objects that are clearly in the cluster should be in both lists
+					for(U32 objIdx = 0; objIdx < objectCounts[typeIdx]; ++objIdx)
+					{
+						Aabb aabb;
+						Vec3 inside;
+						computeObjectBounds(rqueue, typeIdx, objIdx, aabb, inside);
+						if(frustum.isInside(rqueue, inside))
+						{
+							ANKI_TEST_EXPECT_EQ(containsObject(bruteForce, objIdx), true);
+							ANKI_TEST_EXPECT_EQ(containsObject(zBinned, objIdx), true);
+							++insideCount;
+						}
+					}
+				}
+
+				// If the brute force ran out of indices the lists are not comparable
+				ANKI_TEST_EXPECT_LT(bruteForceCount, avgObjectsPerCluster - 1);
+			}
+		}
+	}
+
+	ANKI_TEST_EXPECT_GT(insideCount, 0u);
+	ANKI_TEST_LOGI("Z binning dropped %u false positives. %u objects were inside clusters", droppedCount, insideCount);
+}
+
+ANKI_TEST(Renderer, ClusterBinBench)
+{
+	Config cfg;
+	initConfig(cfg);
+	cfg.set("core.storagePerFrameMemorySize", 64_MB);
+	cfg.set("r.avgObjectsPerCluster", 128);
+
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(getCpuCoresCount(), alloc);
+	StagingGpuMemoryManager stagingMem;
+	ANKI_TEST_EXPECT_NO_ERR(stagingMem.init(nullptr, cfg));
+
+	// The lights are as many as the uniform buffers can hold
+	const U32 POINT_LIGHT_COUNT = 1024;
+	const U32 SPOT_LIGHT_COUNT = 256;
+	const U32 PROBE_COUNT = 32;
+	const U32 DECAL_COUNT = 64;
+	const U32 FOG_VOLUME_COUNT = 32;
+	const U32 FRAME_COUNT = 30;
+	const ClusterBinTestScene scene(
+		alloc, POINT_LIGHT_COUNT, SPOT_LIGHT_COUNT, PROBE_COUNT, DECAL_COUNT, FOG_VOLUME_COUNT);
+
+	for(U zBinning = 0; zBinning < 2; ++zBinning)
+	{
+		DynamicArrayAuto<U32> clusters(alloc);
+		DynamicArrayAuto<U32> indices(alloc);
+		const Second binTime =
+			binClusterBinTestScene(scene, cfg, zBinning, FRAME_COUNT, hive, stagingMem, clusters, indices);
+
+		ANKI_TEST_LOGI("%s: %u point lights, %u spot lights, %u probes, %u decals, %u fog volumes binned in %fms",
+			(zBinning) ? "Z binning" : "Brute force",
+			POINT_LIGHT_COUNT,
+			SPOT_LIGHT_COUNT,
+			PROBE_COUNT,
+			DECAL_COUNT,
+			FOG_VOLUME_COUNT,
+			binTime * 1000.0);
+	}
+}
+
+} // end namespace anki
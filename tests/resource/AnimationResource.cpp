@@ -0,0 +1,366 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <tests/framework/Framework.h>
+#include <anki/resource/AnimationResource.h>
+#include <anki/resource/AnimationBinary.h>
+#include <anki/resource/ResourceManager.h>
+#include <anki/resource/ResourceFilesystem.h>
+#include <anki/core/Config.h>
+#include <anki/util/HighRezTimer.h>
+#include <anki/util/Filesystem.h>
+
+namespace anki
+{
+
+static const Second KEYFRAME_INTERVAL = 1.0 / 30.0;
+
+/// Create a channel with keyframes in regular intervals.
+static void createChannel(ResourceAllocator<U8> alloc, U32 keyCount, AnimationChannel& ch)
+{
+	ch.m_positions.create(alloc, keyCount);
+	ch.m_rotations.create(alloc, keyCount);
+	for(U32 i = 0; i < keyCount; ++i)
+	{
+		const Second time = i * KEYFRAME_INTERVAL;
+		ch.m_positions[i] = AnimationKeyframe<Vec3>(time, Vec3(F32(i), F32(i) * 2.0f, 0.0f));
+		ch.m_rotations[i] = AnimationKeyframe<Quat>(time, Quat(Axisang(F32(i) * 0.01f, Vec3(0.0f, 1.0f, 0.0f))));
+	}
+}
+
+/// The way interpolation used to work. Scan the keyframes from the beginning.
+static void interpolateLinear(const AnimationChannel& ch, Second time, Vec3& pos, Quat& rot)
+{
+	for(U i = 0; i < ch.m_positions.getSize() - 1; ++i)
+	{
+		const AnimationKeyframe<Vec3>& left = ch.m_positions[i];
+		const AnimationKeyframe<Vec3>& right = ch.m_positions[i + 1];
+		if(time >= left.getTime() && time <= right.getTime())
+		{
+			const Second u = (time - left.getTime()) / (right.getTime() - left.getTime());
+			pos = linearInterpolate(left.getValue(), right.getValue(), u);
+			break;
+		}
+	}
+
+	for(U i = 0; i < ch.m_rotations.getSize() - 1; ++i)
+	{
+		const AnimationKeyframe<Quat>& left = ch.m_rotations[i];
+		const AnimationKeyframe<Quat>& right = ch.m_rotations[i + 1];
+		if(time >= left.getTime() && time <= right.getTime())
+		{
+			const Second u = (time - left.getTime()) / (right.getTime() - left.getTime());
+			rot = left.getValue().slerp(right.getValue(), u);
+			break;
+		}
+	}
+}
+
+ANKI_TEST(Resource, AnimationInterpolation)
+{
+	ResourceAllocator<U8> alloc(allocAligned, nullptr);
+
+	const U32 KEY_COUNT = 100;
+	AnimationChannel ch;
+	createChannel(alloc, KEY_COUNT, ch);
+	const Second duration = (KEY_COUNT - 1) * KEYFRAME_INTERVAL;
+
+	// Play forward, jump around and wrap. The cursor should not change the result
+	AnimationChannelCursor cursor;
+	Second time = 0.0;
+	for(U32 i = 0; i < 2000; ++i)
+	{
+		if(i % 100 == 99)
+		{
+			time = randRange(0.0, duration);
+		}
+		else
+		{
+			time += 1.0 / 60.0;
+			if(time > duration)
+			{
+				time -= duration;
+			}
+		}
+
+		Vec3 refPos(0.0f), pos(0.0f), cursorPos(0.0f);
+		Quat refRot(Quat::getIdentity()), rot(Quat::getIdentity()), cursorRot(Quat::getIdentity());
+		F32 scale = 1.0f;
+		interpolateLinear(ch, time, refPos, refRot);
+		ch.interpolate(time, pos, rot, scale, nullptr);
+		ch.interpolate(time, cursorPos, cursorRot, scale, &cursor);
+
+		ANKI_TEST_EXPECT_EQ(pos, refPos);
+		ANKI_TEST_EXPECT_EQ(cursorPos, refPos);
+		ANKI_TEST_EXPECT_EQ(rot, refRot);
+		ANKI_TEST_EXPECT_EQ(cursorRot, refRot);
+	}
+
+	// Out of the keyframe range the values clamp
+	{
+		Vec3 pos(0.0f);
+		Quat rot(Quat::getIdentity());
+		F32 scale = 1.0f;
+
+		ch.interpolate(-1.0, pos, rot, scale, &cursor);
+		ANKI_TEST_EXPECT_EQ(pos, Vec3(0.0f));
+
+		ch.interpolate(duration + 1.0, pos, rot, scale, &cursor);
+		ANKI_TEST_EXPECT_EQ(pos, ch.m_positions[KEY_COUNT - 1].getValue());
+	}
+
+	ch.destroy(alloc);
+}
+
+ANKI_TEST(Resource, AnimationCompression)
+{
+	ResourceAllocator<U8> alloc(allocAligned, nullptr);
+
+	// Rotations
+	for(U32 i = 0; i < 10000; ++i)
+	{
+		const Vec3 axis = Vec3(randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f)) + Vec3(EPSILON);
+		const Quat q(Axisang(randRange(-PI, PI), axis.getNormalized()));
+
+		Array<U16, 3> packed;
+		AnimationBinaryFile::packRotation(q, &packed[0]);
+		const Quat unpacked = AnimationBinaryFile::unpackRotation(&packed[0]);
+
+		// q and -q are the same rotation
+		ANKI_TEST_EXPECT_NEAR(absolute(q.dot(unpacked)), 1.0f, 0.00001f);
+	}
+
+	// Positions
+	{
+		const Vec3 min(-10.0f, 0.0f, 5.0f);
+		const Vec3 range(20.0f, 0.0f, 1.0f);
+		for(U32 i = 0; i < 1000; ++i)
+		{
+			const Vec3 pos = min + range * Vec3(randRange(0.0f, 1.0f), randRange(0.0f, 1.0f), randRange(0.0f, 1.0f));
+
+			Array<U16, 3> packed;
+			AnimationBinaryFile::packPosition(pos, min, range, &packed[0]);
+			const Vec3 unpacked = AnimationBinaryFile::unpackPosition(&packed[0], min, range);
+
+			ANKI_TEST_EXPECT_LEQ((pos - unpacked).getLength(), 0.001f);
+		}
+	}
+
+	// Interpolate a compressed channel and compare it with the uncompressed
+	const U32 KEY_COUNT = 100;
+	AnimationChannel ch;
+	createChannel(alloc, KEY_COUNT, ch);
+
+	std::vector<F32> times(KEY_COUNT);
+	std::vector<U16> positions(KEY_COUNT * 3);
+	std::vector<U16> rotations(KEY_COUNT * 3);
+	AnimationChannel compressed;
+	compressed.m_positionMin = ch.m_positions[0].getValue();
+	compressed.m_positionRange = ch.m_positions[KEY_COUNT - 1].getValue() - ch.m_positions[0].getValue();
+	for(U32 i = 0; i < KEY_COUNT; ++i)
+	{
+		times[i] = ch.m_positions[i].getTime();
+		AnimationBinaryFile::packPosition(
+			ch.m_positions[i].getValue(), compressed.m_positionMin, compressed.m_positionRange, &positions[i * 3]);
+		AnimationBinaryFile::packRotation(ch.m_rotations[i].getValue(), &rotations[i * 3]);
+	}
+	compressed.m_compressedPositions.m_times = ConstWeakArray<F32>(&times[0], KEY_COUNT);
+	compressed.m_compressedPositions.m_values = ConstWeakArray<U16>(&positions[0], positions.size());
+	compressed.m_compressedRotations.m_times = ConstWeakArray<F32>(&times[0], KEY_COUNT);
+	compressed.m_compressedRotations.m_values = ConstWeakArray<U16>(&rotations[0], rotations.size());
+
+	AnimationChannelCursor cursor;
+	for(Second time = 0.0; time < (KEY_COUNT - 1) * KEYFRAME_INTERVAL; time += 1.0 / 60.0)
+	{
+		Vec3 pos(0.0f), refPos(0.0f);
+		Quat rot(Quat::getIdentity()), refRot(Quat::getIdentity());
+		F32 scale = 1.0f;
+		ch.interpolate(time, refPos, refRot, scale, nullptr);
+		compressed.interpolate(time, pos, rot, scale, &cursor);
+
+		ANKI_TEST_EXPECT_LEQ((pos - refPos).getLength(), 0.01f);
+		ANKI_TEST_EXPECT_NEAR(absolute(rot.dot(refRot)), 1.0f, 0.00001f);
+	}
+
+	const PtrSize uncompressedSize = sizeof(AnimationKeyframe<Vec3>) + sizeof(AnimationKeyframe<Quat>);
+	const PtrSize compressedSize = 2 * (sizeof(F32) + AnimationBinaryFile::PACKED_VALUE_SIZE);
+	ANKI_TEST_LOGI("Position and rotation keyframe size: %u bytes uncompressed, %u bytes compressed",
+		U32(uncompressedSize),
+		U32(compressedSize));
+
+	ch.destroy(alloc);
+}
+
+ANKI_TEST(Resource, AnimationBinaryRoundTrip)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+
+	// Linear positions need 2 keyframes. The rotations speed up so they need more. The scale changes less than the
+	// scale tolerance but more than the position tolerance
+	const U32 KEY_COUNT = 100;
+	std::vector<AnimationKeyframe<Vec3>> positions;
+	std::vector<AnimationKeyframe<Quat>> rotations;
+	std::vector<AnimationKeyframe<F32>> scales;
+	for(U32 i = 0; i < KEY_COUNT; ++i)
+	{
+		const Second time = i * KEYFRAME_INTERVAL;
+		positions.push_back(AnimationKeyframe<Vec3>(time, Vec3(F32(i), F32(i) * 2.0f, 0.0f)));
+		rotations.push_back(
+			AnimationKeyframe<Quat>(time, Quat(Axisang(F32(i * i) * 0.0005f, Vec3(0.0f, 1.0f, 0.0f)))));
+		scales.push_back(AnimationKeyframe<F32>(time, 1.0f + 0.0005f * F32(i % 2)));
+	}
+
+	AnimationBinaryWriteChannel channel;
+	channel.m_name = "bone";
+	channel.m_positions = ConstWeakArray<AnimationKeyframe<Vec3>>(&positions[0], KEY_COUNT);
+	channel.m_rotations = ConstWeakArray<AnimationKeyframe<Quat>>(&rotations[0], KEY_COUNT);
+	channel.m_scales = ConstWeakArray<AnimationKeyframe<F32>>(&scales[0], KEY_COUNT);
+
+	AnimationBinaryWriteInfo info;
+	info.m_channels = ConstWeakArray<AnimationBinaryWriteChannel>(&channel, 1);
+
+	// Write the file before the filesystem indexes the directory
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory("anim_test"));
+	ANKI_TEST_EXPECT_NO_ERR(writeAnimationBinary(alloc, info, "anim_test/test.ankianim"));
+
+	ResourceFilesystem fs(alloc);
+	ANKI_TEST_EXPECT_NO_ERR(fs.addNewPath("anim_test"));
+
+	Config config;
+	ResourceManagerInitInfo rinit;
+	rinit.m_gr = nullptr;
+	rinit.m_resourceFs = &fs;
+	rinit.m_config = &config;
+	rinit.m_cacheDir = "/tmp/";
+	rinit.m_allocCallback = allocAligned;
+	rinit.m_allocCallbackData = nullptr;
+	ResourceManager* resources = alloc.newInstance<ResourceManager>();
+	ANKI_TEST_EXPECT_NO_ERR(resources->init(rinit));
+
+	{
+		AnimationResourcePtr anim;
+		ANKI_TEST_EXPECT_NO_ERR(resources->loadResource("test.ankianim", anim));
+		ANKI_TEST_EXPECT_EQ(anim->getChannels().getSize(), 1);
+		ANKI_TEST_EXPECT_NEAR(anim->getStartingTime(), 0.0, EPSILON);
+		ANKI_TEST_EXPECT_NEAR(anim->getDuration(), (KEY_COUNT - 1) * KEYFRAME_INTERVAL, 0.0001);
+
+		const AnimationChannel& ch = anim->getChannels()[0];
+		ANKI_TEST_EXPECT_EQ(ch.m_name, "bone");
+		ANKI_TEST_EXPECT_EQ(ch.m_compressedPositions.getKeyframeCount(), 2);
+		ANKI_TEST_EXPECT_GT(ch.m_compressedRotations.getKeyframeCount(), 2);
+		ANKI_TEST_EXPECT_LT(ch.m_compressedRotations.getKeyframeCount(), KEY_COUNT);
+		ANKI_TEST_EXPECT_EQ(ch.m_scales.getSize(), 1);
+		ANKI_TEST_EXPECT_NEAR(ch.m_scales[0].getValue(), 1.0f, info.m_scaleTolerance);
+
+		// The keyframes that were removed should be reconstructed by the ones that were kept. The times are F32 in the
+		// file so clamp them, the animation loops after its end
+		AnimationChannelCursor cursor;
+		for(U32 i = 0; i < KEY_COUNT; ++i)
+		{
+			Vec3 pos(0.0f);
+			Quat rot(Quat::getIdentity());
+			F32 scale = 1.0f;
+			const Second time = min(positions[i].getTime(), anim->getStartingTime() + anim->getDuration());
+			anim->interpolate(0, time, pos, rot, scale, &cursor);
+
+			ANKI_TEST_EXPECT_LEQ((pos - positions[i].getValue()).getLength(), 0.01f);
+			ANKI_TEST_EXPECT_NEAR(absolute(rot.dot(rotations[i].getValue())), 1.0f, 0.00001f);
+		}
+	}
+
+	alloc.deleteInstance(resources);
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory("anim_test"));
+}
+
+ANKI_TEST(Resource, AnimationInterpolationBench)
+{
+	ResourceAllocator<U8> alloc(allocAligned, nullptr);
+
+	const U32 SKELETON_COUNT = 100;
+	const U32 BONE_COUNT = 100;
+	const U32 KEY_COUNT = 10000;
+	const U32 FRAME_COUNT = 60;
+	const U32 LINEAR_FRAME_COUNT = 4;
+	const Second FRAME_TIME = 1.0 / 60.0;
+	const Second duration = (KEY_COUNT - 1) * KEYFRAME_INTERVAL;
+
+	// All skeletons play the same clip but each one started at a different time
+	std::vector<AnimationChannel> channels(BONE_COUNT);
+	for(AnimationChannel& ch : channels)
+	{
+		createChannel(alloc, KEY_COUNT, ch);
+	}
+
+	std::vector<Second> startTimes(SKELETON_COUNT);
+	for(Second& t : startTimes)
+	{
+		t = randRange(0.0, duration - FRAME_COUNT * FRAME_TIME);
+	}
+
+	std::vector<AnimationChannelCursor> cursors(SKELETON_COUNT * BONE_COUNT);
+
+	enum class Method
+	{
+		LINEAR,
+		BINARY_SEARCH,
+		CURSOR,
+		COUNT
+	};
+	static const Array<const char*, U(Method::COUNT)> METHOD_NAMES = {{"Linear scan", "Binary search", "Cursor"}};
+
+	Vec3 sum(0.0f);
+	for(U m = 0; m < U(Method::COUNT); ++m)
+	{
+		const Method method = Method(m);
+		const U32 frameCount = (method == Method::LINEAR) ? LINEAR_FRAME_COUNT : FRAME_COUNT;
+
+		const Second begin = HighRezTimer::getCurrentTime();
+		for(U32 frame = 0; frame < frameCount; ++frame)
+		{
+			for(U32 skel = 0; skel < SKELETON_COUNT; ++skel)
+			{
+				const Second time = startTimes[skel] + frame * FRAME_TIME;
+
+				for(U32 bone = 0; bone < BONE_COUNT; ++bone)
+				{
+					Vec3 pos(0.0f);
+					Quat rot(Quat::getIdentity());
+					F32 scale = 1.0f;
+
+					switch(method)
+					{
+					case Method::LINEAR:
+						interpolateLinear(channels[bone], time, pos, rot);
+						break;
+					case Method::BINARY_SEARCH:
+						channels[bone].interpolate(time, pos, rot, scale, nullptr);
+						break;
+					default:
+						channels[bone].interpolate(time, pos, rot, scale, &cursors[skel * BONE_COUNT + bone]);
+					}
+
+					sum += pos;
+				}
+			}
+		}
+		const Second time = HighRezTimer::getCurrentTime() - begin;
+
+		ANKI_TEST_LOGI("%s: %fms per frame (%u skeletons, %u bones, %u keyframes)",
+			METHOD_NAMES[m],
+			time / frameCount * 1000.0,
+			SKELETON_COUNT,
+			BONE_COUNT,
+			KEY_COUNT);
+	}
+
+	ANKI_TEST_EXPECT_NEQ(sum, Vec3(0.0f));
+
+	for(AnimationChannel& ch : channels)
+	{
+		ch.destroy(alloc);
+	}
+}
+
+} // end namespace anki
@@ -97,6 +97,79 @@ public:
 	}
 };
 
+/// Lets the test wait for SignalTasks without sleeping.
+class TaskSignal
+{
+public:
+	Mutex m_mtx;
+	ConditionVariable m_condVar;
+	Array<U32, 128> m_order; ///< The IDs of the tasks in the order they started.
+	U32 m_startedCount = 0;
+	U32 m_finishedCount = 0;
+	U32 m_destroyedCount = 0;
+	Bool m_released = true; ///< If it's false the tasks block after they start.
+
+	void setReleased(Bool released)
+	{
+		LockGuard<Mutex> lock(m_mtx);
+		m_released = released;
+		m_condVar.notifyAll();
+	}
+
+	template<typename TFunc>
+	void waitFor(TFunc pred)
+	{
+		LockGuard<Mutex> lock(m_mtx);
+		while(!pred())
+		{
+			m_condVar.wait(m_mtx);
+		}
+	}
+
+	template<typename TFunc>
+	U32 get(TFunc func)
+	{
+		LockGuard<Mutex> lock(m_mtx);
+		return func();
+	}
+};
+
+class SignalTask : public AsyncLoaderTask
+{
+public:
+	TaskSignal* m_signal;
+	U32 m_id;
+
+	SignalTask(TaskSignal* signal, U32 id = 0)
+		: m_signal(signal)
+		, m_id(id)
+	{
+	}
+
+	~SignalTask()
+	{
+		LockGuard<Mutex> lock(m_signal->m_mtx);
+		++m_signal->m_destroyedCount;
+		m_signal->m_condVar.notifyAll();
+	}
+
+	Error operator()(AsyncLoaderTaskContext& ctx)
+	{
+		LockGuard<Mutex> lock(m_signal->m_mtx);
+		m_signal->m_order[m_signal->m_startedCount++] = m_id;
+		m_signal->m_condVar.notifyAll();
+
+		while(!m_signal->m_released)
+		{
+			m_signal->m_condVar.wait(m_signal->m_mtx);
+		}
+
+		++m_signal->m_finishedCount;
+		m_signal->m_condVar.notifyAll();
+		return Error::NONE;
+	}
+};
+
 ANKI_TEST(Resource, AsyncLoader)
 {
 	HeapAllocator<U8> alloc(allocAligned, nullptr);
@@ -233,11 +306,13 @@ ANKI_TEST(Resource, AsyncLoader)
 		HighRezTimer::sleep(1.0);
 		ANKI_TEST_EXPECT_EQ(counter.load(), 4);
 
-		// Check both
+		// Check both. Submit while paused or the resubmitted task might go before the last one
 		counter.set(0);
+		a.pause();
 		a.submitNewTask<Task>(0.0, nullptr, &counter, 0, false, false);
 		a.submitNewTask<Task>(0.0, nullptr, &counter, -1, true, true);
 		a.submitNewTask<Task>(0.0, nullptr, &counter, 2, false, false);
+		a.resume();
 		HighRezTimer::sleep(1.0);
 		ANKI_TEST_EXPECT_EQ(counter.load(), 2);
 		a.resume();
@@ -245,6 +320,120 @@ ANKI_TEST(Resource, AsyncLoader)
 		ANKI_TEST_EXPECT_EQ(counter.load(), 4);
 	}
 
+	// Priorities
+	{
+		AsyncLoader a;
+		a.init(alloc);
+		TaskSignal signal;
+
+		a.pause();
+		a.submitTask(a.newTask<SignalTask>(&signal, 3), AsyncLoaderTaskPriority::LOW);
+		a.submitTask(a.newTask<SignalTask>(&signal, 1), AsyncLoaderTaskPriority::MEDIUM);
+		a.submitTask(a.newTask<SignalTask>(&signal, 0), AsyncLoaderTaskPriority::HIGH);
+
+		// Promote the LOW task to MEDIUM. It goes after the other MEDIUM one
+		AsyncLoaderTaskHandle handle;
+		a.submitTask(a.newTask<SignalTask>(&signal, 2), AsyncLoaderTaskPriority::LOW, &handle);
+		a.setTaskPriority(handle, AsyncLoaderTaskPriority::MEDIUM);
+		ANKI_TEST_EXPECT_EQ(a.getPendingTaskCount(), 4);
+		a.resume();
+
+		signal.waitFor([&]() { return signal.m_destroyedCount == 4; });
+		ANKI_TEST_EXPECT_EQ(signal.m_startedCount, 4);
+		for(U32 i = 0; i < 4; ++i)
+		{
+			ANKI_TEST_EXPECT_EQ(signal.m_order[i], i);
+		}
+
+		ANKI_TEST_EXPECT_EQ(handle.isPending(), false);
+		a.cancelTask(handle); // Does nothing, it's done
+	}
+
+	// Cancel
+	{
+		AsyncLoader a;
+		a.init(alloc);
+		TaskSignal signal;
+
+		// Cancel a pending task. It's deleted without running
+		AsyncLoaderTaskHandle handle;
+		a.pause();
+		a.submitTask(a.newTask<SignalTask>(&signal, 0), AsyncLoaderTaskPriority::MEDIUM, &handle);
+		ANKI_TEST_EXPECT_EQ(handle.isPending(), true);
+		a.cancelTask(handle);
+		ANKI_TEST_EXPECT_EQ(handle.isPending(), false);
+		ANKI_TEST_EXPECT_EQ(a.getPendingTaskCount(), 0);
+		ANKI_TEST_EXPECT_EQ(signal.get([&]() { return signal.m_destroyedCount; }), 1);
+		a.resume();
+
+		// A task of the same priority that is submitted later. With a single thread the canceled one would have run
+		// before it
+		a.submitTask(a.newTask<SignalTask>(&signal, 1), AsyncLoaderTaskPriority::MEDIUM);
+		signal.waitFor([&]() { return signal.m_destroyedCount == 2; });
+		ANKI_TEST_EXPECT_EQ(signal.m_startedCount, 1);
+		ANKI_TEST_EXPECT_EQ(signal.m_order[0], 1);
+
+		// Cancel a running task. It should wait for it. Another thread lets the task finish after the cancel started
+		signal.setReleased(false);
+		a.submitTask(a.newTask<SignalTask>(&signal, 2), AsyncLoaderTaskPriority::MEDIUM, &handle);
+		signal.waitFor([&]() { return signal.m_startedCount == 2; });
+
+		Thread releaser("anki_test");
+		releaser.start(&signal, [](ThreadCallbackInfo& info) -> Error {
+			static_cast<TaskSignal*>(info.m_userData)->setReleased(true);
+			return Error::NONE;
+		});
+
+		a.cancelTask(handle);
+		ANKI_TEST_EXPECT_EQ(signal.get([&]() { return signal.m_finishedCount; }), 2);
+		ANKI_TEST_EXPECT_EQ(handle.isPending(), false);
+		ANKI_TEST_EXPECT_NO_ERR(releaser.join());
+	}
+
+	// Many threads
+	{
+		AsyncLoader a;
+		a.init(alloc, 4);
+		TaskSignal signal;
+		const U COUNT = 100;
+
+		Array<AsyncLoaderTaskHandle, COUNT> handles;
+		for(U i = 0; i < COUNT; i++)
+		{
+			a.submitTask(a.newTask<SignalTask>(&signal, i),
+				AsyncLoaderTaskPriority(i % U(AsyncLoaderTaskPriority::COUNT)),
+				&handles[i]);
+		}
+
+		// Cancel half of them and wait for the rest. Every task is deleted either by the cancel or after it runs
+		for(U i = 0; i < COUNT; i += 2)
+		{
+			a.cancelTask(handles[i]);
+		}
+
+		signal.waitFor([&]() { return signal.m_destroyedCount == COUNT; });
+		ANKI_TEST_EXPECT_EQ(a.getPendingTaskCount(), 0);
+		ANKI_TEST_EXPECT_EQ(signal.m_finishedCount, signal.m_startedCount);
+		ANKI_TEST_EXPECT_LEQ(signal.m_finishedCount, COUNT);
+		ANKI_TEST_EXPECT_GEQ(signal.m_finishedCount, COUNT / 2);
+
+		// The odd tasks were never canceled
+		Array<Bool, COUNT> ran = {};
+		for(U32 i = 0; i < signal.m_startedCount; ++i)
+		{
+			ran[signal.m_order[i]] = true;
+		}
+
+		for(U i = 0; i < COUNT; i++)
+		{
+			ANKI_TEST_EXPECT_EQ(handles[i].isPending(), false);
+			if(i % 2)
+			{
+				ANKI_TEST_EXPECT_EQ(ran[i], true);
+			}
+		}
+	}
+
 	// Fuzzy test
 	{
 		AsyncLoader a;
@@ -0,0 +1,109 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include "tests/framework/Framework.h"
+#include "anki/resource/ImageLoader.h"
+#include "anki/resource/PakBinary.h"
+#include "anki/util/Filesystem.h"
+
+namespace anki
+{
+
+ANKI_TEST(Resource, ImageLoader)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory("img_loader_test"));
+	ANKI_TEST_EXPECT_NO_ERR(writeAnkiTexture("img_loader_test/tex.ankitex", 64, 5));
+
+	{
+		ResourceFilesystem fs(alloc);
+		ANKI_TEST_EXPECT_NO_ERR(fs.addNewPath("img_loader_test"));
+		ImageLoader loader(alloc);
+
+		// All the mips. Peek the type first, the file should be rewound
+		ResourceFilePtr file;
+		ANKI_TEST_EXPECT_NO_ERR(fs.openFile("tex.ankitex", file));
+		ImageLoader::TextureType type = ImageLoader::TextureType::NONE;
+		ANKI_TEST_EXPECT_NO_ERR(loader.peekTextureType(file, "tex.ankitex", type));
+		ANKI_TEST_EXPECT_EQ(U32(type), U32(ImageLoader::TextureType::_2D));
+		ANKI_TEST_EXPECT_NO_ERR(loader.load(file, "tex.ankitex"));
+		ANKI_TEST_EXPECT_EQ(loader.getWidth(), 64);
+		ANKI_TEST_EXPECT_EQ(loader.getMipLevelsCount(), 5);
+		ANKI_TEST_EXPECT_EQ(loader.getSkippedMipLevelsCount(), 0);
+		ANKI_TEST_EXPECT_EQ(loader.getSurface(4, 0, 0).getData()[0], 4);
+
+		// Skip the mips that are bigger than the max size. Load it again with the same loader
+		ANKI_TEST_EXPECT_NO_ERR(fs.openFile("tex.ankitex", file));
+		ANKI_TEST_EXPECT_NO_ERR(loader.load(file, "tex.ankitex", 16));
+		ANKI_TEST_EXPECT_EQ(loader.getWidth(), 16);
+		ANKI_TEST_EXPECT_EQ(loader.getHeight(), 16);
+		ANKI_TEST_EXPECT_EQ(loader.getMipLevelsCount(), 3);
+		ANKI_TEST_EXPECT_EQ(loader.getSkippedMipLevelsCount(), 2);
+		ANKI_TEST_EXPECT_EQ(loader.getSurface(0, 0, 0).getData()[0], 2);
+		ANKI_TEST_EXPECT_EQ(loader.getSurface(2, 0, 0).getData()[0], 4);
+
+		// The last mip is always loaded
+		ANKI_TEST_EXPECT_NO_ERR(fs.openFile("tex.ankitex", file));
+		ANKI_TEST_EXPECT_NO_ERR(loader.load(file, "tex.ankitex", 1));
+		ANKI_TEST_EXPECT_EQ(loader.getWidth(), 4);
+		ANKI_TEST_EXPECT_EQ(loader.getMipLevelsCount(), 1);
+		ANKI_TEST_EXPECT_EQ(loader.getSkippedMipLevelsCount(), 4);
+		ANKI_TEST_EXPECT_EQ(loader.getSurface(0, 0, 0).getData()[0], 4);
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory("img_loader_test"));
+}
+
+ANKI_TEST(Resource, ImageLoaderPak)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	const CString root = "img_loader_pak_test";
+	if(directoryExists(root))
+	{
+		ANKI_TEST_EXPECT_NO_ERR(removeDirectory(root));
+	}
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory(root));
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory("img_loader_pak_test/in"));
+	ANKI_TEST_EXPECT_NO_ERR(writeAnkiTexture("img_loader_pak_test/in/tex.ankitex", 64, 5));
+	ANKI_TEST_EXPECT_NO_ERR(writePakArchive(alloc, "img_loader_pak_test/in", "img_loader_pak_test/tex.ankipak"));
+
+	{
+		ResourceFilesystem fs(alloc);
+		ANKI_TEST_EXPECT_NO_ERR(fs.addNewPath("img_loader_pak_test/tex.ankipak"));
+
+		// The whole file in the mapping
+		ResourceFilePtr file;
+		ANKI_TEST_EXPECT_NO_ERR(fs.openFile("tex.ankitex", file));
+		ANKI_TEST_EXPECT_EQ(file->isMemoryMapped(), true);
+		ConstWeakArray<U8> fileData;
+		ANKI_TEST_EXPECT_NO_ERR(file->readDirect(file->getSize(), fileData));
+		const U8* fileBegin = &fileData[0];
+		const U8* fileEnd = fileBegin + fileData.getSize();
+
+		ImageLoader loader(alloc);
+		ANKI_TEST_EXPECT_NO_ERR(fs.openFile("tex.ankitex", file));
+		ANKI_TEST_EXPECT_NO_ERR(loader.load(file, "tex.ankitex", 32));
+		ANKI_TEST_EXPECT_EQ(loader.getMipLevelsCount(), 4);
+
+		// The loader keeps the file alive
+		file.reset(nullptr);
+
+		// The surfaces point to the mapping instead of copies
+		for(U32 mip = 0; mip < loader.getMipLevelsCount(); ++mip)
+		{
+			const ImageLoader::Surface& surf = loader.getSurface(mip, 0, 0);
+			ANKI_TEST_EXPECT_EQ(surf.m_data.getSize(), 0);
+			ANKI_TEST_EXPECT_GT(surf.m_mappedData.getSize(), 0);
+			ANKI_TEST_EXPECT_GEQ(&surf.m_mappedData[0], fileBegin);
+			ANKI_TEST_EXPECT_LEQ(&surf.m_mappedData[0] + surf.m_mappedData.getSize(), fileEnd);
+			ANKI_TEST_EXPECT_EQ(surf.getData()[0], mip + 1);
+			ANKI_TEST_EXPECT_EQ(surf.getData()[surf.getData().getSize() - 1], mip + 1);
+		}
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory(root));
+}
+
+} // end namespace anki
@@ -5,6 +5,9 @@
 
 #include "tests/framework/Framework.h"
 #include "anki/resource/ResourceFilesystem.h"
+#include "anki/resource/PakBinary.h"
+#include "anki/util/Filesystem.h"
+#include "anki/util/HighRezTimer.h"
 
 namespace anki
 {
@@ -35,4 +38,237 @@ ANKI_TEST(Resource, ResourceFilesystem)
 	}
 }
 
+ANKI_TEST(Resource, ResourceFilesystemPak)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+
+	// A directory with a small and a big file. Everything goes to a temporary directory that is removed at the end
+	const CString root = "pak_test";
+	const CString dir = "pak_test/in";
+	const CString pakFilename = "pak_test/test.ankipak";
+	if(directoryExists(root))
+	{
+		ANKI_TEST_EXPECT_NO_ERR(removeDirectory(root));
+	}
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory(root));
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory(dir));
+
+	Array<U8, 5000> big;
+	for(U32 i = 0; i < big.getSize(); ++i)
+	{
+		big[i] = U8(i);
+	}
+
+	{
+		File file;
+		ANKI_TEST_EXPECT_NO_ERR(file.open("pak_test/in/hello.txt", FileOpenFlag::WRITE));
+		ANKI_TEST_EXPECT_NO_ERR(file.writeText("hello\n"));
+	}
+
+	{
+		File file;
+		ANKI_TEST_EXPECT_NO_ERR(file.open("pak_test/in/big.bin", FileOpenFlag::WRITE | FileOpenFlag::BINARY));
+		ANKI_TEST_EXPECT_NO_ERR(file.write(&big[0], big.getSize()));
+	}
+
+	// Pack it the same way the ankipak tool does
+	ANKI_TEST_EXPECT_NO_ERR(writePakArchive(alloc, dir, pakFilename));
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory(dir));
+
+	// Check the layout
+	{
+		File file;
+		ANKI_TEST_EXPECT_NO_ERR(file.open(pakFilename, FileOpenFlag::READ | FileOpenFlag::BINARY));
+
+		PakBinaryFile::Header header;
+		ANKI_TEST_EXPECT_NO_ERR(file.read(&header, sizeof(header)));
+		ANKI_TEST_EXPECT_EQ(memcmp(&header.m_magic[0], PakBinaryFile::MAGIC, sizeof(header.m_magic)), 0);
+		ANKI_TEST_EXPECT_EQ(header.m_fileCount, 2);
+
+		Array<PakBinaryFile::Entry, 2> entries;
+		ANKI_TEST_EXPECT_NO_ERR(file.read(&entries[0], sizeof(entries)));
+
+		// Sorted by filename
+		Array<char, 64> filenames;
+		ANKI_TEST_EXPECT_EQ(header.m_filenamesSize, sizeof("big.bin") + sizeof("hello.txt"));
+		ANKI_TEST_EXPECT_NO_ERR(file.read(&filenames[0], header.m_filenamesSize));
+		ANKI_TEST_EXPECT_EQ(CString(&filenames[entries[0].m_filenameOffset]), "big.bin");
+		ANKI_TEST_EXPECT_EQ(CString(&filenames[entries[1].m_filenameOffset]), "hello.txt");
+
+		// The data is aligned and the big file starts at a page
+		const PtrSize dataBegin = sizeof(header) + sizeof(entries) + header.m_filenamesSize;
+		ANKI_TEST_EXPECT_GEQ(entries[0].m_dataOffset, dataBegin);
+		ANKI_TEST_EXPECT_EQ(entries[0].m_dataOffset % PakBinaryFile::PAGE_SIZE, 0);
+		ANKI_TEST_EXPECT_EQ(entries[0].m_dataSize, big.getSize());
+		ANKI_TEST_EXPECT_EQ(entries[1].m_dataOffset % PakBinaryFile::DATA_ALIGNMENT, 0);
+		ANKI_TEST_EXPECT_EQ(entries[1].m_dataSize, 6);
+		ANKI_TEST_EXPECT_EQ(file.getSize(), entries[1].m_dataOffset + entries[1].m_dataSize);
+	}
+
+	// Read it
+	{
+		ResourceFilesystem fs(alloc);
+		ANKI_TEST_EXPECT_NO_ERR(fs.addNewPath(pakFilename));
+
+		ResourceFilePtr file;
+		ANKI_TEST_EXPECT_NO_ERR(fs.openFile("hello.txt", file));
+		StringAuto txt(alloc);
+		ANKI_TEST_EXPECT_NO_ERR(file->readAllText(alloc, txt));
+		ANKI_TEST_EXPECT_EQ(txt, "hello\n");
+
+		// The big file is read in place
+		ANKI_TEST_EXPECT_NO_ERR(fs.openFile("big.bin", file));
+		ANKI_TEST_EXPECT_EQ(file->isMemoryMapped(), true);
+		ANKI_TEST_EXPECT_EQ(file->getSize(), big.getSize());
+		ANKI_TEST_EXPECT_NO_ERR(file->seek(100, ResourceFile::SeekOrigin::BEGINNING));
+		ConstWeakArray<U8> data;
+		ANKI_TEST_EXPECT_NO_ERR(file->readDirect(big.getSize() - 100, data));
+		ANKI_TEST_EXPECT_EQ(memcmp(&data[0], &big[100], data.getSize()), 0);
+		ANKI_TEST_EXPECT_ANY_ERR(file->readDirect(1, data));
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory(root));
+	ANKI_TEST_EXPECT_EQ(fileExists(pakFilename), false);
+}
+
+ANKI_TEST(Resource, ResourceFilesystemBadPath)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+
+	const CString root = "rsrc_fs_bad";
+	if(directoryExists(root))
+	{
+		ANKI_TEST_EXPECT_NO_ERR(removeDirectory(root));
+	}
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory(root));
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory("rsrc_fs_bad/good"));
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory("rsrc_fs_bad/empty"));
+
+	{
+		File file;
+		ANKI_TEST_EXPECT_NO_ERR(file.open("rsrc_fs_bad/good/hello.txt", FileOpenFlag::WRITE));
+		ANKI_TEST_EXPECT_NO_ERR(file.writeText("hello\n"));
+	}
+
+	{
+		File file;
+		ANKI_TEST_EXPECT_NO_ERR(file.open("rsrc_fs_bad/corrupted.ankipak", FileOpenFlag::WRITE));
+		ANKI_TEST_EXPECT_NO_ERR(file.writeText("not a pak"));
+	}
+
+	{
+		ResourceFilesystem fs(alloc);
+		ANKI_TEST_EXPECT_NO_ERR(fs.addNewPath("rsrc_fs_bad/good"));
+
+		// The paths that fail leave nothing behind
+		ANKI_TEST_EXPECT_ANY_ERR(fs.addNewPath("rsrc_fs_bad/empty"));
+		ANKI_TEST_EXPECT_ANY_ERR(fs.addNewPath("rsrc_fs_bad/corrupted.ankipak"));
+		ANKI_TEST_EXPECT_ANY_ERR(fs.addNewPath("rsrc_fs_bad/missing.ankipak"));
+
+		U32 pathCount = 0;
+		for(const ResourceFilesystem::Path& p : fs.m_paths)
+		{
+			ANKI_TEST_EXPECT_EQ(p.m_path, "rsrc_fs_bad/good");
+			++pathCount;
+		}
+		ANKI_TEST_EXPECT_EQ(pathCount, 1);
+
+		ResourceFilePtr file;
+		ANKI_TEST_EXPECT_NO_ERR(fs.openFile("hello.txt", file));
+		StringAuto txt(alloc);
+		ANKI_TEST_EXPECT_NO_ERR(file->readAllText(alloc, txt));
+		ANKI_TEST_EXPECT_EQ(txt, "hello\n");
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory(root));
+}
+
+ANKI_TEST(Resource, ResourceFilesystemBench)
+{
+	printf("Test requires the data dir\n");
+
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+
+	// Create a few data paths with many files. Half the files of a path are also in the next path
+	const U32 PATH_COUNT = 4;
+	const U32 FILES_PER_PATH = 5000;
+	const CString root = "rsrc_fs_bench";
+	if(directoryExists(root))
+	{
+		ANKI_TEST_EXPECT_NO_ERR(removeDirectory(root));
+	}
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory(root));
+
+	for(U32 p = 0; p < PATH_COUNT; ++p)
+	{
+		StringAuto dir(alloc);
+		dir.sprintf("%s/path%u", &root[0], p);
+		ANKI_TEST_EXPECT_NO_ERR(createDirectory(dir.toCString()));
+
+		for(U32 f = p * FILES_PER_PATH / 2; f < p * FILES_PER_PATH / 2 + FILES_PER_PATH; ++f)
+		{
+			StringAuto fname(alloc);
+			fname.sprintf("%s/file%u.txt", &dir[0], f);
+			File file;
+			ANKI_TEST_EXPECT_NO_ERR(file.open(fname.toCString(), FileOpenFlag::WRITE));
+			ANKI_TEST_EXPECT_NO_ERR(file.writeText("%u", p));
+		}
+	}
+
+	{
+		ResourceFilesystem fs(alloc);
+
+		Second begin = HighRezTimer::getCurrentTime();
+		for(U32 p = 0; p < PATH_COUNT; ++p)
+		{
+			StringAuto dir(alloc);
+			dir.sprintf("%s/path%u", &root[0], p);
+			ANKI_TEST_EXPECT_NO_ERR(fs.addNewPath(dir.toCString()));
+		}
+		ANKI_TEST_EXPECT_NO_ERR(fs.addNewPath("./data/dir.ankizip"));
+		const Second addTime = HighRezTimer::getCurrentTime() - begin;
+
+		// Open all the files. The newest path should win
+		const U32 fileCount = (PATH_COUNT - 1) * FILES_PER_PATH / 2 + FILES_PER_PATH;
+		begin = HighRezTimer::getCurrentTime();
+		for(U32 f = 0; f < fileCount; ++f)
+		{
+			StringAuto fname(alloc);
+			fname.sprintf("file%u.txt", f);
+			ResourceFilePtr file;
+			ANKI_TEST_EXPECT_NO_ERR(fs.openFile(fname.toCString(), file));
+
+			if((f % 1000) == 0)
+			{
+				StringAuto txt(alloc);
+				ANKI_TEST_EXPECT_NO_ERR(file->readAllText(alloc, txt));
+				StringAuto expected(alloc);
+				expected.sprintf("%u", min(f / (FILES_PER_PATH / 2), PATH_COUNT - 1));
+				ANKI_TEST_EXPECT_EQ(txt, expected);
+			}
+		}
+		const Second openTime = HighRezTimer::getCurrentTime() - begin;
+
+		// Open the same archived file many times
+		const U32 ARCHIVE_OPEN_COUNT = 10000;
+		begin = HighRezTimer::getCurrentTime();
+		for(U32 i = 0; i < ARCHIVE_OPEN_COUNT; ++i)
+		{
+			ResourceFilePtr file;
+			ANKI_TEST_EXPECT_NO_ERR(fs.openFile("subdir0/hello.txt", file));
+		}
+		const Second archiveOpenTime = HighRezTimer::getCurrentTime() - begin;
+
+		ANKI_TEST_LOGI("Added %u paths in %fms. Opened %u files in %fms. Opened an archived file %u times in %fms",
+			PATH_COUNT + 1,
+			addTime * 1000.0,
+			fileCount,
+			openTime * 1000.0,
+			ARCHIVE_OPEN_COUNT,
+			archiveOpenTime * 1000.0);
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory(root));
+}
+
 } // end namespace anki
@@ -7,6 +7,8 @@
 #include "anki/resource/DummyResource.h"
 #include "anki/resource/ResourceManager.h"
 #include "anki/core/Config.h"
+#include "anki/util/ThreadHive.h"
+#include "anki/util/System.h"
 
 namespace anki
 {
@@ -83,6 +85,46 @@ ANKI_TEST(Resource, ResourceManager)
 		}
 	}
 
+	// Load from many threads
+	{
+		ThreadHive hive(getCpuCoresCount(), alloc);
+
+		const U32 LOAD_COUNT = 1024;
+		const U32 NAME_COUNT = 8;
+		Array<DummyResourcePtr, LOAD_COUNT> ptrs;
+		Atomic<U32> errorCount = {0};
+		hive.parallelFor(0, LOAD_COUNT, 1, [&](U32 idx, U32 threadId) {
+			const U32 nameIdx = idx % NAME_COUNT;
+			Array<char, 32> name;
+			snprintf(&name[0], sizeof(name), "%s%u", (nameIdx == 0) ? "error" : "blah", nameIdx);
+
+			if(resources->loadResource(&name[0], ptrs[idx]))
+			{
+				errorCount.fetchAdd(1);
+			}
+
+			// Drop some so the loads race with the deletions
+			if(idx & 1)
+			{
+				ptrs[idx].reset(nullptr);
+			}
+		});
+		hive.waitAllTasks();
+
+		ANKI_TEST_EXPECT_EQ(errorCount.load(), LOAD_COUNT / NAME_COUNT);
+
+		// The loads of the same filename that are still alive share the resource
+		for(U32 idx = 0; idx < LOAD_COUNT; idx += 2)
+		{
+			const U32 nameIdx = idx % NAME_COUNT;
+			ANKI_TEST_EXPECT_EQ(ptrs[idx].isCreated(), nameIdx != 0);
+			if(nameIdx != 0)
+			{
+				ANKI_TEST_EXPECT_EQ(ptrs[idx].get(), ptrs[nameIdx].get());
+			}
+		}
+	}
+
 	// Delete
 	alloc.deleteInstance(resources);
 }
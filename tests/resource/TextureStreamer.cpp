@@ -0,0 +1,264 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include "tests/framework/Framework.h"
+#include "anki/resource/TextureStreamer.h"
+#include "anki/util/Filesystem.h"
+#include "anki/util/HighRezTimer.h"
+
+namespace anki
+{
+
+/// A 256x256 texture with its tail at 64x64. It doesn't have a TextureResource so it can't go through endFrame().
+static void initFakeTexture(StreamedTexture& tex, U8 residentMip, Bool feedback)
+{
+	tex.m_size = UVec2(256u);
+	tex.m_format = Format::R8G8B8A8_UNORM;
+	tex.m_mipCount = 9;
+	tex.m_firstMip = 0;
+	tex.m_tailMip = 2;
+	tex.m_residentMip = residentMip;
+	tex.m_wantedMip = residentMip;
+	if(feedback)
+	{
+		tex.m_mipFeedback.store(1);
+	}
+}
+
+/// A task that stands for a StreamTask.
+class NopTask : public AsyncLoaderTask
+{
+public:
+	Error operator()(AsyncLoaderTaskContext& ctx) final
+	{
+		return Error::NONE;
+	}
+};
+
+ANKI_TEST(Resource, TextureStreamerPriorities)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	TextureStreamer streamer(alloc, MAX_PTR_SIZE, 64);
+	Array<TextureStreamer::Load, TextureStreamer::MAX_LOADS_IN_FLIGHT> loads;
+
+	Array<StreamedTexture, 6> texs;
+	initFakeTexture(texs[0], 2, false); // No feedback, wants all the mips
+	initFakeTexture(texs[1], 2, true); // Visible, wants all the mips
+	initFakeTexture(texs[2], 2, true); // Visible, wants mip 1
+	initFakeTexture(texs[3], 0, true); // Visible, drops to the tail
+	initFakeTexture(texs[4], 2, true); // Visible, wants less than the tail
+	initFakeTexture(texs[5], 2, true); // Visible, wants all the mips
+	for(StreamedTexture& tex : texs)
+	{
+		streamer.registerTexture(tex);
+	}
+
+	ANKI_TEST_EXPECT_EQ(streamer.getResidentMemory(), 5 * texs[0].computeMemory(2) + texs[3].computeMemory(0));
+
+	texs[1].m_requestedMip.min(0);
+	texs[2].m_requestedMip.min(1);
+	texs[3].m_requestedMip.min(2);
+	texs[4].m_requestedMip.min(5);
+	texs[5].m_requestedMip.min(0);
+
+	// The visible textures first, then the ones without feedback. The drop doesn't fit in the loads in flight
+	U32 loadCount = streamer.computeLoads(loads);
+	ANKI_TEST_EXPECT_EQ(texs[0].m_wantedMip, 0);
+	ANKI_TEST_EXPECT_EQ(texs[1].m_wantedMip, 0);
+	ANKI_TEST_EXPECT_EQ(texs[2].m_wantedMip, 1);
+	ANKI_TEST_EXPECT_EQ(texs[3].m_wantedMip, 2);
+	ANKI_TEST_EXPECT_EQ(texs[4].m_wantedMip, 2);
+	ANKI_TEST_EXPECT_EQ(texs[5].m_wantedMip, 0);
+
+	ANKI_TEST_EXPECT_EQ(loadCount, TextureStreamer::MAX_LOADS_IN_FLIGHT);
+	ANKI_TEST_EXPECT_EQ(loads[0].m_tex, &texs[1]);
+	ANKI_TEST_EXPECT_EQ(loads[0].m_mip, 0);
+	ANKI_TEST_EXPECT_EQ(U32(loads[0].m_priority), U32(AsyncLoaderTaskPriority::HIGH));
+	ANKI_TEST_EXPECT_EQ(loads[1].m_tex, &texs[2]);
+	ANKI_TEST_EXPECT_EQ(loads[1].m_mip, 1);
+	ANKI_TEST_EXPECT_EQ(U32(loads[1].m_priority), U32(AsyncLoaderTaskPriority::HIGH));
+	ANKI_TEST_EXPECT_EQ(loads[2].m_tex, &texs[5]);
+	ANKI_TEST_EXPECT_EQ(loads[2].m_mip, 0);
+	ANKI_TEST_EXPECT_EQ(U32(loads[2].m_priority), U32(AsyncLoaderTaskPriority::HIGH));
+	ANKI_TEST_EXPECT_EQ(loads[3].m_tex, &texs[0]);
+	ANKI_TEST_EXPECT_EQ(loads[3].m_mip, 0);
+	ANKI_TEST_EXPECT_EQ(U32(loads[3].m_priority), U32(AsyncLoaderTaskPriority::MEDIUM));
+	ANKI_TEST_EXPECT_EQ(texs[1].m_loadingMip, 0);
+	ANKI_TEST_EXPECT_EQ(texs[3].m_loadingMip, MAX_U8);
+
+	// Nothing else until a load is done
+	texs[3].m_requestedMip.min(2);
+	loadCount = streamer.computeLoads(loads);
+	ANKI_TEST_EXPECT_EQ(loadCount, 0);
+
+	// Free a slot. The drop waits for the handle of its previous task
+	AsyncLoader loader;
+	loader.init(alloc);
+	loader.pause();
+	loader.submitTask(loader.newTask<NopTask>(), AsyncLoaderTaskPriority::MEDIUM, &texs[3].m_streamTask);
+
+	streamer.unregisterTexture(texs[1]);
+	texs[3].m_requestedMip.min(2);
+	loadCount = streamer.computeLoads(loads);
+	ANKI_TEST_EXPECT_EQ(loadCount, 0);
+
+	// Now the drop goes
+	loader.cancelTask(texs[3].m_streamTask);
+	texs[3].m_requestedMip.min(2);
+	loadCount = streamer.computeLoads(loads);
+	ANKI_TEST_EXPECT_EQ(loadCount, 1);
+	ANKI_TEST_EXPECT_EQ(loads[0].m_tex, &texs[3]);
+	ANKI_TEST_EXPECT_EQ(loads[0].m_mip, 2);
+	ANKI_TEST_EXPECT_EQ(U32(loads[0].m_priority), U32(AsyncLoaderTaskPriority::LOW));
+
+	for(StreamedTexture& tex : texs)
+	{
+		if(tex.m_streamerIndex != MAX_U32)
+		{
+			streamer.unregisterTexture(tex);
+		}
+	}
+}
+
+ANKI_TEST(Resource, TextureStreamerBudget)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	Array<StreamedTexture, 4> texs;
+	for(StreamedTexture& tex : texs)
+	{
+		initFakeTexture(tex, 2, true);
+	}
+
+	// Room for 2 textures with all their mips and 2 with their tails
+	const PtrSize allMips = texs[0].computeMemory(0);
+	const PtrSize tail = texs[0].computeMemory(2);
+	TextureStreamer streamer(alloc, 2 * allMips + 2 * tail, 64);
+	Array<TextureStreamer::Load, TextureStreamer::MAX_LOADS_IN_FLIGHT> loads;
+
+	for(StreamedTexture& tex : texs)
+	{
+		streamer.registerTexture(tex);
+	}
+
+	// Every frame a different texture becomes visible and the rest keep the mips they asked for before
+	texs[0].m_requestedMip.min(0);
+	streamer.computeLoads(loads);
+	texs[1].m_requestedMip.min(0);
+	streamer.computeLoads(loads);
+	ANKI_TEST_EXPECT_EQ(texs[0].m_wantedMip, 0);
+	ANKI_TEST_EXPECT_EQ(texs[1].m_wantedMip, 0);
+	ANKI_TEST_EXPECT_EQ(texs[2].m_wantedMip, 2);
+	ANKI_TEST_EXPECT_EQ(texs[3].m_wantedMip, 2);
+
+	// Over the budget. The texture that was requested the longest time ago drops first
+	texs[2].m_requestedMip.min(0);
+	streamer.computeLoads(loads);
+	ANKI_TEST_EXPECT_EQ(texs[0].m_wantedMip, 2);
+	ANKI_TEST_EXPECT_EQ(texs[1].m_wantedMip, 0);
+	ANKI_TEST_EXPECT_EQ(texs[2].m_wantedMip, 0);
+	ANKI_TEST_EXPECT_EQ(texs[3].m_wantedMip, 2);
+
+	texs[3].m_requestedMip.min(0);
+	streamer.computeLoads(loads);
+	ANKI_TEST_EXPECT_EQ(texs[0].m_wantedMip, 2);
+	ANKI_TEST_EXPECT_EQ(texs[1].m_wantedMip, 2);
+	ANKI_TEST_EXPECT_EQ(texs[2].m_wantedMip, 0);
+	ANKI_TEST_EXPECT_EQ(texs[3].m_wantedMip, 0);
+
+	// Visible textures don't drop more than they need to. The rest drop to their tails when they are not used
+	for(U32 i = 0; i < TextureStreamer::UNUSED_FRAME_COUNT + 1; ++i)
+	{
+		texs[2].m_requestedMip.min(1);
+		streamer.computeLoads(loads);
+	}
+
+	ANKI_TEST_EXPECT_EQ(texs[2].m_wantedMip, 1);
+	ANKI_TEST_EXPECT_EQ(texs[3].m_wantedMip, 2);
+
+	for(StreamedTexture& tex : texs)
+	{
+		streamer.unregisterTexture(tex);
+	}
+}
+
+/// Run frames until the texture of the resource has that size.
+static void runStreamingFrames(ResourceManager& resources, GrManager& gr, const TextureResource& tex, U32 size)
+{
+	for(U32 i = 0; i < 1000 && tex.getGrTexture()->getWidth() != size; ++i)
+	{
+		// Same as the App. The loader pauses so the streamer can swap the textures
+		resources.getAsyncLoader().pause();
+		gr.finish();
+		resources.getTextureStreamer().endFrame();
+		resources.getAsyncLoader().resume();
+
+		HighRezTimer::sleep(1.0_ms);
+	}
+
+	ANKI_TEST_EXPECT_EQ(tex.getGrTexture()->getWidth(), size);
+	ANKI_TEST_EXPECT_EQ(tex.getGrTextureView()->getSubresource().m_mipmapCount, tex.getGrTexture()->getMipmapCount());
+}
+
+ANKI_TEST(Resource, TextureStreamerEndFrame)
+{
+	Config cfg;
+	initConfig(cfg);
+	cfg.set("window.debugContext", 0);
+	cfg.set("rsrc.textureStreamingBudget", 64_MB);
+	cfg.set("rsrc.textureStreamingTailSize", 64);
+
+	NativeWindow* win = createWindow(cfg);
+	GrManager* gr = createGrManager(cfg, win);
+	PhysicsWorld* physics = nullptr;
+	ResourceFilesystem* fs = nullptr;
+	ResourceManager* resources = createResourceManager(cfg, gr, physics, fs);
+	TextureStreamer& streamer = resources->getTextureStreamer();
+	AsyncLoader& loader = resources->getAsyncLoader();
+
+	// A 256x256 texture with its tail at 64x64
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory("tex_streamer_test"));
+	ANKI_TEST_EXPECT_NO_ERR(writeAnkiTexture("tex_streamer_test/tex.ankitex", 256, 9));
+
+	{
+		TextureResourcePtr tex;
+		ANKI_TEST_EXPECT_NO_ERR(resources->loadResource("tex_streamer_test/tex.ankitex", tex));
+		ANKI_TEST_EXPECT_EQ(tex->getWidth(), 256);
+		ANKI_TEST_EXPECT_EQ(tex->getGrTexture()->getWidth(), 64);
+		const PtrSize tailMemory = streamer.getResidentMemory();
+
+		// Without feedback the streamer loads all the mips. The new texture replaces the tail when its fence is done
+		runStreamingFrames(*resources, *gr, *tex, 256);
+		ANKI_TEST_EXPECT_EQ(tex->getGrTexture()->getMipmapCount(), 9);
+		ANKI_TEST_EXPECT_GT(streamer.getResidentMemory(), tailMemory);
+
+		// The feedback asks for less than the tail so it drops to it
+		tex->enableMipFeedback();
+		tex->requestMip(3);
+		runStreamingFrames(*resources, *gr, *tex, 64);
+		ANKI_TEST_EXPECT_EQ(streamer.getResidentMemory(), tailMemory);
+
+		// Destroy it while a load waits in the loader. The resource cancels it
+		loader.pause();
+		const U32 pendingTaskCount = loader.getPendingTaskCount();
+		tex->requestMip(0);
+		streamer.endFrame();
+		ANKI_TEST_EXPECT_EQ(loader.getPendingTaskCount(), pendingTaskCount + 1);
+
+		tex.reset(nullptr);
+		ANKI_TEST_EXPECT_EQ(loader.getPendingTaskCount(), pendingTaskCount);
+		ANKI_TEST_EXPECT_EQ(streamer.getResidentMemory(), 0);
+		loader.resume();
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory("tex_streamer_test"));
+
+	delete resources;
+	delete physics;
+	delete fs;
+	GrManager::deleteInstance(gr);
+	delete win;
+}
+
+} // end namespace anki
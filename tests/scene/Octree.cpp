@@ -6,6 +6,9 @@
 #include <tests/framework/Framework.h>
 #include <anki/scene/Octree.h>
 #include <anki/collision/Frustum.h>
+#include <anki/util/HighRezTimer.h>
+#include <anki/util/ThreadHive.h>
+#include <anki/util/System.h>
 
 namespace anki
 {
@@ -85,4 +88,438 @@ ANKI_TEST(Scene, Octree)
 	}
 }
 
+ANKI_TEST(Scene, OctreeLinearLayout)
+{
+	SceneAllocator<U8> alloc(allocAligned, nullptr);
+
+	OrthographicFrustum frustum(-200.0f, 200.0f, -200.0f, 200.0f, 200.0f, -200.0f);
+	frustum.resetTransform(Transform::getIdentity());
+
+	// Do the same random placements and removals to both layouts. The gathers should find the same placeables
+	Array<Octree*, 2> octrees;
+	for(OctreeLayout layout : {OctreeLayout::POINTER_TREE, OctreeLayout::LINEAR})
+	{
+		octrees[U(layout)] = alloc.newInstance<Octree>(alloc);
+		octrees[U(layout)]->init(Vec3(-100.0f), Vec3(100.0f), 4, layout);
+	}
+
+	const U ITERATION_COUNT = 1000;
+	Array2d<OctreePlaceable, 2, ITERATION_COUNT> placeables;
+	std::vector<U32> placed;
+	for(U i = 0; i < ITERATION_COUNT; ++i)
+	{
+		const F32 min = randRange(-100.0f, 100.0f - 1.0f);
+		const F32 max = randRange(min + 1.0f, 100.0f);
+		const Aabb volume(Vec4(Vec3(min), 0.0f), Vec4(Vec3(max), 0.0f));
+
+		const I mode = rand() % 3;
+		if(mode == 0)
+		{
+			for(U l = 0; l < 2; ++l)
+			{
+				placeables[l][i].m_userData = &placeables[0][i];
+				octrees[l]->place(volume, &placeables[l][i]);
+			}
+			placed.push_back(i);
+		}
+		else if(mode == 1 && placed.size() > 0)
+		{
+			for(U l = 0; l < 2; ++l)
+			{
+				octrees[l]->remove(placeables[l][placed.back()]);
+			}
+			placed.pop_back();
+		}
+		else if(placed.size() > 0)
+		{
+			Array<std::vector<void*>, 2> visibles;
+			for(U l = 0; l < 2; ++l)
+			{
+				for(U32 idx : placed)
+				{
+					placeables[l][idx].reset();
+				}
+
+				DynamicArrayAuto<void*> arr(alloc);
+				octrees[l]->gatherVisible(frustum, 0, nullptr, nullptr, arr);
+				for(void* placeable : arr)
+				{
+					visibles[l].push_back(static_cast<OctreePlaceable*>(placeable)->m_userData);
+				}
+
+				std::sort(visibles[l].begin(), visibles[l].end());
+			}
+
+			ANKI_TEST_EXPECT_EQ(visibles[0].size(), placed.size());
+			ANKI_TEST_EXPECT_EQ(visibles[0] == visibles[1], true);
+		}
+	}
+
+	while(!placed.empty())
+	{
+		for(U l = 0; l < 2; ++l)
+		{
+			octrees[l]->remove(placeables[l][placed.back()]);
+		}
+		placed.pop_back();
+	}
+
+	for(Octree* octree : octrees)
+	{
+		alloc.deleteInstance(octree);
+	}
+}
+
+ANKI_TEST(Scene, OctreeLayoutBench)
+{
+	SceneAllocator<U8> alloc(allocAligned, nullptr);
+
+	const U PLACEABLE_COUNT = 100000;
+	const U ITERATION_COUNT = 50;
+	const F32 SCENE_SIZE = 1000.0f;
+
+	std::vector<OctreePlaceable> placeables(PLACEABLE_COUNT);
+	std::vector<Aabb> volumes(PLACEABLE_COUNT);
+	for(U i = 0; i < PLACEABLE_COUNT; ++i)
+	{
+		const Vec3 center(randRange(-SCENE_SIZE, SCENE_SIZE - 10.0f),
+			randRange(-SCENE_SIZE, SCENE_SIZE - 10.0f),
+			randRange(-SCENE_SIZE, SCENE_SIZE - 10.0f));
+		volumes[i] = Aabb(center, center + Vec3(randRange(0.5f, 10.0f)));
+		placeables[i].m_userData = &placeables[i];
+	}
+
+	// A few cameras looking to different directions
+	Array<PerspectiveFrustum, 4> frustums;
+	for(U i = 0; i < frustums.getSize(); ++i)
+	{
+		frustums[i].setAll(toRad(60.0f), toRad(45.0f), 0.1f, SCENE_SIZE);
+		frustums[i].resetTransform(Transform(Vec4(0.0f), Mat3x4(Euler(0.0f, toRad(90.0f) * F32(i), 0.0f)), 1.0f));
+	}
+
+	Array<U32, 2> visibleCounts;
+	for(OctreeLayout layout : {OctreeLayout::POINTER_TREE, OctreeLayout::LINEAR})
+	{
+		Octree octree(alloc);
+		octree.init(Vec3(-SCENE_SIZE), Vec3(SCENE_SIZE), 6, layout);
+
+		for(U i = 0; i < PLACEABLE_COUNT; ++i)
+		{
+			octree.place(volumes[i], &placeables[i]);
+		}
+
+		DynamicArrayAuto<void*> visibles(alloc);
+		Second gatherTime = 0.0;
+		Second rebuildTime = 0.0;
+		U32 visibleCount = 0;
+		for(U it = 0; it < ITERATION_COUNT; ++it)
+		{
+			for(OctreePlaceable& placeable : placeables)
+			{
+				placeable.reset();
+			}
+
+			// Move one placeable like in a dynamic scene
+			octree.place(volumes[it], &placeables[it]);
+
+			const Second begin = HighRezTimer::getCurrentTime();
+			for(U f = 0; f < frustums.getSize(); ++f)
+			{
+				visibles.destroy();
+				octree.gatherVisible(frustums[f], U32(f), nullptr, nullptr, visibles);
+
+				if(f == 0)
+				{
+					// The first gather of the linear layout may include a rebuild
+					rebuildTime += HighRezTimer::getCurrentTime() - begin;
+				}
+			}
+			gatherTime += HighRezTimer::getCurrentTime() - begin;
+
+			visibleCount = U32(visibles.getSize());
+		}
+
+		visibleCounts[U(layout)] = visibleCount;
+		ANKI_TEST_LOGI("Layout %u: gather %fms per frame (first frustum %fms), %u visible",
+			U(layout),
+			gatherTime / ITERATION_COUNT * 1000.0,
+			rebuildTime / ITERATION_COUNT * 1000.0,
+			visibleCount);
+
+		for(OctreePlaceable& placeable : placeables)
+		{
+			octree.remove(placeable);
+		}
+	}
+
+	ANKI_TEST_EXPECT_EQ(visibleCounts[0], visibleCounts[1]);
+}
+
+ANKI_TEST(Scene, OctreeDeferredPlacement)
+{
+	SceneAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(4, alloc);
+
+	OrthographicFrustum frustum(-200.0f, 200.0f, -200.0f, 200.0f, 200.0f, -200.0f);
+	frustum.resetTransform(Transform::getIdentity());
+
+	// Few moves take the simple removal path and many moves take the bulk one. With a hive many moves are placed in
+	// parallel
+	for(U32 test = 0; test < 4; ++test)
+	{
+		const U32 moveCount = (test & 1) ? 2000 : 10;
+		ThreadHive* applyHive = (test & 2) ? &hive : nullptr;
+
+		Octree octree(alloc);
+		octree.init(Vec3(-100.0f), Vec3(100.0f), 4);
+
+		const U32 PLACEABLE_COUNT = 2000;
+		std::vector<OctreePlaceable> placeables(PLACEABLE_COUNT);
+		std::vector<Aabb> volumes(PLACEABLE_COUNT);
+		for(U32 i = 0; i < PLACEABLE_COUNT; ++i)
+		{
+			placeables[i].m_userData = &placeables[i];
+		}
+
+		for(U32 frame = 0; frame < 4; ++frame)
+		{
+			const U32 count = (frame == 0) ? PLACEABLE_COUNT : moveCount;
+			hive.parallelFor(0, count, 0, [&](U32 idx, U32 threadId) {
+				const Vec3 center(randRange(-90.0f, 80.0f), randRange(-90.0f, 80.0f), randRange(-90.0f, 80.0f));
+				volumes[idx] = Aabb(center, center + Vec3(randRange(0.1f, 10.0f)));
+				octree.placeDeferred(volumes[idx], &placeables[idx]);
+			});
+			hive.waitAllTasks();
+
+			// Move one of them twice, only the last volume should count
+			const Vec3 center(randRange(-90.0f, 80.0f), randRange(-90.0f, 80.0f), randRange(-90.0f, 80.0f));
+			volumes[0] = Aabb(center, center + Vec3(1.0f));
+			octree.placeDeferred(volumes[0], &placeables[0]);
+
+			octree.applyDeferredPlacements(applyHive);
+
+			for(OctreePlaceable& placeable : placeables)
+			{
+				placeable.reset();
+			}
+
+			DynamicArrayAuto<void*> arr(alloc);
+			octree.gatherVisible(frustum, 0, nullptr, nullptr, arr);
+			ANKI_TEST_EXPECT_EQ(arr.getSize(), PLACEABLE_COUNT);
+
+			// Everything should be visible exactly once
+			std::vector<U8> found(PLACEABLE_COUNT, 0);
+			for(void* placeable : arr)
+			{
+				const PtrSize idx = static_cast<OctreePlaceable*>(placeable) - &placeables[0];
+				ANKI_TEST_EXPECT_LT(idx, PLACEABLE_COUNT);
+				++found[idx];
+			}
+
+			for(U8 f : found)
+			{
+				ANKI_TEST_EXPECT_EQ(f, 1);
+			}
+		}
+
+		// Removing a placeable that waits for its placement cancels it
+		octree.placeDeferred(volumes[1], &placeables[1]);
+		octree.remove(placeables[1]);
+		octree.applyDeferredPlacements(applyHive);
+
+		for(U32 i = 0; i < PLACEABLE_COUNT; ++i)
+		{
+			octree.remove(placeables[i]);
+		}
+	}
+}
+
+ANKI_TEST(Scene, OctreeDeferredPlacementRemove)
+{
+	SceneAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(4, alloc);
+
+	Octree octree(alloc);
+	octree.init(Vec3(-100.0f), Vec3(100.0f), 4);
+
+	const U32 PLACEABLE_COUNT = 1000;
+	std::vector<OctreePlaceable> placeables(PLACEABLE_COUNT);
+	for(U32 i = 0; i < PLACEABLE_COUNT; ++i)
+	{
+		placeables[i].m_userData = &placeables[i];
+		const Vec3 center(randRange(-90.0f, 80.0f), randRange(-90.0f, 80.0f), randRange(-90.0f, 80.0f));
+		octree.place(Aabb(center, center + Vec3(1.0f)), &placeables[i]);
+	}
+
+	for(U32 frame = 0; frame < 8; ++frame)
+	{
+		// The odd placeables move in the hive while the even ones get removed while they wait for their placement
+		for(U32 i = 0; i < PLACEABLE_COUNT; i += 2)
+		{
+			octree.placeDeferred(Aabb(Vec3(-10.0f), Vec3(10.0f)), &placeables[i]);
+		}
+
+		hive.parallelFor(0, PLACEABLE_COUNT / 2, 1, [&](U32 idx, U32 threadId) {
+			const Vec3 center(randRange(-90.0f, 80.0f), randRange(-90.0f, 80.0f), randRange(-90.0f, 80.0f));
+			octree.placeDeferred(Aabb(center, center + Vec3(1.0f)), &placeables[idx * 2 + 1]);
+		});
+
+		for(U32 i = 0; i < PLACEABLE_COUNT; i += 2)
+		{
+			octree.remove(placeables[i]);
+		}
+
+		hive.waitAllTasks();
+		octree.applyDeferredPlacements(&hive);
+
+		for(OctreePlaceable& placeable : placeables)
+		{
+			placeable.reset();
+		}
+
+		OrthographicFrustum frustum(-200.0f, 200.0f, -200.0f, 200.0f, 200.0f, -200.0f);
+		frustum.resetTransform(Transform::getIdentity());
+		DynamicArrayAuto<void*> arr(alloc);
+		octree.gatherVisible(frustum, 0, nullptr, nullptr, arr);
+		ANKI_TEST_EXPECT_EQ(arr.getSize(), PLACEABLE_COUNT / 2);
+		for(void* placeable : arr)
+		{
+			const PtrSize idx = static_cast<OctreePlaceable*>(placeable) - &placeables[0];
+			ANKI_TEST_EXPECT_EQ(idx & 1, 1);
+		}
+
+		// Place the removed ones again for the next frame
+		for(U32 i = 0; i < PLACEABLE_COUNT; i += 2)
+		{
+			octree.place(Aabb(Vec3(-10.0f), Vec3(10.0f)), &placeables[i]);
+		}
+	}
+
+	for(OctreePlaceable& placeable : placeables)
+	{
+		octree.remove(placeable);
+	}
+}
+
+ANKI_TEST(Scene, OctreeDeferredPlacementPrune)
+{
+	SceneAllocator<U8> alloc(allocAligned, nullptr);
+
+	// Small volumes in one corner and then in the opposite one
+	const U32 PLACEABLE_COUNT = 100;
+	std::vector<OctreePlaceable> placeables(PLACEABLE_COUNT);
+	std::vector<Aabb> volumesA(PLACEABLE_COUNT);
+	std::vector<Aabb> volumesB(PLACEABLE_COUNT);
+	for(U32 i = 0; i < PLACEABLE_COUNT; ++i)
+	{
+		placeables[i].m_userData = &placeables[i];
+		const Vec3 center(randRange(-95.0f, -60.0f), randRange(-95.0f, -60.0f), randRange(-95.0f, -60.0f));
+		volumesA[i] = Aabb(center, center + Vec3(1.0f));
+		volumesB[i] = Aabb(-(center + Vec3(1.0f)), -center);
+	}
+
+	// The leafs the second corner needs on its own
+	U32 leafCountB;
+	{
+		Octree octree(alloc);
+		octree.init(Vec3(-100.0f), Vec3(100.0f), 4);
+		for(U32 i = 0; i < PLACEABLE_COUNT; ++i)
+		{
+			octree.place(volumesB[i], &placeables[i]);
+		}
+		leafCountB = octree.getLeafCount();
+
+		for(OctreePlaceable& placeable : placeables)
+		{
+			octree.remove(placeable);
+		}
+	}
+
+	// Move everything with a bulk removal. The leafs of the first corner should go away
+	Octree octree(alloc);
+	octree.init(Vec3(-100.0f), Vec3(100.0f), 4);
+	for(U32 i = 0; i < PLACEABLE_COUNT; ++i)
+	{
+		octree.placeDeferred(volumesA[i], &placeables[i]);
+	}
+	octree.applyDeferredPlacements();
+
+	for(U32 i = 0; i < PLACEABLE_COUNT; ++i)
+	{
+		octree.placeDeferred(volumesB[i], &placeables[i]);
+	}
+	octree.applyDeferredPlacements();
+	ANKI_TEST_EXPECT_EQ(octree.getLeafCount(), leafCountB);
+
+	for(OctreePlaceable& placeable : placeables)
+	{
+		octree.remove(placeable);
+	}
+}
+
+ANKI_TEST(Scene, OctreeDeferredPlacementBench)
+{
+	SceneAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(getCpuCoresCount(), alloc);
+
+	const U32 PLACEABLE_COUNT = 50000;
+	const U32 ITERATION_COUNT = 4;
+	const F32 SCENE_SIZE = 1000.0f;
+
+	std::vector<OctreePlaceable> placeables(PLACEABLE_COUNT);
+	std::vector<Aabb> volumes(PLACEABLE_COUNT * 2);
+	for(U32 i = 0; i < volumes.size(); ++i)
+	{
+		const Vec3 center(randRange(-SCENE_SIZE, SCENE_SIZE - 10.0f),
+			randRange(-SCENE_SIZE, SCENE_SIZE - 10.0f),
+			randRange(-SCENE_SIZE, SCENE_SIZE - 10.0f));
+		volumes[i] = Aabb(center, center + Vec3(randRange(0.5f, 10.0f)));
+	}
+
+	for(Bool deferred : {false, true})
+	{
+		Octree octree(alloc);
+		octree.init(Vec3(-SCENE_SIZE), Vec3(SCENE_SIZE), 6);
+
+		for(U32 i = 0; i < PLACEABLE_COUNT; ++i)
+		{
+			octree.place(volumes[i], &placeables[i]);
+		}
+
+		// Move the whole crowd every frame
+		const Second begin = HighRezTimer::getCurrentTime();
+		for(U32 it = 0; it < ITERATION_COUNT; ++it)
+		{
+			const U32 offset = (it & 1) ? 0 : PLACEABLE_COUNT;
+			hive.parallelFor(0, PLACEABLE_COUNT, 0, [&](U32 idx, U32 threadId) {
+				if(deferred)
+				{
+					octree.placeDeferred(volumes[idx + offset], &placeables[idx]);
+				}
+				else
+				{
+					octree.place(volumes[idx + offset], &placeables[idx]);
+				}
+			});
+			hive.waitAllTasks();
+
+			if(deferred)
+			{
+				octree.applyDeferredPlacements(&hive);
+			}
+		}
+		const Second time = HighRezTimer::getCurrentTime() - begin;
+
+		ANKI_TEST_LOGI("%s placement of %u placeables: %fms per frame",
+			(deferred) ? "Deferred" : "Immediate",
+			PLACEABLE_COUNT,
+			time / ITERATION_COUNT * 1000.0);
+
+		for(OctreePlaceable& placeable : placeables)
+		{
+			octree.remove(placeable);
+		}
+	}
+}
+
 } // end namespace anki
@@ -0,0 +1,196 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <tests/framework/Framework.h>
+#include <anki/scene/ParticlePool.h>
+#include <anki/util/HighRezTimer.h>
+#include <anki/util/ThreadHive.h>
+#include <anki/util/System.h>
+#include <vector>
+
+namespace anki
+{
+
+static ParticleInitInfo randomParticle()
+{
+	ParticleInitInfo init;
+	init.m_position = Vec3(randRange(-10.0f, 10.0f), randRange(-10.0f, 10.0f), randRange(-10.0f, 10.0f));
+	init.m_velocity = Vec3(randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f));
+	init.m_acceleration = Vec3(0.0f, randRange(-10.0f, -1.0f), 0.0f);
+	init.m_lifetime = randRange(0.1f, 2.0f);
+	init.m_initialSize = randRange(0.1f, 1.0f);
+	init.m_finalSize = randRange(1.0f, 2.0f);
+	init.m_initialAlpha = 1.0f;
+	init.m_finalAlpha = 0.0f;
+	return init;
+}
+
+ANKI_TEST(Scene, ParticlePool)
+{
+	SceneAllocator<U8> alloc(allocAligned, nullptr);
+
+	// The pool with a capacity that is not a multiple of 4 so the SIMD code has to deal with the tail
+	const U32 CAPACITY = 1001;
+	ParticlePool pool;
+	pool.init(alloc, CAPACITY);
+
+	// Reference particles simulated the simple way
+	class RefParticle
+	{
+	public:
+		ParticleInitInfo m_init;
+		Vec3 m_position;
+		Vec3 m_velocity;
+		F32 m_age = 0.0f;
+	};
+	std::vector<RefParticle> refs;
+
+	const F32 dt = 1.0f / 60.0f;
+	std::vector<F32> verts(CAPACITY * ParticlePool::VERTEX_FLOAT_COUNT);
+	for(U32 frame = 0; frame < 200; ++frame)
+	{
+		// Remove the dead from the reference the same way the pool does
+		pool.removeDead();
+		for(U32 i = 0; i < refs.size();)
+		{
+			if(refs[i].m_age >= refs[i].m_init.m_lifetime)
+			{
+				refs[i] = refs.back();
+				refs.pop_back();
+			}
+			else
+			{
+				++i;
+			}
+		}
+		ANKI_TEST_EXPECT_EQ(pool.getParticleCount(), refs.size());
+
+		// Emit a few
+		const U32 emitCount = randRange(0u, 50u);
+		for(U32 i = 0; i < emitCount; ++i)
+		{
+			RefParticle ref;
+			ref.m_init = randomParticle();
+			ref.m_position = ref.m_init.m_position;
+			ref.m_velocity = ref.m_init.m_velocity;
+
+			const Bool emitted = pool.emit(ref.m_init);
+			ANKI_TEST_EXPECT_EQ(emitted, refs.size() < CAPACITY);
+			if(emitted)
+			{
+				refs.push_back(ref);
+			}
+		}
+
+		// Simulate in 2 ranges
+		const U32 count = pool.getParticleCount();
+		const U32 middle = getAlignedRoundDown(4, count / 2);
+		ParticleBounds bounds, bounds2;
+		pool.simulate(0, middle, dt, &verts[0], bounds);
+		pool.simulate(middle, count, dt, &verts[middle * ParticlePool::VERTEX_FLOAT_COUNT], bounds2);
+		bounds.merge(bounds2);
+
+		ParticleBounds refBounds;
+		for(U32 i = 0; i < count; ++i)
+		{
+			RefParticle& ref = refs[i];
+			ref.m_age += dt;
+			ref.m_position += ref.m_velocity * dt + ref.m_init.m_acceleration * (dt * dt);
+			ref.m_velocity += ref.m_init.m_acceleration * dt;
+
+			const Bool alive = ref.m_age < ref.m_init.m_lifetime;
+			const F32 lifeFactor = min(ref.m_age / ref.m_init.m_lifetime, 1.0f);
+			const F32 size = (alive) ? mix(ref.m_init.m_initialSize, ref.m_init.m_finalSize, lifeFactor) : 0.0f;
+			const F32 alpha = mix(ref.m_init.m_initialAlpha, ref.m_init.m_finalAlpha, lifeFactor);
+
+			const F32* v = &verts[i * ParticlePool::VERTEX_FLOAT_COUNT];
+			ANKI_TEST_EXPECT_NEAR(v[0], ref.m_position.x(), 0.001f);
+			ANKI_TEST_EXPECT_NEAR(v[1], ref.m_position.y(), 0.001f);
+			ANKI_TEST_EXPECT_NEAR(v[2], ref.m_position.z(), 0.001f);
+			ANKI_TEST_EXPECT_NEAR(v[3], size, 0.001f);
+			ANKI_TEST_EXPECT_NEAR(v[4], alpha, 0.001f);
+
+			if(alive)
+			{
+				refBounds.m_aabbMin = refBounds.m_aabbMin.min(ref.m_position);
+				refBounds.m_aabbMax = refBounds.m_aabbMax.max(ref.m_position);
+				refBounds.m_maxSize = max(refBounds.m_maxSize, size);
+			}
+		}
+
+		ANKI_TEST_EXPECT_NEAR(bounds.m_maxSize, refBounds.m_maxSize, 0.001f);
+		if(refBounds.m_maxSize > 0.0f)
+		{
+			ANKI_TEST_EXPECT_LEQ((bounds.m_aabbMin - refBounds.m_aabbMin).getLength(), 0.001f);
+			ANKI_TEST_EXPECT_LEQ((bounds.m_aabbMax - refBounds.m_aabbMax).getLength(), 0.001f);
+		}
+	}
+}
+
+ANKI_TEST(Scene, ParticlePoolBench)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(getCpuCoresCount(), alloc);
+
+	const U32 PARTICLE_COUNT = 1024 * 1024;
+	const U32 PARTICLES_PER_TASK = 16 * 1024;
+	const U32 FRAME_COUNT = 60;
+	const F32 dt = 1.0f / 60.0f;
+
+	ParticlePool pool;
+	pool.init(alloc, PARTICLE_COUNT);
+
+	// Keep the pool full. Some particles die every frame so removeDead() has work to do
+	std::vector<F32> verts(PARTICLE_COUNT * ParticlePool::VERTEX_FLOAT_COUNT);
+	for(U32 threaded = 0; threaded < 2; ++threaded)
+	{
+		Second simulateTime = 0.0;
+		Second removeTime = 0.0;
+		U32 emittedCount = 0;
+		for(U32 frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			Second begin = HighRezTimer::getCurrentTime();
+			pool.removeDead();
+			removeTime += HighRezTimer::getCurrentTime() - begin;
+
+			while(pool.getParticleCount() < PARTICLE_COUNT)
+			{
+				ParticleInitInfo init = randomParticle();
+				init.m_lifetime = randRange(0.5f, 5.0f);
+				pool.emit(init);
+				++emittedCount;
+			}
+
+			const U32 count = pool.getParticleCount();
+			begin = HighRezTimer::getCurrentTime();
+			if(threaded)
+			{
+				const U32 taskCount = (count + PARTICLES_PER_TASK - 1) / PARTICLES_PER_TASK;
+				hive.parallelFor(0, taskCount, 1, [&](U32 idx, U32 threadId) {
+					const U32 first = idx * PARTICLES_PER_TASK;
+					const U32 last = min(first + PARTICLES_PER_TASK, count);
+					ParticleBounds bounds;
+					pool.simulate(first, last, dt, &verts[first * ParticlePool::VERTEX_FLOAT_COUNT], bounds);
+				});
+				hive.waitAllTasks();
+			}
+			else
+			{
+				ParticleBounds bounds;
+				pool.simulate(0, count, dt, &verts[0], bounds);
+			}
+			simulateTime += HighRezTimer::getCurrentTime() - begin;
+		}
+
+		ANKI_TEST_LOGI("%s: simulate %u particles %fms per frame, remove dead %fms per frame, %u emitted",
+			(threaded) ? "ThreadHive" : "Single thread",
+			PARTICLE_COUNT,
+			simulateTime / FRAME_COUNT * 1000.0,
+			removeTime / FRAME_COUNT * 1000.0,
+			emittedCount);
+	}
+}
+
+} // end namespace anki
@@ -0,0 +1,364 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <tests/framework/Framework.h>
+#include <anki/Scene.h>
+#include <anki/resource/AnimationBinary.h>
+#include <anki/util/ThreadHive.h>
+#include <anki/util/Filesystem.h>
+#include <anki/util/System.h>
+
+namespace anki
+{
+
+static const CString SKIN_TEST_DIR = "skin_test";
+
+/// A bone of the test skeleton.
+class SkinTestBone
+{
+public:
+	CString m_name;
+	CString m_parent;
+	Vec3 m_position;
+	F32 m_angle;
+};
+
+/// The bones are not sorted by hierarchy on purpose.
+static const Array<SkinTestBone, 5> SKIN_TEST_BONES = {{{"hand", "arm", Vec3(0.0f, 0.0f, 1.0f), 0.3f},
+	{"root", "", Vec3(1.0f, 0.0f, 0.0f), 0.1f},
+	{"arm", "spine", Vec3(0.5f, 0.0f, 0.0f), -0.4f},
+	{"spine", "root", Vec3(0.0f, 1.0f, 0.0f), 0.2f},
+	{"head", "spine", Vec3(0.0f, 0.5f, 0.0f), -0.1f}}};
+
+/// A node that has only a skin.
+class SkinTestNode : public SceneNode
+{
+public:
+	SkinTestNode(SceneGraph* scene, CString name)
+		: SceneNode(scene, name)
+	{
+	}
+
+	ANKI_USE_RESULT Error init(SkeletonResourcePtr skeleton)
+	{
+		newComponent<SkinComponent>(this, skeleton);
+		return Error::NONE;
+	}
+};
+
+/// Everything a SceneGraph needs.
+class SkinTestContext
+{
+public:
+	Config m_cfg;
+	NativeWindow* m_win = nullptr;
+	GrManager* m_gr = nullptr;
+	PhysicsWorld* m_physics = nullptr;
+	ResourceFilesystem* m_fs = nullptr;
+	ResourceManager* m_resources = nullptr;
+	ThreadHive* m_hive = nullptr;
+	SceneGraph* m_scene = nullptr;
+	Timestamp m_timestamp = 1;
+
+	SkinTestContext(U32 threadCount)
+	{
+		initConfig(m_cfg);
+		m_cfg.set("window.debugContext", 0);
+
+		m_win = createWindow(m_cfg);
+		m_gr = createGrManager(m_cfg, m_win);
+		m_resources = createResourceManager(m_cfg, m_gr, m_physics, m_fs);
+
+		HeapAllocator<U8> alloc(allocAligned, nullptr);
+		m_hive = new ThreadHive(threadCount, alloc);
+
+		m_scene = new SceneGraph();
+		ANKI_TEST_EXPECT_NO_ERR(
+			m_scene->init(allocAligned, nullptr, m_hive, m_resources, nullptr, nullptr, &m_timestamp, m_cfg));
+	}
+
+	~SkinTestContext()
+	{
+		delete m_scene;
+		delete m_hive;
+		delete m_resources;
+		delete m_physics;
+		delete m_fs;
+		GrManager::deleteInstance(m_gr);
+		delete m_win;
+	}
+
+	void update(Second prevTime, Second crntTime)
+	{
+		ANKI_TEST_EXPECT_NO_ERR(m_scene->update(prevTime, crntTime));
+		++m_timestamp;
+	}
+};
+
+static void writeMat4(File& file, const Mat4& m)
+{
+	for(U i = 0; i < 16; ++i)
+	{
+		ANKI_TEST_EXPECT_NO_ERR(file.writeText("%f ", m[i]));
+	}
+}
+
+static void writeSkeleton(CString filename)
+{
+	File file;
+	ANKI_TEST_EXPECT_NO_ERR(file.open(filename, FileOpenFlag::WRITE));
+	ANKI_TEST_EXPECT_NO_ERR(file.writeText("<skeleton><bones>\n"));
+	for(const SkinTestBone& bone : SKIN_TEST_BONES)
+	{
+		const Vec3 axis = Vec3(bone.m_position.y(), bone.m_position.z(), 1.0f).getNormalized();
+		ANKI_TEST_EXPECT_NO_ERR(file.writeText("<bone><name>%s</name><transform>", &bone.m_name[0]));
+		writeMat4(file, Mat4(bone.m_position.xyz1(), Mat3(Axisang(bone.m_angle, axis)), 1.0f));
+		ANKI_TEST_EXPECT_NO_ERR(file.writeText("</transform><boneTransform>"));
+		writeMat4(file, Mat4((-bone.m_position).xyz1(), Mat3(Axisang(-bone.m_angle * 0.5f, axis)), 1.0f));
+		ANKI_TEST_EXPECT_NO_ERR(file.writeText("</boneTransform>"));
+		if(bone.m_parent.getLength())
+		{
+			ANKI_TEST_EXPECT_NO_ERR(file.writeText("<parent>%s</parent>", &bone.m_parent[0]));
+		}
+		ANKI_TEST_EXPECT_NO_ERR(file.writeText("</bone>\n"));
+	}
+	ANKI_TEST_EXPECT_NO_ERR(file.writeText("</bones></skeleton>\n"));
+}
+
+/// Write an animation with 2 random keyframes per channel, at 0 and 1 seconds.
+static void writeAnimation(HeapAllocator<U8> alloc, ConstWeakArray<CString> channelNames, CString filename)
+{
+	const U32 channelCount = channelNames.getSize();
+	std::vector<AnimationKeyframe<Vec3>> positions;
+	std::vector<AnimationKeyframe<Quat>> rotations;
+	for(U32 i = 0; i < channelCount * 2; ++i)
+	{
+		const Second time = i % 2;
+		const Vec3 axis = Vec3(randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f)) + Vec3(EPSILON);
+		positions.push_back(AnimationKeyframe<Vec3>(
+			time, Vec3(randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f), randRange(-1.0f, 1.0f))));
+		rotations.push_back(
+			AnimationKeyframe<Quat>(time, Quat(Axisang(randRange(-PI / 2.0f, PI / 2.0f), axis.getNormalized()))));
+	}
+
+	std::vector<AnimationBinaryWriteChannel> channels(channelCount);
+	for(U32 i = 0; i < channelCount; ++i)
+	{
+		channels[i].m_name = channelNames[i];
+		channels[i].m_positions = ConstWeakArray<AnimationKeyframe<Vec3>>(&positions[i * 2], 2);
+		channels[i].m_rotations = ConstWeakArray<AnimationKeyframe<Quat>>(&rotations[i * 2], 2);
+	}
+
+	AnimationBinaryWriteInfo info;
+	info.m_channels = ConstWeakArray<AnimationBinaryWriteChannel>(&channels[0], channelCount);
+	ANKI_TEST_EXPECT_NO_ERR(writeAnimationBinary(alloc, info, filename));
+}
+
+/// A track of the reference skinning.
+class SkinTestTrack
+{
+public:
+	AnimationResourcePtr m_anim;
+	F32 m_weight;
+};
+
+/// Blend the channels that animate a bone. It returns the local transform of the bone.
+static Mat4 computeReferenceLocalTransform(const Bone& bone, ConstWeakArray<SkinTestTrack> tracks, Second time)
+{
+	Vec3 position(0.0f);
+	Vec4 rotation(0.0f);
+	Vec4 firstRotation(0.0f);
+	F32 weight = 0.0f;
+	for(const SkinTestTrack& track : tracks)
+	{
+		for(U i = 0; i < track.m_anim->getChannels().getSize(); ++i)
+		{
+			if(track.m_anim->getChannels()[i].m_name.toCString() != bone.getName().toCString())
+			{
+				continue;
+			}
+
+			Vec3 pos(0.0f);
+			Quat rot(Quat::getIdentity());
+			F32 scale = 1.0f;
+			track.m_anim->interpolate(i, time, pos, rot, scale, nullptr);
+
+			Vec4 rotv(rot.x(), rot.y(), rot.z(), rot.w());
+			if(weight == 0.0f)
+			{
+				firstRotation = rotv;
+			}
+			else if(firstRotation.dot(rotv) < 0.0f)
+			{
+				rotv = -rotv;
+			}
+
+			position += pos * track.m_weight;
+			rotation += rotv * track.m_weight;
+			weight += track.m_weight;
+		}
+	}
+
+	if(weight == 0.0f)
+	{
+		return bone.getTransform();
+	}
+
+	// Normalize when the weights are more than 1 or complete with the bind pose when they are less
+	if(weight < 1.0f)
+	{
+		rotation += Vec4(0.0f, 0.0f, 0.0f, (rotation.w() < 0.0f) ? -1.0f : 1.0f) * (1.0f - weight);
+	}
+	else
+	{
+		position /= weight;
+	}
+
+	const Quat q(rotation.getNormalized());
+	return bone.getTransform() * Mat4(position.xyz1(), Mat3(q), 1.0f);
+}
+
+/// Walk the hierarchy recursively with plain Mat4 math.
+static void computeReferenceBoneTransforms(const Bone& bone,
+	const Mat4& parentTrf,
+	ConstWeakArray<SkinTestTrack> tracks,
+	Second time,
+	DynamicArrayAuto<Mat4>& trfs)
+{
+	const Mat4 trf = parentTrf * computeReferenceLocalTransform(bone, tracks, time);
+	trfs[bone.getIndex()] = trf * bone.getVertexTransform();
+
+	for(const Bone* child : bone.getChildren())
+	{
+		computeReferenceBoneTransforms(*child, trf, tracks, time, trfs);
+	}
+}
+
+static void checkBoneTransforms(
+	const SkinComponent& skin, const SkeletonResource& skeleton, ConstWeakArray<SkinTestTrack> tracks, Second time)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	DynamicArrayAuto<Mat4> refTrfs(alloc);
+	refTrfs.create(skeleton.getBones().getSize());
+	computeReferenceBoneTransforms(skeleton.getRootBone(), Mat4::getIdentity(), tracks, time, refTrfs);
+
+	ANKI_TEST_EXPECT_EQ(skin.getBoneTransforms().getSize(), refTrfs.getSize());
+	for(U32 b = 0; b < refTrfs.getSize(); ++b)
+	{
+		for(U i = 0; i < 16; ++i)
+		{
+			ANKI_TEST_EXPECT_NEAR(skin.getBoneTransforms()[b][i], refTrfs[b][i], 0.0001f);
+		}
+	}
+}
+
+ANKI_TEST(Scene, SkinComponent)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	SkinTestContext ctx(1);
+
+	// The channels are not in the order of the bones. One of them doesn't animate any bone. The spine is animated by
+	// both tracks, the root by none and the rest by one
+	const Array<CString, 4> channels0 = {{"arm", "unknown", "spine", "head"}};
+	const Array<CString, 2> channels1 = {{"spine", "hand"}};
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory(SKIN_TEST_DIR));
+	writeSkeleton("skin_test/test.ankiskel");
+	writeAnimation(alloc, ConstWeakArray<CString>(channels0), "skin_test/test0.ankianim");
+	writeAnimation(alloc, ConstWeakArray<CString>(channels1), "skin_test/test1.ankianim");
+	ANKI_TEST_EXPECT_NO_ERR(ctx.m_fs->addNewPath(SKIN_TEST_DIR));
+
+	{
+		SkeletonResourcePtr skeleton;
+		ANKI_TEST_EXPECT_NO_ERR(ctx.m_resources->loadResource("test.ankiskel", skeleton));
+		Array<SkinTestTrack, 2> tracks;
+		ANKI_TEST_EXPECT_NO_ERR(ctx.m_resources->loadResource("test0.ankianim", tracks[0].m_anim));
+		ANKI_TEST_EXPECT_NO_ERR(ctx.m_resources->loadResource("test1.ankianim", tracks[1].m_anim));
+
+		SkinTestNode* node;
+		ANKI_TEST_EXPECT_NO_ERR(ctx.m_scene->newSceneNode("skin", node, skeleton));
+		SkinComponent& skin = node->getComponent<SkinComponent>();
+
+		// The weights of the spine sum to more than 1, the rest to less
+		tracks[0].m_weight = 0.75f;
+		tracks[1].m_weight = 0.5f;
+		for(U32 t = 0; t < tracks.getSize(); ++t)
+		{
+			skin.playAnimation(t, tracks[t].m_anim, 0.0, true);
+			skin.setAnimationWeight(t, tracks[t].m_weight);
+		}
+
+		// Every update samples the time that the previous one advanced to
+		const Second FRAME_TIME = 0.25;
+		for(U32 frame = 0; frame < 3; ++frame)
+		{
+			ctx.update(frame * FRAME_TIME, (frame + 1) * FRAME_TIME);
+			checkBoneTransforms(skin, *skeleton, ConstWeakArray<SkinTestTrack>(tracks), frame * FRAME_TIME);
+		}
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory(SKIN_TEST_DIR));
+}
+
+ANKI_TEST(Scene, SkinComponentParallelUpdate)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	SkinTestContext ctx(getCpuCoresCount());
+
+	const Array<CString, 5> channels = {{"root", "spine", "arm", "hand", "head"}};
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory(SKIN_TEST_DIR));
+	writeSkeleton("skin_test/test.ankiskel");
+	writeAnimation(alloc, ConstWeakArray<CString>(channels), "skin_test/test.ankianim");
+	ANKI_TEST_EXPECT_NO_ERR(ctx.m_fs->addNewPath(SKIN_TEST_DIR));
+
+	{
+		SkeletonResourcePtr skeleton;
+		ANKI_TEST_EXPECT_NO_ERR(ctx.m_resources->loadResource("test.ankiskel", skeleton));
+		SkinTestTrack track;
+		ANKI_TEST_EXPECT_NO_ERR(ctx.m_resources->loadResource("test.ankianim", track.m_anim));
+		track.m_weight = 1.0f;
+
+		// Many skins so the workers share them. Each starts at a different time of the animation
+		const U32 SKIN_COUNT = 64;
+		const Second START_TIME_STEP = 0.01;
+		Array<SkinComponent*, SKIN_COUNT> skins;
+		for(U32 i = 0; i < SKIN_COUNT; ++i)
+		{
+			StringAuto name(alloc);
+			name.sprintf("skin%u", i);
+			SkinTestNode* node;
+			ANKI_TEST_EXPECT_NO_ERR(ctx.m_scene->newSceneNode(name.toCString(), node, skeleton));
+			skins[i] = &node->getComponent<SkinComponent>();
+			skins[i]->playAnimation(0, track.m_anim, i * START_TIME_STEP, true);
+		}
+
+		// A skin without animations is not queued
+		SkinTestNode* idleNode;
+		ANKI_TEST_EXPECT_NO_ERR(ctx.m_scene->newSceneNode("idleSkin", idleNode, skeleton));
+
+		const Second FRAME_TIME = 1.0 / 60.0;
+		for(U32 frame = 0; frame < 3; ++frame)
+		{
+			ctx.update(frame * FRAME_TIME, (frame + 1) * FRAME_TIME);
+			ANKI_TEST_EXPECT_EQ(ctx.m_scene->getStats().m_animatedSkinCount, SKIN_COUNT);
+
+			for(U32 i = 0; i < SKIN_COUNT; ++i)
+			{
+				checkBoneTransforms(*skins[i],
+					*skeleton,
+					ConstWeakArray<SkinTestTrack>(&track, 1),
+					i * START_TIME_STEP + frame * FRAME_TIME);
+			}
+
+			for(const Mat4& trf : idleNode->getComponent<SkinComponent>().getBoneTransforms())
+			{
+				ANKI_TEST_EXPECT_EQ(trf, Mat4::getIdentity());
+			}
+		}
+	}
+
+	ANKI_TEST_EXPECT_NO_ERR(removeDirectory(SKIN_TEST_DIR));
+}
+
+} // end namespace anki
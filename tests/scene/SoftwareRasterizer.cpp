@@ -0,0 +1,374 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <tests/framework/Framework.h>
+#include <anki/scene/SoftwareRasterizer.h>
+#include <anki/collision/Aabb.h>
+#include <anki/collision/Frustum.h>
+#include <anki/util/HighRezTimer.h>
+#include <anki/util/ThreadHive.h>
+#include <anki/util/System.h>
+
+namespace anki
+{
+
+/// Draw a quad that faces the camera.
+static void drawQuad(SoftwareRasterizer& r, F32 z, F32 halfSize)
+{
+	const Array<Vec3, 6> verts = {{Vec3(-halfSize, -halfSize, z),
+		Vec3(halfSize, -halfSize, z),
+		Vec3(halfSize, halfSize, z),
+		Vec3(-halfSize, -halfSize, z),
+		Vec3(halfSize, halfSize, z),
+		Vec3(-halfSize, halfSize, z)}};
+	r.draw(&verts[0][0], verts.getSize(), sizeof(Vec3), true);
+}
+
+static Bool testBox(const SoftwareRasterizer& r, const Vec3& min, const Vec3& max)
+{
+	const Aabb box(min, max);
+	return r.visibilityTest(box, box);
+}
+
+/// Create random quads and boxes in front of the camera.
+static void createRandomScene(U32 occluderCount, U32 boxCount, std::vector<Vec3>& verts, std::vector<Aabb>& boxes)
+{
+	for(U32 i = 0; i < occluderCount; ++i)
+	{
+		const F32 z = randRange(-200.0f, -5.0f);
+		const Vec3 center(randRange(-1.0f, 1.0f) * -z, randRange(-1.0f, 1.0f) * -z, z);
+		const Vec3 u(randRange(1.0f, 5.0f), randRange(-1.0f, 1.0f), 0.0f);
+		const Vec3 v(randRange(-1.0f, 1.0f), randRange(1.0f, 5.0f), randRange(-2.0f, 2.0f));
+
+		verts.push_back(center - u - v);
+		verts.push_back(center + u - v);
+		verts.push_back(center + u + v);
+		verts.push_back(center - u - v);
+		verts.push_back(center + u + v);
+		verts.push_back(center - u + v);
+	}
+
+	for(U32 i = 0; i < boxCount; ++i)
+	{
+		const F32 z = randRange(-300.0f, -10.0f);
+		const Vec3 center(randRange(-0.7f, 0.7f) * -z, randRange(-0.5f, 0.5f) * -z, z);
+		boxes.push_back(Aabb(center, center + Vec3(randRange(0.5f, 5.0f))));
+	}
+}
+
+/// Bin the occluders from many threads and rasterize the tiles from many threads.
+static void drawBinned(ThreadHive& hive, SoftwareRasterizer& r, const std::vector<Vec3>& verts)
+{
+	const U32 binCount = hive.getThreadCount();
+	const U32 trisPerBin = (verts.size() / 3 + binCount - 1) / binCount;
+	r.initBins(binCount);
+
+	hive.parallelFor(0, binCount, 1, [&](U32 binIdx, U32 threadId) {
+		const U32 firstTri = min<U32>(binIdx * trisPerBin, verts.size() / 3);
+		const U32 lastTri = min<U32>(firstTri + trisPerBin, verts.size() / 3);
+		if(firstTri < lastTri)
+		{
+			r.binTriangles(binIdx, &verts[firstTri * 3][0], (lastTri - firstTri) * 3, sizeof(Vec3), false);
+		}
+		r.finalizeBin(binIdx);
+	});
+	hive.waitAllTasks();
+
+	hive.parallelFor(0, r.getTileCountY(), 1, [&](U32 tileY, U32 threadId) { r.rasterizeBinnedTiles(tileY, tileY); });
+	hive.waitAllTasks();
+}
+
+/// The per pixel rasterizer that was used before the tiled one. It's here for benchmarking.
+class ReferenceRasterizer
+{
+public:
+	HeapAllocator<U8> m_alloc;
+	Mat4 m_mvp;
+	U32 m_width;
+	U32 m_height;
+	DynamicArray<Atomic<U32>> m_zbuffer;
+
+	ReferenceRasterizer(HeapAllocator<U8> alloc, const Mat4& mvp, U32 width, U32 height)
+		: m_alloc(alloc)
+		, m_mvp(mvp)
+		, m_width(width)
+		, m_height(height)
+	{
+		m_zbuffer.create(m_alloc, width * height);
+		for(Atomic<U32>& z : m_zbuffer)
+		{
+			z.set(MAX_U32);
+		}
+	}
+
+	~ReferenceRasterizer()
+	{
+		m_zbuffer.destroy(m_alloc);
+	}
+
+	/// @note The triangles should be in front of the near plane.
+	void draw(const Vec3* verts, U32 vertCount)
+	{
+		for(U32 t = 0; t < vertCount; t += 3)
+		{
+			Array<Vec3, 3> ndc;
+			Array<Vec2, 3> window;
+			Vec2 bboxMin(MAX_F32), bboxMax(MIN_F32);
+			const Vec2 windowSize(m_width, m_height);
+			for(U i = 0; i < 3; i++)
+			{
+				const Vec4 clip = m_mvp * verts[t + i].xyz1();
+				ndc[i] = clip.xyz() / clip.w();
+				window[i] = (ndc[i].xy() / 2.0 + 0.5) * windowSize;
+
+				for(U j = 0; j < 2; j++)
+				{
+					bboxMin[j] = clamp(floorf(min(bboxMin[j], window[i][j])), 0.0f, windowSize[j]);
+					bboxMax[j] = clamp(ceilf(max(bboxMax[j], window[i][j])), 0.0f, windowSize[j]);
+				}
+			}
+
+			for(F32 y = bboxMin.y() + 0.5f; y < bboxMax.y() + 0.5f; y += 1.0f)
+			{
+				for(F32 x = bboxMin.x() + 0.5f; x < bboxMax.x() + 0.5f; x += 1.0f)
+				{
+					const Vec2 dca = window[2] - window[0];
+					const Vec2 dba = window[1] - window[0];
+					const Vec2 dap = window[0] - Vec2(x, y);
+					const Vec3 k = Vec3(dca.x(), dba.x(), dap.x()).cross(Vec3(dca.y(), dba.y(), dap.y()));
+					if(isZero(k.z()))
+					{
+						continue;
+					}
+
+					const Vec3 bc(1.0f - (k.x() + k.y()) / k.z(), k.y() / k.z(), k.x() / k.z());
+					if(bc.x() < 0.0f || bc.y() < 0.0f || bc.z() < 0.0f || U32(x) >= m_width || U32(y) >= m_height)
+					{
+						continue;
+					}
+
+					F32 depth = ndc[0].z() * bc[0] + ndc[1].z() * bc[1] + ndc[2].z() * bc[2];
+					depth = clamp(depth, 0.0f, 1.0f - EPSILON);
+					m_zbuffer[U32(y) * m_width + U32(x)].min(U32(depth * MAX_U32));
+				}
+			}
+		}
+	}
+
+	Bool visibilityTest(const Aabb& aabb) const
+	{
+		Vec4 bboxMin(MAX_F32);
+		Vec4 bboxMax(MIN_F32);
+		for(U i = 0; i < 8; ++i)
+		{
+			const Vec4 p((i & 1) ? aabb.getMax().x() : aabb.getMin().x(),
+				(i & 2) ? aabb.getMax().y() : aabb.getMin().y(),
+				(i & 4) ? aabb.getMax().z() : aabb.getMin().z(),
+				1.0f);
+			Vec4 clip = m_mvp * p;
+			if(clip.w() <= 0.0f)
+			{
+				return true;
+			}
+
+			clip /= clip.w();
+			clip = clip * Vec4(0.5f, 0.5f, 1.0f, 1.0f) + Vec4(0.5f, 0.5f, 0.0f, 0.0f);
+			clip *= Vec4(m_width, m_height, 1.0f, 1.0f);
+			bboxMin = bboxMin.min(clip);
+			bboxMax = bboxMax.max(clip);
+		}
+
+		const U32 minX = U32(clamp(floorf(bboxMin.x()), 0.0f, F32(m_width)));
+		const U32 maxX = U32(clamp(ceilf(bboxMax.x()), 0.0f, F32(m_width)));
+		const U32 minY = U32(clamp(floorf(bboxMin.y()), 0.0f, F32(m_height)));
+		const U32 maxY = U32(clamp(ceilf(bboxMax.y()), 0.0f, F32(m_height)));
+		for(U32 y = minY; y < maxY; ++y)
+		{
+			for(U32 x = minX; x < maxX; ++x)
+			{
+				if(bboxMin.z() < m_zbuffer[y * m_width + x].get() / F32(MAX_U32))
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+};
+
+ANKI_TEST(Scene, SoftwareRasterizer)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+
+	const Mat4 proj = PerspectiveFrustum(toRad(90.0f), toRad(90.0f), 0.1f, 100.0f).calculateProjectionMatrix();
+
+	// Try a size that is not a multiple of the tile size as well
+	for(UVec2 size : {UVec2(320, 192), UVec2(81, 50)})
+	{
+		SoftwareRasterizer r;
+		r.init(alloc);
+		r.prepare(Mat4::getIdentity(), proj, size.x(), size.y());
+
+		// Nothing drawn, everything is visible
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(-1.0f, -1.0f, -20.0f), Vec3(1.0f, 1.0f, -19.0f)), true);
+
+		// A back facing quad shouldn't be drawn
+		{
+			const Array<Vec3, 3> verts = {
+				{Vec3(-5.0f, -5.0f, -10.0f), Vec3(5.0f, 5.0f, -10.0f), Vec3(5.0f, -5.0f, -10.0f)}};
+			r.draw(&verts[0][0], verts.getSize(), sizeof(Vec3), true);
+			ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(1.0f, -2.0f, -20.0f), Vec3(2.0f, -1.0f, -19.0f)), true);
+		}
+
+		// A quad that covers the [-0.5, 0.5] of the NDC space
+		drawQuad(r, -10.0f, 5.0f);
+
+		// Behind the quad
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(-1.0f, -1.0f, -20.0f), Vec3(1.0f, 1.0f, -19.0f)), false);
+
+		// In front of the quad
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(-1.0f, -1.0f, -8.0f), Vec3(1.0f, 1.0f, -7.0f)), true);
+
+		// Intersects the quad
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(-1.0f, -1.0f, -11.0f), Vec3(1.0f, 1.0f, -9.0f)), true);
+
+		// Behind the quad but close to its edge. The tiles are partially covered so the pixels will be tested
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(8.0f, -1.0f, -20.0f), Vec3(9.0f, 1.0f, -19.0f)), false);
+
+		// Behind the quad but crosses its edge
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(8.0f, -1.0f, -20.0f), Vec3(11.0f, 1.0f, -19.0f)), true);
+
+		// Behind the quad but it's not covered
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(14.0f, -1.0f, -20.0f), Vec3(15.0f, 1.0f, -19.0f)), true);
+
+		// Outside the screen
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(40.0f, -1.0f, -20.0f), Vec3(41.0f, 1.0f, -19.0f)), false);
+
+		// Fill with depth
+		std::vector<F32> depth(size.x() * size.y(), 0.0f);
+		r.fillDepthBuffer(ConstWeakArray<F32>(&depth[0], depth.size()));
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(14.0f, -1.0f, -20.0f), Vec3(15.0f, 1.0f, -19.0f)), false);
+
+		// Only the last pixel is far
+		depth.back() = 1.0f;
+		r.fillDepthBuffer(ConstWeakArray<F32>(&depth[0], depth.size()));
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(-1.0f, -1.0f, -20.0f), Vec3(1.0f, 1.0f, -19.0f)), false);
+		ANKI_TEST_EXPECT_EQ(testBox(r, Vec3(15.0f, 15.0f, -20.0f), Vec3(19.0f, 19.0f, -19.0f)), true);
+	}
+}
+
+ANKI_TEST(Scene, SoftwareRasterizerBinned)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(4, alloc);
+
+	const Mat4 proj = PerspectiveFrustum(toRad(60.0f), toRad(45.0f), 0.1f, 500.0f).calculateProjectionMatrix();
+
+	std::vector<Vec3> verts;
+	std::vector<Aabb> boxes;
+	createRandomScene(500, 5000, verts, boxes);
+
+	// The binned rasterization should produce the same results as the draw()
+	SoftwareRasterizer a;
+	a.init(alloc);
+	a.prepare(Mat4::getIdentity(), proj, 320, 192);
+	a.draw(&verts[0][0], verts.size(), sizeof(Vec3), false);
+
+	SoftwareRasterizer b;
+	b.init(alloc);
+	b.prepare(Mat4::getIdentity(), proj, 320, 192);
+	drawBinned(hive, b, verts);
+
+	U32 visible = 0;
+	for(const Aabb& box : boxes)
+	{
+		const Bool visibleA = testBox(a, box.getMin().xyz(), box.getMax().xyz());
+		const Bool visibleB = testBox(b, box.getMin().xyz(), box.getMax().xyz());
+		ANKI_TEST_EXPECT_EQ(visibleA, visibleB);
+		visible += visibleA;
+	}
+
+	// Some should be visible and some not
+	ANKI_TEST_EXPECT_GT(visible, 0);
+	ANKI_TEST_EXPECT_LT(visible, boxes.size());
+}
+
+ANKI_TEST(Scene, SoftwareRasterizerBench)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+
+	const Mat4 proj = PerspectiveFrustum(toRad(60.0f), toRad(45.0f), 0.1f, 500.0f).calculateProjectionMatrix();
+	const U32 OCCLUDER_COUNT = 200;
+	const U32 TEST_COUNT = 20000;
+
+	std::vector<Vec3> verts;
+	std::vector<Aabb> boxes;
+	createRandomScene(OCCLUDER_COUNT, TEST_COUNT, verts, boxes);
+
+	// The old per pixel rasterizer
+	{
+		Second begin = HighRezTimer::getCurrentTime();
+		ReferenceRasterizer r(alloc, proj, 80, 50);
+		r.draw(&verts[0], verts.size());
+		const Second drawTime = HighRezTimer::getCurrentTime() - begin;
+
+		begin = HighRezTimer::getCurrentTime();
+		U32 visible = 0;
+		for(const Aabb& box : boxes)
+		{
+			visible += r.visibilityTest(box);
+		}
+		const Second testTime = HighRezTimer::getCurrentTime() - begin;
+
+		ANKI_TEST_LOGI("Per pixel 80x50: draw %fms, tests %fms, %u visible",
+			drawTime * 1000.0,
+			testTime * 1000.0,
+			visible);
+	}
+
+	// The tiled one
+	for(UVec2 size : {UVec2(80, 50), UVec2(320, 192)})
+	{
+		SoftwareRasterizer r;
+		r.init(alloc);
+
+		Second begin = HighRezTimer::getCurrentTime();
+		r.prepare(Mat4::getIdentity(), proj, size.x(), size.y());
+		r.draw(&verts[0][0], verts.size(), sizeof(Vec3), false);
+		const Second drawTime = HighRezTimer::getCurrentTime() - begin;
+
+		begin = HighRezTimer::getCurrentTime();
+		U32 visible = 0;
+		for(const Aabb& box : boxes)
+		{
+			visible += testBox(r, box.getMin().xyz(), box.getMax().xyz());
+		}
+		const Second testTime = HighRezTimer::getCurrentTime() - begin;
+
+		ANKI_TEST_LOGI("Tiled %ux%u: draw %fms, tests %fms, %u visible",
+			size.x(),
+			size.y(),
+			drawTime * 1000.0,
+			testTime * 1000.0,
+			visible);
+	}
+
+	// The tiled one with binning
+	{
+		ThreadHive hive(getCpuCoresCount(), alloc);
+		SoftwareRasterizer r;
+		r.init(alloc);
+
+		const Second begin = HighRezTimer::getCurrentTime();
+		r.prepare(Mat4::getIdentity(), proj, 320, 192);
+		drawBinned(hive, r, verts);
+		const Second drawTime = HighRezTimer::getCurrentTime() - begin;
+
+		ANKI_TEST_LOGI("Binned 320x192 with %u threads: draw %fms", hive.getThreadCount(), drawTime * 1000.0);
+	}
+}
+
+} // end namespace anki
@@ -43,10 +43,18 @@ ANKI_TEST(Util, Directory)
 	ANKI_TEST_EXPECT_NO_ERR(file.open("./dir/rid/tmp", FileOpenFlag::WRITE));
 	file.close();
 	ANKI_TEST_EXPECT_EQ(fileExists("./dir/rid/tmp"), true);
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory("./dir/rid/dir"));
+	ANKI_TEST_EXPECT_NO_ERR(file.open("./dir/rid/dir/tmp", FileOpenFlag::WRITE));
+	file.close();
+	ANKI_TEST_EXPECT_NO_ERR(createDirectory("./dir/empty"));
+	ANKI_TEST_EXPECT_NO_ERR(file.open("./dir/tmp", FileOpenFlag::WRITE));
+	file.close();
 
 	ANKI_TEST_EXPECT_NO_ERR(removeDirectory("./dir"));
 	ANKI_TEST_EXPECT_EQ(fileExists("./dir/rid/tmp"), false);
+	ANKI_TEST_EXPECT_EQ(directoryExists("./dir/rid/dir"), false);
 	ANKI_TEST_EXPECT_EQ(directoryExists("./dir/rid"), false);
+	ANKI_TEST_EXPECT_EQ(directoryExists("./dir/empty"), false);
 	ANKI_TEST_EXPECT_EQ(directoryExists("./dir"), false);
 }
 
@@ -6,7 +6,9 @@
 #include "tests/framework/Framework.h"
 #include "tests/util/Foo.h"
 #include "anki/util/Memory.h"
+#include "anki/util/Allocator.h"
 #include "anki/util/ThreadPool.h"
+#include "anki/util/HighRezTimer.h"
 #include <type_traits>
 #include <cstring>
 
@@ -218,3 +220,403 @@ ANKI_TEST(Util, ChainMemoryPool)
 		ANKI_TEST_EXPECT_EQ(pool.getChunksCount(), 0);
 	}
 }
+
+ANKI_TEST(Util, StackMemoryPoolThreadArenas)
+{
+	const U THREAD_COUNT = 8;
+	const U ALLOC_COUNT = 256;
+	const U ALLOC_SIZE = 24;
+
+	StackMemoryPool pool;
+	pool.create(allocAligned, nullptr, 1024, 1.0, 0, true, ANKI_SAFE_ALIGNMENT, 512);
+
+	// Big allocations bypass the arenas
+	void* big = pool.allocate(1000, 1);
+	ANKI_TEST_EXPECT_NEQ(big, nullptr);
+	memset(big, 0xAB, 1000);
+
+	class AllocateTask : public ThreadPoolTask
+	{
+	public:
+		StackMemoryPool* m_pool = nullptr;
+		Array<U8*, ALLOC_COUNT> m_allocations;
+
+		Error operator()(U32 taskId, PtrSize threadsCount)
+		{
+			for(U i = 0; i < ALLOC_COUNT; ++i)
+			{
+				m_allocations[i] = static_cast<U8*>(m_pool->allocate(ALLOC_SIZE, 1));
+				memset(m_allocations[i], U8(taskId * ALLOC_COUNT + i), ALLOC_SIZE);
+			}
+
+			return Error::NONE;
+		}
+	};
+
+	ThreadPool threadPool(THREAD_COUNT);
+	Array<AllocateTask, THREAD_COUNT> tasks;
+
+	for(U iteration = 0; iteration < 2; ++iteration)
+	{
+		for(U i = 0; i < THREAD_COUNT; ++i)
+		{
+			tasks[i].m_pool = &pool;
+			threadPool.assignNewTask(i, &tasks[i]);
+		}
+
+		ANKI_TEST_EXPECT_NO_ERR(threadPool.waitForAllThreadsToFinish());
+
+		for(U i = 0; i < THREAD_COUNT; ++i)
+		{
+			for(U j = 0; j < ALLOC_COUNT; ++j)
+			{
+				const U8* ptr = tasks[i].m_allocations[j];
+				ANKI_TEST_EXPECT_EQ(isAligned(ANKI_SAFE_ALIGNMENT, ptr), true);
+
+				for(U k = 0; k < ALLOC_SIZE; ++k)
+				{
+					ANKI_TEST_EXPECT_EQ(ptr[k], U8(i * ALLOC_COUNT + j));
+				}
+			}
+		}
+
+		// Allocations are not counted with arenas
+		ANKI_TEST_EXPECT_EQ(pool.getAllocationsCount(), 0);
+
+		pool.reset();
+	}
+}
+
+ANKI_TEST(Util, ChainMemoryPoolThreadArenas)
+{
+	const U THREAD_COUNT = 8;
+	const U ALLOC_COUNT = 512;
+
+	ChainMemoryPool pool;
+	pool.create(allocAligned, nullptr, 256, 2.0, 0, ANKI_SAFE_ALIGNMENT, true);
+
+	class AllocateTask : public ThreadPoolTask
+	{
+	public:
+		ChainMemoryPool* m_pool = nullptr;
+		Array<U8*, ALLOC_COUNT> m_allocations;
+
+		Error operator()(U32 taskId, PtrSize threadsCount)
+		{
+			for(U i = 0; i < ALLOC_COUNT; ++i)
+			{
+				const PtrSize size = (i % 7) * 8 + 1;
+				m_allocations[i] = static_cast<U8*>(m_pool->allocate(size, 1));
+				memset(m_allocations[i], U8(taskId), size);
+
+				// Free some of them in the middle of the run
+				if((i % 3) == 0)
+				{
+					m_pool->free(m_allocations[i]);
+					m_allocations[i] = nullptr;
+				}
+			}
+
+			return Error::NONE;
+		}
+	};
+
+	class FreeTask : public ThreadPoolTask
+	{
+	public:
+		ChainMemoryPool* m_pool = nullptr;
+		AllocateTask* m_allocTask = nullptr;
+		Bool m_corrupted = false;
+
+		Error operator()(U32 taskId, PtrSize threadsCount)
+		{
+			// Free memory allocated by another thread
+			for(U i = 0; i < ALLOC_COUNT; ++i)
+			{
+				U8* ptr = m_allocTask->m_allocations[i];
+				if(ptr)
+				{
+					const PtrSize size = (i % 7) * 8 + 1;
+					for(U k = 0; k < size; ++k)
+					{
+						m_corrupted = m_corrupted || ptr[k] != U8((taskId + 1) % THREAD_COUNT);
+					}
+
+					m_pool->free(ptr);
+				}
+			}
+
+			return Error::NONE;
+		}
+	};
+
+	ThreadPool threadPool(THREAD_COUNT);
+	Array<AllocateTask, THREAD_COUNT> allocTasks;
+	Array<FreeTask, THREAD_COUNT> freeTasks;
+
+	for(U i = 0; i < THREAD_COUNT; ++i)
+	{
+		allocTasks[i].m_pool = &pool;
+		threadPool.assignNewTask(i, &allocTasks[i]);
+	}
+	ANKI_TEST_EXPECT_NO_ERR(threadPool.waitForAllThreadsToFinish());
+
+	for(U i = 0; i < THREAD_COUNT; ++i)
+	{
+		freeTasks[i].m_pool = &pool;
+		freeTasks[i].m_allocTask = &allocTasks[(i + 1) % THREAD_COUNT];
+		threadPool.assignNewTask(i, &freeTasks[i]);
+	}
+	ANKI_TEST_EXPECT_NO_ERR(threadPool.waitForAllThreadsToFinish());
+
+	for(U i = 0; i < THREAD_COUNT; ++i)
+	{
+		ANKI_TEST_EXPECT_EQ(freeTasks[i].m_corrupted, false);
+	}
+
+	// Only the current chunks of the arenas should be alive
+	ANKI_TEST_EXPECT_LEQ(pool.getChunksCount(), THREAD_COUNT);
+}
+
+ANKI_TEST(Util, MemoryPoolContentionBench)
+{
+	const U MAX_THREAD_COUNT = 32;
+	const U ALLOC_COUNT = 1024 * 16;
+
+	class BenchTask : public ThreadPoolTask
+	{
+	public:
+		StackMemoryPool* m_stackPool = nullptr;
+		ChainMemoryPool* m_chainPool = nullptr;
+		U32 m_allocCount = 0;
+
+		Error operator()(U32 taskId, PtrSize threadsCount)
+		{
+			for(U i = 0; i < m_allocCount; ++i)
+			{
+				const PtrSize size = 16 + (i & 3) * 16;
+				if(m_stackPool)
+				{
+					void* ptr = m_stackPool->allocate(size, 1);
+					static_cast<U8*>(ptr)[0] = 1;
+				}
+				else
+				{
+					void* ptr = m_chainPool->allocate(size, 1);
+					static_cast<U8*>(ptr)[0] = 1;
+					m_chainPool->free(ptr);
+				}
+			}
+
+			return Error::NONE;
+		}
+	};
+
+	for(U threadCount = 1; threadCount <= MAX_THREAD_COUNT; threadCount *= 2)
+	{
+		ThreadPool threadPool(threadCount);
+		Array<BenchTask, MAX_THREAD_COUNT> tasks;
+		const U32 allocsPerThread = ALLOC_COUNT / threadCount;
+
+		for(U arenas = 0; arenas < 2; ++arenas)
+		{
+			// Stack
+			{
+				StackMemoryPool pool;
+				const PtrSize arenaSize = (arenas) ? 16 * 1024 : 0;
+				pool.create(allocAligned, nullptr, 1024 * 1024 * 4, 1.0, 0, true, ANKI_SAFE_ALIGNMENT, arenaSize);
+
+				const Second begin = HighRezTimer::getCurrentTime();
+				for(U i = 0; i < threadCount; ++i)
+				{
+					tasks[i] = BenchTask();
+					tasks[i].m_stackPool = &pool;
+					tasks[i].m_allocCount = allocsPerThread;
+					threadPool.assignNewTask(i, &tasks[i]);
+				}
+				ANKI_TEST_EXPECT_NO_ERR(threadPool.waitForAllThreadsToFinish());
+				const Second elapsed = HighRezTimer::getCurrentTime() - begin;
+
+				ANKI_TEST_LOGI("StackMemoryPool threads %u arenas %u: %fms",
+					threadCount,
+					arenas,
+					elapsed * 1000.0);
+			}
+
+			// Chain
+			{
+				ChainMemoryPool pool;
+				pool.create(allocAligned, nullptr, 1024 * 64, 1.0, 0, ANKI_SAFE_ALIGNMENT, arenas != 0);
+
+				const Second begin = HighRezTimer::getCurrentTime();
+				for(U i = 0; i < threadCount; ++i)
+				{
+					tasks[i] = BenchTask();
+					tasks[i].m_chainPool = &pool;
+					tasks[i].m_allocCount = allocsPerThread;
+					threadPool.assignNewTask(i, &tasks[i]);
+				}
+				ANKI_TEST_EXPECT_NO_ERR(threadPool.waitForAllThreadsToFinish());
+				const Second elapsed = HighRezTimer::getCurrentTime() - begin;
+
+				ANKI_TEST_LOGI("ChainMemoryPool threads %u arenas %u: %fms",
+					threadCount,
+					arenas,
+					elapsed * 1000.0);
+			}
+		}
+	}
+}
+
+ANKI_TEST(Util, TlsfMemoryPool)
+{
+	// Simple
+	{
+		TlsfMemoryPool pool;
+		pool.create(allocAligned, nullptr, 1024);
+
+		void* a = pool.allocate(10, 1);
+		ANKI_TEST_EXPECT_NEQ(a, nullptr);
+		void* b = pool.allocate(100, 1);
+		ANKI_TEST_EXPECT_NEQ(b, nullptr);
+		ANKI_TEST_EXPECT_EQ(pool.getAllocationsCount(), 2);
+
+		pool.free(a);
+		pool.free(b);
+		ANKI_TEST_EXPECT_EQ(pool.getAllocationsCount(), 0);
+
+		// Everything merged back to one block
+		const TlsfMemoryPoolStats stats = pool.getStats();
+		ANKI_TEST_EXPECT_EQ(stats.m_freeBlockCount, 1);
+		ANKI_TEST_EXPECT_EQ(stats.m_usedMemory, 0);
+		ANKI_TEST_EXPECT_EQ(stats.m_fragmentation, 0.0f);
+	}
+
+	// Alignment
+	{
+		TlsfMemoryPool pool;
+		pool.create(allocAligned, nullptr, 1024);
+
+		Array<void*, 8> ptrs;
+		for(U i = 0; i < ptrs.getSize(); ++i)
+		{
+			const PtrSize alignment = PtrSize(1) << (i + 1);
+			ptrs[i] = pool.allocate(1 + i * 3, alignment);
+			ANKI_TEST_EXPECT_NEQ(ptrs[i], nullptr);
+			ANKI_TEST_EXPECT_EQ(isAligned(alignment, ptrs[i]), true);
+		}
+
+		for(void* ptr : ptrs)
+		{
+			pool.free(ptr);
+		}
+
+		ANKI_TEST_EXPECT_EQ(pool.getStats().m_freeBlockCount, 1);
+	}
+
+	// Growing and shrinking
+	{
+		TlsfMemoryPool pool;
+		pool.create(allocAligned, nullptr, 1024);
+
+		void* big = pool.allocate(1024 * 1024, 16);
+		ANKI_TEST_EXPECT_NEQ(big, nullptr);
+		ANKI_TEST_EXPECT_EQ(pool.getStats().m_areaCount, 2);
+
+		pool.free(big);
+		ANKI_TEST_EXPECT_EQ(pool.getStats().m_areaCount, 1);
+	}
+
+	// Fragmentation
+	{
+		TlsfMemoryPool pool;
+		pool.create(allocAligned, nullptr, 64 * 1024);
+
+		Array<void*, 128> ptrs;
+		for(void*& ptr : ptrs)
+		{
+			ptr = pool.allocate(128, 16);
+		}
+
+		// Free every other allocation. The free memory is scattered
+		for(U i = 0; i < ptrs.getSize(); i += 2)
+		{
+			pool.free(ptrs[i]);
+		}
+
+		const TlsfMemoryPoolStats stats = pool.getStats();
+		ANKI_TEST_EXPECT_GT(stats.m_fragmentation, 0.0f);
+		ANKI_TEST_EXPECT_LT(stats.m_largestFreeBlock, stats.m_freeMemory);
+		ANKI_TEST_EXPECT_GEQ(stats.m_freeBlockCount, ptrs.getSize() / 2);
+		ANKI_TEST_EXPECT_EQ(stats.m_reservedMemory >= stats.m_usedMemory + stats.m_freeMemory, true);
+
+		for(U i = 1; i < ptrs.getSize(); i += 2)
+		{
+			pool.free(ptrs[i]);
+		}
+
+		ANKI_TEST_EXPECT_EQ(pool.getStats().m_fragmentation, 0.0f);
+	}
+
+	// Random
+	{
+		TlsfMemoryPool pool;
+		pool.create(allocAligned, nullptr, 4 * 1024);
+
+		class Alloc
+		{
+		public:
+			U8* m_ptr = nullptr;
+			PtrSize m_size = 0;
+			U8 m_magic = 0;
+		};
+
+		Array<Alloc, 256> allocs;
+		U32 seed = 0x1234;
+		for(U i = 0; i < 20000; ++i)
+		{
+			seed = seed * 1103515245 + 12345;
+			Alloc& alloc = allocs[(seed >> 8) % allocs.getSize()];
+
+			if(alloc.m_ptr)
+			{
+				for(U j = 0; j < alloc.m_size; ++j)
+				{
+					ANKI_TEST_EXPECT_EQ(alloc.m_ptr[j], alloc.m_magic);
+				}
+
+				pool.free(alloc.m_ptr);
+				alloc.m_ptr = nullptr;
+			}
+			else
+			{
+				alloc.m_size = (seed >> 4) % 2000 + 1;
+				alloc.m_magic = U8(i);
+				const PtrSize alignment = PtrSize(1) << ((seed >> 16) % 8);
+				alloc.m_ptr = static_cast<U8*>(pool.allocate(alloc.m_size, alignment));
+				ANKI_TEST_EXPECT_EQ(isAligned(alignment, alloc.m_ptr), true);
+				memset(alloc.m_ptr, alloc.m_magic, alloc.m_size);
+			}
+		}
+
+		for(Alloc& alloc : allocs)
+		{
+			if(alloc.m_ptr)
+			{
+				pool.free(alloc.m_ptr);
+			}
+		}
+
+		ANKI_TEST_EXPECT_EQ(pool.getAllocationsCount(), 0);
+		ANKI_TEST_EXPECT_EQ(pool.getStats().m_areaCount, 1);
+		ANKI_TEST_EXPECT_EQ(pool.getStats().m_freeBlockCount, 1);
+	}
+
+	// Through the allocator
+	{
+		TlsfAllocator<U32> alloc(allocAligned, nullptr);
+		U32* arr = alloc.newArray<U32>(100, 0xFFu);
+		ANKI_TEST_EXPECT_EQ(arr[99], 0xFFu);
+		alloc.deleteArray(arr, 100);
+	}
+}
@@ -245,4 +245,319 @@ ANKI_TEST(Util, ThreadHiveBench)
 	ANKI_TEST_EXPECT_EQ(sum.get(), serialFib);
 }
 
+ANKI_TEST(Util, ThreadHiveParallelFor)
+{
+	const U32 threadCount = 4;
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(threadCount, alloc);
+
+	// Every index visited once
+	if(1)
+	{
+		const U32 COUNT = 10000;
+		DynamicArrayAuto<Atomic<U32>> visits(alloc);
+		visits.create(COUNT);
+		for(Atomic<U32>& v : visits)
+		{
+			v.set(0);
+		}
+
+		for(U32 grainSize : {0u, 1u, 7u, 100u, COUNT * 2})
+		{
+			hive.parallelFor(0, COUNT, grainSize, [&](U32 idx, U32 threadId) {
+				ANKI_TEST_EXPECT_LT(threadId, threadCount);
+				visits[idx].fetchAdd(1);
+			});
+			hive.waitAllTasks();
+		}
+
+		for(Atomic<U32>& v : visits)
+		{
+			ANKI_TEST_EXPECT_EQ(v.get(), 5);
+		}
+	}
+
+	// Dependencies
+	if(1)
+	{
+		const U32 COUNT = 1000;
+		Atomic<U32> firstLoop = {0};
+		Atomic<U32> secondLoopErrors = {0};
+
+		ThreadHiveSemaphore* sem = hive.newSemaphore(1);
+		hive.parallelFor(0, COUNT, 3, [&](U32 idx, U32 threadId) { firstLoop.fetchAdd(1); }, nullptr, sem);
+		hive.parallelFor(0,
+			COUNT,
+			0,
+			[&](U32 idx, U32 threadId) {
+				if(firstLoop.load() != COUNT)
+				{
+					secondLoopErrors.fetchAdd(1);
+				}
+			},
+			sem,
+			nullptr);
+
+		// Empty range still signals
+		ThreadHiveSemaphore* sem2 = hive.newSemaphore(1);
+		hive.parallelFor(0, 0, 0, [&](U32 idx, U32 threadId) { secondLoopErrors.fetchAdd(1); }, nullptr, sem2);
+		hive.submitTask(
+			[](void* ud, U32, ThreadHive&, ThreadHiveSemaphore*) { static_cast<Atomic<U32>*>(ud)->fetchAdd(1); },
+			&firstLoop);
+
+		hive.waitAllTasks();
+
+		ANKI_TEST_EXPECT_EQ(firstLoop.get(), COUNT + 1);
+		ANKI_TEST_EXPECT_EQ(secondLoopErrors.get(), 0);
+	}
+}
+
+/// A task that fills the deque of its thread and waits for the other threads to steal everything.
+class StealingTask
+{
+public:
+	static const U32 CHILD_COUNT = 64;
+
+	Atomic<U32> m_childCount = {0};
+	Atomic<U32> m_stolenCount = {0};
+	U32 m_parentThreadId = MAX_U32;
+	Bool8 m_timedOut = false;
+
+	static void callback(void* arg, U32 threadId, ThreadHive& hive, ThreadHiveSemaphore* sem)
+	{
+		StealingTask& parent = *static_cast<StealingTask*>(arg);
+		parent.m_parentThreadId = threadId;
+
+		Array<ThreadHiveTask, CHILD_COUNT> tasks;
+		for(ThreadHiveTask& task : tasks)
+		{
+			task = ANKI_THREAD_HIVE_TASK(
+				{
+					if(threadId != self->m_parentThreadId)
+					{
+						self->m_stolenCount.fetchAdd(1);
+					}
+					self->m_childCount.fetchAdd(1);
+				},
+				&parent,
+				nullptr,
+				nullptr);
+		}
+		hive.submitTasks(&tasks[0], CHILD_COUNT);
+
+		// This thread is busy so only the others can run the children
+		const Second timeout = HighRezTimer::getCurrentTime() + 10.0;
+		while(parent.m_childCount.load() < CHILD_COUNT && !parent.m_timedOut)
+		{
+			parent.m_timedOut = HighRezTimer::getCurrentTime() > timeout;
+		}
+	}
+};
+
+static const U32 OVERFLOW_SUBMIT_COUNT = 40;
+static const U32 OVERFLOW_TASKS_PER_SUBMIT = 50;
+
+ANKI_TEST(Util, ThreadHiveStealing)
+{
+	const U32 threadCount = 4;
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(threadCount, alloc);
+	ANKI_TEST_EXPECT_EQ(hive.isOwnerThread(), true);
+	ANKI_TEST_EXPECT_EQ(hive.isHiveThread(), false);
+
+	// The children go to the deque of the parent's thread and the rest of the threads steal them
+	for(U i = 0; i < 100; ++i)
+	{
+		StealingTask stask;
+		hive.submitTask(StealingTask::callback, &stask);
+		hive.waitAllTasks();
+
+		ANKI_TEST_EXPECT_EQ(stask.m_timedOut, false);
+		ANKI_TEST_EXPECT_EQ(stask.m_childCount.get(), StealingTask::CHILD_COUNT);
+		ANKI_TEST_EXPECT_EQ(stask.m_stolenCount.get(), StealingTask::CHILD_COUNT);
+	}
+
+	// More tasks than the deque can hold overflow to the shared queue. A single thread so nothing steals them
+	{
+		ThreadHive singleHive(1, alloc);
+		Atomic<U32> counter = {0};
+		ThreadHiveTask task;
+		task.m_callback = [](void* ud, U32, ThreadHive& hive, ThreadHiveSemaphore*) {
+			ANKI_TEST_EXPECT_EQ(hive.isHiveThread(), true);
+			ANKI_TEST_EXPECT_EQ(hive.isOwnerThread(), false);
+
+			for(U32 i = 0; i < OVERFLOW_SUBMIT_COUNT; ++i)
+			{
+				Array<ThreadHiveTask, OVERFLOW_TASKS_PER_SUBMIT> tasks;
+				for(ThreadHiveTask& t : tasks)
+				{
+					t = ANKI_THREAD_HIVE_TASK({ self->fetchAdd(1); }, static_cast<Atomic<U32>*>(ud), nullptr, nullptr);
+				}
+				hive.submitTasks(&tasks[0], OVERFLOW_TASKS_PER_SUBMIT);
+			}
+		};
+		task.m_argument = &counter;
+		singleHive.submitTasks(&task, 1);
+		singleHive.waitAllTasks();
+
+		ANKI_TEST_EXPECT_EQ(counter.get(), OVERFLOW_SUBMIT_COUNT * OVERFLOW_TASKS_PER_SUBMIT);
+	}
+
+	// Nested loops from inside the hive
+	{
+		const U32 OUTER_COUNT = 64;
+		const U32 INNER_COUNT = 100;
+		DynamicArrayAuto<Atomic<U32>> visits(alloc);
+		visits.create(OUTER_COUNT * INNER_COUNT);
+		for(Atomic<U32>& v : visits)
+		{
+			v.set(0);
+		}
+
+		hive.parallelFor(0, OUTER_COUNT, 1, [&](U32 outer, U32 threadId) {
+			hive.parallelFor(0, INNER_COUNT, 0, [&, outer](U32 inner, U32 threadId) {
+				visits[outer * INNER_COUNT + inner].fetchAdd(1);
+			});
+		});
+		hive.waitAllTasks();
+
+		for(Atomic<U32>& v : visits)
+		{
+			ANKI_TEST_EXPECT_EQ(v.get(), 1);
+		}
+	}
+}
+
+ANKI_TEST(Util, ThreadHiveTaskGraph)
+{
+	const U32 threadCount = 4;
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	ThreadHive hive(threadCount, alloc);
+
+	for(U i = 0; i < 100; ++i)
+	{
+		// A diamond: a -> (b, c) -> d
+		Atomic<U32> order = {0};
+		Array<U32, 4> stamps = {};
+
+		ThreadHiveTaskGraph graph(hive);
+		ThreadHiveTaskGraph::Node* a = graph.newNode([&](U32, ThreadHive&) { stamps[0] = order.fetchAdd(1); });
+		ThreadHiveTaskGraph::Node* b = graph.newNode([&](U32, ThreadHive&) { stamps[1] = order.fetchAdd(1); });
+		ThreadHiveTaskGraph::Node* c = graph.newNode([&](U32, ThreadHive&) { stamps[2] = order.fetchAdd(1); });
+		ThreadHiveTaskGraph::Node* d = graph.newNode([&](U32, ThreadHive&) { stamps[3] = order.fetchAdd(1); });
+		graph.addDependency(a, b);
+		graph.addDependency(a, c);
+		graph.addDependency(b, d);
+		graph.addDependency(c, d);
+
+		ThreadHiveSemaphore* sem = hive.newSemaphore(1);
+		graph.submit(sem);
+
+		// A task that waits for the whole graph
+		U32 afterGraph = 0;
+		ThreadHiveTask task = ANKI_THREAD_HIVE_TASK({ *self = 1; }, &afterGraph, sem, nullptr);
+		hive.submitTasks(&task, 1);
+
+		hive.waitAllTasks();
+
+		ANKI_TEST_EXPECT_EQ(stamps[0], 0);
+		ANKI_TEST_EXPECT_LT(stamps[1], 3);
+		ANKI_TEST_EXPECT_LT(stamps[2], 3);
+		ANKI_TEST_EXPECT_EQ(stamps[3], 3);
+		ANKI_TEST_EXPECT_EQ(afterGraph, 1);
+	}
+}
+
+class ContentionTask
+{
+public:
+	Atomic<U32>* m_counter;
+	U32 m_depth;
+
+	static void callback(void* arg, U32, ThreadHive& hive, ThreadHiveSemaphore* sem)
+	{
+		ContentionTask& self = *static_cast<ContentionTask*>(arg);
+		self.m_counter->fetchAdd(1);
+
+		if(self.m_depth > 0)
+		{
+			// Fan out from inside the hive
+			const U CHILD_COUNT = 4;
+			ContentionTask* children = static_cast<ContentionTask*>(
+				hive.allocateScratchMemory(sizeof(ContentionTask) * CHILD_COUNT, alignof(ContentionTask)));
+
+			Array<ThreadHiveTask, CHILD_COUNT> tasks;
+			for(U i = 0; i < CHILD_COUNT; ++i)
+			{
+				children[i].m_counter = self.m_counter;
+				children[i].m_depth = self.m_depth - 1;
+				tasks[i].m_callback = ContentionTask::callback;
+				tasks[i].m_argument = &children[i];
+			}
+
+			hive.submitTasks(&tasks[0], CHILD_COUNT);
+		}
+	}
+};
+
+ANKI_TEST(Util, ThreadHiveContentionBench)
+{
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+
+	const U ITERATIONS = 10;
+	const U EXTERNAL_TASK_COUNT = 10000;
+	const U32 FAN_OUT_DEPTH = 7; // 4^0 + 4^1 + ... + 4^7 tasks
+
+	for(U32 threadCount = 1; threadCount <= ThreadHive::MAX_THREADS; threadCount *= 2)
+	{
+		ThreadHive hive(threadCount, alloc);
+		Atomic<U32> counter = {0};
+
+		// Tasks submitted from outside the hive
+		Second externalTime = 0.0;
+		U32 externalTaskCount = 0;
+		for(U it = 0; it < ITERATIONS; ++it)
+		{
+			ContentionTask ctask;
+			ctask.m_counter = &counter;
+			ctask.m_depth = 0;
+			counter.set(0);
+
+			const Second begin = HighRezTimer::getCurrentTime();
+			for(U i = 0; i < EXTERNAL_TASK_COUNT; ++i)
+			{
+				hive.submitTask(ContentionTask::callback, &ctask);
+			}
+			hive.waitAllTasks();
+			externalTime += HighRezTimer::getCurrentTime() - begin;
+
+			ANKI_TEST_EXPECT_EQ(counter.get(), EXTERNAL_TASK_COUNT);
+			externalTaskCount += EXTERNAL_TASK_COUNT;
+		}
+
+		// Tasks that spawn tasks
+		Second fanOutTime = 0.0;
+		U32 fanOutTaskCount = 0;
+		for(U it = 0; it < ITERATIONS; ++it)
+		{
+			ContentionTask ctask;
+			ctask.m_counter = &counter;
+			ctask.m_depth = FAN_OUT_DEPTH;
+			counter.set(0);
+
+			const Second begin = HighRezTimer::getCurrentTime();
+			hive.submitTask(ContentionTask::callback, &ctask);
+			hive.waitAllTasks();
+			fanOutTime += HighRezTimer::getCurrentTime() - begin;
+
+			fanOutTaskCount += counter.get();
+		}
+
+		ANKI_TEST_LOGI("Threads %2u: external submit %10.0f tasks/s, fan-out %10.0f tasks/s",
+			threadCount,
+			F64(externalTaskCount) / externalTime,
+			F64(fanOutTaskCount) / fanOutTime);
+	}
+}
+
 } // end namespace anki
@@ -0,0 +1,32 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <anki/resource/PakBinary.h>
+#include <anki/util/Logger.h>
+
+using namespace anki;
+
+static const char* USAGE = R"(Usage: %s in_dir out_file
+Packs all the files of in_dir to an .ankipak archive. The filenames in the archive are relative to in_dir and the
+archive can be added to the "rsrc.dataPaths" the same way in_dir would
+)";
+
+int main(int argc, char** argv)
+{
+	if(argc != 3)
+	{
+		ANKI_LOGE(USAGE, argv[0]);
+		return 1;
+	}
+
+	HeapAllocator<U8> alloc(allocAligned, nullptr);
+	if(writePakArchive(alloc, argv[1], argv[2]))
+	{
+		ANKI_LOGE("Failed to create the archive");
+		return 1;
+	}
+
+	return 0;
+}
@@ -875,6 +875,16 @@ Error Exporter::exportAll()
 		}
 	}
 
+	for(const tinygltf::Animation& anim : m_model.animations)
+	{
+		const Error err = exportAnimation(anim);
+		if(err)
+		{
+			ANKI_LOGE("Failed to load animation %s", anim.name.c_str());
+			return err;
+		}
+	}
+
 	return Error::NONE;
 }
 
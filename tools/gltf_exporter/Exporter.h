@@ -23,6 +23,15 @@ public:
 
 	F32 m_normalsMergeCosAngle = cos(toRad(30.0));
 
+	/// A keyframe is removed if interpolating its neighbours gives a position that is closer than that.
+	F32 m_animationPositionTolerance = 0.0001f;
+
+	/// A keyframe is removed if interpolating its neighbours gives a rotation that is closer than that (in radians).
+	F32 m_animationRotationTolerance = toRad(0.01f);
+
+	/// A keyframe is removed if interpolating its neighbours gives a scale that is closer than that.
+	F32 m_animationScaleTolerance = 0.001f;
+
 	tinygltf::TinyGLTF m_loader;
 	tinygltf::Model m_model;
 
@@ -43,6 +52,11 @@ private:
 
 	Error exportMaterial(const tinygltf::Material& mtl);
 
+	Error exportAnimation(const tinygltf::Animation& anim);
+
+	/// Read the float components of an accessor.
+	Error readAccessorFloats(I32 accessorIdx, U32 componentCount, std::vector<F32>& out) const;
+
 	Bool getTexture(const tinygltf::Material& mtl, CString texName, StringAuto& fname) const;
 	Bool getMaterialAttrib(const tinygltf::Material& mtl, CString attribName, Vec4& value) const;
 };
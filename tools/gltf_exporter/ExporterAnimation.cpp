@@ -0,0 +1,136 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include "Exporter.h"
+#include <anki/resource/AnimationBinary.h>
+
+namespace anki
+{
+
+class ExportChannel
+{
+public:
+	I32 m_node = -1;
+	std::vector<AnimationKeyframe<Vec3>> m_positions;
+	std::vector<AnimationKeyframe<Quat>> m_rotations;
+	std::vector<AnimationKeyframe<F32>> m_scales;
+};
+
+Error Exporter::readAccessorFloats(I32 accessorIdx, U32 componentCount, std::vector<F32>& out) const
+{
+	EXPORT_ASSERT(accessorIdx >= 0 && U(accessorIdx) < m_model.accessors.size());
+	const tinygltf::Accessor& accessor = m_model.accessors[accessorIdx];
+	EXPORT_ASSERT(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+
+	const tinygltf::BufferView& view = m_model.bufferViews[accessor.bufferView];
+	const U32 stride = (view.byteStride) ? view.byteStride : sizeof(F32) * componentCount;
+	const U8* buff = &m_model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset];
+
+	out.resize(accessor.count * componentCount);
+	for(U32 i = 0; i < accessor.count; ++i)
+	{
+		memcpy(&out[i * componentCount], buff + i * stride, sizeof(F32) * componentCount);
+	}
+
+	return Error::NONE;
+}
+
+Error Exporter::exportAnimation(const tinygltf::Animation& anim)
+{
+	// Gather the glTF channels that animate the same node to a single channel
+	std::vector<ExportChannel> channels;
+	for(const tinygltf::AnimationChannel& gltfChannel : anim.channels)
+	{
+		const tinygltf::AnimationSampler& sampler = anim.samplers[gltfChannel.sampler];
+
+		U32 componentCount;
+		if(gltfChannel.target_path == "translation" || gltfChannel.target_path == "scale")
+		{
+			componentCount = 3;
+		}
+		else if(gltfChannel.target_path == "rotation")
+		{
+			componentCount = 4;
+		}
+		else
+		{
+			ANKI_LOGW("Ignoring animation channel of %s", gltfChannel.target_path.c_str());
+			continue;
+		}
+
+		if(sampler.interpolation != "LINEAR")
+		{
+			ANKI_LOGW("Animation interpolation %s will be linear", sampler.interpolation.c_str());
+		}
+
+		std::vector<F32> times, values;
+		ANKI_CHECK(readAccessorFloats(sampler.input, 1, times));
+		ANKI_CHECK(readAccessorFloats(sampler.output, componentCount, values));
+
+		// Cubic splines have an in tangent, a value and an out tangent
+		const U32 valuesPerKeyframe = (sampler.interpolation == "CUBICSPLINE") ? 3 : 1;
+		const U32 valueOffset = (valuesPerKeyframe == 3) ? componentCount : 0;
+		EXPORT_ASSERT(values.size() == times.size() * componentCount * valuesPerKeyframe);
+
+		auto it = std::find_if(channels.begin(), channels.end(), [&](const ExportChannel& ch) {
+			return ch.m_node == gltfChannel.target_node;
+		});
+		if(it == channels.end())
+		{
+			channels.push_back(ExportChannel());
+			channels.back().m_node = gltfChannel.target_node;
+			it = channels.end() - 1;
+		}
+
+		for(U32 i = 0; i < times.size(); ++i)
+		{
+			const F32* v = &values[i * componentCount * valuesPerKeyframe + valueOffset];
+
+			if(gltfChannel.target_path == "translation")
+			{
+				it->m_positions.push_back(AnimationKeyframe<Vec3>(times[i], Vec3(v[0], v[1], v[2])));
+			}
+			else if(gltfChannel.target_path == "rotation")
+			{
+				it->m_rotations.push_back(
+					AnimationKeyframe<Quat>(times[i], Quat(v[0], v[1], v[2], v[3]).getNormalized()));
+			}
+			else
+			{
+				// Only uniform scale is supported
+				it->m_scales.push_back(AnimationKeyframe<F32>(times[i], v[0]));
+			}
+		}
+	}
+
+	EXPORT_ASSERT(channels.size() > 0);
+
+	// Remove the keyframes that are not needed, compress the rest and write the file
+	std::vector<AnimationBinaryWriteChannel> outChannels(channels.size());
+	for(U32 i = 0; i < channels.size(); ++i)
+	{
+		const ExportChannel& in = channels[i];
+		AnimationBinaryWriteChannel& out = outChannels[i];
+
+		out.m_name = m_model.nodes[in.m_node].name.c_str();
+		out.m_positions = ConstWeakArray<AnimationKeyframe<Vec3>>(in.m_positions.data(), in.m_positions.size());
+		out.m_rotations = ConstWeakArray<AnimationKeyframe<Quat>>(in.m_rotations.data(), in.m_rotations.size());
+		out.m_scales = ConstWeakArray<AnimationKeyframe<F32>>(in.m_scales.data(), in.m_scales.size());
+	}
+
+	AnimationBinaryWriteInfo info;
+	info.m_channels = ConstWeakArray<AnimationBinaryWriteChannel>(&outChannels[0], outChannels.size());
+	info.m_positionTolerance = m_animationPositionTolerance;
+	info.m_rotationTolerance = m_animationRotationTolerance;
+	info.m_scaleTolerance = m_animationScaleTolerance;
+
+	ANKI_CHECK(writeAnimationBinary(m_alloc,
+		info,
+		StringAuto(m_alloc).sprintf("%s/%s.ankianim", m_outputDirectory.cstr(), anim.name.c_str()).toCString()));
+
+	return Error::NONE;
+}
+
+} // end namespace anki
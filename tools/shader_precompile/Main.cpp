@@ -0,0 +1,266 @@
+// Copyright (C) 2009-2018, Panagiotis Christopoulos Charitos and contributors.
+// All rights reserved.
+// Code licensed under the BSD License.
+// http://www.anki3d.org/LICENSE
+
+#include <anki/AnKi.h>
+#include <anki/util/ThreadHive.h>
+#include <vector>
+#include <string>
+
+using namespace anki;
+
+static const char* USAGE = R"(Usage: %s anki_dir [options]
+Compiles all the variants of the shader programs in anki_dir/shaders and stores them in the shader cache.
+Options:
+-materials <dir>  : Also compile the variants of the materials in anki_dir/dir
+-cfg <name> <val> : Set a config option. Use the same options as the game so the variants and the binaries match
+)";
+
+class CmdLineArgs
+{
+public:
+	std::string m_ankiDir;
+	std::vector<std::string> m_materialDirs;
+};
+
+static Error parseCommandLineArgs(int argc, char** argv, CmdLineArgs& args)
+{
+	if(argc < 2)
+	{
+		return Error::USER_DATA;
+	}
+
+	args.m_ankiDir = argv[1];
+
+	for(I i = 2; i < argc; ++i)
+	{
+		if(strcmp(argv[i], "-materials") == 0)
+		{
+			++i;
+			if(i < argc)
+			{
+				args.m_materialDirs.push_back(argv[i]);
+			}
+			else
+			{
+				return Error::USER_DATA;
+			}
+		}
+		else if(strcmp(argv[i], "-cfg") == 0)
+		{
+			// The config will parse it
+			i += 2;
+			if(i >= argc)
+			{
+				return Error::USER_DATA;
+			}
+		}
+		else
+		{
+			return Error::USER_DATA;
+		}
+	}
+
+	return Error::NONE;
+}
+
+/// Find the files with some extension in a directory.
+static Error gatherFiles(const std::string& dir, CString extension, std::vector<std::string>& filenames)
+{
+	class Ctx
+	{
+	public:
+		CString m_extension;
+		std::vector<std::string>* m_filenames;
+	} ctx = {extension, &filenames};
+
+	return walkDirectoryTree(dir.c_str(), &ctx, [](const CString& fname, void* ud, Bool isDir) -> Error {
+		Ctx& ctx = *static_cast<Ctx*>(ud);
+		const std::string str = fname.cstr();
+		const std::string ext = ctx.m_extension.cstr();
+		if(!isDir && str.length() > ext.length() && str.compare(str.length() - ext.length(), ext.length(), ext) == 0)
+		{
+			ctx.m_filenames->push_back(str);
+		}
+
+		return Error::NONE;
+	});
+}
+
+/// A variant of a program that doesn't need any constants.
+class Variant
+{
+public:
+	const ShaderProgramResource* m_program;
+	U32 m_firstMutation;
+};
+
+/// Expand all the permutations of the mutators of a program.
+static void expandPermutations(const ShaderProgramResource& prog,
+	std::vector<ShaderProgramResourceMutation>& mutations,
+	std::vector<Variant>& variants,
+	U32& skippedCount)
+{
+	const U32 mutatorCount = prog.getMutators().getSize();
+	std::vector<U32> wheel(mutatorCount, 0);
+
+	while(true)
+	{
+		Variant variant;
+		variant.m_program = &prog;
+		variant.m_firstMutation = mutations.size();
+		for(U32 i = 0; i < mutatorCount; ++i)
+		{
+			ShaderProgramResourceMutation m;
+			m.m_mutator = &prog.getMutators()[i];
+			m.m_value = m.m_mutator->getValues()[wheel[i]];
+			mutations.push_back(m);
+		}
+
+		// The values of the constants come from the renderer or the materials. Those variants get compiled when the
+		// renderer or the materials (with -materials) are initialized
+		const ConstWeakArray<ShaderProgramResourceMutation> variantMutations(
+			(mutatorCount) ? &mutations[variant.m_firstMutation] : nullptr, mutatorCount);
+		Bool needsConstants = false;
+		for(const ShaderProgramResourceInputVariable& in : prog.getInputVariables())
+		{
+			needsConstants = needsConstants || (in.isConstant() && in.acceptAllMutations(variantMutations));
+		}
+
+		if(needsConstants)
+		{
+			mutations.resize(variant.m_firstMutation);
+			++skippedCount;
+		}
+		else
+		{
+			variants.push_back(variant);
+		}
+
+		// Spin the wheel
+		I32 i = I32(mutatorCount) - 1;
+		for(; i >= 0; --i)
+		{
+			if(++wheel[i] < prog.getMutators()[i].getValues().getSize())
+			{
+				break;
+			}
+
+			wheel[i] = 0;
+		}
+
+		if(i < 0)
+		{
+			break;
+		}
+	}
+}
+
+static Error precompile(App& app, const CmdLineArgs& args)
+{
+	ResourceManager& resources = app.getResourceManager();
+	ThreadHive& hive = app.getThreadHive();
+	const Second startTime = HighRezTimer::getCurrentTime();
+
+	// Load the programs and expand their variants
+	std::vector<std::string> programFilenames;
+	ANKI_CHECK(gatherFiles(args.m_ankiDir + "/shaders", ".glslp", programFilenames));
+
+	std::vector<ShaderProgramResourcePtr> programs;
+	std::vector<ShaderProgramResourceMutation> mutations;
+	std::vector<Variant> variants;
+	U32 skippedCount = 0;
+	for(const std::string& fname : programFilenames)
+	{
+		programs.push_back(ShaderProgramResourcePtr());
+		ANKI_CHECK(resources.loadResource(("shaders/" + fname).c_str(), programs.back(), false));
+	}
+
+	for(const ShaderProgramResourcePtr& prog : programs)
+	{
+		expandPermutations(*prog, mutations, variants, skippedCount);
+	}
+
+	ANKI_LOGI("Compiling %u variants of %u programs using %u threads. Skipping %u variants that need constants",
+		U32(variants.size()),
+		U32(programs.size()),
+		U32(hive.getThreadCount()),
+		skippedCount);
+
+	// Compile them on all threads
+	Atomic<U32> failedCount = {0};
+	hive.parallelFor(0, variants.size(), 1, [&](U32 idx, U32 threadId) {
+		const Variant& variant = variants[idx];
+		const U32 mutatorCount = variant.m_program->getMutators().getSize();
+		const ConstWeakArray<ShaderProgramResourceMutation> variantMutations(
+			(mutatorCount) ? &mutations[variant.m_firstMutation] : nullptr, mutatorCount);
+
+		if(variant.m_program->precompileVariant(variantMutations, ConstWeakArray<ShaderProgramResourceConstantValue>()))
+		{
+			ANKI_LOGE("Failed to compile a variant of %s", &variant.m_program->getFilename()[0]);
+			failedCount.fetchAdd(1);
+		}
+	});
+	hive.waitAllTasks();
+
+	// The materials compile the variants they use in parallel when they load
+	U32 materialCount = 0;
+	for(const std::string& dir : args.m_materialDirs)
+	{
+		std::vector<std::string> materialFilenames;
+		ANKI_CHECK(gatherFiles(args.m_ankiDir + "/" + dir, ".ankimtl", materialFilenames));
+
+		for(const std::string& fname : materialFilenames)
+		{
+			MaterialResourcePtr mtl;
+			ANKI_CHECK(resources.loadResource((dir + "/" + fname).c_str(), mtl, false));
+			++materialCount;
+		}
+	}
+
+	const ShaderCompilerCache& cache = resources.getShaderCompiler();
+	ANKI_CHECK(cache.flush());
+
+	ANKI_LOGI("Done in %fsec. %u materials, %u failed variants. %u shaders compiled, %u were already in the cache. "
+			  "The cache is in %s",
+		HighRezTimer::getCurrentTime() - startTime,
+		materialCount,
+		failedCount.load(),
+		cache.getMissCount(),
+		cache.getHitCount(),
+		&app.getCacheDirectory()[0]);
+
+	return (failedCount.load()) ? Error::FUNCTION_FAILED : Error::NONE;
+}
+
+int main(int argc, char** argv)
+{
+	CmdLineArgs args;
+	if(parseCommandLineArgs(argc, argv, args))
+	{
+		ANKI_LOGE(USAGE, argv[0]);
+		return 1;
+	}
+
+	Config config;
+	config.set("rsrc.dataPaths", args.m_ankiDir.c_str());
+	config.set("rsrc.precompileShaderVariants", true);
+	config.set("window.debugContext", 0);
+	if(config.setFromCommandLineArguments(argc, argv))
+	{
+		return 1;
+	}
+
+	App* app = new App;
+	if(app->init(config, allocAligned, nullptr))
+	{
+		ANKI_LOGE("Failed to initialize");
+		return 1;
+	}
+
+	// Delete the app even on failure so the cache gets written
+	const Error err = precompile(*app, args);
+	delete app;
+	return (err) ? 1 : 0;
+}